@@ -10,10 +10,13 @@ crow::response listApplicationInstances(PersistentStore& store, const crow::requ
 ///Destroy an instance of an application
 ///\param instanceID the instance to query
 crow::response fetchApplicationInstanceInfo(PersistentStore& store, const crow::request& req, const std::string& instanceID);
-///Stop and restart an instance of an application
+///Stop and restart an instance of an application. If the client requests an
+///asynchronous response the restart is done as a background operation. 
 ///\param instanceID the instance to restart
 crow::response restartApplicationInstance(PersistentStore& store, const crow::request& req, const std::string& instanceID);
-///Stop and restart an instance of an application applying an updated configuration file
+///Stop and restart an instance of an application applying an updated configuration file. 
+///If the client requests an asynchronous response the update is done as a 
+///background operation. 
 ///\param instanceID the instance to restart
 crow::response updateApplicationInstance(PersistentStore& store, const crow::request& req, const std::string& instanceID);
 ///Destroy an instance of an application
@@ -39,6 +42,30 @@ namespace internal{
 	///\return a string describing the error which has occured, or an empty 
 	///        string indicating success
 	std::string deleteApplicationInstance(PersistentStore& store, const ApplicationInstance& instance, bool force);
+	
+	///Internal function which stops an application instance and starts it 
+	///again with its stored configuration, assuming that all authentication, 
+	///authorization, and validation of the command has already been performed
+	///\param instance the instance to restart
+	///\param result set to the JSON description of the restarted instance on 
+	///              success, or to a description of the error which occurred
+	///\param progress called to report each step of the restart
+	///\return whether the instance was restarted
+	bool restartApplicationInstance(PersistentStore& store, ApplicationInstance instance, 
+	                                std::string& result,
+	                                const OperationScheduler::ProgressReporter& progress);
+	
+	///Internal function which stops an application instance and starts it 
+	///again with a new configuration, which is then stored
+	///\param instance the instance to update, with its new configuration
+	///\param chartVersion the version of the application's chart to install
+	///\param result set to the JSON description of the updated instance on 
+	///              success, or to a description of the error which occurred
+	///\param progress called to report each step of the update
+	///\return whether the instance was updated
+	bool updateApplicationInstance(PersistentStore& store, const ApplicationInstance& instance, 
+	                               const std::string& chartVersion, std::string& result,
+	                               const OperationScheduler::ProgressReporter& progress);
 }
 
 #endif //SLATE_APPLICATION_INSTANCE_COMMANDS_H
@@ -5,14 +5,24 @@
 #include <map>
 #include <memory>
 #include <ostream>
+#include <streambuf>
 #include <string>
 
 ///Check whether a string has only valid base64 characters
 bool sanityCheckBase64(const std::string& str);
 
 ///Decode base64 encoded data
+///\throws std::runtime_error if the data contains a character which is not 
+///        part of the base64 alphabet, other than trailing padding
 std::string decodeBase64(const std::string& coded);
 
+///Decode base64 encoded data, checking that it is valid in the same pass
+///\param coded the encoded data
+///\param decoded the string which will be replaced by the decoded data
+///\return false, leaving decoded empty, if the data contains a character which 
+///        is not part of the base64 alphabet, other than trailing padding
+bool decodeBase64(const std::string& coded, std::string& decoded);
+
 ///Encode data to base64
 std::string encodeBase64(const std::string& raw);
 
@@ -22,6 +32,68 @@ void gzipDecompress(std::istream& src, std::ostream& dest);
 ///compress gzipped data from one stream to another
 void gzipCompress(std::istream& src, std::ostream& dest);
 
+namespace internal{
+///The ways in which base64 data can be encoded and decoded, using different 
+///instruction sets. The fastest supported by the processor is used unless 
+///another is selected. 
+enum class Base64Implementation{Scalar, SSSE3, AVX2};
+
+///\return whether the processor running this program can use an implementation
+bool base64ImplementationSupported(Base64Implementation impl);
+
+///Change the implementation used by all base64 encoding and decoding. This is
+///intended for testing and benchmarking. 
+///\throws std::runtime_error if the implementation is not supported
+void setBase64Implementation(Base64Implementation impl);
+}
+
+///A stream buffer which decodes base64 data from memory as it is read, so that
+///the decoded data is never held in memory all at once. 
+///Invalid characters cause reading to throw std::runtime_error, so streams 
+///using this buffer should have badbit set in their exception masks. 
+class Base64DecodingBuffer : public std::streambuf{
+public:
+	///\param data the encoded data, which must remain valid while this buffer 
+	///            is in use
+	///\param size the length of the encoded data
+	Base64DecodingBuffer(const char* data, std::size_t size);
+protected:
+	int_type underflow() override;
+private:
+	const static std::size_t bufferSize=48*1024;
+	const char* next;
+	const char* end;
+	char buffer[bufferSize];
+};
+
+///A stream buffer which decompresses gzipped data from another stream as it is
+///read, holding only a fixed amount of data in memory. 
+///Errors, including exceeding the size limit, cause reading to throw, so 
+///streams using this buffer should have badbit set in their exception masks. 
+class GzipDecompressingBuffer : public std::streambuf{
+public:
+	///\param src the stream of compressed data, whose header is read immediately
+	///\param limit if non-zero, the largest amount of decompressed data which 
+	///             may be read. Reading beyond this throws std::length_error. 
+	///\throws std::runtime_error if the source does not begin with a valid 
+	///        gzip header
+	explicit GzipDecompressingBuffer(std::istream& src, std::size_t limit=0);
+	~GzipDecompressingBuffer();
+	GzipDecompressingBuffer(const GzipDecompressingBuffer&)=delete;
+	GzipDecompressingBuffer& operator=(const GzipDecompressingBuffer&)=delete;
+	///\return the amount of decompressed data produced so far
+	std::size_t decompressedSize() const{ return totalOut; }
+protected:
+	int_type underflow() override;
+private:
+	struct State;
+	std::unique_ptr<State> state;
+	std::istream& src;
+	const std::size_t limit;
+	std::size_t totalOut;
+	bool ended;
+};
+
 //A simple interface for reading a tarball. 
 //Files are read in on demand, and can be dropped from memory when no longer needed. 
 //Once dropped, a file cannot be retrieved again. 
@@ -91,14 +163,30 @@ public:
 	void dropFile(const std::string& name);
 	///Test whether the end of the archive has been reached
 	bool eof() const;
-	///Write the entire contents of the archive to the filesystem
+	///Write the entire contents of the archive to the filesystem. The contents 
+	///of regular files are copied directly from the source stream to disk, 
+	///rather than being held in memory. 
 	///\param prefix the path prefix which should be prepended to all paths in 
 	///              the archive
-	///\param dropAfterExtracting remove file records from memory after they 
-	///                           have been written to disk
+	///\param dropAfterExtracting unused, since no file records are kept in 
+	///                           memory
 	void extractToFileSystem(const std::string& prefix, bool dropAfterExtracting=true);
 	
 private:
+	///The information from the header of one entry in the archive
+	struct EntryHeader{
+		std::string name;
+		FileRecord::fileType type;
+		long long size;
+		int mode;
+		std::string linkName;
+	};
+	
+	///Read the header of the next entry in the archive
+	///\return false if the end of the archive has been reached
+	bool readHeader(EntryHeader& header);
+	///Skip the padding which follows an entry's data
+	void skipPadding(long long size);
 	std::string readFiles(const std::string& target);
 	
 	std::istream& src;
@@ -13,7 +13,8 @@ crow::response createCluster(PersistentStore& store, const crow::request& req);
 ///\param clusterID the cluster to look up
 crow::response getClusterInfo(PersistentStore& store, const crow::request& req,
                               const std::string clusterID);
-///Delete a cluster
+///Delete a cluster. If the client requests an asynchronous response the 
+///deletion is done as a background operation. 
 ///\param clusterID the cluster to destroy
 crow::response deleteCluster(PersistentStore& store, const crow::request& req, 
                              const std::string& clusterID);
@@ -99,6 +100,41 @@ namespace internal{
 	///\return a string describing the error which has occured, or an empty 
 	///        string indicating success
 	std::string deleteCluster(PersistentStore& store, const Cluster& cluster, bool force);
+	
+	///Internal function which deletes a cluster and then notifies the groups
+	///which were allowed to use it, assuming that all authentication, 
+	///authorization, and validation of the command has already been performed
+	///\param cluster the cluster to delete
+	///\param force whether to remove the cluster from the persistent store 
+	///             even if contacting it with kubectl fails
+	///\return a string describing the error which has occured, or an empty 
+	///        string indicating success
+	std::string deleteClusterAndNotifyGroups(PersistentStore& store, const Cluster& cluster, bool force);
+	
+	///Contact a cluster to check whether it is reachable
+	///\param cluster the cluster to check
+	///\return whether the cluster could be contacted
+	bool pingCluster(PersistentStore& store, const Cluster& cluster);
+	
+	///Find the secrets which exist in all of the group namespaces on a 
+	///cluster. If permitted, the secrets in all namespaces are listed at 
+	///once; otherwise each namespace is listed separately, in parallel.
+	///\param executor the executor on which to list namespaces in parallel
+	///\param clusterID the ID of the cluster, which is used as the key for 
+	///                 the executor's limit on commands per cluster
+	///\param configPath the path to the cluster's kubeconfig
+	///\return the names of the secrets, in the form "groupName:secretName"
+	std::set<std::string> listClusterSecrets(Executor& executor, const std::string& clusterID,
+	                                         const std::string& configPath);
+	
+	///Determine whether a cluster is reachable, using a recent result if one
+	///is cached, and otherwise checking and caching the result. Results of
+	///checks made here while no background prober is running are cached only
+	///for ClusterProber::defaultInterval.
+	///\param cluster the cluster to check
+	///\param fresh whether to check even if a cached result is available
+	///\return whether the cluster could be contacted
+	bool checkClusterReachability(PersistentStore& store, const Cluster& cluster, bool fresh);
 }
 
 #endif //SLATE_CLUSTER_COMMANDS_H
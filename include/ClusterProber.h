@@ -0,0 +1,121 @@
+#ifndef SLATE_CLUSTER_PROBER_H
+#define SLATE_CLUSTER_PROBER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <Entities.h>
+#include <Executor.h>
+
+class PersistentStore;
+
+///Checks in the background whether every registered cluster can be contacted,
+///and records the results in the persistent store's reachability cache, so
+///that requests which need to know whether a cluster is reachable need not
+///wait to find out.
+///
+///Each cluster is checked about once per interval. The time of each check is
+///randomly varied, so that checks of many clusters, and of clusters which are
+///added at the same time, are spread out rather than all being made at once.
+class ClusterProber{
+public:
+	///A function which checks whether a cluster can be contacted
+	using Probe=std::function<bool(const Cluster&)>;
+
+	///Upper bounds, in milliseconds, of the buckets into which probe
+	///latencies are counted. Probes slower than the last bound are counted in
+	///an additional, final bucket.
+	static constexpr std::array<unsigned int,10> latencyBuckets{{10,25,50,100,250,500,1000,2500,5000,10000}};
+	///The number of buckets into which latencies are counted
+	static constexpr std::size_t latencyBucketCount=latencyBuckets.size()+1;
+	///The default average time between checks of each cluster, in seconds.
+	///When no prober is running, results of checks made by requests are
+	///cached for this long, so that they are about as current as a prober's.
+	static constexpr unsigned int defaultInterval=60;
+
+	///Counts of the checks made by a prober
+	struct Statistics{
+		///Clusters which are currently being checked
+		std::size_t clusters;
+		///Checks which have been made
+		std::size_t probes;
+		///Checks which found a cluster to be unreachable
+		std::size_t failures;
+		///Checks which threw exceptions, which count as failures
+		std::size_t errors;
+		///The number of checks whose latencies fell into each bucket
+		std::array<std::size_t,latencyBucketCount> latencyCounts;
+		///The total time spent on all checks
+		std::chrono::milliseconds totalLatency;
+	};
+
+	///Start checking clusters
+	///\param store the store from which clusters are listed and in which
+	///             results are cached
+	///\param probe the function which checks each cluster
+	///\param interval the average time between checks of each cluster
+	///\param concurrency the largest number of checks which may run at once
+	ClusterProber(PersistentStore& store, Probe probe,
+	              std::chrono::seconds interval, unsigned int concurrency);
+
+	///Stops checking clusters, waiting for any checks which are running to
+	///finish
+	~ClusterProber();
+
+	ClusterProber(const ClusterProber&)=delete;
+	ClusterProber& operator=(const ClusterProber&)=delete;
+
+	///Check a cluster immediately, and record the result
+	///\return whether the cluster could be contacted
+	bool probe(const Cluster& cluster);
+
+	///\return a snapshot of this prober's counters
+	Statistics getStatistics() const;
+
+private:
+	PersistentStore& store;
+	const Probe probeFunction;
+	const std::chrono::seconds interval;
+	///Runs checks, keyed by cluster ID, so that each cluster has at most one
+	///check in progress
+	Executor executor;
+	///All queued and running checks. This must be destroyed before the
+	///executor.
+	std::unique_ptr<Executor::TaskGroup> tasks;
+
+	///Protects the schedule and the random number generator
+	mutable std::mutex mut;
+	std::condition_variable wake;
+	bool stop;
+	///The time at which each known cluster should next be checked
+	std::map<std::string,std::chrono::steady_clock::time_point> schedule;
+	///Clusters whose checks have been queued and have not yet finished
+	std::set<std::string> inProgress;
+	std::mt19937 rng;
+
+	std::atomic<std::size_t> probes, failures, errors;
+	std::array<std::atomic<std::size_t>,latencyBucketCount> latencyCounts;
+	std::atomic<std::size_t> totalLatency;
+
+	///The thread which queues checks as they become due
+	std::thread scheduler;
+
+	///Queue checks of clusters as they become due, until stopped
+	void run();
+	///Choose a random delay between checks. The lock must be held.
+	///\param min the shortest delay, as a fraction of the interval
+	///\param max the longest delay, as a fraction of the interval
+	std::chrono::steady_clock::duration randomDelay(double min, double max);
+};
+
+#endif //SLATE_CLUSTER_PROBER_H
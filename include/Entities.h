@@ -400,6 +400,63 @@ namespace std{
 	};
 }
 
+///A long running task, such as restarting an application instance or deleting
+///a cluster, which is carried out in the background after the request for it
+///has been answered
+struct Operation{
+	Operation():valid(false),state(Pending),leaseExpiration(0){}
+	
+	enum State{
+		///Waiting to be started
+		Pending,
+		///Currently being carried out
+		Running,
+		///Finished successfully
+		Succeeded,
+		///Finished unsuccessfully
+		Failed
+	};
+	
+	///Indicates whether the operation exists/is valid
+	bool valid;
+	std::string id;
+	///What the operation does, such as "restartInstance"
+	std::string kind;
+	///The ID of the object on which the operation acts
+	std::string target;
+	///The ID of the user who requested the operation
+	std::string user;
+	///Any further inputs needed to carry out the operation, as a JSON object
+	std::string parameters;
+	State state;
+	///A description of the step the operation has reached
+	std::string progress;
+	///The JSON result of the operation if it succeeded, or an explanation of 
+	///what went wrong if it failed
+	std::string result;
+	std::string ctime;
+	///The time at which the operation's record was last changed
+	std::string mtime;
+	///The ID of the server replica which has claimed the operation, if any
+	std::string owner;
+	///The time, in seconds since the epoch, until which the owner's claim 
+	///holds. The owner extends this while the operation is queued or running, 
+	///and other replicas may take over the operation once it has passed. 
+	long long leaseExpiration;
+	
+	///\return whether the operation has finished, successfully or not
+	bool finished() const{ return state==Succeeded || state==Failed; }
+	
+	explicit operator bool() const{ return valid; }
+};
+
+///Compare operations by ID
+bool operator==(const Operation& o1, const Operation& o2);
+std::ostream& operator<<(std::ostream& os, const Operation& o);
+
+std::string to_string(Operation::State state);
+Operation::State operationStateFromString(const std::string& s);
+
 static class IDGenerator{
 public:
 	///Creates a random ID for a new user
@@ -426,6 +483,15 @@ public:
 	std::string generateVolumeID(){
 		return volumeIDPrefix+generateRawID();
 	}
+	///Creates a random ID for a new operation
+	std::string generateOperationID(){
+		return operationIDPrefix+generateRawID();
+	}
+	///Creates a random ID for an instance of the server, to distinguish it 
+	///from other replicas sharing the same database
+	std::string generateReplicaID(){
+		return replicaIDPrefix+generateRawID();
+	}
 	///Creates a random access token for a user
 	///At the moment there is no apparent reason that a user's access token
 	///should have any particular structure or meaning. Definite requirements:
@@ -445,6 +511,8 @@ public:
 	const static std::string instanceIDPrefix;
 	const static std::string secretIDPrefix;
 	const static std::string volumeIDPrefix;
+	const static std::string operationIDPrefix;
+	const static std::string replicaIDPrefix;
 	
 private:
 	std::mutex mut;
@@ -0,0 +1,484 @@
+#ifndef SLATE_EVICTING_CACHE_H
+#define SLATE_EVICTING_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <libcuckoo/cuckoohash_map.hh>
+
+//Estimates of the memory used by values, including any heap storage which
+//they own. Overloads for other types should be declared alongside those types,
+//so that they are found by argument-dependent lookup.
+
+template<typename T>
+typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value,std::size_t>::type
+approximateMemoryUsage(const T&){ return sizeof(T); }
+inline std::size_t approximateMemoryUsage(const std::string& s);
+template<typename T, typename U>
+std::size_t approximateMemoryUsage(const std::pair<T,U>& p);
+template<typename T, typename A>
+std::size_t approximateMemoryUsage(const std::vector<T,A>& v);
+template<typename T, typename C, typename A>
+std::size_t approximateMemoryUsage(const std::set<T,C,A>& s);
+template<typename T, typename H, typename E, typename A>
+std::size_t approximateMemoryUsage(const std::unordered_set<T,H,E,A>& s);
+template<typename T>
+std::size_t approximateMemoryUsage(const std::shared_ptr<T>& p);
+
+inline std::size_t approximateMemoryUsage(const std::string& s){
+	//strings of up to 15 characters are stored inline by libstdc++
+	return sizeof(s)+(s.capacity()>15 ? s.capacity()+1 : 0);
+}
+
+template<typename T, typename U>
+std::size_t approximateMemoryUsage(const std::pair<T,U>& p){
+	return approximateMemoryUsage(p.first)+approximateMemoryUsage(p.second)
+	       +sizeof(p)-sizeof(T)-sizeof(U);
+}
+
+template<typename T, typename A>
+std::size_t approximateMemoryUsage(const std::vector<T,A>& v){
+	std::size_t usage=sizeof(v)+(v.capacity()-v.size())*sizeof(T);
+	for(const auto& item : v)
+		usage+=approximateMemoryUsage(item);
+	return usage;
+}
+
+template<typename T, typename C, typename A>
+std::size_t approximateMemoryUsage(const std::set<T,C,A>& s){
+	//each node holds three pointers and a color
+	std::size_t usage=sizeof(s)+s.size()*4*sizeof(void*);
+	for(const auto& item : s)
+		usage+=approximateMemoryUsage(item);
+	return usage;
+}
+
+template<typename T, typename H, typename E, typename A>
+std::size_t approximateMemoryUsage(const std::unordered_set<T,H,E,A>& s){
+	//each node holds a pointer and a cached hash, and each bucket a pointer
+	std::size_t usage=sizeof(s)+s.size()*2*sizeof(void*)+s.bucket_count()*sizeof(void*);
+	for(const auto& item : s)
+		usage+=approximateMemoryUsage(item);
+	return usage;
+}
+
+template<typename T>
+std::size_t approximateMemoryUsage(const std::shared_ptr<T>& p){
+	//count the control block as two counts and two pointers
+	return sizeof(p)+(p ? approximateMemoryUsage(*p)+4*sizeof(void*) : 0);
+}
+
+///The interface through which caches of all types can be swept and reported on
+class EvictingCacheBase{
+public:
+	///Counts of the contents of a cache and the work done by it
+	struct Statistics{
+		///Records currently held
+		std::size_t entries;
+		///The approximate memory used by the records currently held
+		std::size_t bytes;
+		///Lookups which found a record which had not expired
+		std::size_t hits;
+		///Lookups which found no record, or only an expired one
+		std::size_t misses;
+		///Records removed to keep the cache within its limits
+		std::size_t evictions;
+		///Expired records removed by sweeping
+		std::size_t expirations;
+	};
+
+	explicit EvictingCacheBase(std::string name):name(std::move(name)){}
+	virtual ~EvictingCacheBase(){}
+
+	///\return the name used to identify this cache in statistics
+	const std::string& getName() const{ return name; }
+	///Change the limits on the size of the cache, evicting records if it is
+	///now too large
+	///\param maxEntries the largest number of records which may be held, or
+	///                  zero for no limit
+	///\param maxBytes the largest approximate amount of memory which may be
+	///                used by the records held, or zero for no limit
+	virtual void setLimits(std::size_t maxEntries, std::size_t maxBytes)=0;
+	///Remove all expired records
+	///\return the number of records removed
+	virtual std::size_t sweep()=0;
+	///\return a snapshot of this cache's counters
+	virtual Statistics getStatistics() const=0;
+
+private:
+	const std::string name;
+};
+
+///A concurrent cache, built on cuckoohash_map, which is limited in the number
+///of records it holds and the approximate memory they use. When a limit is
+///exceeded, records are evicted with the CLOCK algorithm: each lookup marks
+///the record it finds as recently used, and eviction passes over the table,
+///removing expired records and those not used since the previous pass, and
+///clearing the marks of the others, until the cache is comfortably within
+///its limits again.
+///Expired records are not removed when they are looked up, since callers may
+///still make use of them; they are removed by eviction or by calling sweep.
+///\tparam Value the type of the cached records, which must have an expired()
+///              member function, and for which approximateMemoryUsage must be
+///              defined
+template<typename Key, typename Value,
+         typename KeyHash=std::hash<Key>, typename KeyEqual=std::equal_to<Key>>
+class EvictingCache : public EvictingCacheBase{
+public:
+	using key_type=Key;
+	using mapped_type=Value;
+	using size_type=std::size_t;
+
+	///\param name the name used to identify this cache in statistics
+	///\param maxEntries the largest number of records which may be held, or
+	///                  zero for no limit
+	///\param maxBytes the largest approximate amount of memory which may be
+	///                used by the records held, or zero for no limit
+	explicit EvictingCache(std::string name, std::size_t maxEntries=0, std::size_t maxBytes=0):
+	EvictingCacheBase(std::move(name)),
+	maxEntries(maxEntries),maxBytes(maxBytes),count(0),bytes(0),hand(0),
+	hits(0),misses(0),evictions(0),expirations(0){}
+
+	void setLimits(std::size_t maxEntries, std::size_t maxBytes) override{
+		this->maxEntries=maxEntries;
+		this->maxBytes=maxBytes;
+		maybeEvict();
+	}
+
+	///Set a function to be called whenever records are removed by eviction or
+	///sweeping, rather than being erased explicitly. This is not safe to call
+	///concurrently with other operations on the cache.
+	void setRemovalHandler(std::function<void()> handler){ onRemoval=std::move(handler); }
+
+	///\return the total number of records which have been removed by eviction
+	///        or sweeping
+	std::size_t removals() const{ return evictions.load()+expirations.load(); }
+
+	///Look up a record, marking it as recently used
+	///\param key the key for which to search
+	///\param val set to the record if it is found, which may have expired
+	///\return whether the key was found
+	template<typename K>
+	bool find(const K& key, mapped_type& val) const{
+		bool found=data.find_fn(key,[&val](const Entry& entry){
+			val=entry.value;
+			entry.referenced=true;
+		});
+		if(found && !val.expired())
+			hits++;
+		else
+			misses++;
+		return found;
+	}
+
+	///\return whether the key is present, without marking it as used
+	template<typename K>
+	bool contains(const K& key) const{ return data.contains(key); }
+
+	///Insert a record if the key is not already present
+	///\param key the key of the record
+	///\param args the arguments from which to construct the record
+	///\return whether the record was inserted
+	template<typename K, typename... Args>
+	bool insert(K&& key, Args&&... args){
+		Entry entry(key,mapped_type(std::forward<Args>(args)...));
+		const std::size_t size=entry.bytes;
+		bool inserted=data.insert(std::forward<K>(key),std::move(entry));
+		if(inserted){
+			account(1,size,0);
+			maybeEvict();
+		}
+		return inserted;
+	}
+
+	///Insert a record, replacing any which already exists with the same key
+	///\param key the key of the record
+	///\param val the record
+	///\return true if the key was newly inserted, false if a record was
+	///        replaced
+	template<typename K, typename V>
+	bool insert_or_assign(K&& key, V&& val){
+		Entry entry(key,mapped_type(std::forward<V>(val)));
+		std::size_t added=entry.bytes, removed=0;
+		bool inserted=true;
+		data.upsert(std::forward<K>(key),[&](Entry& existing){
+			inserted=false;
+			removed=existing.bytes;
+			existing=std::move(entry);
+		},std::move(entry));
+		account(inserted ? 1 : 0,added,removed);
+		maybeEvict();
+		return inserted;
+	}
+
+	///Insert a record, or replace the record which already exists with the 
+	///same key if a predicate accepts it
+	///\param key the key of the record
+	///\param val the record
+	///\param shouldReplace a function which is given the existing record, if
+	///                     there is one, and returns whether to replace it
+	///\return whether the record was stored
+	template<typename K, typename V, typename F>
+	bool insert_or_assign_if(K&& key, V&& val, F shouldReplace){
+		Entry entry(key,mapped_type(std::forward<V>(val)));
+		std::size_t added=entry.bytes, removed=0;
+		bool inserted=true, replaced=false;
+		data.upsert(std::forward<K>(key),[&](Entry& existing){
+			inserted=false;
+			if(!shouldReplace(const_cast<const mapped_type&>(existing.value)))
+				return;
+			replaced=true;
+			removed=existing.bytes;
+			existing=std::move(entry);
+		},std::move(entry));
+		if(!inserted && !replaced)
+			return false;
+		account(inserted ? 1 : 0,added,removed);
+		maybeEvict();
+		return true;
+	}
+
+	///Remove a record
+	///\return whether the key was found
+	template<typename K>
+	bool erase(const K& key){
+		std::size_t removed=0;
+		bool erased=data.erase_fn(key,[&removed](const Entry& entry){
+			removed=entry.bytes;
+			return true;
+		});
+		if(erased)
+			account(-1,0,removed);
+		return erased;
+	}
+
+	///Call a function with the key and value of every record, while the whole
+	///cache is locked
+	template<typename F>
+	void for_each(F f) const{
+		auto table=data.lock_table();
+		for(const auto& item : table)
+			f(item.first,item.second.value);
+	}
+
+	///Remove every record for which a predicate, given the key and value, is
+	///true, while the whole cache is locked
+	///\return the number of records removed
+	template<typename F>
+	std::size_t erase_if(F f){
+		std::size_t erased=0, removed=0;
+		{
+			auto table=data.lock_table();
+			for(auto it=table.begin(); it!=table.end();){
+				if(f(it->first,it->second.value)){
+					removed+=it->second.bytes;
+					it=table.erase(it);
+					erased++;
+				}
+				else
+					++it;
+			}
+		}
+		account(-(long long)erased,0,removed);
+		return erased;
+	}
+
+	///Remove all records
+	void clear(){
+		std::size_t erased=0, removed=0;
+		{
+			auto table=data.lock_table();
+			for(const auto& item : table)
+				removed+=item.second.bytes;
+			erased=table.size();
+			table.clear();
+		}
+		//subtract what was removed rather than resetting the counts, since 
+		//other threads may not yet have accounted for their changes
+		account(-(long long)erased,0,removed);
+	}
+
+	///\return the number of records held
+	std::size_t size() const{ return nonNegative(count.load()); }
+	///\return the approximate memory used by the records held
+	std::size_t memoryUsage() const{ return nonNegative(bytes.load()); }
+
+	std::size_t sweep() override{
+		std::size_t erased=erase_if([](const key_type&, const mapped_type& value){
+			return value.expired();
+		});
+		if(erased){
+			expirations+=erased;
+			if(onRemoval)
+				onRemoval();
+		}
+		return erased;
+	}
+
+	Statistics getStatistics() const override{
+		Statistics stats;
+		stats.entries=size();
+		stats.bytes=memoryUsage();
+		stats.hits=hits.load();
+		stats.misses=misses.load();
+		stats.evictions=evictions.load();
+		stats.expirations=expirations.load();
+		return stats;
+	}
+
+private:
+	struct Entry{
+		template<typename K>
+		Entry(const K& key, mapped_type&& value):
+		value(std::move(value)),
+		bytes(approximateMemoryUsage(key_type(key))+approximateMemoryUsage(this->value)
+		      +sizeof(Entry)-sizeof(mapped_type)),
+		referenced(false){}
+
+		mapped_type value;
+		///The approximate memory used by this record and its key
+		std::size_t bytes;
+		///Whether this record has been used since the last eviction pass; this
+		///is only accessed while the record's bucket is locked
+		mutable bool referenced;
+	};
+	using Table=cuckoohash_map<Key,Entry,KeyHash,KeyEqual>;
+
+	///The fraction of each limit to which eviction reduces the cache, so that
+	///evictions happen in batches rather than on every insertion
+	static constexpr double evictionTarget=0.9;
+
+	mutable Table data;
+	std::atomic<std::size_t> maxEntries, maxBytes;
+	///The number of records held and their approximate memory use, which are
+	///kept separately since counting the records in the table is slow. These 
+	///are updated after the table, so a removal may be counted before the 
+	///insertion it undoes, briefly making them negative. 
+	std::atomic<long long> count, bytes;
+	///Held while evicting, so that only one thread does so at a time
+	std::mutex evictionMutex;
+	///The position in the table at which the next eviction pass begins
+	std::size_t hand;
+	std::function<void()> onRemoval;
+	mutable std::atomic<std::size_t> hits, misses;
+	std::atomic<std::size_t> evictions, expirations;
+
+	static std::size_t nonNegative(long long value){ return value>0 ? value : 0; }
+
+	///Record a change in the number of records and their memory use
+	///\param entries the change in the number of records
+	///\param added the memory used by records which were stored
+	///\param removed the memory used by records which were removed
+	void account(long long entries, std::size_t added, std::size_t removed){
+		if(entries)
+			count+=entries;
+		bytes+=(long long)added-(long long)removed;
+	}
+
+	bool overLimit(double fraction) const{
+		const std::size_t entryLimit=maxEntries.load(), byteLimit=maxBytes.load();
+		return (entryLimit && size()>entryLimit*fraction)
+		    || (byteLimit && memoryUsage()>byteLimit*fraction);
+	}
+
+	///Evict records if the cache is over either of its limits
+	void maybeEvict(){
+		if(!overLimit(1))
+			return;
+		//if another thread is already evicting, it will do enough for both
+		std::unique_lock<std::mutex> lock(evictionMutex,std::try_to_lock);
+		if(!lock.owns_lock())
+			return;
+		std::size_t evicted=0, removed=0;
+		{
+			auto table=data.lock_table();
+			const std::size_t entryLimit=maxEntries.load(), byteLimit=maxBytes.load();
+			std::size_t entries=table.size(), used=memoryUsage();
+			auto done=[&]{
+				return (!entryLimit || entries<=entryLimit*evictionTarget)
+				    && (!byteLimit || used<=removed || used-removed<=byteLimit*evictionTarget);
+			};
+			//Iterators are not kept while the table is unlocked, so the hand
+			//is a count of records from the start of the table. Every record
+			//is removed by the third pass at the latest, since the first
+			//clears all marks.
+			if(hand>=entries)
+				hand=0;
+			auto it=table.begin();
+			std::advance(it,hand);
+			for(unsigned int passes=0; !done() && entries && passes<3;){
+				if(it==table.end()){
+					it=table.begin();
+					hand=0;
+					passes++;
+					continue;
+				}
+				if(it->second.referenced && !it->second.value.expired()){
+					it->second.referenced=false;
+					++it;
+					hand++;
+				}
+				else{
+					removed+=it->second.bytes;
+					it=table.erase(it);
+					entries--;
+					evicted++;
+				}
+			}
+		}
+		account(-(long long)evicted,0,removed);
+		if(evicted){
+			evictions+=evicted;
+			if(onRemoval)
+				onRemoval();
+		}
+	}
+};
+
+template<typename Key, typename Value, typename KeyHash, typename KeyEqual>
+constexpr double EvictingCache<Key,Value,KeyHash,KeyEqual>::evictionTarget;
+
+///Runs a function periodically on a background thread, for sweeping expired
+///records out of caches or other periodic maintenance
+class CacheSweeper{
+public:
+	///\param interval the time between sweeps
+	///\param sweep the function which does the sweeping
+	///\param activity a description of what the function does, used when 
+	///                logging its failures
+	CacheSweeper(std::chrono::seconds interval, std::function<void()> sweep,
+	             std::string activity="Sweeping caches");
+	///Stops the background thread, waiting for any sweep in progress to finish
+	~CacheSweeper();
+	CacheSweeper(const CacheSweeper&)=delete;
+	CacheSweeper& operator=(const CacheSweeper&)=delete;
+
+	///\return the number of sweeps which have been completed
+	std::size_t sweeps() const{ return sweepCount.load(); }
+
+private:
+	const std::chrono::seconds interval;
+	const std::function<void()> sweepFunction;
+	const std::string activity;
+	std::mutex mut;
+	std::condition_variable wake;
+	bool stop;
+	std::atomic<std::size_t> sweepCount;
+	std::thread thread;
+
+	void run();
+};
+
+#endif //SLATE_EVICTING_CACHE_H
@@ -0,0 +1,219 @@
+#ifndef SLATE_EXECUTOR_H
+#define SLATE_EXECUTOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+///A fixed set of worker threads shared by many independent groups of tasks.
+///
+///Tasks are always submitted as part of a TaskGroup, which may limit how many
+///of its tasks run at once so that one large group cannot occupy every worker.
+///Workers serve the groups which have runnable tasks in turn. A thread which
+///waits for a group to finish takes that group's queued tasks and runs them
+///itself rather than sleeping, so a group always makes progress even when
+///every worker is busy with other groups.
+///
+///Tasks may also be submitted with a key, such as the ID of the cluster the task
+///will contact, in which case the executor limits how many tasks with the same
+///key run at once across all groups. Keys should only be given to tasks which 
+///do not themselves wait for other tasks with the same key. 
+class Executor{
+public:
+	class TaskGroup;
+	
+	///The order in which groups are served. Workers always start queued 
+	///interactive tasks before bulk tasks. 
+	enum class Priority{
+		///Work on which a user is waiting
+		Interactive,
+		///Background or large scale work, such as cleaning up deleted objects
+		Bulk
+	};
+
+	///Counts of the work done by an executor
+	struct Statistics{
+		///Number of worker threads
+		std::size_t threads;
+		///Tasks which were submitted in total
+		std::size_t tasksSubmitted;
+		///Tasks which have finished running
+		std::size_t tasksCompleted;
+		///Tasks which were discarded without being run
+		std::size_t tasksCancelled;
+		///Tasks which were run by threads waiting for their groups rather than
+		///by workers
+		std::size_t tasksRunByWaiters;
+		///Tasks currently waiting to run
+		std::size_t queued;
+		///Bulk priority tasks currently waiting to run
+		std::size_t bulkQueued;
+		///Tasks currently running
+		std::size_t running;
+		///The largest number of tasks which have been waiting at once
+		std::size_t maxQueued;
+		///The total time tasks have spent waiting to start
+		std::chrono::microseconds totalQueueTime;
+		///The longest time any task has waited to start
+		std::chrono::microseconds maxQueueTime;
+	};
+
+	///\param name the name used for this executor in statistics reports
+	///\param threads the number of worker threads to start
+	///\param maxPerKey the maximum number of tasks with the same key which may
+	///                 run at once. Zero means no limit. 
+	Executor(const std::string& name, unsigned int threads, unsigned int maxPerKey=0);
+
+	///Stops the worker threads. All task groups using this executor must be
+	///destroyed first.
+	~Executor();
+
+	Executor(const Executor&)=delete;
+	Executor& operator=(const Executor&)=delete;
+
+	const std::string& getName() const{ return name; }
+
+	///\return a snapshot of this executor's counters
+	Statistics getStatistics() const;
+
+private:
+	using clock=std::chrono::steady_clock;
+
+	struct Task{
+		std::function<void()> work;
+		std::string key;
+		clock::time_point enqueued;
+	};
+
+	///The state of a TaskGroup, which is shared with the executor's queue of
+	///groups which have runnable tasks
+	struct GroupState{
+		GroupState(unsigned int maxConcurrency, Priority priority);
+		std::deque<Task> pending;
+		///The maximum number of this group's tasks which may run at once
+		const unsigned int maxConcurrency;
+		const Priority priority;
+		///The number of this group's tasks which are running
+		unsigned int running;
+		///Whether the group is currently in the executor's ready queue
+		bool scheduled;
+		///Whether the group has queued tasks which cannot start only because 
+		///of the limit on tasks with the same key
+		bool blocked;
+		///Whether new tasks should be discarded rather than queued
+		bool cancelled;
+		///The number of this group's tasks which were discarded
+		std::size_t cancelledTasks;
+		///Signaled whenever one of the group's tasks finishes
+		std::condition_variable changed;
+	};
+
+	const std::string name;
+	///Protects all queues and counters, including those of groups
+	mutable std::mutex mut;
+	std::condition_variable workAvailable;
+	///Groups which have tasks which may be started, in the order they will be
+	///served, for each priority
+	std::deque<std::shared_ptr<GroupState>> readyGroups[2];
+	///Groups which are waiting for the number of running tasks with some key 
+	///to fall
+	std::vector<std::shared_ptr<GroupState>> blockedGroups;
+	///The maximum number of tasks with the same key which may run at once
+	const unsigned int maxPerKey;
+	///The number of running tasks with each key
+	std::map<std::string,unsigned int> runningPerKey;
+	std::vector<std::thread> workers;
+	bool stopping;
+	Statistics stats;
+
+	void workerLoop();
+	///Find the first of a group's queued tasks which may be started now. The 
+	///executor's lock must be held.
+	///\return an iterator to the task, or the end of the group's queue if none
+	///        may start
+	std::deque<Task>::iterator nextTask(GroupState& group);
+	///Put a group in the ready queue if it has tasks which may be started and
+	///is not already there. The executor's lock must be held.
+	void schedule(const std::shared_ptr<GroupState>& group);
+	///Remove a task from a group's queue and count it as running. The 
+	///executor's lock must be held.
+	Task startTask(GroupState& group, std::deque<Task>::iterator task);
+	///Run a task which has been started, and then count it as finished. The
+	///executor's lock must be held; it is released while the task runs.
+	void runTask(std::unique_lock<std::mutex>& lock,
+	             const std::shared_ptr<GroupState>& group,
+	             Task& task);
+
+	friend class TaskGroup;
+};
+
+///A set of related tasks which run on an Executor and which can be waited for
+///or cancelled together
+class Executor::TaskGroup{
+public:
+	///\param executor the executor which should run the tasks
+	///\param maxConcurrency the maximum number of this group's tasks which may
+	///                      run at once. Zero means no limit other than the
+	///                      executor's number of threads.
+	///\param priority how the group's tasks should be ordered relative to 
+	///                those of other groups
+	TaskGroup(Executor& executor, unsigned int maxConcurrency=0, 
+	          Priority priority=Priority::Interactive);
+
+	///Discards any tasks which have not started, and waits for those which
+	///have.
+	~TaskGroup();
+
+	TaskGroup(const TaskGroup&)=delete;
+	TaskGroup& operator=(const TaskGroup&)=delete;
+
+	///Add a task to the group. Tasks should handle their own exceptions; any
+	///which escape are logged and discarded. If the group has been cancelled
+	///the task is discarded.
+	void submit(std::function<void()> task);
+	
+	///Add a task to the group, subject to the executor's limit on running 
+	///tasks with the same key. 
+	///\param key identifies the resource the task uses, such as a cluster ID
+	///\param task the work to do
+	void submit(const std::string& key, std::function<void()> task);
+
+	///Wait for all of the group's tasks to finish, running queued tasks on the
+	///calling thread while doing so.
+	void wait();
+
+	///Wait for all of the group's tasks to finish, running queued tasks on the
+	///calling thread while doing so, but cancel the group if it is no longer
+	///wanted.
+	///\param keepGoing a check which is made periodically, and between tasks,
+	///                 which should return false if the group's work is no
+	///                 longer needed
+	///\param checkInterval the longest time to wait between checks
+	///\return true if all tasks ran, false if some were cancelled
+	bool wait(const std::function<bool()>& keepGoing,
+	          std::chrono::milliseconds checkInterval);
+
+	///Discard all tasks which have not yet started. Tasks which are already
+	///running are not interrupted.
+	void cancel();
+
+	///\return the number of this group's tasks which were discarded
+	std::size_t cancelledTasks() const;
+
+private:
+	Executor& executor;
+	std::shared_ptr<GroupState> state;
+};
+
+///\return lines of text describing the statistics of every existing executor
+std::string getExecutorStatistics();
+
+#endif //SLATE_EXECUTOR_H
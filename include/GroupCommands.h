@@ -15,7 +15,8 @@ crow::response getGroupInfo(PersistentStore& store, const crow::request& req, co
 ///Change a Group's information
 ///\param groupID the Group to update
 crow::response updateGroup(PersistentStore& store, const crow::request& req, const std::string& groupID);
-///Delete a group
+///Delete a group. If the client requests an asynchronous response, deleting 
+///the objects which belong to the group is done as a background operation. 
 ///\param groupID the Group to destroy
 crow::response deleteGroup(PersistentStore& store, const crow::request& req, const std::string& groupID);
 ///List the users who belong to a group
@@ -25,4 +26,14 @@ crow::response listGroupMembers(PersistentStore& store, const crow::request& req
 ///\param groupID the Group to list
 crow::response listGroupClusters(PersistentStore& store, const crow::request& req, const std::string& groupID);
 
+namespace internal{
+	///Internal function which deletes the instances, secrets, namespaces, and
+	///clusters belonging to a group whose record has already been removed. 
+	///Objects which cannot be deleted are logged and skipped. 
+	///\param targetGroup the deleted group, which must have its ID and name
+	///\param progress called to report each step of the cleanup
+	void deleteGroupResources(PersistentStore& store, const Group& targetGroup, 
+	                          const OperationScheduler::ProgressReporter& progress);
+}
+
 #endif //SLATE_GroupCOMMANDS_H
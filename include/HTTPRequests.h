@@ -1,6 +1,7 @@
 #ifndef SLATE_HTTPREQUESTS_H
 #define SLATE_HTTPREQUESTS_H
 
+#include <cstddef>
 #include <map>
 #include <string>
 
@@ -64,6 +65,27 @@ Response httpPostForm(const std::string& url,
                       const std::multimap<std::string,std::string>& formData, 
                       const Options& options={});
 
+namespace detail{
+
+///Helper data used for collecting output data from libcurl
+struct CurlOutputData{
+	///The collected output, should be empty initially
+	std::string output;
+	///Context information to be included in messages if an error occurs
+	std::string context;
+};
+
+///Callback function for collecting data from libcurl, and only to be called by libcurl. 
+///See https://curl.haxx.se/libcurl/c/CURLOPT_WRITEFUNCTION.html
+///\param buffer the data being provided by libcurl
+///\param size the number of 'items' in the available data
+///\param nmemb the size of each 'item' of available data
+///\param userp pointer to a CurlOutputData object with the buffer where data is to be collected and
+///             error context information
+std::size_t collectCurlOutput(char* buffer, std::size_t size, std::size_t nmemb, void* userp);
+
+}
+
 #ifdef SLATE_EXTRACT_HOSTNAME_AVAIL
 ///Get the hostname component from a URL. 
 ///\throws std::invalid_argument if \p url cannot be parsed as a URL.
@@ -0,0 +1,94 @@
+#ifndef SLATE_KUBE_API_CLIENT_H
+#define SLATE_KUBE_API_CLIENT_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#include "Process.h"
+
+namespace kubernetes{
+	///Restrictions on which objects should be fetched by kubectl_get
+	struct GetOptions{
+		///The namespace in which to look. If empty, the default namespace of
+		///the kubeconfig's current context is used. Ignored for kinds which are
+		///not namespaced.
+		std::string nspace;
+		///If non-empty, the single object which should be fetched
+		std::string name;
+		///A label selector expression, equivalent to kubectl's -l
+		std::string labelSelector;
+		///A field selector expression, equivalent to kubectl's --field-selector
+		std::string fieldSelector;
+	};
+
+	///Get objects from a cluster, producing the same result as
+	///`kubectl get <kind> -o=json`, but by making the request directly to the
+	///cluster's API server over a connection which is kept open for reuse.
+	///
+	///Supported kinds are pods, services, events, nodes, namespaces,
+	///storageclasses, and priorityclasses (as well as the singular and short
+	///names kubectl accepts for them). For any other kind, for kubeconfigs
+	///which cannot be used without kubectl (for example because they use an
+	///exec credential plugin), or if the API server cannot be contacted, the
+	///request is passed to kubectl instead.
+	///\param configPath path to the kubeconfig for the target cluster
+	///\param kind the type of object to get
+	///\param options the namespace, object name, and selectors to use
+	///\return the JSON object or list in output, or an explanation in error
+	///        if status is non-zero
+	commandResult kubectl_get(const std::string& configPath,
+	                          const std::string& kind,
+	                          const GetOptions& options={});
+
+	///The outcome of waiting for objects to be deleted
+	enum class DeletionWaitResult{
+		///No matching objects remain
+		Deleted,
+		///The deadline passed while matching objects remained
+		TimedOut,
+		///The cluster could not be queried
+		Failed
+	};
+
+	///Wait until no objects of the kinds listed by `kubectl get all` which
+	///match a label selector remain in a namespace.
+	///
+	///Where the kubeconfig can be used directly, this watches the API server
+	///for deletion events, so it returns as soon as the last object is gone.
+	///Otherwise it polls using kubectl.
+	///\param configPath path to the kubeconfig for the target cluster
+	///\param nspace the namespace in which to look
+	///\param labelSelector a label selector expression, equivalent to kubectl's -l
+	///\param deadline the time after which to stop waiting
+	///\param error set to an explanation if the result is Failed
+	///\return whether the objects were deleted before the deadline
+	DeletionWaitResult waitForDeletion(const std::string& configPath,
+	                                   const std::string& nspace,
+	                                   const std::string& labelSelector,
+	                                   std::chrono::steady_clock::time_point deadline,
+	                                   std::string& error);
+
+	///Discard any connections and credentials held for a cluster. This should
+	///be used when its kubeconfig is changed or removed; otherwise it will
+	///only be noticed on the next request.
+	///\param configPath path to the kubeconfig for the cluster
+	void dropAPIConnections(const std::string& configPath);
+
+	///Counts of requests made through kubectl_get and waitForDeletion
+	struct APIClientStatistics{
+		///Requests answered directly by an API server
+		std::size_t directRequests;
+		///Requests which were passed to kubectl
+		std::size_t fallbackRequests;
+		///New connection handles which had to be created
+		std::size_t connectionsCreated;
+		///Watches opened by waitForDeletion
+		std::size_t watchesStarted;
+	};
+
+	///\return counts of requests made through kubectl_get and waitForDeletion
+	APIClientStatistics getAPIClientStatistics();
+}
+
+#endif //SLATE_KUBE_API_CLIENT_H
@@ -12,6 +12,14 @@ namespace kubernetes{
 	commandResult kubectl(const std::string& configPath,
 	                      const std::vector<std::string>& arguments);
 	
+	///Run kubectl, sending data to its standard input
+	///\param configPath path to the kubeconfig file
+	///\param arguments the arguments for kubectl
+	///\param input the data to send, for use with arguments like `-f -`
+	commandResult kubectl(const std::string& configPath,
+	                      const std::vector<std::string>& arguments,
+	                      const std::string& input);
+	
 	commandResult helm(const std::string& configPath,
 	                   const std::string& tillerNamespace,
 	                   const std::vector<std::string>& arguments);
@@ -30,19 +38,53 @@ namespace kubernetes{
 
 	///Collect the types and names of all objects matching a selector
 	///
-	///This function is very inefficient and should be avoided whenever possible, 
-	///as it must issue a separate kubectl command for every resource type known
-	///on the cluster, whether or not there turn out to be any relevant resources 
-	///of that type. 
+	///All resource types known on the cluster are searched with a single kubectl
+	///command. The list of types is remembered for each cluster for a few 
+	///minutes, and is fetched again if the cluster reports that one of them no
+	///longer exists. 
 	///\param clusterConfig path to the kubeconfig file
 	///\param selector the selector expression to use for filtering
 	///\param nspace the namespace in which to search. Non-namespaced resources 
 	///              are always found regardless of this parameter's value.
+	///\param verbs the verbs which resource types must support to be searched
+	///\return a map from resource types, in the form used by kubectl to name 
+	///        objects (e.g. deployment.apps), to the names of objects
 	std::multimap<std::string,std::string> findAll(const std::string& clusterConfig, 
 	                                               const std::string& selector, 
 	                                               const std::string& nspace, 
 	                                               const std::string& verbs="get");
 	
+	///A description of the installed Helm and the features which depend on its 
+	///version
+	struct HelmCapabilities{
+		///The full version number reported by helm, without the leading 'v'
+		std::string version;
+		///The major component of the version number
+		unsigned int majorVersion;
+		///Whether helm must be told how to reach a tiller instance
+		bool usesTiller;
+		///Whether searching is done with `helm search repo` rather than just 
+		///`helm search`
+		bool searchRepoSubcommand;
+		///The option used to set the maximum column width of search output, 
+		///or empty if this version of helm is not known to have one
+		std::string columnWidthFlag;
+		
+		HelmCapabilities():majorVersion(0),usesTiller(false),searchRepoSubcommand(false){}
+	};
+	
+	///Get the capabilities of the installed helm. The probe (running 
+	///`helm version`) is performed only the first time this function is called, 
+	///or after refreshHelmCapabilities; all other calls return the stored 
+	///result. Safe to call concurrently. 
+	///\throws std::runtime_error if the helm version cannot be determined
+	HelmCapabilities getHelmCapabilities();
+	
+	///Re-run the helm version probe, replacing the stored capabilities. This 
+	///should be used if the installed helm may have changed. 
+	///\throws std::runtime_error if the helm version cannot be determined
+	HelmCapabilities refreshHelmCapabilities();
+	
 	///\return the major component of the installed Helm's current version number
 	unsigned int getHelmMajorVersion();
 }
@@ -1,53 +1,90 @@
 #ifndef SLATE_LOGGING_H
 #define SLATE_LOGGING_H
 
+#include <atomic>
 #include <iostream>
 #include <sstream>
 #include <mutex>
+#include <string>
 #include <thread>
 
 #include "Utilities.h"
 #include "ServerUtilities.h"
 
-struct logTarget{
-	std::ostream& stream;
-	std::mutex mutex;
-	
-	void write(const std::string& msg){
-		std::lock_guard<std::mutex> guard(mutex);
-		stream << msg;
-		stream.flush();
-	}
+///The severity of a log message
+enum class LogLevel : int{
+	Info=0,
+	Warn=1,
+	Error=2,
+	Fatal=3
 };
 
-extern logTarget logStdout;
-extern logTarget logStderr;
+///How log messages are written
+enum class LogFormat{
+	///Human readable lines: "LEVEL: [time] (TID thread) message"
+	Text,
+	///One JSON object per line, with time, level, thread, and message fields
+	JSON
+};
+
+///The least severe level of message which is currently written
+extern std::atomic<int> logLevelThreshold;
+
+///\return whether messages of the given level are currently written
+inline bool logEnabled(LogLevel level){
+	return (int)level>=logLevelThreshold.load(std::memory_order_relaxed);
+}
+
+///Set the least severe level of message to write. This may be changed at any
+///time, from any thread. Fatal messages are always written.
+void setLogLevel(LogLevel level);
+///Set how messages are formatted. This may be changed at any time, from any
+///thread, and affects messages which have not yet been written.
+void setLogFormat(LogFormat format);
+///Parse a level name ("info", "warn", "error", or "fatal")
+///\throws std::runtime_error if the name is not recognized
+LogLevel parseLogLevel(const std::string& name);
+///Parse a format name ("text" or "json")
+///\throws std::runtime_error if the name is not recognized
+LogFormat parseLogFormat(const std::string& name);
+
+///Queue a message to be written by the background logging thread. Messages
+///at the Info level go to stdout, all others to stderr. This does not block
+///unless the queue is full.
+///\param level the severity of the message
+///\param message the text of the message, without a trailing newline
+void logMessage(LogLevel level, std::string message);
+///Wait until all messages queued before this call have been written
+void flushLog();
 
 ///Log an informational message to stdout
 #define log_info(msg) \
 do{ \
-	std::ostringstream str; \
-	str << "INFO: [" << timestamp() << "] (TID " \
-	<< std::this_thread::get_id() << ") " << msg << std::endl; \
-	logStdout.write(str.str()); \
+	if(logEnabled(LogLevel::Info)){ \
+		std::ostringstream str; \
+		str << msg; \
+		logMessage(LogLevel::Info,str.str()); \
+	} \
 } while(0)
 
 ///Log that an error or problem has occurred to stderr
 #define log_warn(msg) \
 do{ \
-	std::ostringstream str; \
-	str << "WARN: [" << timestamp() << "] (TID " \
-	<< std::this_thread::get_id() << ") " << msg << std::endl; \
-	logStderr.write(str.str()); \
+	if(logEnabled(LogLevel::Warn)){ \
+		std::ostringstream str; \
+		str << msg; \
+		logMessage(LogLevel::Warn,str.str()); \
+	} \
 } while(0)
 
 ///Log that an error or problem has occurred to stderr
 #define log_error(msg) \
 do{ \
-	std::ostringstream str; \
-	str << "ERROR: [" << timestamp() << "] (TID " \
-	<< std::this_thread::get_id() << ") " << msg << std::endl; \
-	logStderr.write(str.str()); \
+	if(logEnabled(LogLevel::Error)){ \
+		std::ostringstream str; \
+		str << msg; \
+		logMessage(LogLevel::Error,str.str()); \
+	} \
 } while(0)
 
 ///Log an error to stderr and abort the current activity by throwing an exception
@@ -56,10 +93,7 @@ do{ \
 do{ \
 	std::ostringstream mstr; \
 	mstr << msg; \
-	std::ostringstream str; \
-	str << "FATAL: [" << timestamp() << "] (TID " \
-	<< std::this_thread::get_id() << ") " << mstr.str() << std::endl; \
-	logStderr.write(str.str()); \
+	logMessage(LogLevel::Fatal,mstr.str()); \
 	throw std::runtime_error(mstr.str()); \
 } while(0)
 
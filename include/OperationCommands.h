@@ -0,0 +1,29 @@
+#ifndef SLATE_OPERATION_COMMANDS_H
+#define SLATE_OPERATION_COMMANDS_H
+
+#include "crow.h"
+#include "Entities.h"
+#include "PersistentStore.h"
+
+///List the operations requested by the current user
+crow::response listOperations(PersistentStore& store, const crow::request& req);
+///Get the state, progress, and result of an operation
+///\param operationID the operation to look up
+crow::response getOperation(PersistentStore& store, const crow::request& req, const std::string& operationID);
+
+///Determine whether a client would like a long running request to be answered
+///as soon as the work has been scheduled, rather than when it is complete.
+///This is indicated either by an 'async' query parameter or by a
+///'Prefer: respond-async' header.
+bool asyncRequested(const crow::request& req);
+
+///Construct the response to a request which has started an operation
+///\param operation the operation which was started
+///\return a response with status 202 which gives the ID of the operation
+crow::response operationAccepted(const Operation& operation);
+
+///Set the handlers for all kinds of operations on the store's scheduler. This
+///must be done before operations are started or resumed.
+void registerOperationHandlers(PersistentStore& store);
+
+#endif //SLATE_OPERATION_COMMANDS_H
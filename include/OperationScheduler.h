@@ -0,0 +1,152 @@
+#ifndef SLATE_OPERATION_SCHEDULER_H
+#define SLATE_OPERATION_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <Entities.h>
+#include <EvictingCache.h>
+#include <Executor.h>
+
+class PersistentStore;
+
+///Carries out long running operations in the background, so that the requests
+///which start them can be answered immediately.
+///
+///Every operation is recorded in the persistent store before it is queued, and
+///its record is updated as it progresses, so that clients can poll for its
+///state and result, and so that operations which were interrupted by the
+///server stopping can be resumed when it starts again. For that reason the
+///work done for each kind of operation must be safe to repeat from the
+///beginning.
+///
+///Several replicas of the server may share one database, so each operation 
+///record names the replica which owns it, and a lease time until which that 
+///owner's claim holds. A scheduler periodically extends the leases of the 
+///operations it has queued or is running, and periodically takes over 
+///unfinished operations whose leases have expired, such as those of a replica 
+///which has stopped. Taking over is done with a conditional update, so only 
+///one replica can succeed in claiming an operation. 
+///
+///Operations run on their own executor, keyed by their targets, so that at most
+///one operation acts on any given object at a time.
+class OperationScheduler{
+public:
+	///A function which records how far an operation has progressed
+	using ProgressReporter=std::function<void(const std::string&)>;
+	///A function which carries out an operation
+	///\param operation the record of the operation to carry out
+	///\param result set to the JSON result of the operation if it succeeds,
+	///              or to an explanation of what went wrong if it fails
+	///\param progress called to report each step the operation reaches
+	///\return whether the operation succeeded
+	using Handler=std::function<bool(const Operation& operation, std::string& result,
+	                                 const ProgressReporter& progress)>;
+
+	///Counts of the operations handled by a scheduler
+	struct Statistics{
+		std::size_t started;
+		std::size_t resumed;
+		std::size_t succeeded;
+		std::size_t failed;
+	};
+
+	///\param store the store in which operations are recorded
+	///\param threads the number of operations which may run at once
+	///\param leaseDuration how long this scheduler's claim on an operation 
+	///                     lasts unless it is renewed. Once background tasks 
+	///                     are started, leases are renewed three times per 
+	///                     duration, and other replicas' expired leases are 
+	///                     checked for once per duration. 
+	OperationScheduler(PersistentStore& store, unsigned int threads,
+	                   std::chrono::seconds leaseDuration=std::chrono::seconds(60));
+
+	///Discards any operations which have not started, which will remain
+	///recorded as pending until their leases expire and they are taken over, 
+	///and waits for those which are running to finish.
+	~OperationScheduler();
+
+	OperationScheduler(const OperationScheduler&)=delete;
+	OperationScheduler& operator=(const OperationScheduler&)=delete;
+
+	///Set the function which carries out one kind of operation. Handlers
+	///should be set before any operations are started or resumed.
+	///\param kind the kind of operation, such as "restartInstance"
+	///\param handler the function which does the work
+	void setHandler(const std::string& kind, Handler handler);
+
+	///Begin renewing the leases on this scheduler's operations, and 
+	///periodically taking over operations whose leases have expired. This 
+	///should be done once all handlers are set, since operations of kinds 
+	///without handlers are not taken over. Until it is done, the leases on 
+	///operations started here are not renewed. 
+	void startBackgroundTasks();
+
+	///Record a new operation and queue it to be run
+	///\param kind the kind of operation, for which a handler must be set
+	///\param target the ID of the object on which the operation acts
+	///\param user the ID of the user who requested the operation
+	///\param parameters any further inputs the handler needs, as a JSON object
+	///\return the record of the operation, which is invalid if it could not be
+	///        stored
+	Operation start(const std::string& kind, const std::string& target,
+	                const std::string& user, const std::string& parameters="{}");
+
+	///Claim and queue every operation which is recorded as pending or running
+	///and which no replica holds a current lease on, such as those which were 
+	///interrupted when a server stopped. Operations of kinds for which no 
+	///handler is set are not claimed. This should be done at startup, after 
+	///the handlers are set; it is also done periodically once background 
+	///tasks are started. 
+	///\return the number of operations which were queued
+	std::size_t resumeUnfinished();
+
+	///\return a snapshot of this scheduler's counters
+	Statistics getStatistics() const;
+
+private:
+	PersistentStore& store;
+	const std::chrono::seconds leaseDuration;
+	std::mutex handlerMut;
+	std::map<std::string,Handler> handlers;
+	///Runs operations, keyed by their targets
+	Executor executor;
+	///All queued and running operations. This must be destroyed before the
+	///executor.
+	std::unique_ptr<Executor::TaskGroup> tasks;
+	std::atomic<std::size_t> started, resumed, succeeded, failed;
+	///Prevents concurrent resumptions from claiming the same operation twice
+	std::mutex resumeMut;
+	std::mutex ownedMut;
+	///The operations this scheduler has claimed and not yet finished, indexed 
+	///by ID
+	std::map<std::string,Operation> owned;
+	///Periodically renews the leases on owned operations
+	std::unique_ptr<CacheSweeper> leaseRenewer;
+	///Periodically takes over operations whose leases have expired
+	std::unique_ptr<CacheSweeper> takeoverChecker;
+
+	///\return the time, in seconds since the epoch, until which a lease taken 
+	///        or renewed now will hold
+	long long leaseExpirationTime() const;
+	///Queue an operation which has been recorded and claimed
+	void submit(const Operation& operation);
+	///Carry out an operation, keeping its record up to date
+	void run(Operation operation);
+	///Extend the leases on all owned operations, giving up any which another 
+	///replica has taken over
+	void renewLeases();
+	///\return whether a handler is set for the given kind of operation
+	bool hasHandler(const std::string& kind);
+	///\return whether this scheduler still owns the given operation
+	bool owns(const std::string& id);
+	///Stop renewing the lease on an operation
+	void release(const std::string& id);
+};
+
+#endif //SLATE_OPERATION_SCHEDULER_H
@@ -2,7 +2,10 @@
 #define SLATE_PERSISTENT_STORE_H
 
 #include <atomic>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 
@@ -14,10 +17,17 @@
 #include <libcuckoo/cuckoohash_map.hh>
 
 #include <concurrent_multimap.h>
+#include <ClusterProber.h>
 #include <DNSManipulator.h>
 #include <Entities.h>
+#include <EvictingCache.h>
+#include <Executor.h>
 #include <FileHandle.h>
 #include <Geocoder.h>
+#include <OperationScheduler.h>
+#include <Process.h>
+#include <SecretCipher.h>
+#include <SingleFlight.h>
 
 //In libstdc++ versions < 5 std::atomic seems to be broken for non-integral types
 //In that case, we must use our own, minimal replacement
@@ -115,6 +125,21 @@ struct hash<std::set<T>>{
 };
 }
 
+//Estimates of the memory used by cached records, for limiting the sizes of
+//the caches
+std::size_t approximateMemoryUsage(const User& user);
+std::size_t approximateMemoryUsage(const Group& group);
+std::size_t approximateMemoryUsage(const Cluster& cluster);
+std::size_t approximateMemoryUsage(const GeoLocation& location);
+std::size_t approximateMemoryUsage(const ApplicationInstance& instance);
+std::size_t approximateMemoryUsage(const Secret& secret);
+std::size_t approximateMemoryUsage(const PersistentVolumeClaim& pvc);
+std::size_t approximateMemoryUsage(const commandResult& result);
+template <typename T>
+std::size_t approximateMemoryUsage(const CacheRecord<T>& record){
+	return approximateMemoryUsage(record.record)+sizeof(record)-sizeof(T);
+}
+
 ///An interface for sending email with the MailGun service
 class EmailClient{
 public:
@@ -169,6 +194,14 @@ public:
 	///\return the corresponding user or an invalid user object if the id is not known
 	User getUser(const std::string& id);
 	
+	///Find information about many users at once, fetching any which are not 
+	///cached with as few database requests as possible
+	///\param ids the IDs of the users
+	///\param complete if not null, set to whether every ID was looked up, so
+	///                that any user missing from the result does not exist
+	///\return the users which were found, indexed by ID
+	std::map<std::string,User> getUsers(const std::vector<std::string>& ids, bool* complete=nullptr);
+	
 	///Find the user who owns the given access token. Currently does not bother 
 	///to retreive the user's name, email address, or globus ID. 
 	///\param token access token
@@ -195,6 +228,13 @@ public:
 	///Compile a list of all current user records
 	///\return all users, but with only IDs, names, and email addresses
 	std::vector<User> listUsers();
+	
+	///Pass each current user record to a function in turn, without collecting
+	///them all first
+	///\param handle the function to call with each user
+	///\return whether all users were found; if false some may have been 
+	///        passed to the function before the failure
+	bool forEachUser(const std::function<void(const User&)>& handle);
 
 	///Compile a list of all current user records for the given group
 	///\return all users from the given group, but with only IDs, names, and email addresses
@@ -267,6 +307,14 @@ public:
 	///\return the group corresponding to the ID, or an invalid group if none exists
 	Group findGroupByID(const std::string& id);
 	
+	///Find many groups at once, fetching any which are not cached with as few
+	///database requests as possible
+	///\param ids the IDs of the groups
+	///\param complete if not null, set to whether every ID was looked up, so
+	///                that any Group missing from the result does not exist
+	///\return the groups which were found, indexed by ID
+	std::map<std::string,Group> getGroups(const std::vector<std::string>& ids, bool* complete=nullptr);
+	
 	///Find the group, if any, with the given name
 	///\param name the name to look up
 	///\return the group corresponding to the name, or an invalid group if none exists
@@ -314,6 +362,14 @@ public:
 	///        none exists
 	Cluster findClusterByID(const std::string& id);
 	
+	///Find many clusters at once, fetching any which are not cached with as 
+	///few database requests as possible
+	///\param ids the IDs of the clusters
+	///\param complete if not null, set to whether every ID was looked up, so
+	///                that any cluster missing from the result does not exist
+	///\return the clusters which were found, indexed by ID
+	std::map<std::string,Cluster> getClusters(const std::vector<std::string>& ids, bool* complete=nullptr);
+	
 	///Find the cluster, if any, with the given name
 	///\param name the name to look up
 	///\return the cluster corresponding to the name, or an invalid cluster if 
@@ -401,6 +457,12 @@ public:
 	///\return the list of all locations on record
 	std::vector<GeoLocation> getLocationsForCluster(std::string idOrName);
 	
+	///Get the recorded locations of many clusters at once
+	///\param ids the IDs of the clusters
+	///\return the list of locations for each cluster, indexed by cluster ID. 
+	///        Clusters whose records could not be fetched are omitted. 
+	std::map<std::string,std::vector<GeoLocation>> getLocationsForClusters(const std::vector<std::string>& ids);
+	
 	///Record location(s) at which a cluster's hardware is located
 	///\param idOrName the ID or name of the cluster
 	///\param the list of all hardware locations
@@ -435,6 +497,25 @@ public:
 	///                 succeeded
 	void cacheClusterReachability(std::string idOrName, bool reachable);
 	
+	///Store a recently obtained result for whether a given cluster is reachable
+	///\param idOrName the ID or name of the cluster
+	///\param reachable whether the most recent attempt to contact the cluster 
+	///                 succeeded
+	///\param validity how long the result should be used
+	void cacheClusterReachability(std::string idOrName, bool reachable, 
+	                              std::chrono::seconds validity);
+	
+	///Get a listing of objects from a cluster which change rarely, such as its
+	///storage classes, priority classes, or nodes. Listings are cached, and
+	///those which are used when close to expiring are refreshed in the 
+	///background, so that frequently used listings are always available 
+	///without contacting the cluster. Cached listings for a cluster are 
+	///discarded when it is updated or removed. 
+	///\param cID the ID of the cluster
+	///\param kind the kind of objects to list, as accepted by kubectl_get
+	///\return the same result as kubernetes::kubectl_get
+	commandResult getClusterObjects(const std::string& cID, const std::string& kind);
+	
 	//----
 	
 	///Store a record for a new application instance
@@ -480,9 +561,25 @@ public:
 	
 	//----
 	
+	///Encrypt secret data for storage
+	///\param s the data to encrypt
+	///\return the encrypted data, including the header which identifies its format
 	std::string encryptSecret(const SecretData& s) const;
+	///Decrypt the data of a secret record. If decrypted secrets are being 
+	///cached, the result may come from the cache. 
+	///\param s the secret whose data should be decrypted
+	///\return the decrypted data
 	SecretData decryptSecret(const Secret& s) const;
 	
+	///Set how long decrypted secret data may be kept in memory for reuse. 
+	///Cached data is erased from memory when it expires or is replaced. 
+	///\param validity the time for which decrypted data remains valid, where 
+	///                zero disables caching
+	void setDecryptedSecretCacheValidity(std::chrono::seconds validity){ decryptedSecretCacheValidity=validity; }
+	///Set the number of scrypt key derivations which may run at once, since 
+	///each uses a large amount of memory
+	void setScryptConcurrencyLimit(unsigned int limit){ secretCipher->setConcurrencyLimit(limit); }
+	
 	///Store a record for a new secret
 	///\param secret the secret to store
 	///\return Whether the record was successfully added to the database
@@ -568,6 +665,43 @@ public:
 	
 	std::vector<PersistentVolumeClaim> listPersistentVolumeClaimsByClusterOrGroup(std::string group, std::string cluster);
 	
+	//----
+	
+	///Store the record of a new operation
+	///\return false if the record could not be stored, or already exists
+	bool addOperation(const Operation& operation);
+	
+	///Record an operation's new state, progress, modification time, and 
+	///result. This succeeds only if the operation is still owned by the owner 
+	///given in the operation, so that a replica which has lost its claim on an 
+	///operation cannot overwrite the record kept by its new owner. 
+	bool updateOperation(const Operation& operation);
+	
+	///Extend the owner's claim on an operation to the lease expiration time
+	///given in the operation
+	///\return false if the operation is no longer owned by the given owner, 
+	///        has finished, or the record could not be updated
+	bool renewOperationLease(const Operation& operation);
+	
+	///Take over an unfinished operation whose owner's lease has expired, or 
+	///which has never been claimed, recording its new owner, lease expiration 
+	///time, state, progress, and modification time. 
+	///\return whether the operation was claimed; false if another replica 
+	///        still holds it, it has finished, or the record could not be 
+	///        updated
+	bool claimOperation(const Operation& operation);
+	
+	///Find an operation by ID. Operations are not cached, since their records
+	///change frequently, and may be changed by other servers. 
+	///\return the operation, which will be invalid if it does not exist
+	Operation getOperation(const std::string& id);
+	
+	///List the operations requested by a user
+	std::vector<Operation> listOperationsByUser(const std::string& uID);
+	
+	///List the operations which are pending or running
+	std::vector<Operation> listUnfinishedOperations();
+	
 	//----
 
 	///Look up one application, returning a cached result if possible.
@@ -636,6 +770,85 @@ public:
 	const std::string& getOpsEmail(){ return opsEmail; }
 	void setOpsEmail(std::string address){ opsEmail=address; }
 	
+	///\return the executor on which work which runs kubectl or helm against 
+	///        clusters should be done. Tasks submitted to it should be keyed by
+	///        the ID of the cluster they contact. 
+	Executor& getCommandExecutor(){ return *commandExecutor; }
+	///Replace the executor used for commands run against clusters. This must 
+	///be done before any work is submitted to it. 
+	///\param threads the number of commands which may run at once in total
+	///\param perCluster the number of commands which may run at once against 
+	///                  any one cluster
+	void setCommandExecutorLimits(unsigned int threads, unsigned int perCluster);
+	
+	///Set the number of segments into which scans of whole tables are 
+	///divided, which are then scanned in parallel
+	///\param segments the number of segments, where one means that tables 
+	///                are scanned sequentially
+	void setScanSegments(unsigned int segments){ scanSegments=(segments ? segments : 1); }
+	
+	///Set the limits on the size of each of the caches of database records, 
+	///evicting records from any cache which is now too large
+	///\param maxEntries the largest number of records each cache may hold, or
+	///                  zero for no limit
+	///\param maxBytes the largest approximate amount of memory the records in
+	///                each cache may use, or zero for no limit
+	void setCacheLimits(std::size_t maxEntries, std::size_t maxBytes);
+	///Set how often expired records are swept out of the caches
+	///\param interval the time between sweeps, where zero disables sweeping
+	void setCacheSweepInterval(std::chrono::seconds interval);
+	///Begin recording each change this store makes to the database in the 
+	///change log, and periodically applying changes which other replicas 
+	///have recorded, so that their caches do not serve outdated records. 
+	///Each change uses one write unit of the change log table, and each poll
+	///uses at least 16 read units; the table is created with enough capacity
+	///for about 50 changes per second and 50 replicas polling every 20 
+	///seconds. 
+	///\param pollInterval the time between checks for changes by other 
+	///                    replicas
+	///\param cacheValidityScale the factor by which to multiply the times for
+	///                          which cached records remain valid. This is 
+	///                          reasonable only when all replicas sharing the
+	///                          database use the change log, and is ignored 
+	///                          unless \p pollInterval is non-zero. This 
+	///                          should be set before the store is used. 
+	void startChangeLog(std::chrono::seconds pollInterval, unsigned int cacheValidityScale=1);
+	///Check for changes recorded by other replicas, and invalidate the cached
+	///records they affect. This is called periodically once the change log is
+	///started, but may also be called directly. 
+	///\return the number of new changes found
+	std::size_t pollChanges();
+	
+	///Fill the caches from the user, group, cluster and application instance
+	///tables, so that a newly started server need not query the database for
+	///each record the first time it is requested. The tables are scanned in 
+	///parallel, and progress is logged periodically. 
+	///\param timeBudget the longest time to spend loading records; any which
+	///                  have not been loaded by then are fetched on demand
+	///\return whether all of the tables were loaded completely
+	bool preloadCaches(std::chrono::seconds timeBudget);
+	
+	///\return the identifier of this store, which distinguishes it from other 
+	///        replicas sharing the same database
+	const std::string& getReplicaID() const{ return replicaID; }
+	
+	///\return the scheduler which runs long operations in the background
+	OperationScheduler& getOperationScheduler(){ return *operationScheduler; }
+	///Replace the scheduler used for long running operations. This must be 
+	///done before any handlers are set on it, or any operations are started. 
+	///\param threads the number of operations which may run at once
+	void setOperationThreads(unsigned int threads);
+	
+	///Start checking in the background whether clusters are reachable, 
+	///replacing any prober which was already running
+	///\param probe the function which checks each cluster
+	///\param interval the average time between checks of each cluster
+	///\param concurrency the largest number of checks which may run at once
+	void startClusterProber(ClusterProber::Probe probe, 
+	                        std::chrono::seconds interval, unsigned int concurrency);
+	///\return the background cluster prober, or nullptr if none is running
+	ClusterProber* getClusterProber(){ return clusterProber.get(); }
+	
 private:
 	///Database interface object
 	Aws::DynamoDB::DynamoDBClient dbClient;
@@ -653,6 +866,10 @@ private:
 	const std::string monCredTableName;
 	///Name of the monitoring credentials table in the database
 	const std::string volumeTableName;
+	///Name of the operations table in the database
+	const std::string operationTableName;
+	///Name of the table of changes made by all replicas, in the database
+	const std::string changeTableName;
 	
 	///Sub-object for handling DNS
 	DNSManipulator dnsClient;
@@ -666,56 +883,105 @@ private:
 	///in order for kubectl and helm to read
 	const FileHandle clusterConfigDir;
 	
+	///duration for which the knowledge that a record does not exist should be 
+	///cached. This is kept short, since such records may be created by other 
+	///means. 
+	const std::chrono::seconds negativeCacheValidity;
 	///duration for which cached user records should remain valid
-	const std::chrono::seconds userCacheValidity;
+	std::chrono::seconds userCacheValidity;
 	slate_atomic<std::chrono::steady_clock::time_point> userCacheExpirationTime;
-	cuckoohash_map<std::string,CacheRecord<User>> userCache;
-	cuckoohash_map<std::string,CacheRecord<User>> userByTokenCache;
-	cuckoohash_map<std::string,CacheRecord<User>> userByGlobusIDCache;
+	EvictingCache<std::string,CacheRecord<User>> userCache;
+	EvictingCache<std::string,CacheRecord<User>> userByTokenCache;
+	EvictingCache<std::string,CacheRecord<User>> userByGlobusIDCache;
 	concurrent_multimap<std::string,CacheRecord<std::string>> userByGroupCache;
+	///Whether users are members of groups, indexed by "userID:groupID"
+	EvictingCache<std::string,CacheRecord<bool>> groupMembershipCache;
 	///duration for which cached group records should remain valid
-	const std::chrono::seconds groupCacheValidity;
+	std::chrono::seconds groupCacheValidity;
 	slate_atomic<std::chrono::steady_clock::time_point> groupCacheExpirationTime;
-	cuckoohash_map<std::string,CacheRecord<Group>> groupCache;
-	cuckoohash_map<std::string,CacheRecord<Group>> groupByNameCache;
+	EvictingCache<std::string,CacheRecord<Group>> groupCache;
+	EvictingCache<std::string,CacheRecord<Group>> groupByNameCache;
 	concurrent_multimap<std::string,CacheRecord<Group>> groupByUserCache;
 	///duration for which cached cluster records should remain valid
-	const std::chrono::seconds clusterCacheValidity;
+	std::chrono::seconds clusterCacheValidity;
 	slate_atomic<std::chrono::steady_clock::time_point> clusterCacheExpirationTime;
-	cuckoohash_map<std::string,CacheRecord<Cluster>> clusterCache;
-	cuckoohash_map<std::string,CacheRecord<Cluster>> clusterByNameCache;
+	EvictingCache<std::string,CacheRecord<Cluster>> clusterCache;
+	EvictingCache<std::string,CacheRecord<Cluster>> clusterByNameCache;
 	concurrent_multimap<std::string,CacheRecord<Cluster>> clusterByGroupCache;
 	cuckoohash_map<std::string,SharedFileHandle> clusterConfigs;
-	concurrent_multimap<std::string,CacheRecord<std::string>> clusterGroupAccessCache;
-	cuckoohash_map<std::string,CacheRecord<std::set<std::string>>> clusterGroupApplicationCache;
-	cuckoohash_map<std::string,CacheRecord<std::vector<GeoLocation>>> clusterLocationCache;
+	///Whether groups may use clusters, indexed by "clusterID:groupID", where the
+	///group ID may be the wildcard
+	EvictingCache<std::string,CacheRecord<bool>> clusterGroupAccessCache;
+	EvictingCache<std::string,CacheRecord<std::set<std::string>>> clusterGroupApplicationCache;
+	EvictingCache<std::string,CacheRecord<std::vector<GeoLocation>>> clusterLocationCache;
 	///This cache is a little tricky since it represents state of the network, 
 	///not something stored in the database, so it's data isn't directly handled
 	///by the persistent store. 
-	cuckoohash_map<std::string,CacheRecord<bool>> clusterConnectivityCache;
+	EvictingCache<std::string,CacheRecord<bool>> clusterConnectivityCache;
+	///duration for which listings of objects from clusters remain valid
+	const std::chrono::seconds clusterObjectCacheValidity;
+	///listings which are used when they have less than this much time 
+	///remaining before expiring are refreshed in the background
+	const std::chrono::seconds clusterObjectRefreshMargin;
+	///Listings of objects from clusters, indexed by "clusterID:kind"
+	EvictingCache<std::string,CacheRecord<commandResult>> clusterObjectCache;
+	///Listings which have background refreshes queued, indexed as above
+	cuckoohash_map<std::string,bool> clusterObjectRefreshes;
+	///Incremented whenever cached listings are discarded, so that fetches 
+	///which were already running when that happened can avoid storing their
+	///possibly outdated results
+	std::atomic<std::size_t> clusterObjectGeneration;
 	///duration for which cached instance records should remain valid
-	const std::chrono::seconds instanceCacheValidity;
+	std::chrono::seconds instanceCacheValidity;
 	slate_atomic<std::chrono::steady_clock::time_point> instanceCacheExpirationTime;
-	cuckoohash_map<std::string,CacheRecord<ApplicationInstance>> instanceCache;
-	cuckoohash_map<std::string,CacheRecord<std::string>> instanceConfigCache;
+	EvictingCache<std::string,CacheRecord<ApplicationInstance>> instanceCache;
+	EvictingCache<std::string,CacheRecord<std::string>> instanceConfigCache;
 	concurrent_multimap<std::string,CacheRecord<ApplicationInstance>> instanceByGroupCache;
 	concurrent_multimap<std::string,CacheRecord<ApplicationInstance>> instanceByNameCache;
 	concurrent_multimap<std::string,CacheRecord<ApplicationInstance>> instanceByClusterCache;
 	concurrent_multimap<std::string,CacheRecord<ApplicationInstance>> instanceByGroupAndClusterCache;
 	///duration for which cached secret records should remain valid
-	const std::chrono::seconds secretCacheValidity;
-	cuckoohash_map<std::string,CacheRecord<Secret>> secretCache;
+	std::chrono::seconds secretCacheValidity;
+	EvictingCache<std::string,CacheRecord<Secret>> secretCache;
 	concurrent_multimap<std::string,CacheRecord<Secret>> secretByGroupCache;
 	concurrent_multimap<std::string,CacheRecord<Secret>> secretByGroupAndClusterCache;
+	///Decrypted secret data, along with the encrypted data from which it came
+	struct DecryptedSecret{
+		std::string encrypted;
+		std::shared_ptr<const SecretData> data;
+		
+		friend std::size_t approximateMemoryUsage(const DecryptedSecret& s){
+			return sizeof(s)+::approximateMemoryUsage(s.encrypted)-sizeof(s.encrypted)
+			       +(s.data ? sizeof(SecretData)+s.data->dataSize : 0);
+		}
+	};
+	///duration for which decrypted secret data should remain cached, or zero 
+	///if it should not be cached
+	std::chrono::seconds decryptedSecretCacheValidity;
+	mutable EvictingCache<std::string,CacheRecord<DecryptedSecret>> decryptedSecretCache;
+	///Erase expired decrypted data from the cache
+	void sweepDecryptedSecretCache() const;
 	///duration for which cached volume claim records should remain valid
-	const std::chrono::seconds volumeCacheValidity;
+	std::chrono::seconds volumeCacheValidity;
 	slate_atomic<std::chrono::steady_clock::time_point> volumeCacheExpirationTime;
-	cuckoohash_map<std::string,CacheRecord<PersistentVolumeClaim>> volumeCache;
+	EvictingCache<std::string,CacheRecord<PersistentVolumeClaim>> volumeCache;
 	concurrent_multimap<std::string,CacheRecord<PersistentVolumeClaim>> volumeByGroupCache;
 	concurrent_multimap<std::string,CacheRecord<PersistentVolumeClaim>> volumeByClusterCache;
 	concurrent_multimap<std::string,CacheRecord<PersistentVolumeClaim>> volumeByGroupAndClusterCache;
 	///This cache also contains data not directly managed by the persistent store
 	concurrent_multimap<std::string,CacheRecord<Application>> applicationCache;
+	///All of the caches above which are bounded in size
+	std::vector<EvictingCacheBase*> evictingCaches;
+	///Remove expired records from all caches
+	void sweepCaches();
+	
+	///Database lookups which are currently in progress, so that concurrent 
+	///requests for the same information can share them
+	SingleFlight<User> userByTokenLookups;
+	SingleFlight<bool> groupMembershipLookups;
+	SingleFlight<std::vector<std::string>> groupMembershipListLookups;
+	SingleFlight<bool> clusterGroupAccessLookups;
+	SingleFlight<commandResult> clusterObjectLookups;
 	
 	///Check that all necessary tables exist in the database, and create them if 
 	///they do not
@@ -728,14 +994,77 @@ private:
 	void InitializeSecretTable();
 	void InitializeMonCredTable();
 	void InitializeVolumeTable();
+	void InitializeOperationTable();
+	void InitializeChangeTable();
+	///Multiply the times for which cached database records remain valid
+	///\param scale the factor by which the default validity times are 
+	///             multiplied
+	void setCacheValidityScale(unsigned int scale);
 	
 	void loadEncyptionKey(const std::string& fileName);
 	
+	///Look up the user who owns a token in the database, without checking 
+	///the cache first
+	User queryUserByToken(const std::string& token);
+	///Look up the IDs of the groups to which a user belongs in the database, 
+	///without checking the cache first
+	std::vector<std::string> queryUserGroupMemberships(const std::string& uID);
+	///Look up whether a user belongs to a group in the database, without 
+	///checking the cache first
+	bool queryUserInGroup(const std::string& uID, const std::string& groupID);
+	///Check whether there is a record granting a group access to a cluster
+	///\param cID the ID of the cluster
+	///\param groupID the ID of the group, or the wildcard
+	bool clusterGroupAccessRecordExists(const std::string& cID, const std::string& groupID);
+	///A function which is given each item returned by a database query or scan
+	using ItemHandler=std::function<void(const Aws::Map<Aws::String,Aws::DynamoDB::Model::AttributeValue>&)>;
+	///Run a query, following continuation keys until every matching item has 
+	///been passed to the handler, so that results larger than one page are
+	///not truncated. 
+	///\param request the query to run
+	///\param handle the function to call with each matching item
+	///\return whether all pages of results were fetched
+	bool queryAll(Aws::DynamoDB::Model::QueryRequest request, const ItemHandler& handle);
+	///Run a scan, following continuation keys until every matching item has 
+	///been passed to the handler. If more than one scan segment is configured
+	///the segments are scanned in parallel, but the handler is still called 
+	///for only one item at a time. 
+	///\param request the scan to run
+	///\param handle the function to call with each matching item
+	///\param shouldStop if set, called before each page is fetched, and the 
+	///                  scan ends without fetching the rest of the table once
+	///                  it returns true
+	///\return whether all pages of results were fetched
+	bool scanAll(Aws::DynamoDB::Model::ScanRequest request, const ItemHandler& handle,
+	             const std::function<bool()>& shouldStop=nullptr);
+	///Fetch many records from a table using BatchGetItem, splitting the keys 
+	///into as many requests as necessary and retrying any which are not 
+	///processed. 
+	///\param tableName the table from which to fetch
+	///\param ids the IDs of the records, which must not contain duplicates
+	///\param sortKeySuffix the suffix which is appended to each ID to form the
+	///                     record's sort key
+	///\param items the records which were found are appended to this list
+	///\return whether every key was looked up, so that any record which was
+	///        not found does not exist
+	bool batchGetItems(const std::string& tableName, 
+	                   const std::vector<std::string>& ids, 
+	                   const std::string& sortKeySuffix,
+	                   std::vector<Aws::Map<Aws::String,Aws::DynamoDB::Model::AttributeValue>>& items);
+	
 	///For consumption by kubectl we store configs in the filesystem
 	///These files have implicit validity derived from the corresponding entries
 	///in clusterCache.
 	void writeClusterConfigToDisk(const Cluster& cluster);
 	
+	///List objects from a cluster, and cache the result if it is successful
+	commandResult fetchClusterObjects(const std::string& cID, const std::string& kind);
+	///Queue a background refresh of a cached listing, unless one is already 
+	///queued
+	void refreshClusterObjects(const std::string& cID, const std::string& kind);
+	///Discard all cached listings of objects from a cluster
+	void invalidateClusterObjects(const std::string& cID);
+	
 	///Ensure that a string is a group ID, rather than a group name. 
 	///\param groupID the group ID or name. If the value is a valid name, it will 
 	///               be replaced with the corresponding ID. 
@@ -752,6 +1081,8 @@ private:
 	
 	///The encryption key used for secrets
 	SecretData secretKey;
+	///Encrypts and decrypts secrets with keys derived from secretKey
+	std::unique_ptr<SecretCipher> secretCipher;
 	
 	///The server to which application instances should send monitoring data
 	std::string appLoggingServerName;
@@ -761,7 +1092,64 @@ private:
 	EmailClient emailClient;
 	std::string opsEmail;
 	
+	///Runs commands against clusters on behalf of all requests
+	std::unique_ptr<Executor> commandExecutor;
+	///Background refreshes of cached listings of objects from clusters, which
+	///run on the command executor. This must be destroyed before the executor.
+	std::unique_ptr<Executor::TaskGroup> clusterObjectRefreshTasks;
+	///The identifier of this store in the change log and in the records of 
+	///operations it owns. This must outlive the operation scheduler. 
+	const std::string replicaID;
+	///Runs long operations in the background
+	std::unique_ptr<OperationScheduler> operationScheduler;
+	///The number of segments into which table scans are divided
+	std::atomic<unsigned int> scanSegments;
+	
 	std::atomic<size_t> cacheHits, databaseQueries, databaseScans;
+	///Cache hits which showed that a record does not exist
+	std::atomic<size_t> negativeCacheHits;
+	///Lookups which were answered by sharing another, concurrent lookup
+	std::atomic<size_t> coalescedLookups;
+	///Background refreshes of cached listings of objects from clusters
+	std::atomic<size_t> clusterObjectRefreshCount;
+	///Decryptions which were answered from the cache of decrypted secrets
+	mutable std::atomic<size_t> decryptedSecretCacheHits;
+	///Keys of the multimap caches which were removed because all of their 
+	///records had expired
+	std::atomic<size_t> cacheCategoriesSwept;
+	///Periodically removes expired records from the caches. This must be 
+	///destroyed before the caches. 
+	std::unique_ptr<CacheSweeper> cacheSweeper;
+	
+	///Whether changes are being recorded in the change log
+	std::atomic<bool> changeLogEnabled;
+	///Distinguishes changes recorded by this store at the same time
+	std::atomic<std::size_t> changeCounter;
+	///Held while polling for changes, and protects the two members below
+	std::mutex changePollMutex;
+	///The time at which the last successful poll for changes began
+	std::chrono::system_clock::time_point lastChangePoll;
+	///Changes found by recent polls, indexed by their keys in the change log,
+	///with the number of times each has been applied
+	std::map<std::string,unsigned int> recentChanges;
+	std::atomic<size_t> changesRecorded, changesNotRecorded, changesApplied, changePolls;
+	///The number of records loaded into the caches by preloadCaches
+	std::atomic<size_t> recordsPreloaded;
+	///Record in the change log that an entity was changed, if the log is enabled
+	///\param kind the type of entity which was changed
+	///\param id the ID of the entity
+	///\param detail other information identifying the change, such as the
+	///              second entity involved in a relationship
+	void recordChange(const std::string& kind, const std::string& id, const std::string& detail=std::string());
+	///Invalidate all cached records which a change could affect
+	void applyChange(const std::string& kind, const std::string& id, const std::string& detail);
+	///Periodically polls the change log. This must be destroyed before the 
+	///caches. 
+	std::unique_ptr<CacheSweeper> changePoller;
+	
+	///Checks whether clusters are reachable. This is destroyed first, since it
+	///uses the rest of the store. 
+	std::unique_ptr<ClusterProber> clusterProber;
 };
 
 ///\param store the database in which to look up the user
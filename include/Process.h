@@ -3,8 +3,11 @@
 
 #include <atomic>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <istream>
 #include <map>
+#include <mutex>
 #include <ostream>
 #include <streambuf>
 #include <vector>
@@ -54,6 +57,12 @@ public:
 	///been called. 
 	void endInput();
 	
+	///\return the file descriptor from which data is read, or -1 if there is none
+	int readFd() const{ return fd_out; }
+	///\return the file descriptor to which data is written, or -1 if there is 
+	///        none or input has been ended
+	int writeFd() const{ return fd_in; }
+	
 private:
 	const static std::size_t bufferSize=4096;
 
@@ -121,6 +130,18 @@ public:
 	std::istream& getStderr(){ return(err); }
 	///Close the stream to the child process's stdin
 	void endInput(){ inoutBuf.endInput(); }
+	///Get the file descriptor connected to the child process's stdout, for 
+	///reading directly rather than through getStdout(). The two methods should
+	///not be mixed. 
+	int stdoutFd() const{ return inoutBuf.readFd(); }
+	///Get the file descriptor connected to the child process's stderr, for 
+	///reading directly rather than through getStderr(). The two methods should
+	///not be mixed. 
+	int stderrFd() const{ return errBuf.readFd(); }
+	///Get the file descriptor connected to the child process's stdin, for 
+	///writing directly rather than through getStdin(). The two methods should
+	///not be mixed. 
+	int stdinFd() const{ return inoutBuf.writeFd(); }
 	///Give up responsibility for stopping the child process
 	void detach(){
 		child=0;
@@ -130,6 +151,13 @@ public:
 	}
 	///Only valid if the child process has not been detached
 	bool done() const;
+	///Block until the child process has exited, so that done() is true. 
+	///Only valid if the child process has not been detached
+	void wait();
+	///Block until the child process has exited or a timeout expires.
+	///Only valid if the child process has not been detached
+	///\return whether the child process has exited
+	bool waitFor(std::chrono::milliseconds timeout);
 	///Only valid if the child process has not been detached and done() is true
 	char exitStatus() const;
 private:
@@ -139,6 +167,10 @@ private:
 	std::istream out, err;
 	unsigned char exitStatusValue;
 	std::atomic<bool> hasExitStatus;
+	///Used with exitCondition to wait for hasExitStatus to be set. These belong
+	///to the handle object, so they are not transferred by moves. 
+	std::mutex exitMutex;
+	std::condition_variable exitCondition;
 	
 	///Terminate the child process if it is still running
 	void shutDown();
@@ -152,26 +184,37 @@ private:
 
 ///Reap any child processes which have exited
 void reapProcesses();
-///Spawn a separate thread to periodically run reapProcesses()
+///Spawn a separate thread to run reapProcesses() whenever a child process exits
 void startReaper();
 //Stop the background reaping thread
 void stopReaper();
 
+///\return the total number of child processes this process has started
+unsigned long long childProcessesStarted();
+
 struct ForkCallbacks{
-	///Called immediately before fork().
+	///Called immediately before the child process is created.
 	virtual void beforeFork(){}
-	///Called immediately after fork() in the child process
+	///Called immediately after fork() in the child process. Only used if 
+	///needsChildCallback() returns true. 
 	virtual void inChild(){}
-	///Called immediately after fork() in the parent process
+	///Called immediately after the child process is created, in the parent 
+	///process
 	virtual void inParent(){}
+	///Child processes are normally started with posix_spawn, which cannot run 
+	///code in the child. Implementations which override inChild must also 
+	///override this to return true, which causes the child process to be 
+	///created with fork() instead. 
+	virtual bool needsChildCallback() const{ return false; }
 };
 
 ///Start a child process and leave it running. 
 ///\param exe executable to start
 ///\param args arguments to pass to \p exe. \p exe will be automatically 
 ///            prepended as argv[0]
+///\param env additions and changes to the child command's environment
 ///\param callbacks a callback object for actions which must be taken 
-///                 immediately before and after calling fork
+///                 immediately before and after creating the child process
 ///\param detachable whether the child process should be started in a detachable 
 ///                  state. Being detachable means that no communication will be
 ///                  possible with the child. 
@@ -189,6 +232,28 @@ struct commandResult{
 	std::string error;
 	///The process's exit status
 	int status;
+	///Whether the process was stopped because it ran for longer than allowed
+	bool timedOut;
+	///Whether the process was stopped because it produced more output than 
+	///allowed, in which case output and/or error are incomplete
+	bool truncated;
+};
+
+///Restrictions on an external command run by runCommand or runCommandWithInput
+struct CommandOptions{
+	CommandOptions():outputLimit(0),timeout(0),largeOutput(false){}
+	///If non-zero, the largest number of bytes which will be collected from 
+	///either of the command's stdout or stderr. If the command writes more, it 
+	///is stopped. 
+	std::size_t outputLimit;
+	///If non-zero, the longest time for which the command may run before it is
+	///stopped
+	std::chrono::milliseconds timeout;
+	///Whether the command is expected to write a large amount of data to its
+	///stdout, in which case the pipe is enlarged so that the data can be 
+	///passed with fewer context switches. Enlarged pipes count against a 
+	///per-user limit, so this should not be set for ordinary commands. 
+	bool largeOutput;
 };
 
 ///Run an external command
@@ -200,13 +265,19 @@ struct commandResult{
 ///\param env additions and changes to the child command's environment. These 
 ///           are added to the current process's environment to form the full
 ///           child environment. 
+///\param options limits on the command's running time and output
 ///\return a structure containing all data written by the child process to its
 ///        standard ouput and error and the child process's exit status
 commandResult runCommand(const std::string& command, 
                          const std::vector<std::string>& args={}, 
-                         const std::map<std::string,std::string>& env={});
+                         const std::map<std::string,std::string>& env={},
+                         const CommandOptions& options=CommandOptions());
 
-///Run an external command, sending given data to its standard input
+///Run an external command, sending given data to its standard input. The 
+///input is written as the child is able to accept it, while its output is 
+///collected, so that neither process can block waiting for the other. If the 
+///child exits or closes its standard input before reading all of the input, 
+///the remainder is discarded. 
 ///\param command the command to be run. If \p command contains no slashes, a  
 ///               search will be performed in all entries of $PATH (or 
 ///               _PATH_DEFPATH if $PATH is not set) for a file with a matching 
@@ -216,11 +287,13 @@ commandResult runCommand(const std::string& command,
 ///\param env additions and changes to the child command's environment. These 
 ///           are added to the current process's environment to form the full
 ///           child environment. 
+///\param options limits on the command's running time and output
 ///\return a structure containing all data written by the child process to its
 ///        standard ouput and error and the child process's exit status
 commandResult runCommandWithInput(const std::string& command, 
                                   const std::string& input,
                                   const std::vector<std::string>& args={}, 
-                                  const std::map<std::string,std::string>& env={});
+                                  const std::map<std::string,std::string>& env={},
+                                  const CommandOptions& options=CommandOptions());
 
 #endif //SLATE_PROCESS_H
@@ -0,0 +1,117 @@
+#ifndef SLATE_SECRET_CIPHER_H
+#define SLATE_SECRET_CIPHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <Entities.h>
+
+///Encrypts and decrypts secret data.
+///
+///Data is encrypted with AES-256-GCM, using a key derived from a password with
+///scrypt. Deriving a key is deliberately slow and memory hungry, so each
+///derived key is remembered, and all data encrypted by one instance of this
+///class uses the same salt, and so the same key. Each encrypted item begins
+///with a header which records the format version and the parameters needed
+///to derive its key again:
+///
+///    "slatev2" | logN (1 byte) | r (4 bytes) | p (4 bytes) | salt (32 bytes)
+///    | nonce (12 bytes) | ciphertext | tag (16 bytes)
+///
+///where r and p are big-endian. The header, up to the nonce, is authenticated
+///along with the ciphertext. Data in the original format, produced by
+///scryptenc_buf, which derives a new key for every item, can still be
+///decrypted.
+class SecretCipher{
+public:
+	///Counts of the work done by a cipher
+	struct Statistics{
+		///Keys which have been derived with scrypt
+		std::size_t keyDerivations;
+		///Derived keys which are currently remembered
+		std::size_t keysCached;
+		///Items in the original format which have been decrypted
+		std::size_t legacyDecryptions;
+	};
+
+	///\param password the password from which keys are derived
+	///\param concurrency the largest number of scrypt computations which may
+	///                   run at once
+	SecretCipher(const SecretData& password, unsigned int concurrency=2);
+
+	SecretCipher(const SecretCipher&)=delete;
+	SecretCipher& operator=(const SecretCipher&)=delete;
+
+	///Encrypt data in the current format
+	///\throws std::runtime_error if encryption fails
+	std::string encrypt(const SecretData& data) const;
+
+	///Decrypt data in either the current or the original format
+	///\throws std::runtime_error if the data is malformed, or was not
+	///        encrypted with this cipher's password
+	SecretData decrypt(const std::string& data) const;
+
+	///Check whether data appears to have been produced by encrypt, or by the
+	///original scryptenc_buf encryption
+	static bool isEncrypted(const std::string& data);
+
+	///Change the number of scrypt computations which may run at once
+	void setConcurrencyLimit(unsigned int concurrency);
+
+	///\return a snapshot of this cipher's counters
+	Statistics getStatistics() const;
+
+private:
+	///The size of derived keys, salts, nonces and tags, in bytes
+	static constexpr std::size_t keySize=32, saltSize=32, nonceSize=12, tagSize=16;
+	///The size of the header which precedes the ciphertext
+	static constexpr std::size_t headerSize=7+1+4+4+saltSize+nonceSize;
+	///The cost parameters used for new keys
+	static constexpr uint8_t logN=17;
+	static constexpr uint32_t r=8, p=1;
+	///The largest number of derived keys which are remembered
+	static constexpr std::size_t maxKeysCached=256;
+
+	///A derived key, which is erased when destroyed
+	struct DerivedKey{
+		DerivedKey():ready(false){}
+		~DerivedKey();
+		///Held while the key is derived, so that concurrent users of the
+		///same salt wait for one derivation rather than each running their own
+		std::mutex mut;
+		bool ready;
+		uint8_t key[keySize];
+	};
+
+	SecretData password;
+	///The salt used for all data encrypted by this instance
+	std::string salt;
+
+	mutable std::mutex keyMutex;
+	///Derived keys, indexed by the parameters and salt from which they were
+	///derived
+	mutable std::map<std::string,std::shared_ptr<DerivedKey>> keys;
+
+	///Protects the count of scrypt computations which are running
+	mutable std::mutex scryptMutex;
+	mutable std::condition_variable scryptDone;
+	unsigned int scryptLimit;
+	mutable unsigned int scryptRunning;
+
+	mutable std::atomic<std::size_t> keyDerivations, legacyDecryptions;
+
+	///Find or derive the key for a set of parameters
+	///\param params the header bytes from logN through the salt
+	std::shared_ptr<DerivedKey> getKey(const std::string& params) const;
+	///Run a function once fewer than the limit of scrypt computations are
+	///running
+	template<typename F>
+	auto limitScrypt(F f) const -> decltype(f());
+};
+
+#endif //SLATE_SECRET_CIPHER_H
@@ -81,6 +81,16 @@ std::string trim(const std::string& s);
 ///removed
 std::string reduceYAML(const std::string& input);
 
+///A rapidjson output stream which writes directly into a std::string, so that
+///JSON can be written incrementally without building a document first
+struct StringOutputStream{
+	typedef char Ch;
+	std::string& str;
+	explicit StringOutputStream(std::string& str):str(str){}
+	void Put(char c){ str.push_back(c); }
+	void Flush(){}
+};
+
 template<typename JSONDocument>
 std::string to_string(const JSONDocument& json){
 	rapidjson::StringBuffer buf;
@@ -0,0 +1,63 @@
+#ifndef SLATE_SINGLE_FLIGHT_H
+#define SLATE_SINGLE_FLIGHT_H
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+///Coalesces concurrent identical lookups, so that when several threads ask for
+///the same key at once only one of them does the work, and the others wait for
+///and share its result. Nothing is remembered once the lookup finishes;
+///caching the result is left to the caller.
+template<typename Value, typename Key=std::string, typename KeyHash=std::hash<Key>>
+class SingleFlight{
+public:
+	///Perform a lookup, or wait for the identical lookup which is already in
+	///progress. If the lookup throws, every thread waiting for it receives
+	///the same exception.
+	///\param key identifies the lookup
+	///\param fetch the function which does the lookup
+	///\param shared set to whether the result was taken from another thread's
+	///              lookup rather than being fetched by this thread
+	///\return the result of the lookup
+	template<typename Function>
+	Value run(const Key& key, Function fetch, bool& shared){
+		std::promise<Value> promise;
+		std::shared_future<Value> existing;
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			auto it=inFlight.find(key);
+			if(it!=inFlight.end())
+				existing=it->second;
+			else
+				inFlight.emplace(key,promise.get_future().share());
+		}
+		if(existing.valid()){
+			shared=true;
+			return existing.get();
+		}
+		shared=false;
+		try{
+			Value result=fetch();
+			promise.set_value(result);
+			finish(key);
+			return result;
+		}catch(...){
+			promise.set_exception(std::current_exception());
+			finish(key);
+			throw;
+		}
+	}
+
+private:
+	std::mutex mut;
+	std::unordered_map<Key,std::shared_future<Value>,KeyHash> inFlight;
+
+	void finish(const Key& key){
+		std::lock_guard<std::mutex> lock(mut);
+		inFlight.erase(key);
+	}
+};
+
+#endif //SLATE_SINGLE_FLIGHT_H
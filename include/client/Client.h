@@ -133,6 +133,9 @@ struct GroupClusterAppUseOptions : public ClusterOptions{
 };
 
 struct ClusterPingOptions : public ClusterOptions{
+	bool fresh;
+	
+	ClusterPingOptions():fresh(false){}
 };
 
 struct ClusterComponentOptions{
@@ -1,7 +1,10 @@
 #ifndef SLATE_CONCURRENT_MULTIMAP_H
 #define SLATE_CONCURRENT_MULTIMAP_H
 
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <unordered_set>
 
 #include <libcuckoo/cuckoohash_map.hh>
@@ -13,6 +16,11 @@
 ///in the underlying cuckoohash_map can proceed concurrently, however, operations
 ///involving different values with the same key are guaranteed to map to the same
 ///bucket and thus will block each other waiting for its lock. 
+///The values for each key are kept in a copy-on-write set: looking up a key 
+///yields a reference-counted snapshot of its set, which is never changed 
+///afterwards, so readers hold the bucket lock only long enough to take a 
+///reference. A change to a key's values copies its set only if some reader
+///still holds a snapshot of it; otherwise the set is changed in place. 
 ///Does not currently have allocation or iteration support.
 template<typename Key, typename Value, 
          typename KeyHash=std::hash<Key>, typename KeyEqual=std::equal_to<Key>, 
@@ -22,17 +30,22 @@ public:
 	using steady_clock=std::chrono::steady_clock;
 	///The collection of values to which a key maps
 	using set_type=std::unordered_set<Value,ValueHash,ValueEqual>;
-	///The set of values the key maps to with its associated expiration time
-	using category_type=std::pair<set_type,steady_clock::time_point>;
+	///An immutable snapshot of the set of values the key maps to, with its 
+	///associated expiration time. The set pointer is never null. 
+	using category_type=std::pair<std::shared_ptr<const set_type>,steady_clock::time_point>;
+	///The set of values the key maps to, as stored in the table
+	using stored_category_type=std::pair<std::shared_ptr<set_type>,steady_clock::time_point>;
 	///The underlying hash table type
-	using Table=cuckoohash_map<Key,category_type,KeyHash,KeyEqual>;
+	using Table=cuckoohash_map<Key,stored_category_type,KeyHash,KeyEqual>;
 	using key_type=Key;
 	using mapped_type=Value;
-	using value_type=std::pair<const Key,category_type>;
+	using value_type=std::pair<const Key,stored_category_type>;
 	using size_type=typename Table::size_type;
 
 	concurrent_multimap(){}
-	///If other is being modified concurrently, behavior is unspecified.
+	///If other is being modified concurrently, behavior is unspecified. 
+	///The copy initially shares its sets with other, copying each only when 
+	///either map changes it. 
 	concurrent_multimap(const concurrent_multimap& other):data(other.data){}
 	///If other is being modified concurrently, behavior is unspecified.
 	concurrent_multimap(concurrent_multimap&& other):data(std::move(other.data)){}
@@ -80,8 +93,8 @@ public:
 	template <typename K>
 	size_type erase(const K& k){
 		size_type erased=0;
-		data.erase_fn(k,[&erased](const category_type& cat){
-			erased=cat.first.size();
+		data.erase_fn(k,[&erased](const stored_category_type& cat){
+			erased=cat.first->size();
 			return true;
 		});
 		return erased;
@@ -93,23 +106,51 @@ public:
 	template <typename K>
 	size_type erase(const K& k, const mapped_type& v){
 		size_type erased=0;
-		data.erase_fn(k,[&erased,&v](category_type& cat){
-			erased=cat.first.erase(v);
-			return cat.first.empty(); //only erase whole category if empty
+		data.erase_fn(k,[&erased,&v](stored_category_type& cat){
+			if(!cat.first->count(v))
+				return false;
+			set_type& values=writable(cat);
+			erased=values.erase(v);
+			return values.empty(); //only erase whole category if empty
 		});
 		return erased;
 	}
 	
-	///Searches the table for \p k and returns the associated value it
-	///finds. @c mapped_type must be @c CopyConstructible.
+	///Erases every key for which a predicate is true, while the whole table is
+	///locked
+	///\tparam Pred a function taking the key, its set of values, and the 
+	///             expiration time of the set, and returning whether the key
+	///             should be erased
+	///\return the number of keys erased
+	template <typename Pred>
+	size_type erase_if(Pred pred){
+		size_type erased=0;
+		auto table=data.lock_table();
+		for(auto it=table.begin(); it!=table.end();){
+			if(pred(it->first,(const set_type&)*it->second.first,it->second.second)){
+				it=table.erase(it);
+				erased++;
+			}
+			else
+				++it;
+		}
+		return erased;
+	}
+	
+	///Searches the table for \p k and returns a snapshot of the associated 
+	///values it finds. The values are not copied, and the snapshot is 
+	///unaffected by later changes to the map. 
 	///\tparam K type of the key
 	///\param k the key for which to search
-	///\return the collection of values associated with the key, or any empty 
-	///        collection if the key is not found
+	///\return the collection of values associated with the key, or an empty 
+	///        collection which has already expired if the key is not found
 	template <typename K>
 	category_type find(const K& key) const{
-		category_type items;
-		data.find_fn(key,[&items](const category_type& cat){ items=cat;	});
+		category_type items(emptySet(),steady_clock::time_point());
+		data.find_fn(key,[&items](const stored_category_type& cat){ 
+			items.first=cat.first;
+			items.second=cat.second;
+		});
 		return items;
 	}
 	
@@ -128,14 +169,15 @@ public:
 		//need to preemptively construct an entire category_type object which
 		//may be unneeded.
 		data.upsert(std::forward<K>(key), 
-					[&](category_type& cat){
-						if(cat.first.count(val)){
+					[&](stored_category_type& cat){
+						set_type& values=writable(cat);
+						if(values.count(val)){
 							inserted=false;
 							//ensure replacement
-							cat.first.erase(val);
+							values.erase(val);
 						}
-						cat.first.emplace(val);
-			    },category_type({val}, steady_clock::now()));
+						values.emplace(val);
+			    },makeCategory(val));
 		return inserted;
 	}
 	
@@ -148,9 +190,12 @@ public:
 		//need to preemptively construct an entire category_type object which
 		//may be unneeded.
 		data.upsert(std::forward<K>(key), 
-					[&](category_type& cat){
-						inserted=cat.first.emplace(val).second;
-			    },category_type({mapped_type{val}}, steady_clock::now()));
+					[&](stored_category_type& cat){
+						if(cat.first->count(val))
+							inserted=false;
+						else
+							writable(cat).emplace(val);
+			    },makeCategory(val));
 		return inserted;
 	}
 	
@@ -165,12 +210,13 @@ public:
 	template<typename K, typename V>
 	bool update(K&& key, V&& val){
 		bool updated=false;
-		data.update_fn(key,[&](category_type& cat){
-			if(cat.first.count(val)){
+		data.update_fn(key,[&](stored_category_type& cat){
+			if(cat.first->count(val)){
 				updated=true;
 				//ensure replacement
-				cat.first.erase(val);
-				cat.first.emplace(val);
+				set_type& values=writable(cat);
+				values.erase(val);
+				values.emplace(val);
 			}
 		});
 		return updated;
@@ -184,7 +230,7 @@ public:
 	template <typename K>
 	bool update_expiration(K&& key, steady_clock::time_point time){
 		bool updated=false;
-		data.update_fn(key,[&](category_type& cat){
+		data.update_fn(key,[&](stored_category_type& cat){
 		    cat.second = time;
 		    updated=true;
 		});
@@ -209,7 +255,7 @@ public:
 	template <typename K, typename V>
 	bool contains(const K& key, V&& val) const{
 		bool found=false;
-		data.find_fn(key,[&](const category_type& cat){ found=cat.first.count(val); });
+		data.find_fn(key,[&](const stored_category_type& cat){ found=cat.first->count(val); });
 		return found;
 	}
 	
@@ -221,7 +267,7 @@ public:
 	template <typename K>
 	size_type count(const K& k) const{
 		size_type n=0;
-		data.find_fn(k,[&n](const category_type& cat){ n=cat.first.size(); });
+		data.find_fn(k,[&n](const stored_category_type& cat){ n=cat.first->size(); });
 		return n;
 	}
 	
@@ -234,7 +280,7 @@ public:
 	template <typename K, typename V>
 	size_type count(const K& k, V&& v) const{
 		size_type n=0;
-		data.find_fn(k,[&](const category_type& cat){ n=cat.first.count(v); });
+		data.find_fn(k,[&](const stored_category_type& cat){ n=cat.first->count(v); });
 		return n;
 	}
 	
@@ -247,16 +293,44 @@ public:
 	template <typename K, typename V>
 	bool find(const K& key, V&& val) const{
 		bool found=false;
-		data.find_fn(key,[&](const category_type& cat){
-			found=cat.first.count(val);
+		data.find_fn(key,[&](const stored_category_type& cat){
+			auto it=cat.first->find(val);
+			found=(it!=cat.first->end());
 			if(found)
-				val=*cat.first.find(val);
+				val=*it;
 		});
 		return found;
 	}
 
 private:
 	Table data;
+	
+	///\return a shared, empty set to return when a key is not found
+	static const std::shared_ptr<const set_type>& emptySet(){
+		static const std::shared_ptr<const set_type> empty=std::make_shared<const set_type>();
+		return empty;
+	}
+	
+	///Create a new category holding one value, which has already expired
+	template<typename V>
+	static stored_category_type makeCategory(V&& val){
+		return stored_category_type(std::make_shared<set_type>(std::initializer_list<mapped_type>{mapped_type{val}}),
+		                            steady_clock::now());
+	}
+	
+	///Get a category's set for modification, first replacing it with a copy if
+	///any reader holds a snapshot of it. Must be called with the category's 
+	///bucket locked, so that no new snapshot can be taken meanwhile. 
+	static set_type& writable(stored_category_type& cat){
+		if(cat.first.use_count()!=1)
+			cat.first=std::make_shared<set_type>(*cat.first);
+		else{
+			//The last reader may have just released its snapshot; make sure its
+			//reads of the set happen before the set is changed. 
+			std::atomic_thread_fence(std::memory_order_acquire);
+		}
+		return *cat.first;
+	}
 };
 
 #endif //SLATE_CONCURRENT_MULTIMAP_H
@@ -308,7 +308,7 @@ namespace crow
             if (!is_invalid_request)
             {
                 res.complete_request_handler_ = []{};
-                res.is_alive_helper_ = [this]()->bool{ return adaptor_.is_open(); };
+                res.is_alive_helper_ = [this]()->bool{ return !detail::peer_has_closed(adaptor_.raw_socket()); };
 
                 ctx_ = detail::context<Middlewares...>();
                 req.middleware_context = (void*)&ctx_;
@@ -1,4 +1,6 @@
 #pragma once
+#include <poll.h>
+#include <sys/socket.h>
 #include <boost/asio.hpp>
 #ifdef CROW_ENABLE_SSL
 #include <boost/asio/ssl.hpp>
@@ -14,6 +16,38 @@ namespace crow
     using namespace boost;
     using tcp = asio::ip::tcp;
 
+    namespace detail
+    {
+        /// Check, without blocking or consuming any data, whether the remote
+        /// end of a connection has closed it. This notices a client which has
+        /// gone away while its request is still being handled, which
+        /// is_open() alone does not, since nothing reads from the socket then.
+        inline bool peer_has_closed(tcp::socket::lowest_layer_type& socket)
+        {
+            if (!socket.is_open())
+                return true;
+            pollfd pfd;
+            pfd.fd = socket.native_handle();
+            pfd.events = POLLIN;
+#ifdef POLLRDHUP
+            pfd.events |= POLLRDHUP;
+#endif
+            pfd.revents = 0;
+            if (poll(&pfd, 1, 0) <= 0)
+                return false;
+            if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+                return true;
+#ifdef POLLRDHUP
+            if (pfd.revents & POLLRDHUP)
+                return true;
+#endif
+            // readable data may just be a pipelined request; only an orderly
+            // shutdown reads as zero bytes
+            char c;
+            return recv(pfd.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+        }
+    }
+
     struct SocketAdaptor
     {
         using context = void;
@@ -590,6 +590,9 @@ std::pair<bool,std::string> extractChartName(const std::string& path){
 		return std::make_pair(false,result.error);
 }
 
+///The largest size to which an ad-hoc application chart may decompress
+const std::size_t maxAdHocChartSize=256<<20;
+
 crow::response installAdHocApplication(PersistentStore& store, const crow::request& req){
 	const User user=authenticateUser(store, req.url_params.get("token"));
 	log_info(user << " requested to install an instance of an ad-hoc application from " << req.remote_endpoint);
@@ -622,11 +625,21 @@ crow::response installAdHocApplication(PersistentStore& store, const crow::reque
 	} dirCleaner{chartDir};
 	try{
 		chartDir=makeTemporaryDir("/tmp/slate_chart_");
-		std::stringstream gzipStream(decodeBase64(body["chart"].GetString())), tarStream;
-		gzipDecompress(gzipStream,tarStream);
+		//decode, decompress, and extract the chart in a single pass, so that 
+		//only a small, fixed amount of it is held in memory at once
+		const auto& chart=body["chart"];
+		Base64DecodingBuffer decoded(chart.GetString(),chart.GetStringLength());
+		std::istream gzipStream(&decoded);
+		gzipStream.exceptions(std::ios::badbit);
+		GzipDecompressingBuffer decompressed(gzipStream,maxAdHocChartSize);
+		std::istream tarStream(&decompressed);
+		tarStream.exceptions(std::ios::badbit);
 		TarReader tr(tarStream);
 		tr.extractToFileSystem(chartDir+"/");
 		log_info("Extracted chart to " << chartDir.path());
+	}catch(std::length_error& ex){
+		log_error("Unable to extract application chart: " << ex.what());
+		return crow::response(400,generateError("Application chart is too large"));
 	}catch(std::exception& ex){
 		log_error("Unable to extract application chart: " << ex.what());
 		return crow::response(500,generateError("Failed to extract application chart"));
@@ -675,6 +688,12 @@ crow::response updateCatalog(PersistentStore& store, const crow::request& req){
 		log_error("helm repo update failed: [exit] " << result.status << " [err] " << result.error << " [out] " << result.output);
 		return crow::response(500,generateError("helm repo update failed"));
 	}
+	//in case helm itself has been upgraded, check its version again
+	try{
+		kubernetes::refreshHelmCapabilities();
+	}catch(std::runtime_error& err){
+		log_error("Failed to re-probe helm version: " << err.what());
+	}
 	
 	store.fetchApplications("slate");
 	store.fetchApplications("slate-dev");
@@ -11,10 +11,12 @@
 #include "yaml-cpp/node/detail/impl.h"
 #include <yaml-cpp/node/parse.h>
 
+#include "KubeAPIClient.h"
 #include "KubeInterface.h"
 #include "Logging.h"
 #include "ServerUtilities.h"
 #include "ApplicationCommands.h"
+#include "OperationCommands.h"
 
 #include <chrono>
 
@@ -45,6 +47,16 @@ crow::response listApplicationInstances(PersistentStore& store, const crow::requ
 	} else
 		instances=store.listApplicationInstances();
 	
+	//look up all groups and clusters to which the instances belong together, 
+	//rather than one at a time
+	std::vector<std::string> groupIDs, clusterIDs;
+	for(const ApplicationInstance& instance : instances){
+		groupIDs.push_back(instance.owningGroup);
+		clusterIDs.push_back(instance.cluster);
+	}
+	const auto groups=store.getGroups(groupIDs);
+	const auto clusters=store.getClusters(clusterIDs);
+	
 	rapidjson::Document result(rapidjson::kObjectType);
 	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
 	
@@ -62,8 +74,10 @@ crow::response listApplicationInstances(PersistentStore& store, const crow::requ
 		if(application.find('/')!=std::string::npos && application.find('/')<application.size()-1)
 			application=application.substr(application.find('/')+1);
 		instanceData.AddMember("application", application, alloc);
-		instanceData.AddMember("group", store.getGroup(instance.owningGroup).name, alloc);
-		instanceData.AddMember("cluster", store.getCluster(instance.cluster).name, alloc);
+		auto group=groups.find(instance.owningGroup);
+		instanceData.AddMember("group", group!=groups.end() ? group->second.name : std::string(), alloc);
+		auto cluster=clusters.find(instance.cluster);
+		instanceData.AddMember("cluster", cluster!=clusters.end() ? cluster->second.name : std::string(), alloc);
 		instanceData.AddMember("created", instance.ctime, alloc);
 		instanceResult.AddMember("metadata", instanceData, alloc);
 		resultItems.PushBack(instanceResult, alloc);
@@ -95,7 +109,7 @@ std::multimap<std::string,ServiceInterface> getServices(const SharedFileHandle&
                                                    const std::string& systemNamespace){
 	using namespace std::chrono;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
-	auto servicesResult=kubernetes::kubectl(*configPath,{"get","services","-l","release="+releaseName,"--namespace",nspace,"-o=json"});
+	auto servicesResult=kubernetes::kubectl_get(*configPath,"services",{nspace,"","release="+releaseName});
 	high_resolution_clock::time_point t2 = high_resolution_clock::now();
 	log_info("kubectl get services completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 	if(servicesResult.status){
@@ -142,7 +156,7 @@ std::multimap<std::string,ServiceInterface> getServices(const SharedFileHandle&
 			}
 			//now try to locate the pod in question
 			t1 = high_resolution_clock::now();
-			auto podResult=kubernetes::kubectl(*configPath,{"get","pod","-l",filter,"--namespace",nspace,"-o=json"});
+			auto podResult=kubernetes::kubectl_get(*configPath,"pod",{nspace,"",filter});
 			t2 = high_resolution_clock::now();
 			log_info("kubectl get pod completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 			if(podResult.status){
@@ -168,7 +182,7 @@ std::multimap<std::string,ServiceInterface> getServices(const SharedFileHandle&
 					auto nodename=podData["items"][0]["spec"]["nodeName"].GetString();
 
 					t1 = high_resolution_clock::now();
-					auto nodeResult=kubernetes::kubectl(*configPath,{"get","node",nodename,"-o=json"});
+					auto nodeResult=kubernetes::kubectl_get(*configPath,"node",{"",nodename});
 					t2 = high_resolution_clock::now();
 					log_info("kubectl get node completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 					if(nodeResult.status){
@@ -323,7 +337,7 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 	
 	//find out what pods make up this instance
 	t1 = high_resolution_clock::now();
-	auto result=kubernetes::kubectl(*configPath,{"get","pods","-l","release="+instance.name,"-n",nspace,"-o=json"});
+	auto result=kubernetes::kubectl_get(*configPath,"pods",{nspace,"","release="+instance.name});
 	t2 = high_resolution_clock::now();
 	log_info("kubectl get pods completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 	if(result.status){
@@ -337,7 +351,6 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 	}	
 
 	rapidjson::Document podData(&alloc);
-	std::vector<std::future<std::pair<std::size_t,std::string>>> eventData;
 	try{
 		podData.Parse(result.output.c_str());
 	}
@@ -345,6 +358,8 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 		log_error("Unable to parse kubectl output for " << instance << " pods");
 		throw std::runtime_error("Could not find pods for instance");
 	}
+	std::vector<std::string> eventData(podData["items"].Size());
+	Executor::TaskGroup eventFetches(store.getCommandExecutor());
 	std::size_t podIndex=0;
 	for(auto& pod : podData["items"].GetArray()){
 		std::string podName=pod["metadata"]["name"].GetString();
@@ -406,24 +421,25 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 		}
 		
 		//Also try to fetch events associated with the pod
-		auto getPodEvents=[&nspace,&configPath](std::size_t podIndex, const std::string podName)->std::pair<std::size_t,std::string>{
+		auto getPodEvents=[&nspace,&configPath,&eventData,podIndex,podName](){
 			high_resolution_clock::time_point t1 = high_resolution_clock::now();
-			auto result=kubernetes::kubectl(*configPath,{"get","event","--field-selector","involvedObject.name="+podName,"-n",nspace,"-o=json"});
+			auto result=kubernetes::kubectl_get(*configPath,"event",{nspace,"","","involvedObject.name="+podName});
 			high_resolution_clock::time_point t2 = high_resolution_clock::now();
 			log_info("kubectl get event completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 			if(result.status)
 				log_warn("kubectl get event failed for pod " << podName << " in namespace " << nspace);
-			return std::make_pair(podIndex,std::move(result.output));
+			eventData[podIndex]=std::move(result.output);
 		};
-		eventData.emplace_back(std::async(std::launch::async,getPodEvents,podIndex++,podName));
+		eventFetches.submit(instance.cluster,getPodEvents);
+		podIndex++;
 		
 		podDetails.PushBack(podInfo,alloc);
 	}
-	for(auto& f : eventData){
-		auto p=f.get();
+	eventFetches.wait();
+	for(std::size_t i=0; i<eventData.size(); i++){
 		rapidjson::Document data(rapidjson::kObjectType,&alloc);
 		try{
-			data.Parse(p.second.c_str());
+			data.Parse(eventData[i].c_str());
 		}catch(std::runtime_error& err){
 			log_warn("Unable to parse event data as JSON");
 			continue;
@@ -444,7 +460,7 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 					eventInfo.AddMember("message",item["message"],alloc);
 				events.PushBack(eventInfo,alloc);
 			}
-			podDetails[p.first].AddMember("events",events,alloc);
+			podDetails[i].AddMember("events",events,alloc);
 		}
 		
 	}
@@ -620,58 +636,29 @@ std::string deleteApplicationInstance(PersistentStore& store, const ApplicationI
 }
 }
 
-crow::response updateApplicationInstance(PersistentStore& store, const crow::request& req, const std::string& instanceID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
-	log_info(user << " requested to update " << instanceID << " from " << req.remote_endpoint);
-	if(!user)
-		return crow::response(403,generateError("Not authorized"));
-	
-	auto instance=store.getApplicationInstance(instanceID);
-	if(!instance)
-		return crow::response(404,generateError("Application instance not found"));
-	//only admins or members of the Group which owns an instance may restart it
-	if(!user.admin && !store.userInGroup(user.id,instance.owningGroup))
-		return crow::response(403,generateError("Not authorized"));
-		
-	const Group group=store.getGroup(instance.owningGroup);
-	if(!group)
-		return crow::response(500,generateError("Invalid Group"));
-	const Cluster cluster=store.getCluster(instance.cluster);
-	if(!cluster)
-		return crow::response(500,generateError("Invalid Cluster"));
-
-	rapidjson::Document body;
-	try{
-		body.Parse(req.body.c_str());
-	}catch(std::runtime_error& err){
-		return crow::response(400,generateError("Invalid JSON in request body"));
-	}
-	if(body.IsNull())
-		return crow::response(400,generateError("Invalid JSON in request body"));
-
-	if(!body["configuration"].IsString())
-		return crow::response(400,generateError("Incorrect type for configuration"));
-
-	instance.config=body["configuration"].GetString();
-
-	std::string chartVersion = "";
-	if(body["chartVersion"].IsString())
-		chartVersion = body["chartVersion"].GetString();
-
-	auto helmSearchResult = runCommand("helm",{"inspect","values",instance.application, "--version", chartVersion});
-	if(helmSearchResult.status){
-		log_error("Command failed: helm search " << (instance.application) << ": [exit] " << helmSearchResult.status << " [err] " << helmSearchResult.error << " [out] " << helmSearchResult.output);
-		return crow::response(500, generateError("Unable to fetch application version"));
-	}
-
-	std::string resultMessage;
+namespace{
 	
+///Stop an application instance and start it again, with whatever configuration
+///the instance record now holds. 
+///\param extraInstallArgs arguments to pass to helm install in addition to 
+///                        those which are always needed
+///\param warnings any problems which do not prevent the reinstall are appended
+///                to this string
+///\param error set to a description of what went wrong if the reinstall fails
+///\param progress called to report each step
+///\return whether the instance was restarted
+bool reinstallApplicationInstance(PersistentStore& store, const ApplicationInstance& instance, 
+                                  const Group& group, const Cluster& cluster, 
+                                  const std::vector<std::string>& extraInstallArgs,
+                                  std::string& warnings, std::string& error,
+                                  const OperationScheduler::ProgressReporter& progress){
 	auto clusterConfig=store.configPathForCluster(cluster.id);
 	//TODO: it would be good to detect if there is nothing to stop and proceed 
 	//      with restarting in that case
 	log_info("Stopping old " << instance);
+	progress("Stopping old instance");
 	try{
-		auto systemNamespace=store.getCluster(instance.cluster).systemNamespace;
+		auto systemNamespace=cluster.systemNamespace;
 		std::vector<std::string> deleteArgs={"delete",instance.name};
 		unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
 		std::string notFoundMsg;
@@ -690,55 +677,34 @@ crow::response updateApplicationInstance(PersistentStore& store, const crow::req
 		    (helmResult.output.find("release \""+instance.name+"\" deleted")==std::string::npos && 
 		     helmResult.output.find("release \""+instance.name+"\" uninstalled")==std::string::npos))
 		   && helmResult.error.find(notFoundMsg)==std::string::npos){
-			std::string message="helm delete failed: " + helmResult.error;
-			log_error(message);
-			return crow::response(500,generateError(message));
+			error="helm delete failed: " + helmResult.error;
+			log_error(error);
+			return false;
 		}
 	}
 	catch(std::runtime_error& e){
-		return crow::response(500,generateError(std::string("Failed to delete instance using helm: ")+e.what()));
+		error=std::string("Failed to delete instance using helm: ")+e.what();
+		return false;
 	}
 	
 	log_info("Waiting to ensure that all previous objects from " << instance << " have been deleted");
-	std::chrono::seconds maxTime(120), elapsedTime(0), maxPollDelay(10), pollDelay(1);
-	while(elapsedTime<maxTime){
-		pollDelay+=pollDelay;
-		if(pollDelay>maxPollDelay)
-			pollDelay=maxPollDelay;
-		std::this_thread::sleep_for(pollDelay);
-		try{
-			auto objsResult=kubernetes::kubectl(*clusterConfig,{"get","all","-l release="+instance.name,"-n",group.namespaceName(),"-o=json"});
-			if(objsResult.status){
-				log_error("Failed to check for deleted instance objects: " << objsResult.error);
-				resultMessage+="Failed to check whether objects from old instance are fully deleted; reinstall may fail\n";
-				break;
-			}
-			rapidjson::Document objData;
-			try{
-				objData.Parse(objsResult.output.c_str());
-			}
-			catch(std::runtime_error& err){
-				log_error("Unable to parse kubectl output for " << "get all -l release=" << instance.name << " -n" << group.namespaceName() << " -o=json");
-			}
-			//check whether any objects remain
-			if(objData.HasMember("items") && objData["items"].IsArray() && objData["items"].Empty())
-				break;
-		}
-		catch(std::runtime_error& e){
-			log_error("Failed to check for deleted instance objects: " << e.what());
-			resultMessage+="[Warning] Failed to check whether objects from old instance are fully deleted; reinstall may fail\n";
-			break;
-		}
-		//We only count up the time we deliberately waited, which will miss any 
-		//latency added by kubernetes. This could be accounted for if necessary.
-		elapsedTime+=pollDelay;
+	progress("Waiting for old instance objects to be deleted");
+	std::string waitError;
+	auto waitResult=kubernetes::waitForDeletion(*clusterConfig,group.namespaceName(),
+	                                            "release="+instance.name,
+	                                            std::chrono::steady_clock::now()+std::chrono::seconds(120),
+	                                            waitError);
+	if(waitResult==kubernetes::DeletionWaitResult::Failed){
+		log_error("Failed to check for deleted instance objects: " << waitError);
+		warnings+="[Warning] Failed to check whether objects from old instance are fully deleted; reinstall may fail\n";
 	}
-	if(elapsedTime>=maxTime){
+	else if(waitResult==kubernetes::DeletionWaitResult::TimedOut){
 		log_warn("Object deletion check timeout reached; proceeding with reinstall anyway");
-		resultMessage+="[Warning] Object deletion check timeout reached; proceeding with reinstall anyway\n";
+		warnings+="[Warning] Object deletion check timeout reached; proceeding with reinstall anyway\n";
 	}
 	
 	log_info("Starting new " << instance);
+	progress("Starting new instance");
 	//write configuration to a file for helm's benefit
 	FileHandle instanceConfig=makeTemporaryFile(instance.id);
 	{
@@ -746,7 +712,8 @@ crow::response updateApplicationInstance(PersistentStore& store, const crow::req
 		outfile << instance.config;
 		if(!outfile){
 			log_error("Failed to write instance configuration to " << instanceConfig.path());
-			return crow::response(500,generateError("Failed to write instance configuration to disk"));
+			error="Failed to write instance configuration to disk";
+			return false;
 		}
 	}
 	std::string additionalValues=internal::assembleExtraHelmValues(store,cluster,instance,group);
@@ -756,7 +723,8 @@ crow::response updateApplicationInstance(PersistentStore& store, const crow::req
 	}
 	catch(std::runtime_error& err){
 		store.removeApplicationInstance(instance.id);
-		return crow::response(500,generateError(err.what()));
+		error=err.what();
+		return false;
 	}
 
 	std::vector<std::string> installArgs={"install",
@@ -765,8 +733,8 @@ crow::response updateApplicationInstance(PersistentStore& store, const crow::req
 	   "--namespace",group.namespaceName(),
 	   "--values",instanceConfig.path(),
 	   "--set",additionalValues,
-	   "--version",chartVersion,
 	   };
+	installArgs.insert(installArgs.end(),extraInstallArgs.begin(),extraInstallArgs.end());
 	unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
 	if(helmMajorVersion==2){
 		installArgs.insert(installArgs.begin()+1,"--name");
@@ -778,25 +746,24 @@ crow::response updateApplicationInstance(PersistentStore& store, const crow::req
 	if(commandResult.status || 
 	   (commandResult.output.find("STATUS: DEPLOYED")==std::string::npos &&
 	    commandResult.output.find("STATUS: deployed")==std::string::npos)){
-		std::string errMsg="Failed to start application instance with helm:\n"+commandResult.error+"\n system namespace: "+cluster.systemNamespace;
-		log_error(errMsg);
+		error="Failed to start application instance with helm:\n"+commandResult.error+"\n system namespace: "+cluster.systemNamespace;
+		log_error(error);
 		//helm will (unhelpfully) keep broken 'releases' around, so clean up here
 		std::vector<std::string> deleteArgs={"delete",instance.name,"--namespace",group.namespaceName()};
 		if(kubernetes::getHelmMajorVersion()==2)
 			deleteArgs.insert(deleteArgs.begin()+1,"--purge");
 		auto helmResult=kubernetes::helm(*clusterConfig,cluster.systemNamespace,deleteArgs);
 		//TODO: include any other error information?
-		if(!resultMessage.empty())
-			errMsg+="\n"+resultMessage;
-		return crow::response(500,generateError(errMsg));
+		if(!warnings.empty())
+			error+="\n"+warnings;
+		return false;
 	}
+	return true;
+}
 
-	// Not sure if this is the best way to handle updating db records
-	store.removeApplicationInstance(instanceID);
-	store.addApplicationInstance(instance);
-
-	log_info("Updated " << instance << " on " << cluster << " on behalf of " << user);
-	
+///Describe an instance which has been restarted
+std::string reinstalledInstanceResult(const ApplicationInstance& instance, const Group& group, 
+                                      const std::string& message){
 	rapidjson::Document result(rapidjson::kObjectType);
 	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
 	
@@ -822,14 +789,16 @@ crow::response updateApplicationInstance(PersistentStore& store, const crow::req
 	result.AddMember("metadata", metadata, alloc);
 	//TODO: not including this data is non-compliant with the spec, but it is never used
 	//result.AddMember("status", "DEPLOYED", alloc);
-	result.AddMember("message", resultMessage, alloc);
+	result.AddMember("message", message, alloc);
 	
-	return crow::response(to_string(result));	
+	return to_string(result);
 }
 
-crow::response restartApplicationInstance(PersistentStore& store, const crow::request& req, const std::string& instanceID){
+}
+
+crow::response updateApplicationInstance(PersistentStore& store, const crow::request& req, const std::string& instanceID){
 	const User user=authenticateUser(store, req.url_params.get("token"));
-	log_info(user << " requested to restart " << instanceID << " from " << req.remote_endpoint);
+	log_info(user << " requested to update " << instanceID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
@@ -846,164 +815,129 @@ crow::response restartApplicationInstance(PersistentStore& store, const crow::re
 	const Cluster cluster=store.getCluster(instance.cluster);
 	if(!cluster)
 		return crow::response(500,generateError("Invalid Cluster"));
-	
-	instance.config=store.getApplicationInstanceConfig(instance.id);
 
-	std::string resultMessage;
-	
-	auto clusterConfig=store.configPathForCluster(cluster.id);
-	//TODO: it would be good to detect if there is nothing to stop and proceed 
-	//      with restarting in that case
-	log_info("Stopping old " << instance);
+	rapidjson::Document body;
 	try{
-		auto systemNamespace=store.getCluster(instance.cluster).systemNamespace;
-		std::vector<std::string> deleteArgs={"delete",instance.name};
-		unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
-		std::string notFoundMsg;
-		if(helmMajorVersion==2){
-			deleteArgs.insert(deleteArgs.begin()+1,"--purge");
-			notFoundMsg="\""+instance.name+"\" not found";
-		}
-		else if(helmMajorVersion==3){
-			deleteArgs.push_back("--namespace");
-			deleteArgs.push_back(group.namespaceName());
-			notFoundMsg=instance.name+": release: not found";
-		}
-		auto helmResult=kubernetes::helm(*clusterConfig,systemNamespace,deleteArgs);
-	
-		if((helmResult.status || 
-		    (helmResult.output.find("release \""+instance.name+"\" deleted")==std::string::npos && 
-		     helmResult.output.find("release \""+instance.name+"\" uninstalled")==std::string::npos))
-		   && helmResult.error.find(notFoundMsg)==std::string::npos){
-			std::string message="helm delete failed: " + helmResult.error;
-			log_error(message);
-			return crow::response(500,generateError(message));
-		}
+		body.Parse(req.body.c_str());
+	}catch(std::runtime_error& err){
+		return crow::response(400,generateError("Invalid JSON in request body"));
 	}
-	catch(std::runtime_error& e){
-		return crow::response(500,generateError(std::string("Failed to delete instance using helm: ")+e.what()));
+	if(body.IsNull())
+		return crow::response(400,generateError("Invalid JSON in request body"));
+
+	if(!body["configuration"].IsString())
+		return crow::response(400,generateError("Incorrect type for configuration"));
+
+	instance.config=body["configuration"].GetString();
+
+	std::string chartVersion = "";
+	if(body["chartVersion"].IsString())
+		chartVersion = body["chartVersion"].GetString();
+
+	auto helmSearchResult = runCommand("helm",{"inspect","values",instance.application, "--version", chartVersion});
+	if(helmSearchResult.status){
+		log_error("Command failed: helm search " << (instance.application) << ": [exit] " << helmSearchResult.status << " [err] " << helmSearchResult.error << " [out] " << helmSearchResult.output);
+		return crow::response(500, generateError("Unable to fetch application version"));
 	}
 	
-	log_info("Waiting to ensure that all previous objects from " << instance << " have been deleted");
-	std::chrono::seconds maxTime(120), elapsedTime(0), maxPollDelay(10), pollDelay(1);
-	while(elapsedTime<maxTime){
-		pollDelay+=pollDelay;
-		if(pollDelay>maxPollDelay)
-			pollDelay=maxPollDelay;
-		std::this_thread::sleep_for(pollDelay);
-		try{
-			auto objsResult=kubernetes::kubectl(*clusterConfig,{"get","all","-l release="+instance.name,"-n",group.namespaceName(),"-o=json"});
-			if(objsResult.status){
-				log_error("Failed to check for deleted instance objects: " << objsResult.error);
-				resultMessage+="Failed to check whether objects from old instance are fully deleted; reinstall may fail\n";
-				break;
-			}
-			rapidjson::Document objData;
-			try{
-				objData.Parse(objsResult.output.c_str());
-			}
-			catch(std::runtime_error& err){
-				log_error("Unable to parse kubectl output for " << "get all -l release=" << instance.name << " -n" << group.namespaceName() << " -o=json");
-			}
-			//check whether any objects remain
-			if(objData.HasMember("items") && objData["items"].IsArray() && objData["items"].Empty())
-				break;
-		}
-		catch(std::runtime_error& e){
-			log_error("Failed to check for deleted instance objects: " << e.what());
-			resultMessage+="[Warning] Failed to check whether objects from old instance are fully deleted; reinstall may fail\n";
-			break;
-		}
-		//We only count up the time we deliberately waited, which will miss any 
-		//latency added by kubernetes. This could be accounted for if necessary.
-		elapsedTime+=pollDelay;
-	}
-	if(elapsedTime>=maxTime){
-		log_warn("Object deletion check timeout reached; proceeding with reinstall anyway");
-		resultMessage+="[Warning] Object deletion check timeout reached; proceeding with reinstall anyway\n";
+	if(asyncRequested(req)){
+		rapidjson::Document parameters(rapidjson::kObjectType);
+		parameters.AddMember("configuration", instance.config, parameters.GetAllocator());
+		parameters.AddMember("chartVersion", chartVersion, parameters.GetAllocator());
+		auto operation=store.getOperationScheduler().start("updateInstance",instance.id,user.id,to_string(parameters));
+		if(!operation)
+			return crow::response(500,generateError("Failed to schedule instance update"));
+		return operationAccepted(operation);
 	}
 	
-	log_info("Starting new " << instance);
-	//write configuration to a file for helm's benefit
-	FileHandle instanceConfig=makeTemporaryFile(instance.id);
-	{
-		std::ofstream outfile(instanceConfig.path());
-		outfile << instance.config;
-		if(!outfile){
-			log_error("Failed to write instance configuration to " << instanceConfig.path());
-			return crow::response(500,generateError("Failed to write instance configuration to disk"));
-		}
-	}
-	std::string additionalValues=internal::assembleExtraHelmValues(store,cluster,instance,group);
+	std::string result;
+	if(!internal::updateApplicationInstance(store,instance,chartVersion,result,[](const std::string&){}))
+		return crow::response(500,generateError(result));
+	log_info("Updated " << instance << " on " << cluster << " on behalf of " << user);
+	return crow::response(result);
+}
+
+crow::response restartApplicationInstance(PersistentStore& store, const crow::request& req, const std::string& instanceID){
+	const User user=authenticateUser(store, req.url_params.get("token"));
+	log_info(user << " requested to restart " << instanceID << " from " << req.remote_endpoint);
+	if(!user)
+		return crow::response(403,generateError("Not authorized"));
 	
-	try{
-		kubernetes::kubectl_create_namespace(*clusterConfig, group);
-	}
-	catch(std::runtime_error& err){
-		store.removeApplicationInstance(instance.id);
-		return crow::response(500,generateError(err.what()));
+	auto instance=store.getApplicationInstance(instanceID);
+	if(!instance)
+		return crow::response(404,generateError("Application instance not found"));
+	//only admins or members of the Group which owns an instance may restart it
+	if(!user.admin && !store.userInGroup(user.id,instance.owningGroup))
+		return crow::response(403,generateError("Not authorized"));
+		
+	const Group group=store.getGroup(instance.owningGroup);
+	if(!group)
+		return crow::response(500,generateError("Invalid Group"));
+	const Cluster cluster=store.getCluster(instance.cluster);
+	if(!cluster)
+		return crow::response(500,generateError("Invalid Cluster"));
+	
+	if(asyncRequested(req)){
+		auto operation=store.getOperationScheduler().start("restartInstance",instance.id,user.id);
+		if(!operation)
+			return crow::response(500,generateError("Failed to schedule instance restart"));
+		return operationAccepted(operation);
 	}
+	
+	std::string result;
+	if(!internal::restartApplicationInstance(store,instance,result,[](const std::string&){}))
+		return crow::response(500,generateError(result));
+	log_info("Restarted " << instance << " on " << cluster << " on behalf of " << user);
+	return crow::response(result);
+}
 
-	std::vector<std::string> installArgs={"install",
-	  instance.name,
-	  instance.application,
-	   "--namespace",group.namespaceName(),
-	   "--values",instanceConfig.path(),
-	   "--set",additionalValues,
-	   };
-	unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
-	if(helmMajorVersion==2){
-		installArgs.insert(installArgs.begin()+1,"--name");
-		installArgs.push_back("--tiller-namespace");
-		installArgs.push_back(cluster.systemNamespace);
+namespace internal{
+bool restartApplicationInstance(PersistentStore& store, ApplicationInstance instance, 
+                                std::string& result,
+                                const OperationScheduler::ProgressReporter& progress){
+	const Group group=store.getGroup(instance.owningGroup);
+	if(!group){
+		result="Invalid Group";
+		return false;
 	}
-	   
-	auto commandResult=runCommand("helm",installArgs,{{"KUBECONFIG",*clusterConfig}});
-	if(commandResult.status || 
-	   (commandResult.output.find("STATUS: DEPLOYED")==std::string::npos &&
-	    commandResult.output.find("STATUS: deployed")==std::string::npos)){
-		std::string errMsg="Failed to start application instance with helm:\n"+commandResult.error+"\n system namespace: "+cluster.systemNamespace;
-		log_error(errMsg);
-		//helm will (unhelpfully) keep broken 'releases' around, so clean up here
-		std::vector<std::string> deleteArgs={"delete",instance.name,"--namespace",group.namespaceName()};
-		if(kubernetes::getHelmMajorVersion()==2)
-			deleteArgs.insert(deleteArgs.begin()+1,"--purge");
-		auto helmResult=kubernetes::helm(*clusterConfig,cluster.systemNamespace,deleteArgs);
-		//TODO: include any other error information?
-		if(!resultMessage.empty())
-			errMsg+="\n"+resultMessage;
-		return crow::response(500,generateError(errMsg));
+	const Cluster cluster=store.getCluster(instance.cluster);
+	if(!cluster){
+		result="Invalid Cluster";
+		return false;
 	}
-	log_info("Restarted " << instance << " on " << cluster << " on behalf of " << user);
-	
-	rapidjson::Document result(rapidjson::kObjectType);
-	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
+	instance.config=store.getApplicationInstanceConfig(instance.id);
 	
-	result.AddMember("apiVersion", "v1alpha3", alloc);
-	result.AddMember("kind", "Configuration", alloc);
-	rapidjson::Value metadata(rapidjson::kObjectType);
-	metadata.AddMember("id", instance.id, alloc);
-	metadata.AddMember("name", instance.name, alloc);
-	//TODO: not including this data is non-compliant with the spec, but it is never used
-	/*if(lines.size()>1){
-		auto cols = string_split_columns(lines[1], '\t');
-		if(cols.size()>3){
-			metadata.AddMember("revision", cols[1], alloc);
-			metadata.AddMember("updated", cols[2], alloc);
-		}
+	std::string warnings;
+	if(!reinstallApplicationInstance(store,instance,group,cluster,{},warnings,result,progress))
+		return false;
+	result=reinstalledInstanceResult(instance,group,warnings);
+	return true;
+}
+
+bool updateApplicationInstance(PersistentStore& store, const ApplicationInstance& instance, 
+                               const std::string& chartVersion, std::string& result,
+                               const OperationScheduler::ProgressReporter& progress){
+	const Group group=store.getGroup(instance.owningGroup);
+	if(!group){
+		result="Invalid Group";
+		return false;
+	}
+	const Cluster cluster=store.getCluster(instance.cluster);
+	if(!cluster){
+		result="Invalid Cluster";
+		return false;
 	}
-	if(!metadata.HasMember("revision")){
-		metadata.AddMember("revision", "?", alloc);
-		metadata.AddMember("updated", "?", alloc);
-	}*/
-	metadata.AddMember("application", instance.application, alloc);
-	metadata.AddMember("group", group.id, alloc);
-	result.AddMember("metadata", metadata, alloc);
-	//TODO: not including this data is non-compliant with the spec, but it is never used
-	//result.AddMember("status", "DEPLOYED", alloc);
-	result.AddMember("message", resultMessage, alloc);
 	
-	return crow::response(to_string(result));
+	std::string warnings;
+	if(!reinstallApplicationInstance(store,instance,group,cluster,{"--version",chartVersion},warnings,result,progress))
+		return false;
+
+	// Not sure if this is the best way to handle updating db records
+	store.removeApplicationInstance(instance.id);
+	store.addApplicationInstance(instance);
+	result=reinstalledInstanceResult(instance,group,warnings);
+	return true;
+}
 }
 
 crow::response getApplicationInstanceScale(PersistentStore& store, const crow::request& req, const std::string& instanceID){
@@ -1226,7 +1160,7 @@ crow::response getApplicationInstanceLogs(PersistentStore& store,
 	
 	//Make a list of all containers in all pods, including any filtering requested by the user
 	std::vector<std::pair<std::string,std::string>> allContainers;
-	auto podsResult=kubernetes::kubectl(*configPath,{"get","pods","-l release="+instance.name,"-n",nspace,"-o=json"});
+	auto podsResult=kubernetes::kubectl_get(*configPath,"pods",{nspace,"","release="+instance.name});
 	if(podsResult.status){
 		log_error("Failed to look up pods for " << instance << ": " << podsResult.error);
 		return crow::response(500,generateError("Failed to look up pods"));
@@ -1278,11 +1212,17 @@ crow::response getApplicationInstanceLogs(PersistentStore& store,
 		return logData;
 	};
 
-	std::vector<std::future<std::string>> logBlocks;
-	for(const auto& container : allContainers)
-		logBlocks.emplace_back(std::async(std::launch::async,collectLog,container.first,container.second));
-	for(auto& result : logBlocks)
-		logData+=result.get();
+	std::vector<std::string> logBlocks(allContainers.size());
+	{
+		Executor::TaskGroup logFetches(store.getCommandExecutor());
+		for(std::size_t i=0; i<allContainers.size(); i++)
+			logFetches.submit(instance.cluster,[&,i](){
+				logBlocks[i]=collectLog(allContainers[i].first,allContainers[i].second);
+			});
+		logFetches.wait();
+	}
+	for(const auto& block : logBlocks)
+		logData+=block;
 	
 	rapidjson::Document result(rapidjson::kObjectType);
 	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
@@ -1,10 +1,12 @@
 #include <Archive.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <climits>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <map>
@@ -22,12 +24,325 @@
 
 #include <FileSystem.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+	#define SLATE_BASE64_X86 1
+	#include <immintrin.h>
+#endif
+
 namespace{
 	const char base64lookupTable[65]=
 		"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 		"abcdefghijklmnopqrstuvwxyz"
 		"0123456789"
 		"+/";
+	
+	///Maps each character to its 6-bit value, or -1 if it is not part of the 
+	///base64 alphabet
+	struct Base64DecodeTable{
+		signed char values[256];
+		Base64DecodeTable(){
+			std::fill(values,values+256,-1);
+			for(int i=0; i<64; i++)
+				values[(unsigned char)base64lookupTable[i]]=i;
+		}
+	};
+	const Base64DecodeTable base64DecodeTable;
+	
+	///Encode data, writing 4*ceil(size/3) characters, including padding
+	using Base64EncodeFunction=void(*)(const unsigned char* in, std::size_t size, char* out);
+	///Decode data which contains no padding, writing size*3/4 bytes
+	///\return false if any character is not part of the base64 alphabet
+	using Base64DecodeFunction=bool(*)(const char* in, std::size_t size, char* out);
+	
+	struct Base64Codec{
+		Base64EncodeFunction encode;
+		Base64DecodeFunction decode;
+	};
+	
+	void encodeBase64Scalar(const unsigned char* in, std::size_t size, char* out){
+		std::size_t i=0;
+		for(; i+3<=size; i+=3, out+=4){
+			uint32_t bits=(in[i]<<16)|(in[i+1]<<8)|in[i+2];
+			out[0]=base64lookupTable[bits>>18];
+			out[1]=base64lookupTable[(bits>>12)&0x3F];
+			out[2]=base64lookupTable[(bits>>6)&0x3F];
+			out[3]=base64lookupTable[bits&0x3F];
+		}
+		if(i==size)
+			return;
+		uint32_t bits=in[i]<<16;
+		if(i+2==size)
+			bits|=in[i+1]<<8;
+		out[0]=base64lookupTable[bits>>18];
+		out[1]=base64lookupTable[(bits>>12)&0x3F];
+		out[2]=(i+2==size ? base64lookupTable[(bits>>6)&0x3F] : '=');
+		out[3]='=';
+	}
+	
+	bool decodeBase64Scalar(const char* coded, std::size_t size, char* out){
+		const unsigned char* in=(const unsigned char*)coded;
+		const signed char* values=base64DecodeTable.values;
+		std::size_t i=0;
+		for(; i+4<=size; i+=4, out+=3){
+			int a=values[in[i]], b=values[in[i+1]], c=values[in[i+2]], d=values[in[i+3]];
+			if((a|b|c|d)<0)
+				return false;
+			uint32_t bits=(a<<18)|(b<<12)|(c<<6)|d;
+			out[0]=(char)(bits>>16);
+			out[1]=(char)(bits>>8);
+			out[2]=(char)bits;
+		}
+		//a trailing partial group carries only as many whole bytes as it has 
+		//bits; a single character carries none, but must still be valid
+		int bits[3]={0,0,0};
+		for(std::size_t j=0; i+j<size; j++){
+			bits[j]=values[in[i+j]];
+			if(bits[j]<0)
+				return false;
+		}
+		if(size-i>=2)
+			out[0]=(char)((bits[0]<<2)|(bits[1]>>4));
+		if(size-i==3)
+			out[1]=(char)((bits[1]<<4)|(bits[2]>>2));
+		return true;
+	}
+	
+	const Base64Codec scalarCodec={&encodeBase64Scalar,&decodeBase64Scalar};
+	
+#ifdef SLATE_BASE64_X86
+	//The vectorized codecs follow Muła and Lemire, "Faster Base64 Encoding and 
+	//Decoding Using AVX2 Instructions". Each block of 3 input bytes is spread
+	//over a 32 bit lane so that its four 6 bit fields can be moved into place 
+	//with multiplications, and characters are translated with small shuffle 
+	//tables rather than a 256 entry lookup. 
+	//Blocks are stored whole, so each loop stops early enough that the stores
+	//cannot run past the end of the output, and the scalar code finishes. 
+	
+	__attribute__((target("ssse3")))
+	inline __m128i base64SplitBytes(__m128i in){
+		in=_mm_shuffle_epi8(in,_mm_set_epi8(10,11,9,10,7,8,6,7,4,5,3,4,1,2,0,1));
+		const __m128i t0=_mm_and_si128(in,_mm_set1_epi32(0x0fc0fc00));
+		const __m128i t1=_mm_mulhi_epu16(t0,_mm_set1_epi32(0x04000040));
+		const __m128i t2=_mm_and_si128(in,_mm_set1_epi32(0x003f03f0));
+		const __m128i t3=_mm_mullo_epi16(t2,_mm_set1_epi32(0x01000010));
+		return _mm_or_si128(t1,t3);
+	}
+	
+	__attribute__((target("ssse3")))
+	inline __m128i base64Translate(__m128i values){
+		//offsets from each 6-bit value to its character, for the ranges
+		//A-Z, a-z, 0-9 (10 entries), + and /
+		const __m128i offsets=_mm_setr_epi8(65,71,-4,-4,-4,-4,-4,-4,-4,-4,-4,-4,-19,-16,0,0);
+		__m128i range=_mm_subs_epu8(values,_mm_set1_epi8(51));
+		range=_mm_sub_epi8(range,_mm_cmpgt_epi8(values,_mm_set1_epi8(25)));
+		return _mm_add_epi8(values,_mm_shuffle_epi8(offsets,range));
+	}
+	
+	///Convert characters to their 6-bit values
+	///\return false if any character is not part of the base64 alphabet
+	__attribute__((target("ssse3")))
+	inline bool base64Values(__m128i in, __m128i& values){
+		//signed comparisons, so that bytes of 128 or more match no range
+		const __m128i upper=_mm_and_si128(_mm_cmpgt_epi8(in,_mm_set1_epi8('A'-1)),
+		                                  _mm_cmpgt_epi8(_mm_set1_epi8('Z'+1),in));
+		const __m128i lower=_mm_and_si128(_mm_cmpgt_epi8(in,_mm_set1_epi8('a'-1)),
+		                                  _mm_cmpgt_epi8(_mm_set1_epi8('z'+1),in));
+		const __m128i digit=_mm_and_si128(_mm_cmpgt_epi8(in,_mm_set1_epi8('0'-1)),
+		                                  _mm_cmpgt_epi8(_mm_set1_epi8('9'+1),in));
+		const __m128i plus=_mm_cmpeq_epi8(in,_mm_set1_epi8('+'));
+		const __m128i slash=_mm_cmpeq_epi8(in,_mm_set1_epi8('/'));
+		const __m128i valid=_mm_or_si128(_mm_or_si128(upper,lower),
+		                                 _mm_or_si128(digit,_mm_or_si128(plus,slash)));
+		if(_mm_movemask_epi8(valid)!=0xFFFF)
+			return false;
+		__m128i shift=_mm_and_si128(upper,_mm_set1_epi8(-65));
+		shift=_mm_or_si128(shift,_mm_and_si128(lower,_mm_set1_epi8(-71)));
+		shift=_mm_or_si128(shift,_mm_and_si128(digit,_mm_set1_epi8(4)));
+		shift=_mm_or_si128(shift,_mm_and_si128(plus,_mm_set1_epi8(19)));
+		shift=_mm_or_si128(shift,_mm_and_si128(slash,_mm_set1_epi8(16)));
+		values=_mm_add_epi8(in,shift);
+		return true;
+	}
+	
+	///Pack groups of four 6-bit values into three bytes, leaving the 12 result
+	///bytes at the start of the vector
+	__attribute__((target("ssse3")))
+	inline __m128i base64PackValues(__m128i values){
+		const __m128i pairs=_mm_maddubs_epi16(values,_mm_set1_epi32(0x01400140));
+		const __m128i groups=_mm_madd_epi16(pairs,_mm_set1_epi32(0x00011000));
+		return _mm_shuffle_epi8(groups,_mm_setr_epi8(2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1));
+	}
+	
+	__attribute__((target("ssse3")))
+	void encodeBase64SSSE3(const unsigned char* in, std::size_t size, char* out){
+		std::size_t i=0;
+		//each step reads 16 bytes but consumes only 12
+		for(; i+16<=size; i+=12, out+=16){
+			__m128i block=_mm_loadu_si128((const __m128i*)(in+i));
+			_mm_storeu_si128((__m128i*)out,base64Translate(base64SplitBytes(block)));
+		}
+		encodeBase64Scalar(in+i,size-i,out);
+	}
+	
+	__attribute__((target("ssse3")))
+	bool decodeBase64SSSE3(const char* in, std::size_t size, char* out){
+		std::size_t i=0;
+		//each step stores 16 bytes but produces only 12, so stop while at 
+		//least 8 more characters (6 more bytes) remain
+		for(; i+24<=size; i+=16, out+=12){
+			__m128i values;
+			if(!base64Values(_mm_loadu_si128((const __m128i*)(in+i)),values))
+				return false;
+			_mm_storeu_si128((__m128i*)out,base64PackValues(values));
+		}
+		return decodeBase64Scalar(in+i,size-i,out);
+	}
+	
+	const Base64Codec ssse3Codec={&encodeBase64SSSE3,&decodeBase64SSSE3};
+	
+	__attribute__((target("avx2")))
+	inline __m256i base64SplitBytes(__m256i in){
+		in=_mm256_shuffle_epi8(in,_mm256_set_epi8(10,11,9,10,7,8,6,7,4,5,3,4,1,2,0,1,
+		                                          10,11,9,10,7,8,6,7,4,5,3,4,1,2,0,1));
+		const __m256i t0=_mm256_and_si256(in,_mm256_set1_epi32(0x0fc0fc00));
+		const __m256i t1=_mm256_mulhi_epu16(t0,_mm256_set1_epi32(0x04000040));
+		const __m256i t2=_mm256_and_si256(in,_mm256_set1_epi32(0x003f03f0));
+		const __m256i t3=_mm256_mullo_epi16(t2,_mm256_set1_epi32(0x01000010));
+		return _mm256_or_si256(t1,t3);
+	}
+	
+	__attribute__((target("avx2")))
+	inline __m256i base64Translate(__m256i values){
+		const __m256i offsets=_mm256_setr_epi8(65,71,-4,-4,-4,-4,-4,-4,-4,-4,-4,-4,-19,-16,0,0,
+		                                       65,71,-4,-4,-4,-4,-4,-4,-4,-4,-4,-4,-19,-16,0,0);
+		__m256i range=_mm256_subs_epu8(values,_mm256_set1_epi8(51));
+		range=_mm256_sub_epi8(range,_mm256_cmpgt_epi8(values,_mm256_set1_epi8(25)));
+		return _mm256_add_epi8(values,_mm256_shuffle_epi8(offsets,range));
+	}
+	
+	__attribute__((target("avx2")))
+	inline bool base64Values(__m256i in, __m256i& values){
+		const __m256i upper=_mm256_and_si256(_mm256_cmpgt_epi8(in,_mm256_set1_epi8('A'-1)),
+		                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z'+1),in));
+		const __m256i lower=_mm256_and_si256(_mm256_cmpgt_epi8(in,_mm256_set1_epi8('a'-1)),
+		                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z'+1),in));
+		const __m256i digit=_mm256_and_si256(_mm256_cmpgt_epi8(in,_mm256_set1_epi8('0'-1)),
+		                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9'+1),in));
+		const __m256i plus=_mm256_cmpeq_epi8(in,_mm256_set1_epi8('+'));
+		const __m256i slash=_mm256_cmpeq_epi8(in,_mm256_set1_epi8('/'));
+		const __m256i valid=_mm256_or_si256(_mm256_or_si256(upper,lower),
+		                                    _mm256_or_si256(digit,_mm256_or_si256(plus,slash)));
+		if(_mm256_movemask_epi8(valid)!=-1)
+			return false;
+		__m256i shift=_mm256_and_si256(upper,_mm256_set1_epi8(-65));
+		shift=_mm256_or_si256(shift,_mm256_and_si256(lower,_mm256_set1_epi8(-71)));
+		shift=_mm256_or_si256(shift,_mm256_and_si256(digit,_mm256_set1_epi8(4)));
+		shift=_mm256_or_si256(shift,_mm256_and_si256(plus,_mm256_set1_epi8(19)));
+		shift=_mm256_or_si256(shift,_mm256_and_si256(slash,_mm256_set1_epi8(16)));
+		values=_mm256_add_epi8(in,shift);
+		return true;
+	}
+	
+	///Pack groups of four 6-bit values into three bytes, leaving the 24 result
+	///bytes at the start of the vector
+	__attribute__((target("avx2")))
+	inline __m256i base64PackValues(__m256i values){
+		const __m256i pairs=_mm256_maddubs_epi16(values,_mm256_set1_epi32(0x01400140));
+		const __m256i groups=_mm256_madd_epi16(pairs,_mm256_set1_epi32(0x00011000));
+		const __m256i packed=_mm256_shuffle_epi8(groups,_mm256_setr_epi8(
+			2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1,
+			2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1));
+		//the shuffle works within each 128 bit half, so join the two halves
+		return _mm256_permutevar8x32_epi32(packed,_mm256_setr_epi32(0,1,2,4,5,6,7,7));
+	}
+	
+	__attribute__((target("avx2")))
+	void encodeBase64AVX2(const unsigned char* in, std::size_t size, char* out){
+		std::size_t i=0;
+		//each step reads 28 bytes, as two overlapping halves, but consumes 24
+		for(; i+28<=size; i+=24, out+=32){
+			__m256i block=_mm256_inserti128_si256(
+				_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in+i))),
+				_mm_loadu_si128((const __m128i*)(in+i+12)),1);
+			_mm256_storeu_si256((__m256i*)out,base64Translate(base64SplitBytes(block)));
+		}
+		encodeBase64SSSE3(in+i,size-i,out);
+	}
+	
+	__attribute__((target("avx2")))
+	bool decodeBase64AVX2(const char* in, std::size_t size, char* out){
+		std::size_t i=0;
+		//each step stores 32 bytes but produces only 24, so stop while at 
+		//least 12 more characters (9 more bytes) remain
+		for(; i+44<=size; i+=32, out+=24){
+			__m256i values;
+			if(!base64Values(_mm256_loadu_si256((const __m256i*)(in+i)),values))
+				return false;
+			_mm256_storeu_si256((__m256i*)out,base64PackValues(values));
+		}
+		return decodeBase64SSSE3(in+i,size-i,out);
+	}
+	
+	const Base64Codec avx2Codec={&encodeBase64AVX2,&decodeBase64AVX2};
+#endif //SLATE_BASE64_X86
+	
+	const Base64Codec& codecFor(internal::Base64Implementation impl){
+		switch(impl){
+#ifdef SLATE_BASE64_X86
+			case internal::Base64Implementation::SSSE3: return ssse3Codec;
+			case internal::Base64Implementation::AVX2: return avx2Codec;
+#endif
+			default: return scalarCodec;
+		}
+	}
+	
+	///The codec used by all base64 functions, initially the fastest which the
+	///processor supports
+	std::atomic<const Base64Codec*>& activeBase64Codec(){
+		static std::atomic<const Base64Codec*> codec([]{
+			using internal::Base64Implementation;
+			for(auto impl : {Base64Implementation::AVX2,Base64Implementation::SSSE3}){
+				if(internal::base64ImplementationSupported(impl))
+					return &codecFor(impl);
+			}
+			return &scalarCodec;
+		}());
+		return codec;
+	}
+	
+	///Report the first character of some data which is not part of the base64
+	///alphabet
+	[[noreturn]] void throwIllegalBase64(const char* data, std::size_t size){
+		const char* bad=std::find_if(data,data+size,[](char c){ 
+			return base64DecodeTable.values[(unsigned char)c]<0;
+		});
+		throw std::runtime_error("Illegal base64 character: '"+std::string(1,bad!=data+size ? *bad : '?')+"'");
+	}
+}
+
+namespace internal{
+bool base64ImplementationSupported(Base64Implementation impl){
+	switch(impl){
+		case Base64Implementation::Scalar:
+			return true;
+#ifdef SLATE_BASE64_X86
+		case Base64Implementation::SSSE3:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("ssse3");
+		case Base64Implementation::AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+void setBase64Implementation(Base64Implementation impl){
+	if(!base64ImplementationSupported(impl))
+		throw std::runtime_error("Base64 implementation not supported by this processor");
+	activeBase64Codec().store(&codecFor(impl));
+}
 }
 
 bool sanityCheckBase64(const std::string& str){
@@ -39,89 +354,36 @@ bool sanityCheckBase64(const std::string& str){
 	return pos==std::string::npos;
 }
 
-std::string decodeBase64(const std::string& coded){
-	//table used by boost::archive::iterators::detail::to_6_bit
-	static const signed char lookupTable[] = {
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63,
-		52,53,54,55,56,57,58,59,60,61,-1,-1,-1, 0,-1,-1,
-		-1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,
-		15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1,
-		-1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,
-		41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1
-	};
+bool decodeBase64(const std::string& coded, std::string& decoded){
 	std::size_t codedSize=coded.size();
 	while(codedSize && coded[codedSize-1]=='=')
 		codedSize--;
-	std:size_t outLen=(codedSize*3)/4;
-	std::string decoded(outLen,'\0');
-	char* outData=&decoded.front();
-	unsigned char curBits=0;
-	for(const unsigned char next : coded){
-		if(next=='=')
-			break;
-		if(next>=128 || lookupTable[next]==-1)
-			throw std::runtime_error("Illegal base64 character: '"+std::string(1,next)+"'");
-		unsigned char newBits=lookupTable[next];
-		unsigned char putBits=0;
-		//shove as many bits into the current byte as will fit
-		{
-			putBits=std::min(CHAR_BIT-curBits,6);
-			unsigned int mask=(((1u<<putBits)-1)<<(6-putBits));
-			*outData|=((newBits&mask)>>(6-putBits))<<(CHAR_BIT-curBits-putBits);
-			curBits+=putBits;
-		}
-		if(curBits==CHAR_BIT){ //if the byte is full, advance to the next
-			curBits=0;
-			outData++;
-			//if more bits need to be written put them in now
-			if(putBits<6){
-				putBits=6-putBits;
-				unsigned int mask=(1u<<putBits)-1;
-				*outData|=(newBits&mask)<<(CHAR_BIT-putBits);
-				curBits=putBits;
-			}
-		}
+	decoded.resize((codedSize*3)/4);
+	if(codedSize && !activeBase64Codec().load()->decode(coded.data(),codedSize,&decoded[0])){
+		decoded.clear();
+		return false;
 	}
+	return true;
+}
+
+std::string decodeBase64(const std::string& coded){
+	std::string decoded;
+	if(!decodeBase64(coded,decoded))
+		throwIllegalBase64(coded.data(),coded.size());
 	return decoded;
 }
 
 std::string encodeBase64(const std::string& raw){
-	std::size_t pad=(3-raw.size()%3)%3;
-	std:size_t outLen=4*std::ceil(raw.size()/3.);
-	std::string encoded(outLen,'\0');
-	unsigned char availBits=CHAR_BIT;
-	size_t inputIdx=0;
-	for(size_t i=0; i<outLen-pad; i++){
-		unsigned char getBits=0;
-		unsigned char lutIdx=0;
-		//grab as many bits as possible from the current byte
-		{
-			getBits=std::min((unsigned char)6,availBits);
-			unsigned int mask=((1u<<getBits)-1)<<(availBits-getBits);
-			lutIdx|=((raw[inputIdx]&mask)>>(availBits-getBits))<<(6-getBits);
-			availBits-=getBits;
-		}
-		if(availBits==0){ //if that byte is exhausted, advance to the next
-			inputIdx++;
-			availBits=CHAR_BIT;
-			//if more bits are needed get them now
-			if(getBits<6){
-				getBits=6-getBits;
-				unsigned int mask=((1u<<getBits)-1)<<(availBits-getBits);
-				lutIdx|=((raw[inputIdx]&mask)>>(availBits-getBits));
-				availBits-=getBits;
-			}
-		}
-		encoded[i]=base64lookupTable[lutIdx];
-	}
-	for(size_t i=0; i<pad; i++)
-		encoded[outLen-pad+i]='=';
+	std::string encoded(4*((raw.size()+2)/3),'\0');
+	if(!raw.empty())
+		activeBase64Codec().load()->encode((const unsigned char*)raw.data(),raw.size(),&encoded[0]);
 	return encoded;
 }
 
-void gzipDecompress(std::istream& src, std::ostream& dest){
+namespace{
+///Read and check the header of a gzip stream, leaving the source positioned at
+///the start of the compressed data
+void readGzipHeader(std::istream& src){
 	//https://tools.ietf.org/html/rfc1952 section 2.2
 	unsigned char id[2];
 	src.read((char*)id,2);
@@ -165,14 +427,14 @@ void gzipDecompress(std::istream& src, std::ostream& dest){
 		if(src.eof() || src.fail())
 			throw std::runtime_error("Invalid gzip header");
 		xlen=((uint16_t)xlenRaw[0]) | ((uint16_t)xlenRaw[1]<<8);
-		src.seekg(src.tellg()+(std::streamoff)xlen);
+		src.ignore(xlen);
 	}
 	
 	if(flg&fnameMask){ //if the original filename is included, skip over it
 		char dummy;
 		do{
 			src.get(dummy);
-		}while(dummy);
+		}while(dummy && src);
 		if(src.eof() || src.fail())
 			throw std::runtime_error("Invalid gzip header");
 	}
@@ -181,7 +443,7 @@ void gzipDecompress(std::istream& src, std::ostream& dest){
 		char dummy;
 		do{
 			src.get(dummy);
-		}while(dummy);
+		}while(dummy && src);
 		if(src.eof() || src.fail())
 			throw std::runtime_error("Invalid gzip header");
 	}
@@ -193,6 +455,11 @@ void gzipDecompress(std::istream& src, std::ostream& dest){
 			throw std::runtime_error("Invalid gzip header");
 		//could check checksum here; not implemented
 	}
+}
+}
+
+void gzipDecompress(std::istream& src, std::ostream& dest){
+	readGzipHeader(src);
 	
 	const std::streamsize readBlockSize=1024;
 	//We expect the data to decompress, so we allocate the
@@ -341,6 +608,97 @@ void gzipCompress(std::istream& src, std::ostream& dest){
 	dest.write((const char*)&totalSize,sizeof(totalSize));
 }
 
+Base64DecodingBuffer::Base64DecodingBuffer(const char* data, std::size_t size):
+next(data),end(data+size){
+	//padding may only appear at the end
+	while(end!=next && *(end-1)=='=')
+		end--;
+	setg(buffer,buffer,buffer);
+}
+
+Base64DecodingBuffer::int_type Base64DecodingBuffer::underflow(){
+	if(gptr()<egptr())
+		return traits_type::to_int_type(*gptr());
+	if(next==end)
+		return traits_type::eof();
+	//decode whole groups of four characters, which produce three bytes each, 
+	//until the buffer is full or the data ends
+	const std::size_t length=std::min<std::size_t>(end-next,(bufferSize/3)*4);
+	if(length%4==1)
+		throw std::runtime_error("Truncated base64 data");
+	if(!activeBase64Codec().load()->decode(next,length,buffer))
+		throwIllegalBase64(next,length);
+	next+=length;
+	setg(buffer,buffer,buffer+(length*3)/4);
+	return traits_type::to_int_type(*gptr());
+}
+
+struct GzipDecompressingBuffer::State{
+	const static std::size_t inSize=64*1024, outSize=256*1024;
+	z_stream zs;
+	char in[inSize];
+	char out[outSize];
+};
+
+GzipDecompressingBuffer::GzipDecompressingBuffer(std::istream& src, std::size_t limit):
+state(new State),src(src),limit(limit),totalOut(0),ended(false){
+	readGzipHeader(src);
+	z_stream& zs=state->zs;
+	zs.next_in=Z_NULL;
+	zs.avail_in=0;
+	zs.zalloc=Z_NULL;
+	zs.zfree=Z_NULL;
+	zs.opaque=Z_NULL;
+	//negative window bits indicate that the zlib header is absent
+	if(inflateInit2(&zs,-15)!=Z_OK)
+		throw std::runtime_error("Failed to initialize zlib decompression");
+	setg(state->out,state->out,state->out);
+}
+
+GzipDecompressingBuffer::~GzipDecompressingBuffer(){
+	inflateEnd(&state->zs);
+}
+
+GzipDecompressingBuffer::int_type GzipDecompressingBuffer::underflow(){
+	if(gptr()<egptr())
+		return traits_type::to_int_type(*gptr());
+	if(ended)
+		return traits_type::eof();
+	z_stream& zs=state->zs;
+	zs.next_out=(unsigned char*)state->out;
+	zs.avail_out=State::outSize;
+	//inflate until some output is produced, or the stream ends
+	while(zs.avail_out==State::outSize){
+		if(!zs.avail_in){
+			src.read(state->in,State::inSize);
+			zs.next_in=(unsigned char*)state->in;
+			zs.avail_in=src.gcount();
+			if(!zs.avail_in)
+				throw std::runtime_error("Unexpected end of compressed stream");
+		}
+		int result=inflate(&zs,Z_NO_FLUSH);
+		if(result<Z_OK || result==Z_NEED_DICT){
+			std::ostringstream ss;
+			ss << "Zlib decompression error: " << result;
+			if(zs.msg!=Z_NULL)
+				ss << " (" << zs.msg << ')';
+			throw std::runtime_error(ss.str());
+		}
+		if(result==Z_STREAM_END){
+			ended=true;
+			break;
+		}
+	}
+	const std::size_t produced=State::outSize-zs.avail_out;
+	totalOut+=produced;
+	if(limit && totalOut>limit)
+		throw std::length_error("Decompressed data exceeds the limit of "+std::to_string(limit)+" bytes");
+	setg(state->out,state->out,state->out+produced);
+	if(!produced)
+		return traits_type::eof();
+	return traits_type::to_int_type(*gptr());
+}
+
 struct header_posix_ustar {
 	enum typeCode{
 		RegularFile = 0,
@@ -645,25 +1003,22 @@ bool TarReader::eof() const{
 	return(fileEnded);
 }
 
-std::string TarReader::readFiles(const std::string& target){
+bool TarReader::readHeader(EntryHeader& entry){
 	header_posix_ustar h;
-	long long size;
 	unsigned short nEmpty=0;
-	std::string name;
 	while(true){
-		name="";
 		src.read((char*)&h,sizeof(h));
 		
 		if(src.eof() || src.fail()){
 			fileEnded=true;
-			break;
+			return false;
 		}
 		
 		if(h.isEmpty()){
 			nEmpty++;
 			if(nEmpty==2){
 				fileEnded=true;
-				break;
+				return false;
 			}
 			else
 				continue;
@@ -682,30 +1037,44 @@ std::string TarReader::readFiles(const std::string& target){
 		};
 		if(!properlyTerminated(h.size,12))
 			throw std::runtime_error("Improperly terminated file size field in UStar header");
-		sscanf(h.size,"%llo",&size);
-		if(size>0x1FFFFFFFF)
+		sscanf(h.size,"%llo",&entry.size);
+		if(entry.size>0x1FFFFFFFF)
 			throw std::runtime_error("Overlarge file size in UStar header");
 		if(!properlyTerminated(h.mode,8))
 			throw std::runtime_error("Improperly terminated file size field in UStar header");
-		int mode;
-		sscanf(h.mode,"%o",&mode);
-		
-		FileRecord::fileType type = typeForTarTypeFlag(*h.typeflag);
-		name=h.getName();
+		sscanf(h.mode,"%o",&entry.mode);
 		
-		if(type==FileRecord::REGULAR_FILE)
-			files.insert(std::make_pair(name,FileRecord(type,size,src,mode)));
-		else if(type == FileRecord::SYMBOLIC_LINK)
-			files.insert(std::make_pair(name,FileRecord(type,h.linkname,mode)));
+		entry.type = typeForTarTypeFlag(*h.typeflag);
+		entry.name=h.getName();
+		entry.linkName.clear();
+		if(entry.type==FileRecord::SYMBOLIC_LINK)
+			entry.linkName=std::string(h.linkname,strnlen(h.linkname,sizeof(h.linkname)));
+		return true;
+	}
+}
+
+void TarReader::skipPadding(long long size){
+	if(size%512)
+		src.ignore(512-(size%512));
+}
+
+std::string TarReader::readFiles(const std::string& target){
+	EntryHeader entry;
+	std::string name;
+	while(readHeader(entry)){
+		name=entry.name;
+		if(entry.type==FileRecord::REGULAR_FILE)
+			files.insert(std::make_pair(name,FileRecord(entry.type,entry.size,src,entry.mode)));
+		else if(entry.type == FileRecord::SYMBOLIC_LINK)
+			files.insert(std::make_pair(name,FileRecord(entry.type,entry.linkName,entry.mode)));
 		else
-			files.insert(std::make_pair(name,FileRecord(type,mode)));
+			files.insert(std::make_pair(name,FileRecord(entry.type,entry.mode)));
 		
-		if(size%512)
-			src.ignore(512-(size%512));
+		skipPadding(entry.size);
 		if(name==target || target=="")
-			break;
+			return(name);
 	}
-	return(name);
+	return("");
 }
 
 ///A version of realpath(3) which can process paths which may not currently exist. 
@@ -863,10 +1232,13 @@ void TarReader::extractToFileSystem(const std::string& prefix, bool dropAfterExt
 		return std::string(rawPrefix.get());
 	}();
 	
+	EntryHeader entry;
+	std::unique_ptr<char[]> copyBuffer;
+	const std::size_t copyBufferSize=64*1024;
 	while(!eof()){
-		std::string baseFileName=readFiles("");
-		if(baseFileName.empty())
+		if(!readHeader(entry))
 			break;
+		const std::string& baseFileName=entry.name;
 		std::string filePath=baseFileName;
 		if(!truePrefix.empty())
 			filePath=truePrefix+"/"+filePath;
@@ -880,22 +1252,31 @@ void TarReader::extractToFileSystem(const std::string& prefix, bool dropAfterExt
 		if(filePath.find(truePrefix)!=0)
 			throw std::runtime_error("Refusing to extract "+baseFileName+" to "+filePath+" which is not within "+truePrefix);
 		
-		const FileRecord& file=files[baseFileName];
 		//TODO: set permissions on extracted files
-		switch(file.getType()){
+		switch(entry.type){
 			case FileRecord::REGULAR_FILE:
 			{
-				std::ofstream outfile(filePath);
+				std::ofstream outfile(filePath,std::ios::binary);
 				if(!outfile)
 					throw std::runtime_error("Unable to open "+filePath+" for writing");
-				std::ostreambuf_iterator<char> out_it (outfile);
-				const std::string& fileData=file.getData();
-				std::copy(fileData.begin(), fileData.end(), out_it);
+				if(!copyBuffer)
+					copyBuffer.reset(new char[copyBufferSize]);
+				long long remaining=entry.size;
+				while(remaining>0){
+					std::streamsize amount=std::min((long long)copyBufferSize,remaining);
+					src.read(copyBuffer.get(),amount);
+					if(src.gcount()!=amount)
+						throw std::runtime_error("Archive ended in the middle of "+baseFileName);
+					outfile.write(copyBuffer.get(),amount);
+					if(!outfile)
+						throw std::runtime_error("Failed while writing to "+filePath);
+					remaining-=amount;
+				}
 				break;
 			}
 			case FileRecord::SYMBOLIC_LINK:
 			{
-				std::string linkPath=realpathHyp(file.getData());
+				std::string linkPath=realpathHyp(entry.linkName);
 				if(linkPath.find(truePrefix)!=0)
 					throw std::runtime_error("Refusing to extract symlink pointing to "+linkPath+" which is not within "+truePrefix);
 				int err=symlink(linkPath.c_str(),filePath.c_str());
@@ -911,10 +1292,11 @@ void TarReader::extractToFileSystem(const std::string& prefix, bool dropAfterExt
 				break;
 			}
 			default:
-				throw std::runtime_error("Extraction not implemented for file type "+std::to_string(file.getType()));
+				throw std::runtime_error("Extraction not implemented for file type "+std::to_string(entry.type));
 		}
-		if(dropAfterExtracting)
-			dropFile(baseFileName);
+		if(entry.type!=FileRecord::REGULAR_FILE)
+			src.ignore(entry.size);
+		skipPadding(entry.size);
 	}
 }
 
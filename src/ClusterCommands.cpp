@@ -15,10 +15,12 @@
 #include "yaml-cpp/node/detail/impl.h"
 #include <yaml-cpp/node/parse.h>
 
+#include "KubeAPIClient.h"
 #include "KubeInterface.h"
 #include "Logging.h"
 #include "ServerUtilities.h"
 #include "ApplicationInstanceCommands.h"
+#include "OperationCommands.h"
 #include "SecretCommands.h"
 #include "VolumeClaimCommands.h"
 
@@ -37,12 +39,23 @@ crow::response listClusters(PersistentStore& store, const crow::request& req){
 	else
 		clusters=store.listClusters();
 
+	//look up the clusters' owning groups and locations together, rather than 
+	//one at a time
+	std::vector<std::string> groupIDs, clusterIDs;
+	for(const Cluster& cluster : clusters){
+		groupIDs.push_back(cluster.owningGroup);
+		clusterIDs.push_back(cluster.id);
+	}
+	const auto groups=store.getGroups(groupIDs);
+	const auto allLocations=store.getLocationsForClusters(clusterIDs);
+
 	rapidjson::Document result(rapidjson::kObjectType);
 	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
 	
 	result.AddMember("apiVersion", "v1alpha3", alloc);
 	rapidjson::Value resultItems(rapidjson::kArrayType);
 	resultItems.Reserve(clusters.size(), alloc);
+	const std::vector<GeoLocation> noLocations;
 	for(const Cluster& cluster : clusters){
 		rapidjson::Value clusterResult(rapidjson::kObjectType);
 		clusterResult.AddMember("apiVersion", "v1alpha3", alloc);
@@ -50,9 +63,11 @@ crow::response listClusters(PersistentStore& store, const crow::request& req){
 		rapidjson::Value clusterData(rapidjson::kObjectType);
 		clusterData.AddMember("id", cluster.id, alloc);
 		clusterData.AddMember("name", cluster.name, alloc);
-		clusterData.AddMember("owningGroup", store.findGroupByID(cluster.owningGroup).name, alloc);
+		auto group=groups.find(cluster.owningGroup);
+		clusterData.AddMember("owningGroup", group!=groups.end() ? group->second.name : std::string(), alloc);
 		clusterData.AddMember("owningOrganization", cluster.owningOrganization, alloc);
-		std::vector<GeoLocation> locations=store.getLocationsForCluster(cluster.id);
+		auto found=allLocations.find(cluster.id);
+		const std::vector<GeoLocation>& locations=(found!=allLocations.end() ? found->second : noLocations);
 		rapidjson::Value clusterLocation(rapidjson::kArrayType);
 		clusterLocation.Reserve(locations.size(), alloc);
 		for(const auto& location : locations){
@@ -451,9 +466,7 @@ namespace internal{
 	std::vector<StorageClass> getClusterStorageClasses(PersistentStore& store, const Cluster& cluster){
 		std::vector<StorageClass> storageClasses;
 		
-		auto configPath=store.configPathForCluster(cluster.id);
-
-		auto classInfoRaw=kubernetes::kubectl(*configPath,{"get","storageclasses","-o=json"});
+		auto classInfoRaw=store.getClusterObjects(cluster.id,"storageclasses");
 		if(classInfoRaw.status!=0){
 			log_error("Error from kubectl get storageclasses -o=json: " << classInfoRaw.error);
 			return storageClasses;
@@ -498,6 +511,21 @@ namespace internal{
 		return storageClasses;
 	}
 	
+	///Find the address of a cluster's API server from its kubeconfig
+	///\return the address, or an empty string if it could not be determined
+	std::string getClusterMasterAddress(const Cluster& cluster){
+		try{
+			YAML::Node config=YAML::Load(cluster.config);
+			YAML::Node clusters=config["clusters"];
+			if(clusters && clusters.IsSequence() && clusters.size()>0 
+			   && clusters[0]["cluster"] && clusters[0]["cluster"]["server"])
+				return clusters[0]["cluster"]["server"].as<std::string>();
+		}catch(YAML::Exception& ex){
+			log_error("Failed to parse kubeconfig for " << cluster << ": " << ex.what());
+		}
+		return "";
+	}
+	
 	struct PriorityClass{
 		std::string name;
 		std::string description;
@@ -510,9 +538,7 @@ namespace internal{
 	std::vector<PriorityClass> getClusterPriorityClasses(PersistentStore& store, const Cluster& cluster){
 		std::vector<PriorityClass> priorityClasses;
 		
-		auto configPath=store.configPathForCluster(cluster.id);
-
-		auto classInfoRaw=kubernetes::kubectl(*configPath,{"get","priorityclasses","-o=json"});
+		auto classInfoRaw=store.getClusterObjects(cluster.id,"priorityclasses");
 		if(classInfoRaw.status!=0){
 			log_error("Error from kubectl get priorityclasses -o=json: " << classInfoRaw.error);
 			return priorityClasses;
@@ -577,10 +603,7 @@ crow::response getClusterInfo(PersistentStore& store, const crow::request& req,
 	clusterData.AddMember("owningGroup", store.findGroupByID(cluster.owningGroup).name, alloc);
 	clusterData.AddMember("owningOrganization", cluster.owningOrganization, alloc);
 	// Attempt to find master node address (API server address-- typically the same)
-	auto configPath=store.configPathForCluster(cluster.id);
-	std::vector<std::string> serverArgs = {"config","view","-o=jsonpath={.clusters[0].cluster.server}"};
-	auto server_info = kubernetes::kubectl(*configPath, serverArgs);
-	clusterData.AddMember("masterAddress", rapidjson::StringRef(server_info.output), alloc);
+	clusterData.AddMember("masterAddress", internal::getClusterMasterAddress(cluster), alloc);
 
 	std::vector<GeoLocation> locations=store.getLocationsForCluster(cluster.id);
 	rapidjson::Value clusterLocation(rapidjson::kArrayType);
@@ -627,7 +650,7 @@ crow::response getClusterInfo(PersistentStore& store, const crow::request& req,
 	// Collect all node info if requested
 	if (all_nodes) {
 		rapidjson::Value nodeInfo(rapidjson::kArrayType);
-		auto node_info = kubernetes::kubectl(*configPath, {"get", "nodes", "-o", "json"});
+		auto node_info = store.getClusterObjects(cluster.id, "nodes");
 		rapidjson::Document cmdOutput;
 		cmdOutput.Parse(node_info.output);
 		if(cmdOutput.HasMember("items")) {
@@ -715,13 +738,30 @@ crow::response deleteCluster(PersistentStore& store, const crow::request& req,
 			return crow::response(403,generateError("Not authorized"));
 	}
 	 //TODO: other restrictions on cluster deletions?
+	
+	if(asyncRequested(req)){
+		rapidjson::Document parameters(rapidjson::kObjectType);
+		parameters.AddMember("force", force, parameters.GetAllocator());
+		auto operation=store.getOperationScheduler().start("deleteCluster",cluster.id,user.id,to_string(parameters));
+		if(!operation)
+			return crow::response(500,generateError("Failed to schedule cluster deletion"));
+		return operationAccepted(operation);
+	}
 
+	auto err=internal::deleteClusterAndNotifyGroups(store,cluster,force);
+	if(!err.empty())
+		return crow::response(500,generateError(err));
+	return(crow::response(200));
+}
+
+namespace internal{
+std::string deleteClusterAndNotifyGroups(PersistentStore& store, const Cluster& cluster, bool force){
 	// Fetch VOs that have access to the cluster in order to later notify them
-	const std::vector<std::string> vos = store.listGroupsAllowedOnCluster(clusterID, false);
+	const std::vector<std::string> vos = store.listGroupsAllowedOnCluster(cluster.id, false);
 
-	auto err=internal::deleteCluster(store,cluster,force);
+	auto err=deleteCluster(store,cluster,force);
 	if(!err.empty())
-		return crow::response(500,generateError(err));
+		return err;
 
 	// Send an email to VOs that have access to the cluster that the cluster has been deleted
 	std::vector<std::string> contacts;
@@ -735,7 +775,8 @@ crow::response deleteCluster(PersistentStore& store, const crow::request& req,
 	message.body="A cluster your organization has access to ("+
 				cluster.name+") has been deleted by the cluster administrator.";
 	store.getEmailClient().sendEmail(message);
-	return(crow::response(200));
+	return "";
+}
 }
 
 namespace internal{
@@ -766,38 +807,36 @@ std::string deleteCluster(PersistentStore& store, const Cluster& cluster, bool f
 		}
 	}
 	
-	std::vector<std::future<std::string>> secretDeletions;	
-	std::vector<std::future<std::string>> volumeDeletions;
-	std::vector<std::future<void>> namespaceDeletions;
-
+	//Deleting a cluster is background work which should not delay other users' 
+	//requests, and all of its commands target the same cluster
+	Executor::TaskGroup deletions(store.getCommandExecutor(),0,Executor::Priority::Bulk);
 	
 	// Delete any remaining secrets present on the cluster
 	auto secrets=store.listSecrets("",cluster.id);
-	for (const Secret& secret : secrets){
-		//std::string result=internal::deleteSecret(store,secret,/*force*/true);
-		//if(!force && !result.empty())
-		//	return "Failed to delete cluster due to failure deleting secret: "+result;
-		secretDeletions.emplace_back(std::async(std::launch::async,[&store,secret](){ return internal::deleteSecret(store,secret,/*force*/true); }));
+	std::vector<std::string> secretResults(secrets.size());
+	for(std::size_t i=0; i<secrets.size(); i++){
+		deletions.submit(cluster.id,[&store,&secrets,&secretResults,i](){
+			secretResults[i]=internal::deleteSecret(store,secrets[i],/*force*/true);
+		});
 	}
 
 	// Delete any remaining volumes present on the cluster
 	auto volumes=store.listPersistentVolumeClaimsByClusterOrGroup("",cluster.id);
-	for (const PersistentVolumeClaim& volume : volumes){
-		volumeDeletions.emplace_back(std::async(std::launch::async,[&store,volume]() { return internal::deleteVolumeClaim(store, volume, true); }));
+	std::vector<std::string> volumeResults(volumes.size());
+	for(std::size_t i=0; i<volumes.size(); i++){
+		deletions.submit(cluster.id,[&store,&volumes,&volumeResults,i](){
+			volumeResults[i]=internal::deleteVolumeClaim(store,volumes[i],true);
+		});
 	}
 
-	// Ensure volume deletions are complete before deleting namespaces
-	log_info("Deleting volumes on cluster " << cluster.id);
-	for(auto& item : volumeDeletions){
-		auto result=item.get();
+	// Ensure volume and secret deletions are complete before deleting namespaces
+	log_info("Deleting volumes and secrets on cluster " << cluster.id);
+	deletions.wait();
+	for(const auto& result : volumeResults){
 		if(!force && !result.empty())
 			return "Failed to delete cluster due to failue deleting volume: "+result;
 	}
-	
-	// Ensure secret deletions are complete before deleting namespaces
-	log_info("Deleting secrets on cluster " << cluster.id);
-	for(auto& item : secretDeletions){
-		auto result=item.get();
+	for(const auto& result : secretResults){
 		if(!force && !result.empty())
 			return "Failed to delete cluster due to failure deleting secret: "+result;
 	}
@@ -806,7 +845,7 @@ std::string deleteCluster(PersistentStore& store, const Cluster& cluster, bool f
 	log_info("Deleting namespaces on cluster " << cluster.id);
 	auto vos = store.listGroups();
 	for (const Group& group : vos){
-		namespaceDeletions.emplace_back(std::async(std::launch::async,[&cluster,&configPath,group](){
+		deletions.submit(cluster.id,[&cluster,&configPath,group](){
 			//Delete the Group's namespace on the cluster, if it exists
 			try{
 				kubernetes::kubectl_delete_namespace(*configPath,group);
@@ -814,10 +853,9 @@ std::string deleteCluster(PersistentStore& store, const Cluster& cluster, bool f
 				log_error("Failed to delete namespace " << group.namespaceName() 
 						  << " from " << cluster << ": " << ex.what());
 			}
-		}));
+		});
 	}
-	for(auto& item : namespaceDeletions)
-		item.wait();
+	deletions.wait();
 	
 	// Delete our DNS record for the cluster
 	auto dnsName="*."+store.dnsNameForCluster(cluster);
@@ -1405,6 +1443,80 @@ bool pingCluster(PersistentStore& store, const Cluster& cluster){
 	}
 }
 
+std::set<std::string> listClusterSecrets(Executor& executor, const std::string& clusterID,
+                                         const std::string& configPath){
+	std::set<std::string> secretNames;
+	//start by learning which namespaces we can see, in which we should search for secrets
+	auto namespaceInfo=kubernetes::kubectl(configPath,{"get","clusternamespaces","-o=jsonpath={.items[*].metadata.name}"});
+	std::set<std::string> namespaceNames;
+	for(const auto& namespaceName : string_split_columns(namespaceInfo.output,' ',false)){
+		if(namespaceName.find(Group::namespacePrefix())!=0){
+			log_error("Found peculiar namespace: " << namespaceName);
+			continue;
+		}
+		namespaceNames.insert(namespaceName);
+	}
+	if(namespaceNames.empty())
+		return secretNames;
+	
+	auto addSecret=[&](const std::string& namespaceName, const std::string& secretName){
+		if(secretName.find("default-token-")==0)
+			return; //ignore kubernetes infrastructure
+		secretNames.insert(namespaceName.substr(Group::namespacePrefix().size())+":"+secretName);
+	};
+	
+	//If we are allowed to, list the secrets in all namespaces at once
+	auto allSecretsInfo=kubernetes::kubectl(configPath,{"get","secrets","--all-namespaces",
+		"-o=jsonpath={range .items[*]}{.metadata.namespace}{\" \"}{.metadata.name}{\"\\n\"}{end}"});
+	if(allSecretsInfo.status==0){
+		for(const auto& line : string_split_lines(allSecretsInfo.output)){
+			auto items=string_split_columns(line,' ',false);
+			if(items.size()!=2 || !namespaceNames.count(items[0]))
+				continue;
+			addSecret(items[0],items[1]);
+		}
+		return secretNames;
+	}
+	
+	//Otherwise, list the secrets in each namespace, several at a time
+	std::vector<std::string> namespaceList(namespaceNames.begin(),namespaceNames.end());
+	std::vector<std::string> outputs(namespaceList.size());
+	Executor::TaskGroup listings(executor);
+	for(std::size_t i=0; i<namespaceList.size(); i++){
+		listings.submit(clusterID,[&configPath,&namespaceList,&outputs,i](){
+			try{
+				outputs[i]=kubernetes::kubectl(configPath,{"get","secrets","-n",namespaceList[i],
+				                                           "-o=jsonpath={.items[*].metadata.name}"}).output;
+			}catch(std::exception& ex){
+				log_error("Failed to list secrets in " << namespaceList[i] << ": " << ex.what());
+			}
+		});
+	}
+	listings.wait();
+	for(std::size_t i=0; i<namespaceList.size(); i++){
+		for(const auto& secretName : string_split_columns(outputs[i],' ',false))
+			addSecret(namespaceList[i],secretName);
+	}
+	return secretNames;
+}
+
+bool checkClusterReachability(PersistentStore& store, const Cluster& cluster, bool fresh){
+	if(!fresh){
+		CacheRecord<bool> cacheResult=store.getCachedClusterReachability(cluster.id);
+		if(cacheResult)
+			return cacheResult.record;
+	}
+	//if the background prober is running, let it record the result
+	if(ClusterProber* prober=store.getClusterProber())
+		return prober->probe(cluster);
+	//Otherwise, nothing else will refresh this result, so it must not be
+	//trusted for as long as other cluster data
+	bool reachable=pingCluster(store, cluster);
+	store.cacheClusterReachability(cluster.id, reachable, 
+	                               std::chrono::seconds(ClusterProber::defaultInterval));
+	return reachable;
+}
+
 }
 
 ClusterConsistencyResult::ClusterConsistencyResult(PersistentStore& store, const Cluster& cluster){
@@ -1413,7 +1525,7 @@ ClusterConsistencyResult::ClusterConsistencyResult(PersistentStore& store, const
 	status=ClusterConsistencyState::Consistent;
 	
 	//check that the cluster can be reached
-	if(!internal::pingCluster(store, cluster)){
+	if(!internal::checkClusterReachability(store, cluster, false)){
 		status=ClusterConsistencyState::Unreachable;
 		return;
 	}
@@ -1464,29 +1576,18 @@ ClusterConsistencyResult::ClusterConsistencyResult(PersistentStore& store, const
 		status=ClusterConsistencyState::Inconsistent;
 	
 	//figure out what secrets currently exist
-	//start by learning which namespaces we can see, in which we should search for secrets
-	auto namespaceInfo=kubernetes::kubectl(*configPath,{"get","clusternamespaces","-o=jsonpath={.items[*].metadata.name}"});
-	std::vector<std::string> namespaceNames=string_split_columns(namespaceInfo.output,' ',false);
-	//iterate over namespaces, listing secrets
-	for(const auto& namespaceName : namespaceNames){
-		if(namespaceName.find(Group::namespacePrefix())!=0){
-			log_error("Found peculiar namespace: " << namespaceName);
-			continue;
-		}
-		std::string groupName=namespaceName.substr(Group::namespacePrefix().size());
-		auto secretsInfo=kubernetes::kubectl(*configPath,{"get","secrets","-n",namespaceName,"-o=jsonpath={.items[*].metadata.name}"});
-		for(const auto& secretName : string_split_columns(secretsInfo.output,' ',false)){
-			if(secretName.find("default-token-")==0)
-				continue; //ignore kubernetes infrastructure
-			existingSecretNames.insert(groupName+":"+secretName);
-		}
-	}
+	existingSecretNames=internal::listClusterSecrets(store.getCommandExecutor(),cluster.id,*configPath);
 	
 	//figure out what secrets are supposed to exist
 	expectedSecrets=store.listSecrets("", cluster.id);
+	std::vector<std::string> secretGroupIDs;
+	for(const auto& secret : expectedSecrets)
+		secretGroupIDs.push_back(secret.group);
+	const auto secretGroups=store.getGroups(secretGroupIDs);
 	std::set<std::string> expectedSecretNames;
 	for(const auto& secret : expectedSecrets){
-		std::string groupName=store.findGroupByID(secret.group).name;
+		auto group=secretGroups.find(secret.group);
+		std::string groupName=(group!=secretGroups.end() ? group->second.name : std::string());
 		std::string secretName=groupName+":"+secret.name;
 		expectedSecretNames.insert(secretName);
 		expectedSecretsByName.emplace(secretName,secret);
@@ -1573,20 +1674,10 @@ crow::response pingCluster(PersistentStore& store, const crow::request& req,
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 		
-	bool useCache=req.url_params.get("cache");
-	
-	CacheRecord<bool> cacheResult;
-	if(useCache)
-		cacheResult=store.getCachedClusterReachability(cluster.id);
-	
-	bool reachable;
-	if(cacheResult) //if we got a valid result it can only be because we asked for it
-		reachable=cacheResult.record;
-	else{ //if we either didn't use the cache, it was empty, or expired, get a fresh result
-		reachable=internal::pingCluster(store, cluster);
-		//update the cache
-		store.cacheClusterReachability(cluster.id, reachable);
-	}
+	//Results are normally taken from the cache, which the background prober
+	//keeps up to date, unless the client insists on a fresh check
+	bool fresh=req.url_params.get("fresh");
+	bool reachable=internal::checkClusterReachability(store, cluster, fresh);
 	
 	rapidjson::Document result(rapidjson::kObjectType);
 	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
@@ -0,0 +1,141 @@
+#include "ClusterProber.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Logging.h"
+#include "PersistentStore.h"
+
+constexpr std::array<unsigned int,10> ClusterProber::latencyBuckets;
+constexpr std::size_t ClusterProber::latencyBucketCount;
+constexpr unsigned int ClusterProber::defaultInterval;
+
+ClusterProber::ClusterProber(PersistentStore& store, Probe probe,
+                             std::chrono::seconds interval, unsigned int concurrency):
+store(store),
+probeFunction(std::move(probe)),
+interval(interval),
+executor("Cluster probe",concurrency,1),
+tasks(new Executor::TaskGroup(executor,0,Executor::Priority::Bulk)),
+stop(false),
+rng(std::random_device{}()),
+probes(0),failures(0),errors(0),
+totalLatency(0)
+{
+	for(auto& count : latencyCounts)
+		count=0;
+	scheduler=std::thread([this]{ run(); });
+}
+
+ClusterProber::~ClusterProber(){
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stop=true;
+	}
+	wake.notify_all();
+	scheduler.join();
+	tasks.reset();
+}
+
+bool ClusterProber::probe(const Cluster& cluster){
+	using namespace std::chrono;
+	auto start=steady_clock::now();
+	bool reachable=false;
+	try{
+		reachable=probeFunction(cluster);
+	}catch(std::exception& ex){
+		errors++;
+		log_warn("Failed to check whether " << cluster << " is reachable: " << ex.what());
+	}
+	auto latency=duration_cast<milliseconds>(steady_clock::now()-start);
+
+	probes++;
+	if(!reachable)
+		failures++;
+	std::size_t bucket=std::lower_bound(latencyBuckets.begin(),latencyBuckets.end(),
+	                                    (unsigned long)latency.count())-latencyBuckets.begin();
+	latencyCounts[bucket]++;
+	totalLatency+=latency.count();
+
+	//If this prober stops running, or falls far behind, requests should go
+	//back to checking for themselves rather than using old results.
+	store.cacheClusterReachability(cluster.id,reachable,3*interval);
+	return reachable;
+}
+
+ClusterProber::Statistics ClusterProber::getStatistics() const{
+	Statistics stats;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stats.clusters=schedule.size();
+	}
+	stats.probes=probes.load();
+	stats.failures=failures.load();
+	stats.errors=errors.load();
+	for(std::size_t i=0; i<latencyBucketCount; i++)
+		stats.latencyCounts[i]=latencyCounts[i].load();
+	stats.totalLatency=std::chrono::milliseconds(totalLatency.load());
+	return stats;
+}
+
+void ClusterProber::run(){
+	using namespace std::chrono;
+	std::unique_lock<std::mutex> lock(mut);
+	steady_clock::time_point nextListing=steady_clock::now();
+	std::vector<Cluster> clusters;
+	while(!stop){
+		auto now=steady_clock::now();
+		if(now>=nextListing){
+			lock.unlock();
+			try{
+				clusters=store.listClusters();
+			}catch(std::exception& ex){
+				log_error("Failed to list clusters to check: " << ex.what());
+			}
+			lock.lock();
+			if(stop)
+				break;
+			now=steady_clock::now();
+			nextListing=now+interval;
+			//forget clusters which no longer exist, and spread the first
+			//checks of new clusters over one interval
+			std::set<std::string> current;
+			for(const Cluster& cluster : clusters){
+				current.insert(cluster.id);
+				if(!schedule.count(cluster.id))
+					schedule[cluster.id]=now+randomDelay(0,1);
+			}
+			for(auto it=schedule.begin(); it!=schedule.end();){
+				if(!current.count(it->first))
+					it=schedule.erase(it);
+				else
+					++it;
+			}
+		}
+
+		steady_clock::time_point nextWake=nextListing;
+		for(const Cluster& cluster : clusters){
+			auto it=schedule.find(cluster.id);
+			if(it==schedule.end())
+				continue;
+			if(it->second<=now){
+				it->second=now+randomDelay(0.9,1.1);
+				//if the last check is still going, skip this one
+				if(inProgress.insert(cluster.id).second){
+					tasks->submit(cluster.id,[this,cluster]{
+						probe(cluster);
+						std::lock_guard<std::mutex> lock(mut);
+						inProgress.erase(cluster.id);
+					});
+				}
+			}
+			nextWake=std::min(nextWake,it->second);
+		}
+		wake.wait_until(lock,nextWake,[this]{ return stop; });
+	}
+}
+
+std::chrono::steady_clock::duration ClusterProber::randomDelay(double min, double max){
+	std::uniform_real_distribution<double> dist(min,max);
+	return std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval*dist(rng));
+}
@@ -160,6 +160,41 @@ PersistentVolumeClaim::VolumeMode volumeModeFromString(const std::string& s){
 	throw std::runtime_error("Unrecognized volume mode: "+s);
 }
 
+bool operator==(const Operation& o1, const Operation& o2){
+	return o1.id==o2.id;
+}
+
+std::ostream& operator<<(std::ostream& os, const Operation& o){
+	if(!o)
+		return os << "invalid operation";
+	os << o.id;
+	if(!o.kind.empty())
+		os << " (" << o.kind << ' ' << o.target << ')';
+	return os;
+}
+
+std::string to_string(Operation::State state){
+	switch(state){
+		case Operation::Pending: return "Pending";
+		case Operation::Running: return "Running";
+		case Operation::Succeeded: return "Succeeded";
+		case Operation::Failed: return "Failed";
+	}
+	throw std::logic_error("Unexpected operation state");
+}
+
+Operation::State operationStateFromString(const std::string& s){
+	if(s=="Pending")
+		return Operation::Pending;
+	if(s=="Running")
+		return Operation::Running;
+	if(s=="Succeeded")
+		return Operation::Succeeded;
+	if(s=="Failed")
+		return Operation::Failed;
+	throw std::runtime_error("Unrecognized operation state: "+s);
+}
+
 std::ostream& operator<<(std::ostream& os, const GeoLocation& gl){
 	os << gl.lat << ',' << gl.lon;
 	if(!gl.description.empty())
@@ -219,6 +254,8 @@ const std::string IDGenerator::groupIDPrefix="group_";
 const std::string IDGenerator::instanceIDPrefix="instance_";
 const std::string IDGenerator::secretIDPrefix="secret_";
 const std::string IDGenerator::volumeIDPrefix="volume_";
+const std::string IDGenerator::operationIDPrefix="operation_";
+const std::string IDGenerator::replicaIDPrefix="replica_";
 
 std::string IDGenerator::generateRawID(){
 	uint64_t value;
@@ -0,0 +1,39 @@
+#include "EvictingCache.h"
+
+#include "Logging.h"
+
+CacheSweeper::CacheSweeper(std::chrono::seconds interval, std::function<void()> sweep,
+                           std::string activity):
+interval(interval),
+sweepFunction(std::move(sweep)),
+activity(std::move(activity)),
+stop(false),
+sweepCount(0)
+{
+	thread=std::thread([this]{ run(); });
+}
+
+CacheSweeper::~CacheSweeper(){
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stop=true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+void CacheSweeper::run(){
+	std::unique_lock<std::mutex> lock(mut);
+	while(!stop){
+		if(wake.wait_for(lock,interval,[this]{ return stop; }))
+			break;
+		lock.unlock();
+		try{
+			sweepFunction();
+		}catch(std::exception& ex){
+			log_error(activity << " failed: " << ex.what());
+		}
+		sweepCount++;
+		lock.lock();
+	}
+}
@@ -0,0 +1,276 @@
+#include "Executor.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+#include "Logging.h"
+
+namespace{
+
+///All executors which currently exist, so that they can be reported on
+struct ExecutorRegistry{
+	std::mutex mut;
+	std::vector<const Executor*> executors;
+};
+
+ExecutorRegistry& registry(){
+	static ExecutorRegistry reg;
+	return reg;
+}
+
+}
+
+Executor::GroupState::GroupState(unsigned int maxConcurrency, Priority priority):
+maxConcurrency(maxConcurrency ? maxConcurrency : std::numeric_limits<unsigned int>::max()),
+priority(priority),running(0),scheduled(false),blocked(false),cancelled(false),
+cancelledTasks(0){}
+
+Executor::Executor(const std::string& name, unsigned int threads, unsigned int maxPerKey):
+name(name),
+maxPerKey(maxPerKey ? maxPerKey : std::numeric_limits<unsigned int>::max()),
+stopping(false),stats(){
+	if(threads==0)
+		threads=1;
+	stats.threads=threads;
+	workers.reserve(threads);
+	for(unsigned int i=0; i<threads; i++)
+		workers.emplace_back(&Executor::workerLoop,this);
+	ExecutorRegistry& reg=registry();
+	std::lock_guard<std::mutex> lock(reg.mut);
+	reg.executors.push_back(this);
+}
+
+Executor::~Executor(){
+	{
+		ExecutorRegistry& reg=registry();
+		std::lock_guard<std::mutex> lock(reg.mut);
+		reg.executors.erase(std::remove(reg.executors.begin(),reg.executors.end(),this),
+		                    reg.executors.end());
+	}
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stopping=true;
+	}
+	workAvailable.notify_all();
+	for(auto& worker : workers)
+		worker.join();
+}
+
+Executor::Statistics Executor::getStatistics() const{
+	std::lock_guard<std::mutex> lock(mut);
+	return stats;
+}
+
+void Executor::workerLoop(){
+	auto& interactive=readyGroups[(int)Priority::Interactive];
+	auto& bulk=readyGroups[(int)Priority::Bulk];
+	std::unique_lock<std::mutex> lock(mut);
+	while(true){
+		workAvailable.wait(lock,[&]{ return stopping || !interactive.empty() || !bulk.empty(); });
+		if(stopping)
+			return;
+		auto& queue=(interactive.empty() ? bulk : interactive);
+		std::shared_ptr<GroupState> group=std::move(queue.front());
+		queue.pop_front();
+		group->scheduled=false;
+		//a waiting thread may have taken the group's tasks in the meantime
+		auto next=nextTask(*group);
+		if(next==group->pending.end()){
+			schedule(group);
+			continue;
+		}
+		Task task=startTask(*group,next);
+		//let other workers serve the group's remaining tasks, after any other
+		//groups which are already waiting
+		schedule(group);
+		runTask(lock,group,task);
+	}
+}
+
+std::deque<Executor::Task>::iterator Executor::nextTask(GroupState& group){
+	if(group.running>=group.maxConcurrency)
+		return group.pending.end();
+	for(auto it=group.pending.begin(), end=group.pending.end(); it!=end; ++it){
+		if(it->key.empty())
+			return it;
+		auto count=runningPerKey.find(it->key);
+		if(count==runningPerKey.end() || count->second<maxPerKey)
+			return it;
+	}
+	return group.pending.end();
+}
+
+void Executor::schedule(const std::shared_ptr<GroupState>& group){
+	if(group->scheduled || group->pending.empty() || group->running>=group->maxConcurrency)
+		return;
+	if(nextTask(*group)==group->pending.end()){
+		//only keys are holding this group back, so it must be reconsidered 
+		//when a task with a key finishes
+		if(!group->blocked){
+			group->blocked=true;
+			blockedGroups.push_back(group);
+		}
+		return;
+	}
+	group->scheduled=true;
+	readyGroups[(int)group->priority].push_back(group);
+	workAvailable.notify_one();
+}
+
+Executor::Task Executor::startTask(GroupState& group, std::deque<Task>::iterator next){
+	Task task=std::move(*next);
+	group.pending.erase(next);
+	group.running++;
+	if(!task.key.empty())
+		runningPerKey[task.key]++;
+	stats.queued--;
+	if(group.priority==Priority::Bulk)
+		stats.bulkQueued--;
+	stats.running++;
+	auto waited=std::chrono::duration_cast<std::chrono::microseconds>(clock::now()-task.enqueued);
+	stats.totalQueueTime+=waited;
+	stats.maxQueueTime=std::max(stats.maxQueueTime,waited);
+	return task;
+}
+
+void Executor::runTask(std::unique_lock<std::mutex>& lock,
+                       const std::shared_ptr<GroupState>& group,
+                       Task& task){
+	lock.unlock();
+	try{
+		task.work();
+	}catch(std::exception& ex){
+		log_error("Exception escaped from " << name << " task: " << ex.what());
+	}catch(...){
+		log_error("Exception escaped from " << name << " task");
+	}
+	//destroy anything the task captured before retaking the lock
+	task.work=nullptr;
+	lock.lock();
+	group->running--;
+	stats.running--;
+	stats.tasksCompleted++;
+	if(!task.key.empty()){
+		auto count=runningPerKey.find(task.key);
+		if(--count->second==0)
+			runningPerKey.erase(count);
+		std::vector<std::shared_ptr<GroupState>> waiting;
+		waiting.swap(blockedGroups);
+		for(const auto& other : waiting){
+			other->blocked=false;
+			schedule(other);
+			//threads waiting for the group may be able to run its tasks now
+			other->changed.notify_all();
+		}
+	}
+	schedule(group);
+	group->changed.notify_all();
+}
+
+Executor::TaskGroup::TaskGroup(Executor& executor, unsigned int maxConcurrency, Priority priority):
+executor(executor),state(std::make_shared<GroupState>(maxConcurrency,priority)){}
+
+Executor::TaskGroup::~TaskGroup(){
+	cancel();
+	std::unique_lock<std::mutex> lock(executor.mut);
+	state->changed.wait(lock,[this]{ return state->running==0; });
+}
+
+void Executor::TaskGroup::submit(std::function<void()> task){
+	submit(std::string(),std::move(task));
+}
+
+void Executor::TaskGroup::submit(const std::string& key, std::function<void()> task){
+	std::lock_guard<std::mutex> lock(executor.mut);
+	executor.stats.tasksSubmitted++;
+	if(state->cancelled){
+		state->cancelledTasks++;
+		executor.stats.tasksCancelled++;
+		return;
+	}
+	state->pending.push_back(Task{std::move(task),key,clock::now()});
+	executor.stats.queued++;
+	if(state->priority==Priority::Bulk)
+		executor.stats.bulkQueued++;
+	executor.stats.maxQueued=std::max(executor.stats.maxQueued,executor.stats.queued);
+	executor.schedule(state);
+}
+
+void Executor::TaskGroup::wait(){
+	wait(nullptr,std::chrono::milliseconds(0));
+}
+
+bool Executor::TaskGroup::wait(const std::function<bool()>& keepGoing,
+                               std::chrono::milliseconds checkInterval){
+	std::unique_lock<std::mutex> lock(executor.mut);
+	while(true){
+		if(keepGoing && !state->cancelled && (!state->pending.empty() || state->running)){
+			lock.unlock();
+			bool wanted=keepGoing();
+			if(!wanted)
+				cancel();
+			lock.lock();
+		}
+		auto next=executor.nextTask(*state);
+		if(next!=state->pending.end()){
+			Task task=executor.startTask(*state,next);
+			executor.stats.tasksRunByWaiters++;
+			executor.runTask(lock,state,task);
+			continue;
+		}
+		if(state->pending.empty() && state->running==0)
+			break;
+		if(keepGoing)
+			state->changed.wait_for(lock,checkInterval);
+		else
+			state->changed.wait(lock);
+	}
+	return state->cancelledTasks==0;
+}
+
+void Executor::TaskGroup::cancel(){
+	std::deque<Task> discarded;
+	{
+		std::lock_guard<std::mutex> lock(executor.mut);
+		state->cancelled=true;
+		discarded.swap(state->pending);
+		state->cancelledTasks+=discarded.size();
+		executor.stats.tasksCancelled+=discarded.size();
+		executor.stats.queued-=discarded.size();
+		if(state->priority==Priority::Bulk)
+			executor.stats.bulkQueued-=discarded.size();
+	}
+	//anything captured by the tasks is destroyed here, without the lock held
+}
+
+std::size_t Executor::TaskGroup::cancelledTasks() const{
+	std::lock_guard<std::mutex> lock(executor.mut);
+	return state->cancelledTasks;
+}
+
+std::string getExecutorStatistics(){
+	ExecutorRegistry& reg=registry();
+	std::lock_guard<std::mutex> lock(reg.mut);
+	std::ostringstream os;
+	for(const Executor* executor : reg.executors){
+		Executor::Statistics stats=executor->getStatistics();
+		const std::string& name=executor->getName();
+		os << name << " threads: " << stats.threads << "\n";
+		os << name << " tasks submitted: " << stats.tasksSubmitted << "\n";
+		os << name << " tasks completed: " << stats.tasksCompleted << "\n";
+		os << name << " tasks cancelled: " << stats.tasksCancelled << "\n";
+		os << name << " tasks run by waiting threads: " << stats.tasksRunByWaiters << "\n";
+		os << name << " tasks queued: " << stats.queued << "\n";
+		os << name << " bulk tasks queued: " << stats.bulkQueued << "\n";
+		os << name << " tasks running: " << stats.running << "\n";
+		os << name << " maximum tasks queued: " << stats.maxQueued << "\n";
+		double meanWait=0;
+		std::size_t started=stats.tasksCompleted+stats.running;
+		if(started)
+			meanWait=stats.totalQueueTime.count()/1000.0/started;
+		os << name << " mean queue time (ms): " << meanWait << "\n";
+		os << name << " maximum queue time (ms): " << stats.maxQueueTime.count()/1000.0 << "\n";
+	}
+	return os.str();
+}
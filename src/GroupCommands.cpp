@@ -11,6 +11,7 @@
 #include "KubeInterface.h"
 #include "ApplicationInstanceCommands.h"
 #include "ClusterCommands.h"
+#include "OperationCommands.h"
 #include "SecretCommands.h"
 #include "server_version.h"
 
@@ -386,49 +387,69 @@ crow::response deleteGroup(PersistentStore& store, const crow::request& req, con
 	if (!deleted)
 		return crow::response(500, generateError("Group deletion failed"));
 	
-	std::vector<std::future<void>> work;
+	if(asyncRequested(req)){
+		//the group's record is already gone, so remember what is needed to 
+		//clean up after it
+		rapidjson::Document parameters(rapidjson::kObjectType);
+		parameters.AddMember("name", targetGroup.name, parameters.GetAllocator());
+		auto operation=store.getOperationScheduler().start("deleteGroup",targetGroup.id,user.id,to_string(parameters));
+		if(!operation)
+			return crow::response(500,generateError("Failed to schedule group cleanup"));
+		return operationAccepted(operation);
+	}
 	
+	internal::deleteGroupResources(store,targetGroup,[](const std::string&){});
+	return(crow::response(200));
+}
+
+namespace internal{
+void deleteGroupResources(PersistentStore& store, const Group& targetGroup, 
+                          const OperationScheduler::ProgressReporter& progress){
+	//Cleaning up after the group is bulk work, which should not delay other 
+	//users' requests, or overwhelm any one cluster
+	Executor::TaskGroup work(store.getCommandExecutor(),0,Executor::Priority::Bulk);
+	
+	progress("Deleting instances, secrets, and namespaces");
 	// Remove all instances owned by the group
 	for(auto& instance : store.listApplicationInstancesByClusterOrGroup(targetGroup.id,""))
-		work.emplace_back(std::async(std::launch::async,[&store,instance](){ internal::deleteApplicationInstance(store,instance,true); }));
+		work.submit(instance.cluster,[&store,instance](){ internal::deleteApplicationInstance(store,instance,true); });
 	
 	// Remove all secrets owned by the group
 	for(auto& secret : store.listSecrets(targetGroup.id,""))
-		work.emplace_back(std::async(std::launch::async,[&store,secret](){ internal::deleteSecret(store,secret,true); }));
+		work.submit(secret.cluster,[&store,secret](){ internal::deleteSecret(store,secret,true); });
 	
 	// Remove the Group's namespace on each cluster
 	auto cluster_names = store.listClusters();
 	for (auto& cluster : cluster_names){
-		work.emplace_back(std::async(std::launch::async,[&store,&targetGroup,cluster](){
+		work.submit(cluster.id,[&store,&targetGroup,cluster](){
 			try{
 				kubernetes::kubectl_delete_namespace(*store.configPathForCluster(cluster.id), targetGroup);
 			}
 			catch(std::runtime_error& err){
 				log_error("Failed to delete " << targetGroup << " namespace from " << cluster << ": " << err.what());
 			}
-		}));
+		});
 	}
 	
 	//make sure all instances, secrets, and namespaces are deleted before
 	//deleting any clusters, since some of the other objects may be on clusters
 	//to be deleted
-	for(auto& item : work)
-		item.wait();
-	work.clear();
+	work.wait();
 	
+	progress("Deleting clusters");
 	// Remove all clusters owned by the group
+	//Each cluster deletion runs its own commands against the cluster, so it is 
+	//not itself limited by the cluster's key. 
 	for(auto& cluster : cluster_names){
 		if(cluster.owningGroup==targetGroup.id)
-			work.emplace_back(std::async(std::launch::async,[&store,cluster](){
+			work.submit([&store,cluster](){
 				internal::deleteCluster(store,cluster,true);
-			}));
+			});
 	}
 	
 	//make sure all cluster deletions are done
-	for(auto& item : work)
-		item.wait();
-	
-	return(crow::response(200));
+	work.wait();
+}
 }
 
 crow::response listGroupMembers(PersistentStore& store, const crow::request& req, const std::string& groupID){
@@ -445,6 +466,7 @@ crow::response listGroupMembers(PersistentStore& store, const crow::request& req
 		return crow::response(403,generateError("Not authorized"));
 	
 	auto userIDs=store.getMembersOfGroup(targetGroup.id);
+	auto users=store.getUsers(userIDs);
 	
 	rapidjson::Document result(rapidjson::kObjectType);
 	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
@@ -453,7 +475,14 @@ crow::response listGroupMembers(PersistentStore& store, const crow::request& req
 	rapidjson::Value resultItems(rapidjson::kArrayType);
 	resultItems.Reserve(userIDs.size(), alloc);
 	for(const std::string& userID : userIDs){
-		User user=store.getUser(userID);
+		auto it=users.find(userID);
+		//look up any user the batch missed individually, in case the batch 
+		//lookup gave up before reaching it
+		User user=(it!=users.end() ? it->second : store.getUser(userID));
+		if(!user){
+			log_warn("Member " << userID << " of " << targetGroup << " has no user record");
+			continue;
+		}
 		rapidjson::Value userResult(rapidjson::kObjectType);
 		userResult.AddMember("apiVersion", "v1alpha3", alloc);
 		userResult.AddMember("kind", "User", alloc);
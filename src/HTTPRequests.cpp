@@ -19,14 +19,6 @@ namespace httpRequests{
 
 namespace detail{
 
-///Helper data used for collecting output data from libcurl
-struct CurlOutputData{
-	///The collected output, should be empty initially
-	std::string output;
-	///Context information to be included in messages if an error occurs
-	std::string context;
-};
-
 ///Helper data used for sending input data to libcurl
 struct CurlInputData{
 	///Stream containing data to be given to libcurl
@@ -40,18 +32,11 @@ struct CurlInputData{
 	input(data),context(context){}
 };
 
-///Callback function for collecting data from libcurl, and only to be called by libcurl. 
-///See https://curl.haxx.se/libcurl/c/CURLOPT_WRITEFUNCTION.html
-///\param buffer the data being provided by libcurl
-///\param size the number of 'items' in the available data
-///\param nmemb the size of each 'item' of available data
-///\param userp pointer to a CurlOutputData object with the buffer where data is to be collected and
-///             error context information
-size_t collectCurlOutput(void* buffer, size_t size, size_t nmemb, void* userp){
+size_t collectCurlOutput(char* buffer, size_t size, size_t nmemb, void* userp){
 	CurlOutputData& data=*static_cast<CurlOutputData*>(userp);
 	//curl can't tolerate exceptions, so stop them and log them to stderr here
 	try{
-		data.output.append((char*)buffer,size*nmemb);
+		data.output.append(buffer,size*nmemb);
 	}catch(std::exception& ex){
 		std::cerr << data.context << " Exception thrown while collecting output: " 
 		  << ex.what() << std::endl;
@@ -0,0 +1,732 @@
+#include "KubeAPIClient.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <curl/curl.h>
+
+#include <yaml-cpp/yaml.h>
+
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+
+#include "Archive.h"
+#include "FileHandle.h"
+#include "HTTPRequests.h"
+#include "KubeInterface.h"
+#include "Logging.h"
+#include "ServerUtilities.h"
+
+#ifdef CURL_AT_LEAST_VERSION
+#if CURL_AT_LEAST_VERSION(7, 77, 0)
+#define SLATE_CURL_BLOB_AVAIL 1
+#endif
+#endif
+
+namespace kubernetes{
+
+namespace{
+
+///How to find a kind of object in the API
+struct KindInfo{
+	///The API group and version prefix, e.g. /api/v1
+	std::string pathPrefix;
+	///The plural resource name used in paths
+	std::string resource;
+	///The kind name used in object bodies
+	std::string kind;
+	///The apiVersion used in object bodies
+	std::string apiVersion;
+	///Whether objects of this kind live in namespaces
+	bool namespaced;
+};
+
+///Look up the API location for a kind, accepting the same names kubectl does.
+///\return the kind's information, or nullptr if it is not supported directly
+const KindInfo* lookUpKind(const std::string& kind){
+	static const KindInfo pods{"/api/v1","pods","Pod","v1",true};
+	static const KindInfo services{"/api/v1","services","Service","v1",true};
+	static const KindInfo events{"/api/v1","events","Event","v1",true};
+	static const KindInfo nodes{"/api/v1","nodes","Node","v1",false};
+	static const KindInfo namespaces{"/api/v1","namespaces","Namespace","v1",false};
+	static const KindInfo storageClasses{"/apis/storage.k8s.io/v1","storageclasses",
+		"StorageClass","storage.k8s.io/v1",false};
+	static const KindInfo priorityClasses{"/apis/scheduling.k8s.io/v1","priorityclasses",
+		"PriorityClass","scheduling.k8s.io/v1",false};
+	static const std::map<std::string,const KindInfo*> kinds={
+		{"pod",&pods},{"pods",&pods},{"po",&pods},
+		{"service",&services},{"services",&services},{"svc",&services},
+		{"event",&events},{"events",&events},{"ev",&events},
+		{"node",&nodes},{"nodes",&nodes},{"no",&nodes},
+		{"namespace",&namespaces},{"namespaces",&namespaces},{"ns",&namespaces},
+		{"storageclass",&storageClasses},{"storageclasses",&storageClasses},{"sc",&storageClasses},
+		{"priorityclass",&priorityClasses},{"priorityclasses",&priorityClasses},{"pc",&priorityClasses},
+	};
+	auto it=kinds.find(kind);
+	if(it==kinds.end())
+		return nullptr;
+	return it->second;
+}
+
+///Everything needed to talk to one cluster's API server, along with idle
+///connection handles which can be reused
+struct ClusterConnection{
+	///Base URL of the API server
+	std::string server;
+	///The namespace used when none is specified
+	std::string defaultNamespace;
+	///Bearer token, if used
+	std::string token;
+	///Basic authentication credentials, if used
+	std::string userPassword;
+	///Paths to the certificate authority, client certificate, and client key
+	std::string caPath, certPath, keyPath;
+	///The certificate authority, client certificate, and client key, if they 
+	///were embedded in the kubeconfig, which are given to curl from memory so 
+	///that they are never written to disk
+	std::string caData, certData, keyData;
+#ifndef SLATE_CURL_BLOB_AVAIL
+	///Temporary files holding credentials which were embedded in the kubeconfig,
+	///for versions of curl which can only read them from files
+	std::vector<FileHandle> credentialFiles;
+#endif
+	///Whether the server's certificate should not be verified
+	bool insecure;
+	///Whether the kubeconfig can be used without kubectl
+	bool usable;
+	///Modification time and size of the kubeconfig when this was created
+	struct timespec configTime;
+	off_t configSize;
+
+	std::mutex handleMutex;
+	///curl handles which are not currently in use, each of which may be
+	///holding an open connection to the server
+	std::vector<std::unique_ptr<CURL,void (*)(CURL*)>> idleHandles;
+
+	ClusterConnection():insecure(false),usable(true),configSize(0){}
+};
+
+std::mutex connectionsMutex;
+std::map<std::string,std::shared_ptr<ClusterConnection>> connections;
+
+std::atomic<std::size_t> directRequests(0);
+std::atomic<std::size_t> fallbackRequests(0);
+std::atomic<std::size_t> connectionsCreated(0);
+std::atomic<std::size_t> watchesStarted(0);
+
+///The largest number of idle handles which will be kept for a single cluster
+const std::size_t maxIdleHandles=8;
+
+///Thrown when a kubeconfig describes something this client does not handle,
+///so that kubectl should be used instead
+struct UnsupportedConfig : public std::runtime_error{
+	UnsupportedConfig(const std::string& msg):std::runtime_error(msg){}
+};
+
+///Find the entry with a given name in one of the lists in a kubeconfig
+YAML::Node findNamed(const YAML::Node& config, const std::string& listName,
+                     const std::string& name, const std::string& entryName){
+	const YAML::Node list=config[listName];
+	if(!list || !list.IsSequence())
+		throw UnsupportedConfig("kubeconfig has no "+listName);
+	for(const auto& item : list){
+		if(item["name"] && item["name"].as<std::string>()==name && item[entryName])
+			return item[entryName];
+	}
+	throw UnsupportedConfig("kubeconfig has no "+entryName+" named "+name);
+}
+
+///Find a credential which may be either referenced by path or embedded as 
+///base64 data in the kubeconfig
+///\param path set to the path of the credential, if it is referenced by path
+///\param data set to the credential, if it is embedded
+void loadCredential(const YAML::Node& node, const std::string& key,
+                    const std::string& configDir, ClusterConnection& conn,
+                    std::string& path, std::string& data){
+	if(node[key+"-data"]){
+		data=decodeBase64(node[key+"-data"].as<std::string>());
+#ifndef SLATE_CURL_BLOB_AVAIL
+		//the file is created in the system's temporary directory, readable 
+		//only by this user, and removed when the connection is dropped
+		conn.credentialFiles.emplace_back(makeTemporaryFile("slate_kube_"));
+		path=conn.credentialFiles.back().path();
+		std::ofstream out(path);
+		out << data;
+		if(!out)
+			throw std::runtime_error("Failed to write credential file "+path);
+		data.clear();
+#endif
+		return;
+	}
+	if(node[key]){
+		path=node[key].as<std::string>();
+		if(!path.empty() && path[0]!='/')
+			path=configDir+"/"+path;
+	}
+}
+
+std::shared_ptr<ClusterConnection> loadConnection(const std::string& configPath,
+                                                  const struct stat& info){
+	auto conn=std::make_shared<ClusterConnection>();
+	conn->configTime=info.st_mtim;
+	conn->configSize=info.st_size;
+	std::string configDir=configPath.substr(0,configPath.rfind('/'));
+
+	YAML::Node config=YAML::LoadFile(configPath);
+	if(!config["current-context"])
+		throw UnsupportedConfig("kubeconfig has no current-context");
+	YAML::Node context=findNamed(config,"contexts",config["current-context"].as<std::string>(),"context");
+	if(context["namespace"])
+		conn->defaultNamespace=context["namespace"].as<std::string>();
+	else
+		conn->defaultNamespace="default";
+
+	YAML::Node cluster=findNamed(config,"clusters",context["cluster"].as<std::string>(),"cluster");
+	if(!cluster["server"])
+		throw UnsupportedConfig("kubeconfig cluster has no server");
+	conn->server=cluster["server"].as<std::string>();
+	while(!conn->server.empty() && conn->server.back()=='/')
+		conn->server.pop_back();
+	if(cluster["proxy-url"])
+		throw UnsupportedConfig("proxies are not supported");
+	if(cluster["insecure-skip-tls-verify"])
+		conn->insecure=cluster["insecure-skip-tls-verify"].as<bool>();
+	loadCredential(cluster,"certificate-authority",configDir,*conn,conn->caPath,conn->caData);
+
+	if(context["user"]){
+		YAML::Node user=findNamed(config,"users",context["user"].as<std::string>(),"user");
+		if(user["exec"] || user["auth-provider"])
+			throw UnsupportedConfig("credential plugins are not supported");
+		if(user["token"])
+			conn->token=user["token"].as<std::string>();
+		else if(user["tokenFile"]){
+			std::string path=user["tokenFile"].as<std::string>();
+			if(!path.empty() && path[0]!='/')
+				path=configDir+"/"+path;
+			std::ifstream tokenFile(path);
+			if(!tokenFile)
+				throw UnsupportedConfig("unable to read token file "+path);
+			std::getline(tokenFile,conn->token);
+		}
+		if(user["username"] && user["password"])
+			conn->userPassword=user["username"].as<std::string>()+":"+user["password"].as<std::string>();
+		loadCredential(user,"client-certificate",configDir,*conn,conn->certPath,conn->certData);
+		loadCredential(user,"client-key",configDir,*conn,conn->keyPath,conn->keyData);
+	}
+	return conn;
+}
+
+///Get the connection information for a cluster, (re)loading it if the
+///kubeconfig has changed.
+///\return the connection, or nullptr if the config cannot be used directly
+std::shared_ptr<ClusterConnection> getConnection(const std::string& configPath){
+	struct stat info;
+	if(stat(configPath.c_str(),&info)){
+		dropAPIConnections(configPath);
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> lock(connectionsMutex);
+	auto it=connections.find(configPath);
+	if(it!=connections.end() &&
+	   it->second->configTime.tv_sec==info.st_mtim.tv_sec &&
+	   it->second->configTime.tv_nsec==info.st_mtim.tv_nsec &&
+	   it->second->configSize==info.st_size)
+		return it->second->usable?it->second:nullptr;
+	std::shared_ptr<ClusterConnection> conn;
+	try{
+		conn=loadConnection(configPath,info);
+	}catch(UnsupportedConfig& ex){
+		log_info("Using kubectl for " << configPath << ": " << ex.what());
+		//remember this until the config changes
+		conn=std::make_shared<ClusterConnection>();
+		conn->configTime=info.st_mtim;
+		conn->configSize=info.st_size;
+		conn->usable=false;
+		connections[configPath]=conn;
+		return nullptr;
+	}catch(std::exception& ex){
+		log_warn("Unable to load " << configPath << " for direct API access: " << ex.what());
+		return nullptr; //don't remember this, in case the problem is transient
+	}
+	connections[configPath]=conn;
+	return conn;
+}
+
+///A curl handle borrowed from a ClusterConnection, which is returned to it when
+///dropped
+struct BorrowedHandle{
+	BorrowedHandle(std::shared_ptr<ClusterConnection> conn):
+	conn(std::move(conn)),handle(nullptr,curl_easy_cleanup){
+		{
+			std::lock_guard<std::mutex> lock(this->conn->handleMutex);
+			if(!this->conn->idleHandles.empty()){
+				handle=std::move(this->conn->idleHandles.back());
+				this->conn->idleHandles.pop_back();
+			}
+		}
+		if(!handle){
+			handle.reset(curl_easy_init());
+			if(!handle)
+				throw std::runtime_error("Failed to allocate curl handle");
+			connectionsCreated++;
+		}
+	}
+	~BorrowedHandle(){
+		if(!handle)
+			return;
+		std::lock_guard<std::mutex> lock(conn->handleMutex);
+		if(conn->idleHandles.size()<maxIdleHandles)
+			conn->idleHandles.push_back(std::move(handle));
+	}
+	CURL* get() const{ return handle.get(); }
+
+	std::shared_ptr<ClusterConnection> conn;
+	std::unique_ptr<CURL,void (*)(CURL*)> handle;
+};
+
+std::string escape(CURL* handle, const std::string& raw){
+	std::unique_ptr<char,void (*)(char*)> escaped(curl_easy_escape(handle,raw.c_str(),raw.size()),(void (*)(char*))&curl_free);
+	if(!escaped)
+		throw std::runtime_error("Failed to URL encode "+raw);
+	return escaped.get();
+}
+
+///Construct the URL for objects of one kind
+///\param extraQuery additional query parameters, already encoded, to append
+std::string apiURL(CURL* curl, const ClusterConnection& conn, const KindInfo& kindInfo,
+                   const GetOptions& options, const std::string& extraQuery=""){
+	std::string url=conn.server+kindInfo.pathPrefix;
+	if(kindInfo.namespaced)
+		url+="/namespaces/"+escape(curl,options.nspace.empty()?conn.defaultNamespace:options.nspace);
+	url+="/"+kindInfo.resource;
+	if(!options.name.empty())
+		url+="/"+escape(curl,options.name);
+	char separator='?';
+	if(!options.labelSelector.empty()){
+		url+=separator+std::string("labelSelector=")+escape(curl,options.labelSelector);
+		separator='&';
+	}
+	if(!options.fieldSelector.empty()){
+		url+=separator+std::string("fieldSelector=")+escape(curl,options.fieldSelector);
+		separator='&';
+	}
+	if(!extraQuery.empty())
+		url+=separator+extraQuery;
+	return url;
+}
+
+///Make a GET request to the API server using a borrowed handle.
+///\param timeout the longest the whole request may take
+///\param write the function to which the response body is passed
+///\param writeData the context passed to write
+///\param abortExpected if the transfer is stopped by write returning a short
+///                     count, the request is still considered to have been made
+///\return false if the request could not be made at all
+bool apiRequest(BorrowedHandle& handle, const std::string& url,
+                std::chrono::milliseconds timeout, curl_write_callback write,
+                void* writeData, bool abortExpected, long& code){
+	CURL* curl=handle.get();
+	const ClusterConnection& conn=*handle.conn;
+
+	std::unique_ptr<curl_slist,void (*)(curl_slist*)> headers(nullptr,curl_slist_free_all);
+	headers.reset(curl_slist_append(headers.release(),"Accept: application/json"));
+	if(!conn.token.empty())
+		headers.reset(curl_slist_append(headers.release(),("Authorization: Bearer "+conn.token).c_str()));
+
+	char errBuf[CURL_ERROR_SIZE];
+	errBuf[0]=0;
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errBuf);
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers.get());
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, writeData);
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)timeout.count());
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+	if(!conn.caPath.empty())
+		curl_easy_setopt(curl, CURLOPT_CAINFO, conn.caPath.c_str());
+	if(conn.insecure){
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+	}
+	if(!conn.certPath.empty())
+		curl_easy_setopt(curl, CURLOPT_SSLCERT, conn.certPath.c_str());
+	if(!conn.keyPath.empty())
+		curl_easy_setopt(curl, CURLOPT_SSLKEY, conn.keyPath.c_str());
+#ifdef SLATE_CURL_BLOB_AVAIL
+	//the connection, and so the data, outlives every use of the handle before
+	//it is reset
+	auto setBlob=[curl](CURLoption option, const std::string& data){
+		curl_blob blob{(void*)data.data(),data.size(),CURL_BLOB_NOCOPY};
+		curl_easy_setopt(curl, option, &blob);
+	};
+	if(!conn.caData.empty())
+		setBlob(CURLOPT_CAINFO_BLOB, conn.caData);
+	if(!conn.certData.empty())
+		setBlob(CURLOPT_SSLCERT_BLOB, conn.certData);
+	if(!conn.keyData.empty())
+		setBlob(CURLOPT_SSLKEY_BLOB, conn.keyData);
+#endif
+	if(!conn.userPassword.empty())
+		curl_easy_setopt(curl, CURLOPT_USERPWD, conn.userPassword.c_str());
+
+	CURLcode err=curl_easy_perform(curl);
+	//don't leave a pointer to this stack frame in the handle
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, nullptr);
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+	if(err==CURLE_WRITE_ERROR && abortExpected){
+		//the connection is left mid-response, so it cannot be reused
+		handle.handle.reset();
+		return true;
+	}
+	if(err!=CURLE_OK){
+		log_warn("Direct API request to " << url << " failed: "
+		         << (errBuf[0]?errBuf:curl_easy_strerror(err)));
+		handle.handle.reset(); //don't keep a handle whose connection may be bad
+		return false;
+	}
+	return true;
+}
+
+///Make a GET request to the API server.
+///\return false if the request could not be made at all
+bool apiGet(const std::shared_ptr<ClusterConnection>& conn, const KindInfo& kindInfo,
+            const GetOptions& options, long& code, std::string& body){
+	BorrowedHandle handle(conn);
+	//reset options, but keep the connection cache
+	curl_easy_reset(handle.get());
+	std::string url=apiURL(handle.get(),*conn,kindInfo,options);
+	httpRequests::detail::CurlOutputData output;
+	output.context="GET "+url;
+	//match kubectl's --request-timeout
+	bool made=apiRequest(handle,url,std::chrono::seconds(10),
+	                     httpRequests::detail::collectCurlOutput,&output,false,code);
+	body=std::move(output.output);
+	return made;
+}
+
+///Make the API server's response look like kubectl's output.
+///kubectl presents lists as kind List, and fills in the kind and apiVersion of
+///each item, which the API server omits.
+std::string formatList(const std::string& body, const KindInfo& kindInfo){
+	rapidjson::Document data;
+	data.Parse(body.c_str());
+	if(data.HasParseError() || !data.IsObject() || !data.HasMember("items") || !data["items"].IsArray())
+		return body;
+	auto& alloc=data.GetAllocator();
+	for(auto& item : data["items"].GetArray()){
+		if(!item.IsObject())
+			continue;
+		if(!item.HasMember("kind"))
+			item.AddMember("kind",rapidjson::StringRef(kindInfo.kind.c_str()),alloc);
+		if(!item.HasMember("apiVersion"))
+			item.AddMember("apiVersion",rapidjson::StringRef(kindInfo.apiVersion.c_str()),alloc);
+	}
+	if(data.HasMember("kind"))
+		data["kind"].SetString("List");
+	if(data.HasMember("apiVersion"))
+		data["apiVersion"].SetString("v1");
+	return to_string(data);
+}
+
+///Construct an error message in the same form kubectl would from a Status
+///object returned by the API server
+std::string formatError(const std::string& body, long code){
+	rapidjson::Document data;
+	data.Parse(body.c_str());
+	std::string reason, message;
+	if(!data.HasParseError() && data.IsObject()){
+		if(data.HasMember("reason") && data["reason"].IsString())
+			reason=data["reason"].GetString();
+		if(data.HasMember("message") && data["message"].IsString())
+			message=data["message"].GetString();
+	}
+	if(message.empty())
+		message="the server responded with status "+std::to_string(code);
+	if(reason.empty())
+		return "Error from server: "+message;
+	return "Error from server ("+reason+"): "+message;
+}
+
+///The kinds of objects which `kubectl get all` lists
+const std::vector<KindInfo>& allKinds(){
+	static const std::vector<KindInfo> kinds={
+		{"/api/v1","pods","Pod","v1",true},
+		{"/api/v1","services","Service","v1",true},
+		{"/api/v1","replicationcontrollers","ReplicationController","v1",true},
+		{"/apis/apps/v1","daemonsets","DaemonSet","apps/v1",true},
+		{"/apis/apps/v1","deployments","Deployment","apps/v1",true},
+		{"/apis/apps/v1","replicasets","ReplicaSet","apps/v1",true},
+		{"/apis/apps/v1","statefulsets","StatefulSet","apps/v1",true},
+		{"/apis/autoscaling/v1","horizontalpodautoscalers","HorizontalPodAutoscaler","autoscaling/v1",true},
+		{"/apis/batch/v1","jobs","Job","batch/v1",true},
+		{"/apis/batch/v1","cronjobs","CronJob","batch/v1",true},
+	};
+	return kinds;
+}
+
+///The state of a watch on a set of objects which are expected to be deleted
+struct DeletionWatch{
+	///Names of the objects which still exist
+	std::set<std::string> remaining;
+	///The latest resource version seen, from which a watch can start
+	std::string resourceVersion;
+	///Received data which does not yet form a complete event
+	std::string partial;
+	///Whether the server ended the watch with an error event, for example
+	///because the resource version is too old
+	bool failed;
+
+	DeletionWatch():failed(false){}
+	bool done() const{ return remaining.empty() || failed; }
+	///Update the state according to one watch event
+	void handleEvent(const std::string& line);
+};
+
+void DeletionWatch::handleEvent(const std::string& line){
+	rapidjson::Document event;
+	event.Parse(line.c_str());
+	if(event.HasParseError() || !event.IsObject() || !event.HasMember("type") || !event["type"].IsString())
+		return;
+	const std::string type=event["type"].GetString();
+	if(type=="ERROR"){
+		failed=true;
+		return;
+	}
+	if(!event.HasMember("object") || !event["object"].IsObject() ||
+	   !event["object"].HasMember("metadata") || !event["object"]["metadata"].IsObject())
+		return;
+	const rapidjson::Value& metadata=event["object"]["metadata"];
+	if(metadata.HasMember("resourceVersion") && metadata["resourceVersion"].IsString())
+		resourceVersion=metadata["resourceVersion"].GetString();
+	if(!metadata.HasMember("name") || !metadata["name"].IsString())
+		return;
+	if(type=="DELETED")
+		remaining.erase(metadata["name"].GetString());
+	else if(type=="ADDED" || type=="MODIFIED")
+		remaining.insert(metadata["name"].GetString());
+}
+
+///Feed the newline delimited events of a watch response to a DeletionWatch,
+///stopping the transfer once there is nothing left to wait for
+size_t collectEvents(char* buffer, size_t size, size_t nmemb, void* userp){
+	DeletionWatch& watch=*static_cast<DeletionWatch*>(userp);
+	try{
+		watch.partial.append(buffer,size*nmemb);
+		std::size_t start=0, end;
+		while((end=watch.partial.find('\n',start))!=std::string::npos){
+			watch.handleEvent(watch.partial.substr(start,end-start));
+			start=end+1;
+		}
+		watch.partial.erase(0,start);
+	}catch(...){
+		return(size*nmemb!=0?0:1); //return a different number to indicate error
+	}
+	if(watch.done())
+		return(size*nmemb!=0?0:1);
+	return(size*nmemb);
+}
+
+///Wait until no objects of one kind match a selector, by listing them and then
+///watching for their deletion.
+///\param useKubectl set to true if the API server could not be contacted
+DeletionWaitResult waitForKind(const std::shared_ptr<ClusterConnection>& conn,
+                               const KindInfo& kindInfo, const GetOptions& options,
+                               std::chrono::steady_clock::time_point deadline,
+                               std::string& error, bool& useKubectl){
+	using namespace std::chrono;
+	while(true){
+		if(steady_clock::now()>=deadline)
+			return DeletionWaitResult::TimedOut;
+		long code=0;
+		std::string body;
+		if(!apiGet(conn,kindInfo,options,code,body)){
+			useKubectl=true;
+			return DeletionWaitResult::Failed;
+		}
+		directRequests++;
+		if(code==404) //this kind is not served by the cluster, so there are none
+			return DeletionWaitResult::Deleted;
+		if(code!=200){
+			error=formatError(body,code);
+			return DeletionWaitResult::Failed;
+		}
+		rapidjson::Document data;
+		data.Parse(body.c_str());
+		if(data.HasParseError() || !data.IsObject() || !data.HasMember("items") || !data["items"].IsArray()){
+			error="Unable to parse list of "+kindInfo.resource;
+			return DeletionWaitResult::Failed;
+		}
+		DeletionWatch watch;
+		for(const auto& item : data["items"].GetArray()){
+			if(item.IsObject() && item.HasMember("metadata") && item["metadata"].IsObject() &&
+			   item["metadata"].HasMember("name") && item["metadata"]["name"].IsString())
+				watch.remaining.insert(item["metadata"]["name"].GetString());
+		}
+		if(watch.remaining.empty())
+			return DeletionWaitResult::Deleted;
+		if(data.HasMember("metadata") && data["metadata"].IsObject() &&
+		   data["metadata"].HasMember("resourceVersion") && data["metadata"]["resourceVersion"].IsString())
+			watch.resourceVersion=data["metadata"]["resourceVersion"].GetString();
+
+		auto timeLeft=duration_cast<milliseconds>(deadline-steady_clock::now());
+		if(timeLeft.count()<=0)
+			return DeletionWaitResult::TimedOut;
+		{
+			BorrowedHandle handle(conn);
+			curl_easy_reset(handle.get());
+			std::string query="watch=1&timeoutSeconds="+std::to_string((timeLeft.count()+999)/1000);
+			if(!watch.resourceVersion.empty())
+				query+="&resourceVersion="+escape(handle.get(),watch.resourceVersion);
+			std::string url=apiURL(handle.get(),*conn,kindInfo,options,query);
+			watchesStarted++;
+			//give the server a chance to end the watch itself
+			apiRequest(handle,url,timeLeft+seconds(1),collectEvents,&watch,true,code);
+		}
+		//Whether the watch saw everything deleted or ended early, list again:
+		//this confirms that nothing has been recreated in the meantime, or
+		//picks up from the current state. If the watch made no progress, wait
+		//a little so that a server which ends watches immediately is not
+		//hammered with requests.
+		if(!watch.remaining.empty()){
+			auto pause=std::min(duration_cast<milliseconds>(deadline-steady_clock::now()),milliseconds(250));
+			if(pause.count()>0)
+				std::this_thread::sleep_for(pause);
+		}
+	}
+}
+
+///Wait for objects to be deleted by polling with kubectl, with the delay
+///between checks increasing up to a limit
+DeletionWaitResult pollForDeletion(const std::string& configPath, const std::string& nspace,
+                                   const std::string& labelSelector,
+                                   std::chrono::steady_clock::time_point deadline,
+                                   std::string& error){
+	using namespace std::chrono;
+	const milliseconds maxDelay(2000);
+	milliseconds delay(250);
+	while(true){
+		fallbackRequests++;
+		auto result=kubectl(configPath,{"get","all","-l",labelSelector,"-n",nspace,"-o=json"});
+		if(result.status){
+			error=result.error;
+			return DeletionWaitResult::Failed;
+		}
+		rapidjson::Document data;
+		data.Parse(result.output.c_str());
+		if(data.HasParseError() || !data.IsObject() || !data.HasMember("items") || !data["items"].IsArray()){
+			error="Unable to parse kubectl output";
+			return DeletionWaitResult::Failed;
+		}
+		if(data["items"].Empty())
+			return DeletionWaitResult::Deleted;
+		auto now=steady_clock::now();
+		if(now>=deadline)
+			return DeletionWaitResult::TimedOut;
+		std::this_thread::sleep_for(std::min(delay,duration_cast<milliseconds>(deadline-now)));
+		delay=std::min(delay*2,maxDelay);
+	}
+}
+
+commandResult kubectlFallback(const std::string& configPath, const std::string& kind,
+                              const GetOptions& options){
+	fallbackRequests++;
+	std::vector<std::string> args={"get",kind};
+	if(!options.name.empty())
+		args.push_back(options.name);
+	if(!options.nspace.empty()){
+		args.push_back("--namespace");
+		args.push_back(options.nspace);
+	}
+	if(!options.labelSelector.empty()){
+		args.push_back("-l");
+		args.push_back(options.labelSelector);
+	}
+	if(!options.fieldSelector.empty()){
+		args.push_back("--field-selector");
+		args.push_back(options.fieldSelector);
+	}
+	args.push_back("-o=json");
+	return kubectl(configPath,args);
+}
+
+} //anonymous namespace
+
+commandResult kubectl_get(const std::string& configPath, const std::string& kind,
+                          const GetOptions& options){
+	const KindInfo* kindInfo=lookUpKind(kind);
+	if(!kindInfo)
+		return kubectlFallback(configPath,kind,options);
+	auto conn=getConnection(configPath);
+	if(!conn)
+		return kubectlFallback(configPath,kind,options);
+
+	long code=0;
+	std::string body;
+	try{
+		if(!apiGet(conn,*kindInfo,options,code,body))
+			return kubectlFallback(configPath,kind,options);
+	}catch(std::runtime_error& err){
+		log_warn("Direct API request failed: " << err.what());
+		return kubectlFallback(configPath,kind,options);
+	}
+	directRequests++;
+	if(code!=200)
+		return commandResult{"",formatError(body,code),1};
+	if(options.name.empty())
+		body=formatList(body,*kindInfo);
+	return commandResult{std::move(body),"",0};
+}
+
+DeletionWaitResult waitForDeletion(const std::string& configPath,
+                                   const std::string& nspace,
+                                   const std::string& labelSelector,
+                                   std::chrono::steady_clock::time_point deadline,
+                                   std::string& error){
+	try{
+		if(auto conn=getConnection(configPath)){
+			GetOptions options;
+			options.nspace=nspace;
+			options.labelSelector=labelSelector;
+			bool useKubectl=false;
+			for(const KindInfo& kindInfo : allKinds()){
+				auto result=waitForKind(conn,kindInfo,options,deadline,error,useKubectl);
+				if(useKubectl)
+					break;
+				if(result!=DeletionWaitResult::Deleted)
+					return result;
+			}
+			if(!useKubectl)
+				return DeletionWaitResult::Deleted;
+		}
+		return pollForDeletion(configPath,nspace,labelSelector,deadline,error);
+	}catch(std::runtime_error& err){
+		error=err.what();
+		return DeletionWaitResult::Failed;
+	}
+}
+
+void dropAPIConnections(const std::string& configPath){
+	std::lock_guard<std::mutex> lock(connectionsMutex);
+	connections.erase(configPath);
+}
+
+APIClientStatistics getAPIClientStatistics(){
+	return APIClientStatistics{directRequests.load(),fallbackRequests.load(),
+	                           connectionsCreated.load(),watchesStarted.load()};
+}
+
+} //namespace kubernetes
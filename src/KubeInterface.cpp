@@ -1,25 +1,49 @@
 #include "KubeInterface.h"
 
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <vector>
+
+#include <openssl/evp.h>
 
 #include "Utilities.h"
 #include "FileHandle.h"
 
 namespace kubernetes{
 	
+namespace{
+	std::vector<std::string> kubectlArguments(const std::string& configPath,
+	                                          const std::vector<std::string>& arguments){
+		std::vector<std::string> fullArgs;
+		fullArgs.push_back("--request-timeout=10s");
+		if(!configPath.empty())
+			fullArgs.push_back("--kubeconfig="+configPath);
+		std::copy(arguments.begin(),arguments.end(),std::back_inserter(fullArgs));
+		return fullArgs;
+	}
+	
+	commandResult cleanKubectlResult(const commandResult& result){
+		return commandResult{removeShellEscapeSequences(result.output),
+		                     removeShellEscapeSequences(result.error),result.status,
+		                     result.timedOut,result.truncated};
+	}
+}
+
 commandResult kubectl(const std::string& configPath,
                       const std::vector<std::string>& arguments){
-	std::vector<std::string> fullArgs;
-	fullArgs.push_back("--request-timeout=10s");
-	if(!configPath.empty())
-		fullArgs.push_back("--kubeconfig="+configPath);
-	std::copy(arguments.begin(),arguments.end(),std::back_inserter(fullArgs));
-	auto result=runCommand("kubectl",fullArgs);
-	return commandResult{removeShellEscapeSequences(result.output),
-	                     removeShellEscapeSequences(result.error),result.status};
+	return cleanKubectlResult(runCommand("kubectl",kubectlArguments(configPath,arguments)));
+}
+
+commandResult kubectl(const std::string& configPath,
+                      const std::vector<std::string>& arguments,
+                      const std::string& input){
+	return cleanKubectlResult(runCommandWithInput("kubectl",input,kubectlArguments(configPath,arguments)));
 }
 
 #ifdef SLATE_SERVER
@@ -66,64 +90,180 @@ commandResult helm(const std::string& configPath,
 	return runCommand("helm",fullArgs,{{"KUBECONFIG",configPath}});
 }
 
-unsigned int getHelmMajorVersion(){
-	auto commandResult = runCommand("helm",{"version"});
-	unsigned int helmMajorVersion=0;
-	std::string line;
-	std::istringstream ss(commandResult.output);
-	while(std::getline(ss,line)){
-		if(line.find("Server: ")==0) //ignore tiller version
-			continue;
-		std::string marker="SemVer:\"v";
-		auto startPos=line.find(marker);
-		if(startPos==std::string::npos){
-			marker="Version:\"v";
-			startPos=line.find(marker);
-			if(startPos==std::string::npos)
-				continue; //give up :(
+namespace{
+	std::mutex helmCapabilitiesMutex;
+	kubernetes::HelmCapabilities helmCapabilities;
+	///Cached copy of helmCapabilities.majorVersion for the fast path; zero if 
+	///the probe has not yet been run
+	std::atomic<unsigned int> helmMajorVersionCache(0);
+	
+	kubernetes::HelmCapabilities probeHelm(){
+		auto commandResult = runCommand("helm",{"version"});
+		kubernetes::HelmCapabilities caps;
+		std::string line;
+		std::istringstream ss(commandResult.output);
+		while(std::getline(ss,line)){
+			if(line.find("Server: ")==0) //ignore tiller version
+				continue;
+			std::string marker="SemVer:\"v";
+			auto startPos=line.find(marker);
+			if(startPos==std::string::npos){
+				marker="Version:\"v";
+				startPos=line.find(marker);
+				if(startPos==std::string::npos)
+					continue; //give up :(
+			}
+			startPos+=marker.size();
+			if(startPos>=line.size()-1) //also weird
+				continue;
+			auto endPos=line.find('.',startPos+1);
+			try{
+				caps.majorVersion=std::stoul(line.substr(startPos,endPos-startPos));
+			}catch(std::exception& ex){
+				throw std::runtime_error("Unable to extract helm version");
+			}
+			caps.version=line.substr(startPos,line.find('"',startPos)-startPos);
 		}
-		startPos+=marker.size();
-		if(startPos>=line.size()-1) //also weird
-			continue;
-		auto endPos=line.find('.',startPos+1);
-		try{
-			helmMajorVersion=std::stoul(line.substr(startPos,endPos-startPos));
-		}catch(std::exception& ex){
+		if(!caps.majorVersion)
 			throw std::runtime_error("Unable to extract helm version");
+		caps.usesTiller=(caps.majorVersion==2);
+		caps.searchRepoSubcommand=(caps.majorVersion>=3);
+		if(caps.majorVersion==2)
+			caps.columnWidthFlag="--col-width";
+		else if(caps.majorVersion>=3)
+			caps.columnWidthFlag="--max-col-width";
+		return caps;
+	}
+}
+
+HelmCapabilities getHelmCapabilities(){
+	std::lock_guard<std::mutex> lock(helmCapabilitiesMutex);
+	if(!helmCapabilities.majorVersion){
+		helmCapabilities=probeHelm();
+		helmMajorVersionCache.store(helmCapabilities.majorVersion);
+	}
+	return helmCapabilities;
+}
+
+HelmCapabilities refreshHelmCapabilities(){
+	HelmCapabilities caps=probeHelm();
+	std::lock_guard<std::mutex> lock(helmCapabilitiesMutex);
+	helmCapabilities=caps;
+	helmMajorVersionCache.store(helmCapabilities.majorVersion);
+	return helmCapabilities;
+}
+
+unsigned int getHelmMajorVersion(){
+	unsigned int version=helmMajorVersionCache.load();
+	if(version)
+		return version;
+	return getHelmCapabilities().majorVersion;
+}
+
+namespace{
+	///How long a list of API resource types is trusted before it is fetched again
+	const std::chrono::minutes resourceTypeValidity(10);
+	
+	struct ResourceTypeRecord{
+		std::vector<std::string> types;
+		std::chrono::steady_clock::time_point expirationTime;
+	};
+	std::mutex resourceTypeMutex;
+	///Lists of API resource types, keyed by the verbs used to filter them and 
+	///a hash of the contents of the kubeconfig used to reach each cluster, 
+	///since the same cluster's config may be written to a different temporary 
+	///file each time it is used. Hashing keeps the credentials in the configs 
+	///from being held in memory indefinitely.
+	std::map<std::string,ResourceTypeRecord> resourceTypeCache;
+	
+	std::string resourceTypeCacheKey(const std::string& clusterConfig, const std::string& verbs){
+		std::ifstream configFile(clusterConfig);
+		std::ostringstream contents;
+		contents << configFile.rdbuf();
+		const std::string config=contents.str();
+		unsigned char digest[EVP_MAX_MD_SIZE];
+		unsigned int digestSize=0;
+		if(EVP_Digest(config.data(),config.size(),digest,&digestSize,EVP_sha256(),nullptr)!=1)
+			throw std::runtime_error("Failed to hash kubeconfig");
+		return verbs+'\n'+std::string((const char*)digest,digestSize);
+	}
+	
+	///Remove all expired records from resourceTypeCache, so that entries for 
+	///clusters which are no longer used do not accumulate. 
+	///Must be called with resourceTypeMutex held. 
+	void pruneResourceTypeCache(std::chrono::steady_clock::time_point now){
+		for(auto it=resourceTypeCache.begin(); it!=resourceTypeCache.end();){
+			if(it->second.expirationTime<=now)
+				it=resourceTypeCache.erase(it);
+			else
+				++it;
+		}
+	}
+	
+	///Get the API resource types which support the given verbs, from the cache 
+	///if possible
+	///\param refresh whether to skip the cache and ask the cluster again
+	std::vector<std::string> getResourceTypes(const std::string& clusterConfig, 
+	                                          const std::string& verbs, bool refresh){
+		const std::string key=resourceTypeCacheKey(clusterConfig,verbs);
+		if(!refresh){
+			std::lock_guard<std::mutex> lock(resourceTypeMutex);
+			auto it=resourceTypeCache.find(key);
+			if(it!=resourceTypeCache.end() && it->second.expirationTime>std::chrono::steady_clock::now())
+				return it->second.types;
 		}
+		
+		auto result=kubernetes::kubectl(clusterConfig, {"api-resources","-o=name","--verbs="+verbs});
+		if(result.status!=0)
+			throw std::runtime_error("Failed to determine list of Kubernetes resource types");
+		ResourceTypeRecord record;
+		std::istringstream ss(result.output);
+		std::string item;
+		while(std::getline(ss,item)){
+			if(!item.empty())
+				record.types.push_back(item);
+		}
+		const auto now=std::chrono::steady_clock::now();
+		record.expirationTime=now+resourceTypeValidity;
+		
+		std::lock_guard<std::mutex> lock(resourceTypeMutex);
+		pruneResourceTypeCache(now);
+		resourceTypeCache[key]=record;
+		return record.types;
 	}
-	if(!helmMajorVersion)
-		throw std::runtime_error("Unable to extract helm version");
-	return helmMajorVersion;
 }
 
-	std::multimap<std::string,std::string> findAll(const std::string& clusterConfig, const std::string& selector, const std::string& nspace, const std::string& verbs){
+std::multimap<std::string,std::string> findAll(const std::string& clusterConfig, const std::string& selector, const std::string& nspace, const std::string& verbs){
 	std::multimap<std::string,std::string> objects;
-
-	//first determine all possible API resource types
-	auto result=kubectl(clusterConfig, {"api-resources","-o=name","--verbs="+verbs});
+	
+	//Get objects of all types at once. If the cluster no longer has one of the 
+	//types we remembered, learn its types again and retry.
+	commandResult result;
+	for(bool refresh : {false,true}){
+		auto resourceTypes=getResourceTypes(clusterConfig,verbs,refresh);
+		if(resourceTypes.empty())
+			return objects;
+		std::string typeList;
+		for(const auto& type : resourceTypes)
+			typeList+=(typeList.empty()?"":",")+type;
+		std::vector<std::string> args={"get",typeList,"-o=name","-l="+selector};
+		if(!nspace.empty())
+			args.push_back("-n="+nspace);
+		result=kubectl(clusterConfig, args);
+		if(result.status==0 || result.error.find("doesn't have a resource type")==std::string::npos)
+			break;
+	}
 	if(result.status!=0)
-		throw std::runtime_error("Failed to determine list of Kubernetes resource types");
-	std::vector<std::string> resourceTypes;
+		throw std::runtime_error("Failed to list resources: "+result.error);
+	
+	//each line has the form type/name
 	std::istringstream ss(result.output);
 	std::string item;
-	while(std::getline(ss,item))
-		resourceTypes.push_back(item);
-	
-	//for every type try to find every object matching the selector
-	std::vector<std::string> baseArgs={"get","-o=jsonpath={.items[*].metadata.name}","-l="+selector};
-	if(!nspace.empty())
-		baseArgs.push_back("-n="+nspace);
-	for(const auto& type : resourceTypes){
-		auto args=baseArgs;
-		args.insert(args.begin()+1,type);
-		result=kubectl(clusterConfig, args);
-		if(result.status!=0)
-			throw std::runtime_error("Failed to list resources of type "+type);
-		ss.str(result.output);
-		ss.clear();
-		while(ss >> item)
-			objects.emplace(type,item);
+	while(std::getline(ss,item)){
+		auto slash=item.find('/');
+		if(slash==std::string::npos)
+			continue;
+		objects.emplace(item.substr(0,slash),item.substr(slash+1));
 	}
 	return objects;
 }
@@ -1,4 +1,449 @@
 #include <Logging.h>
 
-logTarget logStdout{std::cout};
-logTarget logStderr{std::cerr};
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+#include <pthread.h>
+
+std::atomic<int> logLevelThreshold((int)LogLevel::Info);
+
+namespace{
+
+std::atomic<int> logFormat((int)LogFormat::Text);
+///Set in forked child processes, which do not have the writer thread, and
+///once the writer thread has been shut down at exit. Messages are then
+///written directly by the thread which logs them.
+std::atomic<bool> synchronousLogging(false);
+
+struct LogRecord{
+	LogLevel level;
+	std::chrono::system_clock::time_point time;
+	std::thread::id thread;
+	std::string message;
+};
+
+///A bounded queue into which any number of threads may push records, and
+///from which a single thread pops them, without locking. Each slot carries a
+///sequence number which tells producers and the consumer whose turn it is to
+///use the slot.
+class LogQueue{
+public:
+	///\param capacity the number of slots, which must be a power of two
+	explicit LogQueue(std::size_t capacity):
+	mask(capacity-1),slots(new Slot[capacity]),head(0),tail(0){
+		for(std::size_t i=0; i<capacity; i++)
+			slots[i].sequence.store(i,std::memory_order_relaxed);
+	}
+
+	///Add a record to the queue
+	///\param record the record to add, which is moved from only on success
+	///\return false if the queue is full
+	bool try_push(LogRecord& record){
+		std::size_t pos=head.load(std::memory_order_relaxed);
+		while(true){
+			Slot& slot=slots[pos&mask];
+			std::size_t seq=slot.sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t diff=(std::ptrdiff_t)seq-(std::ptrdiff_t)pos;
+			if(diff==0){
+				if(head.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed)){
+					slot.record=std::move(record);
+					slot.sequence.store(pos+1,std::memory_order_release);
+					return true;
+				}
+			}
+			else if(diff<0) //the consumer has not yet emptied this slot
+				return false;
+			else //another producer took this slot first
+				pos=head.load(std::memory_order_relaxed);
+		}
+	}
+
+	///Remove the oldest record from the queue. Only one thread may call this.
+	///\param record the object into which to move the record
+	///\return false if no record is ready
+	bool try_pop(LogRecord& record){
+		Slot& slot=slots[tail&mask];
+		if(slot.sequence.load(std::memory_order_acquire)!=tail+1)
+			return false;
+		record=std::move(slot.record);
+		slot.sequence.store(tail+mask+1,std::memory_order_release);
+		tail++;
+		return true;
+	}
+
+	///\return the number of records which have been pushed, or are being 
+	///        pushed, so far
+	std::size_t pushed() const{
+		return head.load();
+	}
+	
+	///\return the number of records which have been popped so far. Only the 
+	///        consumer may call this.
+	std::size_t popped() const{
+		return tail;
+	}
+	
+	///\return whether no record is ready to be popped. Only the consumer may
+	///        call this.
+	bool empty() const{
+		return slots[tail&mask].sequence.load(std::memory_order_acquire)!=tail+1;
+	}
+
+private:
+	struct Slot{
+		std::atomic<std::size_t> sequence;
+		LogRecord record;
+	};
+	const std::size_t mask;
+	std::unique_ptr<Slot[]> slots;
+	///The position at which the next record will be pushed. This is kept on
+	///a separate cache line from the consumer's position.
+	alignas(64) std::atomic<std::size_t> head;
+	///The position from which the next record will be popped
+	alignas(64) std::size_t tail;
+};
+
+///Turns log records into text. Timestamps are formatted only down to the
+///second once per second, and thread IDs once per thread, since consecutive
+///messages usually share both.
+class LogFormatter{
+public:
+	LogFormatter():cachedSecond(-1){}
+
+	void format(const LogRecord& record, LogFormat format, std::string& out){
+		using namespace std::chrono;
+		const auto sinceEpoch=record.time.time_since_epoch();
+		const std::time_t second=duration_cast<seconds>(sinceEpoch).count();
+		const long micros=duration_cast<microseconds>(sinceEpoch).count()%1000000;
+		if(second!=cachedSecond)
+			updateTime(second);
+		char fraction[16];
+		snprintf(fraction,sizeof(fraction),".%06ld",micros);
+
+		if(format==LogFormat::JSON){
+			out+="{\"time\":\"";
+			out+=isoTime;
+			out+=fraction;
+			out+="Z\",\"level\":\"";
+			out+=levelName(record.level,false);
+			out+="\",\"thread\":\"";
+			out+=threadName(record.thread);
+			out+="\",\"message\":\"";
+			appendEscaped(record.message,out);
+			out+="\"}\n";
+		}
+		else{
+			out+=levelName(record.level,true);
+			out+=": [";
+			out+=textTime;
+			out+=fraction;
+			out+=" UTC] (TID ";
+			out+=threadName(record.thread);
+			out+=") ";
+			out+=record.message;
+			out+='\n';
+		}
+	}
+
+private:
+	std::time_t cachedSecond;
+	///The time in the format used by timestamp(), "YYYY-mmm-DD HH:MM:SS"
+	char textTime[32];
+	///The time in ISO 8601 format, "YYYY-MM-DDTHH:MM:SS"
+	char isoTime[32];
+	std::unordered_map<std::thread::id,std::string> threadNames;
+
+	void updateTime(std::time_t second){
+		std::tm parts;
+		gmtime_r(&second,&parts);
+		strftime(textTime,sizeof(textTime),"%Y-%b-%d %H:%M:%S",&parts);
+		strftime(isoTime,sizeof(isoTime),"%Y-%m-%dT%H:%M:%S",&parts);
+		cachedSecond=second;
+	}
+
+	const std::string& threadName(std::thread::id id){
+		auto it=threadNames.find(id);
+		if(it!=threadNames.end())
+			return it->second;
+		//threads come and go, so do not remember all of them forever
+		if(threadNames.size()>=1024)
+			threadNames.clear();
+		std::ostringstream ss;
+		ss << id;
+		return threadNames.emplace(id,ss.str()).first->second;
+	}
+
+	static const char* levelName(LogLevel level, bool upperCase){
+		switch(level){
+			case LogLevel::Info: return upperCase ? "INFO" : "info";
+			case LogLevel::Warn: return upperCase ? "WARN" : "warn";
+			case LogLevel::Error: return upperCase ? "ERROR" : "error";
+			case LogLevel::Fatal: return upperCase ? "FATAL" : "fatal";
+		}
+		return "?";
+	}
+
+	static void appendEscaped(const std::string& raw, std::string& out){
+		for(char c : raw){
+			switch(c){
+				case '"': out+="\\\""; break;
+				case '\\': out+="\\\\"; break;
+				case '\n': out+="\\n"; break;
+				case '\r': out+="\\r"; break;
+				case '\t': out+="\\t"; break;
+				default:
+					if((unsigned char)c<0x20){
+						char escape[8];
+						snprintf(escape,sizeof(escape),"\\u%04x",(unsigned int)c);
+						out+=escape;
+					}
+					else
+						out+=c;
+			}
+		}
+	}
+};
+
+///Write messages directly, as all messages were written before the
+///background thread was introduced
+void writeSynchronously(const LogRecord& record){
+	static std::mutex mutex;
+	std::string text;
+	LogFormatter().format(record,(LogFormat)logFormat.load(),text);
+	std::ostream& stream=(record.level==LogLevel::Info ? std::cout : std::cerr);
+	std::lock_guard<std::mutex> lock(mutex);
+	stream.write(text.data(),text.size());
+	stream.flush();
+}
+
+void enterChildProcess(){
+	synchronousLogging=true;
+}
+
+///Collects log messages from all threads and writes them from a single
+///background thread, in batches, so that logging threads neither contend
+///for a lock nor wait for the output to be flushed.
+class AsyncLogger{
+public:
+	AsyncLogger():
+	queue(queueCapacity),stopping(false),writerExited(false),writerIdle(false),
+	written(0),writer(&AsyncLogger::run,this)
+	{
+		pthread_atfork(nullptr,nullptr,&enterChildProcess);
+	}
+
+	///Stop the writer thread, and write anything which remains queued
+	void shutdown(){
+		//messages logged from here on are written directly, and the writer
+		//thread drains everything logged before
+		synchronousLogging=true;
+		stopping=true;
+		wakeWriter();
+		writer.join();
+		{
+			std::lock_guard<std::mutex> lock(flushMutex);
+			writerExited=true;
+		}
+		flushed.notify_all();
+		//Pairs with the fence in log(): either this sees a record pushed by
+		//a thread which had already checked synchronousLogging, or that 
+		//thread sees that the writer has exited and drains the queue itself.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		drainRemaining();
+	}
+
+	void log(LogRecord& record){
+		while(!queue.try_push(record)){
+			//nothing will empty the queue once the writer has exited
+			if(writerExited.load()){
+				drainRemaining();
+				writeSynchronously(record);
+				return;
+			}
+			//the writer is falling behind, so wait for it rather than
+			//losing messages
+			wakeWriter();
+			std::this_thread::yield();
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(writerExited.load(std::memory_order_relaxed))
+			drainRemaining();
+		else if(writerIdle.load(std::memory_order_relaxed))
+			wakeWriter();
+	}
+
+	void flush(){
+		//records are written in the order of their positions in the queue
+		const std::size_t target=queue.pushed();
+		wakeWriter();
+		{
+			std::unique_lock<std::mutex> lock(flushMutex);
+			flushed.wait(lock,[&]{ return written.load()>=target || writerExited.load(); });
+		}
+		if(writerExited.load())
+			drainRemaining();
+	}
+
+private:
+	static const std::size_t queueCapacity=1u<<14;
+	///The most messages to write at once
+	static const std::size_t maxBatch=1024;
+	///The longest time for which the writer sleeps without checking for
+	///messages, in case a wake up was missed
+	static const std::chrono::milliseconds maxIdleTime;
+
+	LogQueue queue;
+	std::atomic<bool> stopping;
+	///Set once the writer thread has finished, after which records are 
+	///popped from the queue by whichever thread finds them there
+	std::atomic<bool> writerExited;
+	///Serializes popping records once the writer thread has exited
+	std::mutex drainMutex;
+	std::atomic<bool> writerIdle;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	///The number of messages written so far
+	std::atomic<std::size_t> written;
+	std::mutex flushMutex;
+	std::condition_variable flushed;
+	std::thread writer;
+
+	void wakeWriter(){
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		wake.notify_one();
+	}
+
+	void drainRemaining(){
+		std::lock_guard<std::mutex> lock(drainMutex);
+		LogRecord record;
+		while(queue.try_pop(record))
+			writeSynchronously(record);
+	}
+
+	void run(){
+		LogFormatter formatter;
+		LogRecord record;
+		std::string out, err;
+		while(true){
+			const LogFormat format=(LogFormat)logFormat.load(std::memory_order_relaxed);
+			std::size_t count=0;
+			while(count<maxBatch && queue.try_pop(record)){
+				formatter.format(record,format,record.level==LogLevel::Info ? out : err);
+				count++;
+			}
+			if(count){
+				if(!out.empty()){
+					std::cout.write(out.data(),out.size());
+					std::cout.flush();
+					out.clear();
+				}
+				if(!err.empty()){
+					std::cerr.write(err.data(),err.size());
+					std::cerr.flush();
+					err.clear();
+				}
+				{
+					std::lock_guard<std::mutex> lock(flushMutex);
+					written=queue.popped();
+				}
+				flushed.notify_all();
+				continue;
+			}
+			if(stopping.load())
+				return;
+
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			writerIdle.store(true,std::memory_order_relaxed);
+			//Pairs with the fence in log(): either a producer sees that the
+			//writer is idle and wakes it, or the writer sees the new record.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(queue.empty() && !stopping.load())
+				wake.wait_for(lock,maxIdleTime);
+			writerIdle.store(false,std::memory_order_relaxed);
+		}
+	}
+};
+
+const std::chrono::milliseconds AsyncLogger::maxIdleTime(100);
+
+void shutdownLogger();
+
+AsyncLogger& logger(){
+	//The logger is never destroyed, so that threads which are still logging
+	//while the process exits do not use it after it is gone. It is shut down
+	//at exit instead, at the point where it would have been destroyed. It is
+	//constructed in static storage, since operator new need not honor its 
+	//queue's cache line alignment. 
+	static std::aligned_storage<sizeof(AsyncLogger),alignof(AsyncLogger)>::type storage;
+	static AsyncLogger* instance=[]{
+		AsyncLogger* logger=new (&storage) AsyncLogger();
+		std::atexit(&shutdownLogger);
+		return logger;
+	}();
+	return *instance;
+}
+
+void shutdownLogger(){
+	logger().shutdown();
+}
+
+}
+
+void setLogLevel(LogLevel level){
+	//fatal messages are always written, since they explain why an activity
+	//was abandoned
+	if(level>LogLevel::Error)
+		level=LogLevel::Error;
+	logLevelThreshold=(int)level;
+}
+
+void setLogFormat(LogFormat format){
+	logFormat=(int)format;
+}
+
+LogLevel parseLogLevel(const std::string& name){
+	if(name=="info" || name=="INFO")
+		return LogLevel::Info;
+	if(name=="warn" || name=="WARN")
+		return LogLevel::Warn;
+	if(name=="error" || name=="ERROR")
+		return LogLevel::Error;
+	if(name=="fatal" || name=="FATAL")
+		return LogLevel::Fatal;
+	throw std::runtime_error("Unrecognized log level: "+name);
+}
+
+LogFormat parseLogFormat(const std::string& name){
+	if(name=="text")
+		return LogFormat::Text;
+	if(name=="json")
+		return LogFormat::JSON;
+	throw std::runtime_error("Unrecognized log format: "+name);
+}
+
+void logMessage(LogLevel level, std::string message){
+	LogRecord record{level,std::chrono::system_clock::now(),std::this_thread::get_id(),std::move(message)};
+	if(synchronousLogging.load(std::memory_order_relaxed)){
+		writeSynchronously(record);
+		return;
+	}
+	AsyncLogger& log=logger();
+	log.log(record);
+	//a fatal error may end the process, so make sure that its explanation
+	//is not left in the queue
+	if(level==LogLevel::Fatal)
+		log.flush();
+}
+
+void flushLog(){
+	if(!synchronousLogging.load())
+		logger().flush();
+}
@@ -0,0 +1,168 @@
+#include "OperationCommands.h"
+
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+#include "Logging.h"
+#include "ServerUtilities.h"
+#include "ApplicationInstanceCommands.h"
+#include "ClusterCommands.h"
+#include "GroupCommands.h"
+
+namespace{
+
+///Add the description of an operation to a JSON object
+void describeOperation(const Operation& operation, rapidjson::Value& output,
+                       rapidjson::Document::AllocatorType& alloc){
+	output.AddMember("apiVersion", "v1alpha3", alloc);
+	output.AddMember("kind", "Operation", alloc);
+	rapidjson::Value metadata(rapidjson::kObjectType);
+	metadata.AddMember("id", operation.id, alloc);
+	metadata.AddMember("kind", operation.kind, alloc);
+	metadata.AddMember("target", operation.target, alloc);
+	metadata.AddMember("user", operation.user, alloc);
+	metadata.AddMember("created", operation.ctime, alloc);
+	metadata.AddMember("updated", operation.mtime, alloc);
+	output.AddMember("metadata", metadata, alloc);
+	rapidjson::Value status(rapidjson::kObjectType);
+	status.AddMember("state", to_string(operation.state), alloc);
+	status.AddMember("progress", operation.progress, alloc);
+	output.AddMember("status", status, alloc);
+	if(operation.state==Operation::Failed)
+		output.AddMember("error", operation.result, alloc);
+	else if(operation.state==Operation::Succeeded && !operation.result.empty()){
+		rapidjson::Document result(&alloc);
+		result.Parse(operation.result.c_str());
+		if(!result.HasParseError())
+			output.AddMember("result", result, alloc);
+	}
+}
+
+///Parse the parameters of an operation
+///\throws std::runtime_error if they are not a JSON object
+rapidjson::Document operationParameters(const Operation& operation){
+	rapidjson::Document parameters;
+	parameters.Parse(operation.parameters.c_str());
+	if(parameters.HasParseError() || !parameters.IsObject())
+		throw std::runtime_error("Invalid parameters for "+operation.kind+" operation");
+	return parameters;
+}
+
+}
+
+crow::response listOperations(PersistentStore& store, const crow::request& req){
+	const User user=authenticateUser(store, req.url_params.get("token"));
+	log_info(user << " requested to list operations from " << req.remote_endpoint);
+	if(!user)
+		return crow::response(403,generateError("Not authorized"));
+
+	std::vector<Operation> operations=store.listOperationsByUser(user.id);
+
+	rapidjson::Document result(rapidjson::kObjectType);
+	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
+	result.AddMember("apiVersion", "v1alpha3", alloc);
+	rapidjson::Value resultItems(rapidjson::kArrayType);
+	resultItems.Reserve(operations.size(), alloc);
+	for(const Operation& operation : operations){
+		rapidjson::Value operationResult(rapidjson::kObjectType);
+		describeOperation(operation, operationResult, alloc);
+		resultItems.PushBack(operationResult, alloc);
+	}
+	result.AddMember("items", resultItems, alloc);
+
+	return crow::response(to_string(result));
+}
+
+crow::response getOperation(PersistentStore& store, const crow::request& req, const std::string& operationID){
+	const User user=authenticateUser(store, req.url_params.get("token"));
+	log_info(user << " requested information about " << operationID << " from " << req.remote_endpoint);
+	if(!user)
+		return crow::response(403,generateError("Not authorized"));
+
+	const Operation operation=store.getOperation(operationID);
+	if(!operation)
+		return crow::response(404,generateError("Operation not found"));
+	//only admins or the user who started an operation may see it
+	if(!user.admin && operation.user!=user.id)
+		return crow::response(403,generateError("Not authorized"));
+
+	rapidjson::Document result(rapidjson::kObjectType);
+	describeOperation(operation, result, result.GetAllocator());
+	return crow::response(to_string(result));
+}
+
+bool asyncRequested(const crow::request& req){
+	if(req.url_params.get("async"))
+		return true;
+	return req.get_header_value("Prefer").find("respond-async")!=std::string::npos;
+}
+
+crow::response operationAccepted(const Operation& operation){
+	rapidjson::Document result(rapidjson::kObjectType);
+	describeOperation(operation, result, result.GetAllocator());
+	crow::response response(202,to_string(result));
+	response.add_header("Location","/v1alpha3/operations/"+operation.id);
+	return response;
+}
+
+void registerOperationHandlers(PersistentStore& store){
+	OperationScheduler& scheduler=store.getOperationScheduler();
+
+	scheduler.setHandler("restartInstance",
+	  [&store](const Operation& operation, std::string& result,
+	           const OperationScheduler::ProgressReporter& progress)->bool{
+		auto instance=store.getApplicationInstance(operation.target);
+		if(!instance){
+			result="Application instance not found";
+			return false;
+		}
+		return internal::restartApplicationInstance(store,instance,result,progress);
+	});
+
+	scheduler.setHandler("updateInstance",
+	  [&store](const Operation& operation, std::string& result,
+	           const OperationScheduler::ProgressReporter& progress)->bool{
+		auto instance=store.getApplicationInstance(operation.target);
+		if(!instance){
+			result="Application instance not found";
+			return false;
+		}
+		rapidjson::Document parameters=operationParameters(operation);
+		if(!parameters.HasMember("configuration") || !parameters["configuration"].IsString()
+		   || !parameters.HasMember("chartVersion") || !parameters["chartVersion"].IsString())
+			throw std::runtime_error("Invalid parameters for "+operation.kind+" operation");
+		instance.config=parameters["configuration"].GetString();
+		return internal::updateApplicationInstance(store,instance,
+		                                            parameters["chartVersion"].GetString(),
+		                                            result,progress);
+	});
+
+	scheduler.setHandler("deleteCluster",
+	  [&store](const Operation& operation, std::string& result,
+	           const OperationScheduler::ProgressReporter& progress)->bool{
+		const Cluster cluster=store.getCluster(operation.target);
+		//if the operation was interrupted after the cluster's record was
+		//removed, there is nothing left to do
+		if(!cluster)
+			return true;
+		rapidjson::Document parameters=operationParameters(operation);
+		bool force=parameters.HasMember("force") && parameters["force"].IsBool()
+		           && parameters["force"].GetBool();
+		progress("Deleting cluster");
+		result=internal::deleteClusterAndNotifyGroups(store,cluster,force);
+		return result.empty();
+	});
+
+	scheduler.setHandler("deleteGroup",
+	  [&store](const Operation& operation, std::string& result,
+	           const OperationScheduler::ProgressReporter& progress)->bool{
+		rapidjson::Document parameters=operationParameters(operation);
+		if(!parameters.HasMember("name") || !parameters["name"].IsString())
+			throw std::runtime_error("Invalid parameters for "+operation.kind+" operation");
+		Group group(parameters["name"].GetString());
+		group.id=operation.target;
+		internal::deleteGroupResources(store,group,progress);
+		return true;
+	});
+}
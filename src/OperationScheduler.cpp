@@ -0,0 +1,210 @@
+#include "OperationScheduler.h"
+
+#include <vector>
+
+#include "Logging.h"
+#include "PersistentStore.h"
+#include "ServerUtilities.h"
+
+OperationScheduler::OperationScheduler(PersistentStore& store, unsigned int threads,
+                                       std::chrono::seconds leaseDuration):
+store(store),
+leaseDuration(leaseDuration),
+executor("Operation",threads,1),
+tasks(new Executor::TaskGroup(executor)),
+started(0),resumed(0),succeeded(0),failed(0){}
+
+OperationScheduler::~OperationScheduler(){
+	//stop taking on new operations, but keep the leases on running operations 
+	//until they finish
+	takeoverChecker.reset();
+	tasks.reset();
+	leaseRenewer.reset();
+}
+
+void OperationScheduler::setHandler(const std::string& kind, Handler handler){
+	std::lock_guard<std::mutex> lock(handlerMut);
+	handlers[kind]=std::move(handler);
+}
+
+void OperationScheduler::startBackgroundTasks(){
+	std::chrono::seconds renewalInterval=leaseDuration/3;
+	if(renewalInterval<std::chrono::seconds(1))
+		renewalInterval=std::chrono::seconds(1);
+	takeoverChecker.reset();
+	leaseRenewer.reset(new CacheSweeper(renewalInterval,[this]{ renewLeases(); },
+	                                    "Renewing operation leases"));
+	takeoverChecker.reset(new CacheSweeper(leaseDuration,[this]{ resumeUnfinished(); },
+	                                       "Taking over expired operations"));
+}
+
+Operation OperationScheduler::start(const std::string& kind, const std::string& target,
+                                    const std::string& user, const std::string& parameters){
+	Operation operation;
+	operation.valid=true;
+	operation.id=idGenerator.generateOperationID();
+	operation.kind=kind;
+	operation.target=target;
+	operation.user=user;
+	operation.parameters=parameters;
+	operation.state=Operation::Pending;
+	operation.progress="Queued";
+	operation.ctime=timestamp();
+	operation.mtime=operation.ctime;
+	operation.owner=store.getReplicaID();
+	operation.leaseExpiration=leaseExpirationTime();
+	if(!store.addOperation(operation)){
+		log_error("Failed to record " << operation);
+		return Operation();
+	}
+	log_info("Queuing " << operation << " on behalf of " << user);
+	started++;
+	submit(operation);
+	return operation;
+}
+
+std::size_t OperationScheduler::resumeUnfinished(){
+	std::lock_guard<std::mutex> resumeLock(resumeMut);
+	const long long now=std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	std::size_t count=0;
+	for(Operation& operation : store.listUnfinishedOperations()){
+		//skip operations which this scheduler is already carrying out, or 
+		//which another replica still holds
+		if(owns(operation.id) || operation.leaseExpiration>=now)
+			continue;
+		//an operation which cannot be carried out here is left for a replica 
+		//which can, rather than being claimed only to fail
+		if(!hasHandler(operation.kind)){
+			log_warn("Not resuming " << operation << ", which has no handler");
+			continue;
+		}
+		const std::string previousOwner=operation.owner;
+		operation.owner=store.getReplicaID();
+		operation.leaseExpiration=leaseExpirationTime();
+		operation.state=Operation::Pending;
+		operation.progress="Queued after interruption";
+		operation.mtime=timestamp();
+		//another replica may take over the same operation at the same time, 
+		//but only one claim can succeed
+		if(!store.claimOperation(operation))
+			continue;
+		if(previousOwner.empty())
+			log_info("Resuming interrupted " << operation);
+		else
+			log_info("Resuming interrupted " << operation << " from " << previousOwner);
+		resumed++;
+		submit(operation);
+		count++;
+	}
+	return count;
+}
+
+OperationScheduler::Statistics OperationScheduler::getStatistics() const{
+	return Statistics{started.load(),resumed.load(),succeeded.load(),failed.load()};
+}
+
+long long OperationScheduler::leaseExpirationTime() const{
+	return std::chrono::duration_cast<std::chrono::seconds>((std::chrono::system_clock::now()+leaseDuration).time_since_epoch()).count();
+}
+
+void OperationScheduler::submit(const Operation& operation){
+	{
+		std::lock_guard<std::mutex> lock(ownedMut);
+		owned[operation.id]=operation;
+	}
+	tasks->submit(operation.target,[this,operation]{ run(operation); });
+}
+
+void OperationScheduler::run(Operation operation){
+	Handler handler;
+	{
+		std::lock_guard<std::mutex> lock(handlerMut);
+		auto it=handlers.find(operation.kind);
+		if(it!=handlers.end())
+			handler=it->second;
+	}
+
+	auto record=[&](Operation::State state, const std::string& step){
+		operation.state=state;
+		operation.progress=step;
+		operation.mtime=timestamp();
+		if(!store.updateOperation(operation)){
+			log_warn("Failed to update record of " << operation);
+			return false;
+		}
+		return true;
+	};
+
+	//Another replica may have taken over the operation while it was queued. 
+	//If it cannot be confirmed that this one still owns it, leave it to be 
+	//taken over once the lease expires, rather than risk running it twice at 
+	//once. 
+	if(!owns(operation.id) || !record(Operation::Running,"Started")){
+		log_warn("Not starting " << operation << ", which may be owned by another replica");
+		release(operation.id);
+		return;
+	}
+
+	std::string result;
+	bool success=false;
+	if(!handler)
+		result="Unknown operation kind: "+operation.kind;
+	else{
+		log_info("Starting " << operation);
+		try{
+			success=handler(operation,result,
+			                [&](const std::string& step){ record(Operation::Running,step); });
+		}catch(std::exception& ex){
+			success=false;
+			result=ex.what();
+		}
+	}
+
+	operation.result=result;
+	if(success){
+		succeeded++;
+		log_info(operation << " succeeded");
+		record(Operation::Succeeded,"Finished");
+	}
+	else{
+		failed++;
+		log_error(operation << " failed: " << result);
+		record(Operation::Failed,"Finished");
+	}
+	release(operation.id);
+}
+
+void OperationScheduler::renewLeases(){
+	std::vector<Operation> operations;
+	{
+		std::lock_guard<std::mutex> lock(ownedMut);
+		for(const auto& entry : owned)
+			operations.push_back(entry.second);
+	}
+	for(Operation& operation : operations){
+		operation.leaseExpiration=leaseExpirationTime();
+		if(store.renewOperationLease(operation))
+			continue;
+		//If the lease could not be renewed because of an error, it may still 
+		//be renewed next time. If another replica has taken over, give up the 
+		//operation so that it is not started here. 
+		Operation current=store.getOperation(operation.id);
+		if(current && current.owner!=operation.owner)
+			release(operation.id);
+	}
+}
+
+bool OperationScheduler::hasHandler(const std::string& kind){
+	std::lock_guard<std::mutex> lock(handlerMut);
+	return handlers.count(kind);
+}
+
+bool OperationScheduler::owns(const std::string& id){
+	std::lock_guard<std::mutex> lock(ownedMut);
+	return owned.count(id);
+}
+
+void OperationScheduler::release(const std::string& id){
+	std::lock_guard<std::mutex> lock(ownedMut);
+	owned.erase(id);
+}
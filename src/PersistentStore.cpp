@@ -1,10 +1,13 @@
 #include <PersistentStore.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <chrono>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <future>
+#include <mutex>
 #include <thread>
 
 #include <unistd.h>
@@ -12,6 +15,7 @@
 #include <boost/lexical_cast.hpp>
 
 #include <aws/core/utils/Outcome.h>
+#include <aws/dynamodb/model/BatchGetItemRequest.h>
 #include <aws/dynamodb/model/DeleteItemRequest.h>
 #include <aws/dynamodb/model/GetItemRequest.h>
 #include <aws/dynamodb/model/PutItemRequest.h>
@@ -24,14 +28,14 @@
 #include <aws/dynamodb/model/DeleteTableRequest.h>
 #include <aws/dynamodb/model/DescribeTableRequest.h>
 #include <aws/dynamodb/model/UpdateTableRequest.h>
+#include <aws/dynamodb/model/UpdateTimeToLiveRequest.h>
 
+#include <Executor.h>
 #include <HTTPRequests.h>
 #include <Logging.h>
 #include <ServerUtilities.h>
 #include <Process.h>
-extern "C"{
-	#include <scrypt/scryptenc/scryptenc.h>
-}
+#include <KubeAPIClient.h>
 #include <KubeInterface.h>
 
 EmailClient::EmailClient(const std::string& mailgunEndpoint, 
@@ -181,11 +185,248 @@ const Aws::DynamoDB::Model::AttributeValue missingString(" ");
 
 template<typename Cache, typename Key=typename Cache::key_type, typename Value=typename Cache::mapped_type>
 void replaceCacheRecord(Cache& cache, const Key& key, const Value& value){
-	cache.upsert(key,[&value](Value& existing){ existing=value; },value);
+	cache.insert_or_assign(key,value);
+}
+
+///Record that something does not exist in a cache of boolean records. A 
+///lookup which found nothing may finish after a concurrent addition has 
+///cached a positive record, so only a missing, expired, or negative record
+///is replaced.
+template<typename Cache>
+void storeNegativeCacheRecord(Cache& cache, const std::string& key, std::chrono::seconds validity){
+	cache.insert_or_assign_if(key,CacheRecord<bool>(false,validity),
+	                          [](const CacheRecord<bool>& existing){
+		return !existing || !existing.record;
+	});
+}
+
+///Remove the keys of a multimap cache whose listings and records have all 
+///expired
+///\return the number of keys removed
+template<typename Multimap>
+std::size_t sweepCategories(Multimap& cache){
+	const auto now=std::chrono::steady_clock::now();
+	return cache.erase_if([now](const typename Multimap::key_type&, 
+	                            const typename Multimap::set_type& records, 
+	                            std::chrono::steady_clock::time_point expirationTime){
+		if(expirationTime>now)
+			return false;
+		for(const auto& record : records){
+			if(record)
+				return false;
+		}
+		return true;
+	});
+}
+
+///\return the memory used by an object's members beyond their own sizes
+template<typename T>
+std::size_t extraMemoryUsage(const T& t){ return approximateMemoryUsage(t)-sizeof(T); }
+template<typename T, typename... Others>
+std::size_t extraMemoryUsage(const T& t, const Others&... others){
+	return extraMemoryUsage(t)+extraMemoryUsage(others...);
+}
+
+using DatabaseItem=Aws::Map<Aws::String,Aws::DynamoDB::Model::AttributeValue>;
+
+User userFromItem(const DatabaseItem& item){
+	User user;
+	user.valid=true;
+	user.id=findOrThrow(item,"ID","user record missing ID attribute").GetS();
+	user.name=findOrThrow(item,"name","user record missing name attribute").GetS();
+	user.email=findOrThrow(item,"email","user record missing email attribute").GetS();
+	user.phone=findOrDefault(item,"phone",missingString).GetS();
+	user.institution=findOrDefault(item,"institution",missingString).GetS();
+	user.token=findOrThrow(item,"token","user record missing token attribute").GetS();
+	user.globusID=findOrThrow(item,"globusID","user record missing globusID attribute").GetS();
+	user.admin=findOrThrow(item,"admin","user record missing admin attribute").GetBool();
+	return user;
+}
+
+Group groupFromItem(const DatabaseItem& item){
+	Group group;
+	group.valid=true;
+	group.id=findOrThrow(item,"ID","Group record missing ID attribute").GetS();
+	group.name=findOrThrow(item,"name","Group record missing name attribute").GetS();
+	group.email=findOrDefault(item,"email",missingString).GetS();
+	group.phone=findOrDefault(item,"phone",missingString).GetS();
+	group.scienceField=findOrDefault(item,"scienceField",missingString).GetS();
+	group.description=findOrDefault(item,"description",missingString).GetS();
+	return group;
+}
+
+Cluster clusterFromItem(const DatabaseItem& item){
+	Cluster cluster;
+	cluster.valid=true;
+	cluster.id=findOrThrow(item,"ID","Cluster record missing ID attribute").GetS();
+	cluster.name=findOrThrow(item,"name","Cluster record missing name attribute").GetS();
+	cluster.owningGroup=findOrThrow(item,"owningGroup","Cluster record missing owningGroup attribute").GetS();
+	cluster.config=findOrThrow(item,"config","Cluster record missing config attribute").GetS();
+	cluster.systemNamespace=findOrThrow(item,"systemNamespace","Cluster record missing systemNamespace attribute").GetS();
+	cluster.owningOrganization=findOrDefault(item,"owningOrganization",missingString).GetS();
+	cluster.monitoringCredential=S3Credential::deserialize(findOrDefault(item,"monCredential",missingString).GetS());
+	return cluster;
+}
+
+std::vector<GeoLocation> locationsFromItem(const std::string& cID, const DatabaseItem& item){
+	std::vector<GeoLocation> result;
+	const Aws::Vector<Aws::String> rawPositions=findOrThrow(item,"locations","Cluster location record missing locations attribute").GetSS();
+	for(const auto& sPos : rawPositions){
+		try{
+			result.push_back(boost::lexical_cast<GeoLocation>(sPos));
+		}
+		catch(boost::bad_lexical_cast& blc){
+			log_fatal("Malformatted location stored for cluster " << cID << ": " << blc.what());
+		}
+	}
+	return result;
+}
+
+ApplicationInstance instanceFromItem(const DatabaseItem& item){
+	ApplicationInstance instance;
+	instance.valid=true;
+	instance.id=findOrThrow(item,"ID","Instance record missing ID attribute").GetS();
+	instance.name=findOrThrow(item,"name","Instance record missing name attribute").GetS();
+	instance.application=findOrThrow(item,"application","Instance record missing application attribute").GetS();
+	instance.owningGroup=findOrThrow(item,"owningGroup","Instance record missing owning Group attribute").GetS();
+	instance.cluster=findOrThrow(item,"cluster","Instance record missing cluster attribute").GetS();
+	instance.ctime=findOrThrow(item,"ctime","Instance record missing ctime attribute").GetS();
+	return instance;
+}
+
+///Construct a volume claim from its database record, without the selector 
+///details, which are not needed for listings
+PersistentVolumeClaim volumeClaimSummaryFromItem(const DatabaseItem& item){
+	PersistentVolumeClaim pvc;
+	pvc.valid=true;
+	pvc.id=findOrThrow(item,"ID","Volume record missing ID attribute").GetS();
+	pvc.name=findOrThrow(item,"name","Volume record missing name attribute").GetS();
+	pvc.group=findOrThrow(item,"owningGroup","Volume record missing owning group attribute").GetS();
+	pvc.cluster=findOrThrow(item,"cluster","Volume record missing cluster attribute").GetS();
+	pvc.storageRequest=findOrThrow(item,"storageRequest","Volume record missing storageRequest attribute").GetS();
+	pvc.accessMode=accessModeFromString(findOrThrow(item,"accessMode","Volume record missing accessMode attribute").GetS());
+	pvc.volumeMode=volumeModeFromString(findOrThrow(item,"volumeMode","Volume record missing volumeMode attribute").GetS());
+	pvc.ctime=findOrThrow(item,"ctime","Volume missing ctime attribute").GetS();
+	pvc.storageClass=findOrThrow(item,"storageClass","Volume record missing storageClass attribute").GetS();
+	return pvc;
+}
+
+Operation operationFromItem(const DatabaseItem& item){
+	Operation operation;
+	operation.valid=true;
+	operation.id=findOrThrow(item,"ID","Operation record missing ID attribute").GetS();
+	operation.kind=findOrThrow(item,"kind","Operation record missing kind attribute").GetS();
+	operation.target=findOrThrow(item,"target","Operation record missing target attribute").GetS();
+	operation.user=findOrThrow(item,"user","Operation record missing user attribute").GetS();
+	operation.parameters=findOrThrow(item,"parameters","Operation record missing parameters attribute").GetS();
+	operation.state=operationStateFromString(findOrThrow(item,"state","Operation record missing state attribute").GetS());
+	operation.progress=findOrThrow(item,"progress","Operation record missing progress attribute").GetS();
+	auto result=item.find("result");
+	if(result!=item.end())
+		operation.result=result->second.GetS();
+	operation.ctime=findOrThrow(item,"ctime","Operation record missing ctime attribute").GetS();
+	operation.mtime=findOrThrow(item,"mtime","Operation record missing mtime attribute").GetS();
+	auto owner=item.find("owner");
+	if(owner!=item.end())
+		operation.owner=owner->second.GetS();
+	auto lease=item.find("leaseExpires");
+	if(lease!=item.end())
+		operation.leaseExpiration=std::stoll(lease->second.GetN());
+	return operation;
+}
+
+///The suffix of the sort key of the record listing a cluster's locations
+const std::string locationsSortKeySuffix=":Locations";
+
+//default durations for which cached records remain valid
+const std::chrono::seconds defaultUserCacheValidity=std::chrono::minutes(5);
+const std::chrono::seconds defaultGroupCacheValidity=std::chrono::minutes(30);
+const std::chrono::seconds defaultClusterCacheValidity=std::chrono::minutes(30);
+const std::chrono::seconds defaultInstanceCacheValidity=std::chrono::minutes(5);
+const std::chrono::seconds defaultSecretCacheValidity=std::chrono::minutes(5);
+const std::chrono::seconds defaultVolumeCacheValidity=std::chrono::minutes(5);
+
+///The prefix of the hash keys under which records in the change log are 
+///stored. Each replica spreads its changes across changeLogShards keys, so 
+///that the writes of all replicas do not fall on a single partition, and each
+///poll queries all of the keys. 
+const std::string changeLogKeyPrefix="changes:";
+const unsigned int changeLogShards=16;
+///The provisioned capacity of the change log table. Each change made through
+///any replica writes one item of well under 1 kB, using one write unit, and 
+///each poll by each replica makes changeLogShards strongly consistent queries,
+///each using at least one read unit. The write capacity must therefore be at
+///least the peak rate of changes, summed over all replicas, and the read 
+///capacity at least changeLogShards times the number of replicas divided by
+///the poll interval in seconds. These values support about 50 changes per 
+///second and 50 replicas polling every 20 seconds; larger installations 
+///should raise the capacity of the table, or switch it to on-demand billing. 
+const long long changeLogReadCapacity=50;
+const long long changeLogWriteCapacity=50;
+///The largest difference between the clocks of replicas which is tolerated. 
+///Each poll of the change log looks back this far before the previous poll, 
+///so that changes recorded with slightly older times are not missed. 
+const std::chrono::seconds changeClockSkewAllowance(30);
+///The time for which records in the change log are kept
+const std::chrono::hours changeRetention(1);
+///How often to report the progress of loading records into the caches
+const std::chrono::seconds preloadProgressInterval(5);
+
+///Format a time so that later times sort after earlier ones, for use in the
+///sort keys of the change log
+std::string changeLogTime(std::chrono::system_clock::time_point time){
+	long long micros=std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+	char buf[24];
+	snprintf(buf,sizeof(buf),"%020lld",micros);
+	return buf;
 }
 
 } //anonymous namespace
 
+std::size_t approximateMemoryUsage(const User& user){
+	return sizeof(user)+extraMemoryUsage(user.id,user.name,user.email,user.phone,
+	                                     user.institution,user.token,user.globusID);
+}
+
+std::size_t approximateMemoryUsage(const Group& group){
+	return sizeof(group)+extraMemoryUsage(group.id,group.name,group.email,group.phone,
+	                                      group.scienceField,group.description);
+}
+
+std::size_t approximateMemoryUsage(const Cluster& cluster){
+	return sizeof(cluster)+extraMemoryUsage(cluster.id,cluster.name,cluster.config,
+	                                        cluster.systemNamespace,cluster.owningGroup,
+	                                        cluster.owningOrganization,
+	                                        cluster.monitoringCredential.accessKey,
+	                                        cluster.monitoringCredential.secretKey);
+}
+
+std::size_t approximateMemoryUsage(const GeoLocation& location){
+	return sizeof(location)+extraMemoryUsage(location.description);
+}
+
+std::size_t approximateMemoryUsage(const ApplicationInstance& instance){
+	return sizeof(instance)+extraMemoryUsage(instance.id,instance.name,instance.application,
+	                                         instance.owningGroup,instance.cluster,
+	                                         instance.config,instance.ctime);
+}
+
+std::size_t approximateMemoryUsage(const Secret& secret){
+	return sizeof(secret)+extraMemoryUsage(secret.id,secret.name,secret.group,
+	                                       secret.cluster,secret.ctime,secret.data);
+}
+
+std::size_t approximateMemoryUsage(const PersistentVolumeClaim& pvc){
+	return sizeof(pvc)+extraMemoryUsage(pvc.id,pvc.name,pvc.group,pvc.cluster,
+	                                    pvc.storageRequest,pvc.storageClass,
+	                                    pvc.selectorMatchLabel,pvc.ctime,
+	                                    pvc.selectorLabelExpressions);
+}
+
+std::size_t approximateMemoryUsage(const commandResult& result){
+	return sizeof(result)+extraMemoryUsage(result.output,result.error);
+}
+
 ///Check whether the set of cached records for a category is up to date, and if
 ///so return only those which are not stale. 
 #define maybeReturnCachedCategoryMembers(cache,key) \
@@ -194,7 +435,8 @@ do{ \
 	using ResultType=typename decltype(cache)::mapped_type::value_type; \
 	std::vector<ResultType> results; \
 	if(cachedCategory.second > std::chrono::steady_clock::now()){ \
-		for(const auto record : cachedCategory.first){ \
+		results.reserve(cachedCategory.first->size()); \
+		for(const auto& record : *cachedCategory.first){ \
 			if(record){ \
 				results.push_back(record); \
 				cacheHits++; \
@@ -221,26 +463,79 @@ PersistentStore::PersistentStore(const Aws::Auth::AWSCredentials& credentials,
 	secretTableName("SLATE_secrets"),
 	monCredTableName("SLATE_moncreds"),
 	volumeTableName("SLATE_volumes"),
+	operationTableName("SLATE_operations"),
+	changeTableName("SLATE_changes"),
 	dnsClient(credentials,clientConfig),
 	baseDomain("slateci.net"),
 	clusterConfigDir(makeTemporaryDir("/var/tmp/slate_")),
-	userCacheValidity(std::chrono::minutes(5)),
+	negativeCacheValidity(std::chrono::seconds(30)),
+	userCacheValidity(defaultUserCacheValidity),
 	userCacheExpirationTime(std::chrono::steady_clock::now()),
-	groupCacheValidity(std::chrono::minutes(30)),
+	userCache("User"),
+	userByTokenCache("User by token"),
+	userByGlobusIDCache("User by Globus ID"),
+	groupMembershipCache("Group membership"),
+	groupCacheValidity(defaultGroupCacheValidity),
 	groupCacheExpirationTime(std::chrono::steady_clock::now()),
-	clusterCacheValidity(std::chrono::minutes(30)),
+	groupCache("Group"),
+	groupByNameCache("Group by name"),
+	clusterCacheValidity(defaultClusterCacheValidity),
 	clusterCacheExpirationTime(std::chrono::steady_clock::now()),
-	instanceCacheValidity(std::chrono::minutes(5)),
+	clusterCache("Cluster"),
+	clusterByNameCache("Cluster by name"),
+	clusterGroupAccessCache("Cluster access"),
+	clusterGroupApplicationCache("Cluster application whitelist"),
+	clusterLocationCache("Cluster location"),
+	clusterConnectivityCache("Cluster connectivity"),
+	clusterObjectCacheValidity(std::chrono::minutes(5)),
+	clusterObjectRefreshMargin(std::chrono::minutes(1)),
+	clusterObjectCache("Cluster object listing"),
+	clusterObjectGeneration(0),
+	instanceCacheValidity(defaultInstanceCacheValidity),
 	instanceCacheExpirationTime(std::chrono::steady_clock::now()),
-	secretCacheValidity(std::chrono::minutes(5)),
-	volumeCacheValidity(std::chrono::minutes(5)),
+	instanceCache("Instance"),
+	instanceConfigCache("Instance config"),
+	secretCacheValidity(defaultSecretCacheValidity),
+	secretCache("Secret"),
+	decryptedSecretCacheValidity(0),
+	decryptedSecretCache("Decrypted secret data"),
+	volumeCacheValidity(defaultVolumeCacheValidity),
 	volumeCacheExpirationTime(std::chrono::steady_clock::now()),
+	volumeCache("Volume"),
+	evictingCaches{&userCache,&userByTokenCache,&userByGlobusIDCache,&groupMembershipCache,
+	               &groupCache,&groupByNameCache,&clusterCache,&clusterByNameCache,
+	               &clusterGroupAccessCache,&clusterGroupApplicationCache,
+	               &clusterLocationCache,&clusterConnectivityCache,&clusterObjectCache,
+	               &instanceCache,&instanceConfigCache,&secretCache,
+	               &decryptedSecretCache,&volumeCache},
 	secretKey(1024),
 	appLoggingServerName(appLoggingServerName),
 	appLoggingServerPort(appLoggingServerPort),
-	cacheHits(0),databaseQueries(0),databaseScans(0)
+	commandExecutor(new Executor("Cluster command",16,4)),
+	clusterObjectRefreshTasks(new Executor::TaskGroup(*commandExecutor,0,Executor::Priority::Bulk)),
+	replicaID(idGenerator.generateReplicaID()),
+	operationScheduler(new OperationScheduler(*this,8)),
+	scanSegments(1),
+	cacheHits(0),databaseQueries(0),databaseScans(0),
+	negativeCacheHits(0),coalescedLookups(0),clusterObjectRefreshCount(0),
+	decryptedSecretCacheHits(0),cacheCategoriesSwept(0),
+	changeLogEnabled(false),changeCounter(0),
+	lastChangePoll(std::chrono::system_clock::now()),
+	changesRecorded(0),changesNotRecorded(0),changesApplied(0),changePolls(0),
+	recordsPreloaded(0)
 {
+	//Once any record is removed from a cache of a whole table without the 
+	//record being deleted, the cache no longer holds a full listing. 
+	using steady_clock=std::chrono::steady_clock;
+	userCache.setRemovalHandler([this]{ userCacheExpirationTime=steady_clock::time_point::min(); });
+	groupCache.setRemovalHandler([this]{ groupCacheExpirationTime=steady_clock::time_point::min(); });
+	clusterCache.setRemovalHandler([this]{ clusterCacheExpirationTime=steady_clock::time_point::min(); });
+	instanceCache.setRemovalHandler([this]{ instanceCacheExpirationTime=steady_clock::time_point::min(); });
+	volumeCache.setRemovalHandler([this]{ volumeCacheExpirationTime=steady_clock::time_point::min(); });
+	setCacheSweepInterval(std::chrono::seconds(60));
+	
 	loadEncyptionKey(encryptionKeyFile);
+	secretCipher.reset(new SecretCipher(secretKey));
 	log_info("Starting database client");
 	InitializeTables(bootstrapUserFile);
 	log_info("Database client ready");
@@ -1019,6 +1314,120 @@ using namespace Aws::DynamoDB::Model;
 	}
 }
 
+void PersistentStore::InitializeOperationTable(){
+	using namespace Aws::DynamoDB::Model;
+	using AttDef=Aws::DynamoDB::Model::AttributeDefinition;
+	using SAT=Aws::DynamoDB::Model::ScalarAttributeType;
+	
+	//define indices
+	auto getByUserIndex=[](){
+		return GlobalSecondaryIndex()
+		       .WithIndexName("ByUser")
+		       .WithKeySchema({KeySchemaElement()
+		                       .WithAttributeName("user")
+		                       .WithKeyType(KeyType::HASH)})
+		       .WithProjection(Projection()
+		                       .WithProjectionType(ProjectionType::ALL))
+		       .WithProvisionedThroughput(ProvisionedThroughput()
+		                                  .WithReadCapacityUnits(1)
+		                                  .WithWriteCapacityUnits(1));
+	};
+	
+	//check status of the table
+	auto operationTableOut=dbClient.DescribeTable(DescribeTableRequest()
+	                                              .WithTableName(operationTableName));
+	if(!operationTableOut.IsSuccess() &&
+	   operationTableOut.GetError().GetErrorType()!=Aws::DynamoDB::DynamoDBErrors::RESOURCE_NOT_FOUND){
+		log_fatal("Unable to connect to DynamoDB: "
+		          << operationTableOut.GetError().GetMessage());
+	}
+	if(!operationTableOut.IsSuccess()){
+		log_info("Operations table does not exist; creating");
+		auto request=CreateTableRequest();
+		request.SetTableName(operationTableName);
+		request.SetAttributeDefinitions({
+			AttDef().WithAttributeName("ID").WithAttributeType(SAT::S),
+			AttDef().WithAttributeName("sortKey").WithAttributeType(SAT::S),
+			AttDef().WithAttributeName("user").WithAttributeType(SAT::S),
+		});
+		request.SetKeySchema({
+			KeySchemaElement().WithAttributeName("ID").WithKeyType(KeyType::HASH),
+			KeySchemaElement().WithAttributeName("sortKey").WithKeyType(KeyType::RANGE)
+		});
+		request.SetProvisionedThroughput(ProvisionedThroughput()
+		                                 .WithReadCapacityUnits(1)
+		                                 .WithWriteCapacityUnits(1));
+		request.AddGlobalSecondaryIndexes(getByUserIndex());
+		
+		auto createOut=dbClient.CreateTable(request);
+		if(!createOut.IsSuccess())
+			log_fatal("Failed to create operations table: " + createOut.GetError().GetMessage());
+		
+		waitTableReadiness(dbClient,operationTableName);
+		log_info("Created operations table");
+	}
+	else{ //table exists; check whether any indices are missing
+		const TableDescription& tableDesc=operationTableOut.GetResult().GetTable();
+		
+		if(!hasIndex(tableDesc,"ByUser")){
+			auto request=updateTableWithNewSecondaryIndex(operationTableName,getByUserIndex());
+			request.WithAttributeDefinitions({AttDef().WithAttributeName("user").WithAttributeType(SAT::S)});
+			auto createOut=dbClient.UpdateTable(request);
+			if(!createOut.IsSuccess())
+				log_fatal("Failed to add by-user index to operation table: " + createOut.GetError().GetMessage());
+			waitTableReadiness(dbClient,operationTableName);
+			log_info("Added by-user index to operation table");
+		}
+	}
+}
+
+void PersistentStore::InitializeChangeTable(){
+	using namespace Aws::DynamoDB::Model;
+	using AttDef=Aws::DynamoDB::Model::AttributeDefinition;
+	using SAT=Aws::DynamoDB::Model::ScalarAttributeType;
+	
+	//check status of the table
+	auto changeTableOut=dbClient.DescribeTable(DescribeTableRequest()
+	                                           .WithTableName(changeTableName));
+	if(!changeTableOut.IsSuccess() &&
+	   changeTableOut.GetError().GetErrorType()!=Aws::DynamoDB::DynamoDBErrors::RESOURCE_NOT_FOUND){
+		log_fatal("Unable to connect to DynamoDB: "
+		          << changeTableOut.GetError().GetMessage());
+	}
+	if(!changeTableOut.IsSuccess()){
+		log_info("Changes table does not exist; creating");
+		auto request=CreateTableRequest();
+		request.SetTableName(changeTableName);
+		request.SetAttributeDefinitions({
+			AttDef().WithAttributeName("ID").WithAttributeType(SAT::S),
+			AttDef().WithAttributeName("sortKey").WithAttributeType(SAT::S),
+		});
+		request.SetKeySchema({
+			KeySchemaElement().WithAttributeName("ID").WithKeyType(KeyType::HASH),
+			KeySchemaElement().WithAttributeName("sortKey").WithKeyType(KeyType::RANGE)
+		});
+		request.SetProvisionedThroughput(ProvisionedThroughput()
+		                                 .WithReadCapacityUnits(changeLogReadCapacity)
+		                                 .WithWriteCapacityUnits(changeLogWriteCapacity));
+		
+		auto createOut=dbClient.CreateTable(request);
+		if(!createOut.IsSuccess())
+			log_fatal("Failed to create changes table: " + createOut.GetError().GetMessage());
+		
+		waitTableReadiness(dbClient,changeTableName);
+		
+		//old changes are of no further use, so let the database delete them
+		auto ttlOut=dbClient.UpdateTimeToLive(UpdateTimeToLiveRequest()
+		                                      .WithTableName(changeTableName)
+		                                      .WithTimeToLiveSpecification(TimeToLiveSpecification()
+		                                                                   .WithAttributeName("expires")
+		                                                                   .WithEnabled(true)));
+		if(!ttlOut.IsSuccess())
+			log_warn("Failed to enable expiration of old changes: " << ttlOut.GetError().GetMessage());
+		log_info("Created changes table");
+	}
+}
+
 void PersistentStore::InitializeTables(std::string bootstrapUserFile){
 	InitializeUserTable(bootstrapUserFile);
 	InitializeGroupTable();
@@ -1027,6 +1436,8 @@ void PersistentStore::InitializeTables(std::string bootstrapUserFile){
 	InitializeSecretTable();
 	InitializeMonCredTable();
 	InitializeVolumeTable();
+	InitializeOperationTable();
+	InitializeChangeTable();
 }
 
 void PersistentStore::loadEncyptionKey(const std::string& fileName){
@@ -1066,10 +1477,143 @@ bool PersistentStore::addUser(const User& user){
 	replaceCacheRecord(userCache,user.id,record);
 	replaceCacheRecord(userByTokenCache,user.token,record);
 	replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
+	recordChange("user",user.id);
 	
 	return true;
 }
 
+bool PersistentStore::batchGetItems(const std::string& tableName, 
+                                    const std::vector<std::string>& ids, 
+                                    const std::string& sortKeySuffix,
+                                    std::vector<DatabaseItem>& items){
+	using Aws::DynamoDB::Model::AttributeValue;
+	using Aws::DynamoDB::Model::KeysAndAttributes;
+	//DynamoDB accepts no more than this many keys in a single request
+	const std::size_t maxKeysPerRequest=100;
+	//number of times to request keys which DynamoDB declines to process, 
+	//typically because of throttling, before giving up on them
+	const unsigned int maxAttempts=8;
+	
+	bool complete=true;
+	items.reserve(items.size()+ids.size());
+	for(std::size_t start=0; start<ids.size(); start+=maxKeysPerRequest){
+		Aws::Vector<DatabaseItem> keys;
+		for(std::size_t i=start; i<ids.size() && i<start+maxKeysPerRequest; i++)
+			keys.push_back({{"ID",AttributeValue(ids[i])},
+			                {"sortKey",AttributeValue(ids[i]+sortKeySuffix)}});
+		KeysAndAttributes request;
+		request.SetKeys(keys);
+		std::chrono::milliseconds backoff(25);
+		for(unsigned int attempt=1; ; attempt++){
+			databaseQueries++;
+			auto outcome=dbClient.BatchGetItem(Aws::DynamoDB::Model::BatchGetItemRequest()
+			                                   .WithRequestItems({{tableName,request}}));
+			if(!outcome.IsSuccess()){
+				auto err=outcome.GetError();
+				log_error("Failed to fetch records from " << tableName << ": " << err.GetMessage());
+				complete=false;
+				break;
+			}
+			const auto& result=outcome.GetResult();
+			auto found=result.GetResponses().find(tableName);
+			if(found!=result.GetResponses().end())
+				items.insert(items.end(),found->second.begin(),found->second.end());
+			auto unprocessed=result.GetUnprocessedKeys().find(tableName);
+			if(unprocessed==result.GetUnprocessedKeys().end() || unprocessed->second.GetKeys().empty())
+				break;
+			if(attempt==maxAttempts){
+				log_error("Giving up on fetching " << unprocessed->second.GetKeys().size() 
+				          << " records from " << tableName << " after " << attempt << " attempts");
+				complete=false;
+				break;
+			}
+			request=unprocessed->second;
+			std::this_thread::sleep_for(backoff);
+			backoff*=2;
+		}
+	}
+	return complete;
+}
+
+bool PersistentStore::queryAll(Aws::DynamoDB::Model::QueryRequest request, 
+                               const ItemHandler& handle){
+	while(true){
+		auto outcome=dbClient.Query(request);
+		if(!outcome.IsSuccess()){
+			auto err=outcome.GetError();
+			log_error("Failed to query " << request.GetTableName() << ": " << err.GetMessage());
+			return false;
+		}
+		const auto& result=outcome.GetResult();
+		for(const auto& item : result.GetItems())
+			handle(item);
+		//continue with the next page, if there is one
+		if(result.GetLastEvaluatedKey().empty())
+			return true;
+		request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
+	}
+}
+
+bool PersistentStore::scanAll(Aws::DynamoDB::Model::ScanRequest request, 
+                              const ItemHandler& handle,
+                              const std::function<bool()>& shouldStop){
+	auto scanSegment=[this,&shouldStop](Aws::DynamoDB::Model::ScanRequest request, 
+	                                    const ItemHandler& handle)->bool{
+		while(true){
+			if(shouldStop && shouldStop())
+				return false;
+			auto outcome=dbClient.Scan(request);
+			if(!outcome.IsSuccess()){
+				auto err=outcome.GetError();
+				log_error("Failed to scan " << request.GetTableName() << ": " << err.GetMessage());
+				return false;
+			}
+			const auto& result=outcome.GetResult();
+			for(const auto& item : result.GetItems())
+				handle(item);
+			//continue with the next page, if there is one
+			if(result.GetLastEvaluatedKey().empty())
+				return true;
+			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
+		}
+	};
+	
+	const unsigned int segments=scanSegments.load();
+	if(segments<=1)
+		return scanSegment(request,handle);
+	
+	//Scan each segment of the table on its own thread. Items are passed to the
+	//handler one at a time, so it need not be thread-safe. 
+	std::mutex handlerMutex;
+	ItemHandler serializedHandle=[&](const DatabaseItem& item){
+		std::lock_guard<std::mutex> lock(handlerMutex);
+		handle(item);
+	};
+	std::vector<std::future<bool>> results;
+	results.reserve(segments);
+	request.SetTotalSegments(segments);
+	for(unsigned int i=0; i<segments; i++){
+		request.SetSegment(i);
+		results.push_back(std::async(std::launch::async,scanSegment,request,std::cref(serializedHandle)));
+	}
+	//wait for every segment to finish before reporting any failure, since 
+	//they all refer to the handler
+	bool complete=true;
+	std::exception_ptr error;
+	for(auto& result : results){
+		try{
+			if(!result.get())
+				complete=false;
+		}catch(...){
+			if(!error)
+				error=std::current_exception();
+		}
+	}
+	if(error)
+		std::rethrow_exception(error);
+	return complete;
+}
+
 User PersistentStore::getUser(const std::string& id){
 	//first see if we have this cached
 	{
@@ -1098,16 +1642,7 @@ User PersistentStore::getUser(const std::string& id){
 	const auto& item=outcome.GetResult().GetItem();
 	if(item.empty()) //no match found
 		return User{};
-	User user;
-	user.valid=true;
-	user.id=id;
-	user.name=findOrThrow(item,"name","user record missing name attribute").GetS();
-	user.email=findOrThrow(item,"email","user record missing email attribute").GetS();
-	user.phone=findOrDefault(item,"phone",missingString).GetS();
-	user.institution=findOrDefault(item,"institution",missingString).GetS();
-	user.token=findOrThrow(item,"token","user record missing token attribute").GetS();
-	user.globusID=findOrThrow(item,"globusID","user record missing globusID attribute").GetS();
-	user.admin=findOrThrow(item,"admin","user record missing admin attribute").GetBool();
+	User user=userFromItem(item);
 	
 	//update caches
 	CacheRecord<User> record(user,userCacheValidity);
@@ -1118,6 +1653,39 @@ User PersistentStore::getUser(const std::string& id){
 	return user;
 }
 
+std::map<std::string,User> PersistentStore::getUsers(const std::vector<std::string>& ids, bool* complete){
+	std::map<std::string,User> users;
+	if(complete)
+		*complete=true;
+	std::vector<std::string> toFetch;
+	for(const auto& id : std::set<std::string>(ids.begin(),ids.end())){
+		CacheRecord<User> record;
+		if(userCache.find(id,record) && record){
+			cacheHits++;
+			users.emplace(id,record.record);
+		}
+		else
+			toFetch.push_back(id);
+	}
+	if(toFetch.empty())
+		return users;
+	
+	log_info("Querying database for " << toFetch.size() << " users");
+	std::vector<DatabaseItem> items;
+	bool fetchedAll=batchGetItems(userTableName,toFetch,"",items);
+	if(complete)
+		*complete=fetchedAll;
+	for(const auto& item : items){
+		User user=userFromItem(item);
+		CacheRecord<User> record(user,userCacheValidity);
+		replaceCacheRecord(userCache,user.id,record);
+		replaceCacheRecord(userByTokenCache,user.token,record);
+		replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
+		users.emplace(user.id,user);
+	}
+	return users;
+}
+
 User PersistentStore::findUserByToken(const std::string& token){
 	//first see if we have this cached
 	{
@@ -1125,12 +1693,24 @@ User PersistentStore::findUserByToken(const std::string& token){
 		if(userByTokenCache.find(token,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
+				//an invalid user indicates that the token is known not to exist
+				if(record.record)
+					cacheHits++;
+				else
+					negativeCacheHits++;
 				return record;
 			}
 		}
 	}
-	//need to query the database
+	//need to query the database, unless another thread is already doing so
+	bool shared;
+	User user=userByTokenLookups.run(token,[&]{ return queryUserByToken(token); },shared);
+	if(shared)
+		coalescedLookups++;
+	return user;
+}
+
+User PersistentStore::queryUserByToken(const std::string& token){
 	databaseQueries++;
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto request=Aws::DynamoDB::Model::QueryRequest()
@@ -1150,8 +1730,12 @@ User PersistentStore::findUserByToken(const std::string& token){
 		return User();
 	}
 	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0)
+	if(queryResult.GetCount()==0){
+		//remember briefly that there is no such user, so that repeated use of 
+		//a bad token does not turn into repeated queries
+		replaceCacheRecord(userByTokenCache,token,CacheRecord<User>(User(),negativeCacheValidity));
 		return User();
+	}
 	if(queryResult.GetCount()>1)
 		log_fatal("Multiple user records are associated with token " << token << '!');
 	
@@ -1260,6 +1844,7 @@ bool PersistentStore::updateUser(const User& user, const User& oldUser){
 		userByTokenCache.erase(oldUser.token);
 	replaceCacheRecord(userByTokenCache,user.token,record);
 	replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
+	recordChange("user",user.id);
 	
 	return true;
 }
@@ -1294,81 +1879,55 @@ bool PersistentStore::removeUser(const std::string& id){
 		log_error("Failed to delete user record: " << err.GetMessage());
 		return false;
 	}
+	recordChange("user",id);
 	return true;
 }
 
 std::vector<User> PersistentStore::listUsers(){
 	std::vector<User> collected;
+	forEachUser([&collected](const User& user){ collected.push_back(user); });
+	return collected;
+}
+
+bool PersistentStore::forEachUser(const std::function<void(const User&)>& handle){
 	//First check if users are cached
 	if(userCacheExpirationTime.load() > std::chrono::steady_clock::now()){
-		auto table = userCache.lock_table();
-		for(auto itr = table.cbegin(); itr != table.cend(); itr++){
-			auto user = itr->second;
+		userCache.for_each([&](const std::string&, const CacheRecord<User>& record){
 			cacheHits++;
-			collected.push_back(user);
-		}
-		table.unlock();
-		return collected;
+			handle(record.record);
+		});
+		return true;
 	}
 	
 	databaseScans++;
+	//if records are evicted during the scan the cache will be incomplete
+	const std::size_t removals=userCache.removals();
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(userTableName);
-	//request.SetAttributesToGet({"ID","name","email"});
 	request.SetFilterExpression("attribute_not_exists(#groupID)");
 	request.SetExpressionAttributeNames({{"#groupID", "groupID"}});
-	bool keepGoing=false;
-	
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			//TODO: more principled logging or reporting of the nature of the error
-			auto err=outcome.GetError();
-			log_error("Failed to fetch user records: " << err.GetMessage());
-			return collected;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
-		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			User user;
-			user.valid=true;
-			user.id=item.find("ID")->second.GetS();
-			user.globusID=item.find("globusID")->second.GetS();
-			user.token=item.find("token")->second.GetS();
-			user.name=item.find("name")->second.GetS();
-			user.email=item.find("email")->second.GetS();
-			user.phone=findOrDefault(item,"phone",missingString).GetS();
-			user.institution=findOrDefault(item,"institution",missingString).GetS();
-			user.admin=item.find("admin")->second.GetBool();
-			collected.push_back(user);
-
-			CacheRecord<User> record(user,userCacheValidity);
-	replaceCacheRecord(		userCache,user.id,record);
-		}
-	}while(keepGoing);
-	userCacheExpirationTime=std::chrono::steady_clock::now()+userCacheValidity;
+	bool complete=scanAll(request,[&](const DatabaseItem& item){
+		User user=userFromItem(item);
+		CacheRecord<User> record(user,userCacheValidity);
+		replaceCacheRecord(userCache,user.id,record);
+		handle(user);
+	});
+	if(complete && userCache.removals()==removals)
+		userCacheExpirationTime=std::chrono::steady_clock::now()+userCacheValidity;
 	
-	return collected;
+	return complete;
 }
 
 std::vector<User> PersistentStore::listUsersByGroup(const std::string& group){
 	//first check if list of users is cached
 	auto cached = userByGroupCache.find(group);
 	if (cached.second > std::chrono::steady_clock::now()) {
-		auto records = cached.first;
+		std::vector<std::string> ids;
+		for (const auto& record : *cached.first)
+			ids.push_back(record.record);
 		std::vector<User> users;
-		for (auto record : records) {
-			cacheHits++;
-			auto user = getUser(record);
-			users.push_back(user);
-		}
+		for (auto& user : getUsers(ids))
+			users.push_back(std::move(user.second));
 		return users;
 	}
 
@@ -1376,37 +1935,34 @@ std::vector<User> PersistentStore::listUsersByGroup(const std::string& group){
 	using AV=Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
 
-	Aws::DynamoDB::Model::QueryOutcome outcome;
-	outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-			       .WithTableName(userTableName)
-			       .WithIndexName("ByGroup")
-			       .WithKeyConditionExpression("#groupID = :group_val")
-			       .WithExpressionAttributeNames({{"#groupID", "groupID"}})
-			       .WithExpressionAttributeValues({{":group_val", AV(group)}})
-			       );
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to list Users by Group: " << err.GetMessage());
+	std::vector<std::string> ids;
+	bool complete=queryAll(Aws::DynamoDB::Model::QueryRequest()
+	                       .WithTableName(userTableName)
+	                       .WithIndexName("ByGroup")
+	                       .WithKeyConditionExpression("#groupID = :group_val")
+	                       .WithExpressionAttributeNames({{"#groupID", "groupID"}})
+	                       .WithExpressionAttributeValues({{":group_val", AV(group)}}),
+	                       [&ids](const DatabaseItem& item){
+		ids.push_back(findOrThrow(item, "ID", "User record missing ID attribute").GetS());
+	});
+	if(!complete){
+		log_error("Failed to list Users by Group");
 		return users;
 	}
-
-	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0)
+	if(ids.empty())
 		return users;
 
-	for(const auto& item : queryResult.GetItems()){
-		User user;
-		user.id=findOrThrow(item, "ID", "User record missing ID attribute").GetS();
-		user=getUser(user.id);
-		users.push_back(user);
-
+	//fetch all of the users' records together, rather than one at a time
+	for(auto& entry : getUsers(ids,&complete)){
 		//update caches
-		CacheRecord<User> record(user,userCacheValidity);
-		replaceCacheRecord(userCache,user.id,record);
-		CacheRecord<std::string> groupRecord(user.id,userCacheValidity);
+		CacheRecord<std::string> groupRecord(entry.first,userCacheValidity);
 		userByGroupCache.insert_or_assign(group,groupRecord);
+		users.push_back(std::move(entry.second));
 	}
-	userByGroupCache.update_expiration(group,std::chrono::steady_clock::now()+userCacheValidity);
+	//the cached list may only be used in place of the query if no user was 
+	//left out of it because the batch lookup gave up
+	if(complete)
+		userByGroupCache.update_expiration(group,std::chrono::steady_clock::now()+userCacheValidity);
 	
 	return users;	
 }
@@ -1437,8 +1993,10 @@ bool PersistentStore::addUserToGroup(const std::string& uID, std::string groupID
 	//update cache
 	CacheRecord<std::string> record(uID,userCacheValidity);
 	userByGroupCache.insert_or_assign(groupID,record);
+	replaceCacheRecord(groupMembershipCache,uID+":"+groupID,CacheRecord<bool>(true,userCacheValidity));
 	CacheRecord<Group> groupRecord(group,groupCacheValidity); 
 	groupByUserCache.insert_or_assign(user.id, groupRecord);
+	recordChange("membership",uID,groupID);
 	
 	return true;
 }
@@ -1450,11 +2008,13 @@ bool PersistentStore::removeUserFromGroup(const std::string& uID, std::string gr
 	
 	//remove any cache entry
 	userByGroupCache.erase(groupID,CacheRecord<std::string>(uID));
+	groupMembershipCache.erase(uID+":"+groupID);
 
-	CacheRecord<Group> record;
-	bool cached=groupCache.find(groupID,record);
-	if (cached)
-		groupByUserCache.erase(uID, record);
+	//groups are compared only by ID, so this removes the cached record 
+	//whether or not the rest of the group's data is known
+	Group group;
+	group.id=groupID;
+	groupByUserCache.erase(uID, CacheRecord<Group>(group));
 	
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto outcome=dbClient.DeleteItem(Aws::DynamoDB::Model::DeleteItemRequest()
@@ -1466,10 +2026,43 @@ bool PersistentStore::removeUserFromGroup(const std::string& uID, std::string gr
 		log_error("Failed to delete user Group membership record: " << err.GetMessage());
 		return false;
 	}
+	replaceCacheRecord(groupMembershipCache,uID+":"+groupID,CacheRecord<bool>(false,userCacheValidity));
+	recordChange("membership",uID,groupID);
 	return true;
 }
 
 std::vector<std::string> PersistentStore::getUserGroupMemberships(const std::string& uID, bool useNames){
+	std::vector<std::string> vos;
+	{ //first check whether the user's groups are cached
+		auto cached=groupByUserCache.find(uID);
+		if(cached.second > std::chrono::steady_clock::now()){
+			for(const auto& record : *cached.first){
+				if(record){
+					cacheHits++;
+					vos.push_back(useNames ? record.record.name : record.record.id);
+				}
+			}
+			return vos;
+		}
+	}
+	//need to query the database, unless another thread is already doing so
+	bool shared;
+	vos=groupMembershipListLookups.run(uID,[&]{ return queryUserGroupMemberships(uID); },shared);
+	if(shared)
+		coalescedLookups++;
+	
+	if(useNames){
+		//do extra lookups to replace IDs with nicer names
+		for(std::string& groupStr : vos){
+			Group group=findGroupByID(groupStr);
+			groupStr=group.name;
+		}
+	}
+	
+	return vos;
+}
+
+std::vector<std::string> PersistentStore::queryUserGroupMemberships(const std::string& uID){
 	using Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
 	log_info("Querying database for user " << uID << " Group memberships");
@@ -1484,54 +2077,69 @@ std::vector<std::string> PersistentStore::getUserGroupMemberships(const std::str
 		{":id",AttributeValue(uID)},
 		{":prefix",AttributeValue(uID+":"+IDGenerator::groupIDPrefix)}
 	});
-	auto outcome=dbClient.Query(request);
 	std::vector<std::string> vos;
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to fetch user's Group membership records: " << err.GetMessage());
-		return vos;
-	}
-	
-	const auto& queryResult=outcome.GetResult();
-	for(const auto& item : queryResult.GetItems()){
+	bool complete=queryAll(request,[&vos](const DatabaseItem& item){
 		if(item.count("groupID"))
 			vos.push_back(item.find("groupID")->second.GetS());
+	});
+	if(!complete){
+		log_error("Failed to fetch user's Group membership records");
+		return vos;
 	}
 	
-	if(useNames){
-		//do extra lookups to replace IDs with nicer names
-		for(std::string& groupStr : vos){
-			Group group=findGroupByID(groupStr);
-			groupStr=group.name;
+	//update caches, which is only possible if all of the groups can be found
+	for(const std::string& groupID : vos){
+		Group group=findGroupByID(groupID);
+		if(!group){
+			complete=false;
+			continue;
 		}
+		groupByUserCache.insert_or_assign(uID,CacheRecord<Group>(group,groupCacheValidity));
+		replaceCacheRecord(groupMembershipCache,uID+":"+groupID,CacheRecord<bool>(true,userCacheValidity));
 	}
+	if(complete)
+		groupByUserCache.update_expiration(uID,std::chrono::steady_clock::now()+groupCacheValidity);
 	
 	return vos;
 }
 
 bool PersistentStore::userInGroup(const std::string& uID, std::string groupID){
-	//TODO: possible issue: We only store memberships, so repeated queries about
-	//a user's belonging to a Group to which that user does not in fact belong will
-	//never be in the cache, and will always incur a database query. This should
-	//not be a problem for normal/well intentioned use, but seems like a way to
-	//turn accident or malice into denial of service or a large AWS bill. 
-	
 	//check whether the 'ID' we got was actually a name
 	if(!normalizeGroupID(groupID))
 		return false;
 	
-	//first see if we have this cached
+	//first see if we have this cached, either as a membership or as a known 
+	//non-membership
+	const std::string key=uID+":"+groupID;
+	{
+		CacheRecord<bool> record;
+		if(groupMembershipCache.find(key,record) && record){
+			if(record.record)
+				cacheHits++;
+			else
+				negativeCacheHits++;
+			return record.record;
+		}
+	}
 	{
 		CacheRecord<std::string> record(uID);
 		if(userByGroupCache.find(groupID,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
 				cacheHits++;
-				return record;
+				return true;
 			}
 		}
 	}
-	//need to query the database
+	//need to query the database, unless another thread is already doing so
+	bool shared;
+	bool member=groupMembershipLookups.run(key,[&]{ return queryUserInGroup(uID,groupID); },shared);
+	if(shared)
+		coalescedLookups++;
+	return member;
+}
+
+bool PersistentStore::queryUserInGroup(const std::string& uID, const std::string& groupID){
 	databaseQueries++;
 	log_info("Querying database for user " << uID << " membership in Group " << groupID);
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -1545,12 +2153,17 @@ bool PersistentStore::userInGroup(const std::string& uID, std::string groupID){
 		return false;
 	}
 	const auto& item=outcome.GetResult().GetItem();
-	if(item.empty()) //no match found
+	if(item.empty()){ //no match found
+		//remember this briefly, so that repeated checks do not each reach 
+		//the database
+		storeNegativeCacheRecord(groupMembershipCache,uID+":"+groupID,negativeCacheValidity);
 		return false;
+	}
 	
 	//update cache
 	CacheRecord<std::string> record(uID,userCacheValidity);
 	userByGroupCache.insert_or_assign(groupID,record);
+	replaceCacheRecord(groupMembershipCache,uID+":"+groupID,CacheRecord<bool>(true,userCacheValidity));
 	
 	return true;
 }
@@ -1588,6 +2201,7 @@ bool PersistentStore::addGroup(const Group& group){
 	replaceCacheRecord(groupCache,group.id,record);
 	replaceCacheRecord(groupByNameCache,group.name,record);
         
+	recordChange("group",group.id);
 	return true;
 }
 
@@ -1628,6 +2242,7 @@ bool PersistentStore::removeGroup(const std::string& groupID){
 		log_error("Failed to delete Group record: " << err.GetMessage());
 		return false;
 	}
+	recordChange("group",groupID);
 	return true;
 }
 
@@ -1659,6 +2274,7 @@ bool PersistentStore::updateGroup(const Group& group){
 	//in principle we should update the groupByUserCache here, but we don't know 
 	//which users are the keys. However, that cache is used only for Group properties 
 	//which cannot be changed (ID, name), so failing to update it does not do any harm. 
+	recordChange("group",group.id);
 	
 	return true;
 }
@@ -1667,23 +2283,18 @@ std::vector<std::string> PersistentStore::getMembersOfGroup(const std::string gr
 	using Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
 	log_info("Querying database for members of Group " << groupID);
-	auto outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-	                            .WithTableName(userTableName)
-	                            .WithIndexName("ByGroup")
-	                            .WithKeyConditionExpression("#groupID = :id_val")
-	                            .WithExpressionAttributeNames({{"#groupID","groupID"}})
-								.WithExpressionAttributeValues({{":id_val",AttributeValue(groupID)}})
-	                            );
 	std::vector<std::string> users;
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to fetch Group membership records: " << err.GetMessage());
-		return users;
-	}
-	const auto& queryResult=outcome.GetResult();
-	users.reserve(queryResult.GetCount());
-	for(const auto& item : queryResult.GetItems())
+	bool complete=queryAll(Aws::DynamoDB::Model::QueryRequest()
+	                       .WithTableName(userTableName)
+	                       .WithIndexName("ByGroup")
+	                       .WithKeyConditionExpression("#groupID = :id_val")
+	                       .WithExpressionAttributeNames({{"#groupID","groupID"}})
+	                       .WithExpressionAttributeValues({{":id_val",AttributeValue(groupID)}}),
+	                       [&users](const DatabaseItem& item){
 		users.push_back(item.find("ID")->second.GetS());
+	});
+	if(!complete)
+		log_error("Failed to fetch Group membership records");
 	
 	return users;
 }
@@ -1692,23 +2303,18 @@ std::vector<std::string> PersistentStore::clustersOwnedByGroup(const std::string
 	using Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
 	log_info("Querying database for clusters owned by Group " << groupID);
-	auto outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-	                            .WithTableName(clusterTableName)
-	                            .WithIndexName("ByGroup")
-	                            .WithKeyConditionExpression("#groupID = :id_val")
-	                            .WithExpressionAttributeNames({{"#groupID","owningGroup"}})
-								.WithExpressionAttributeValues({{":id_val",AttributeValue(groupID)}})
-	                            );
 	std::vector<std::string> clusters;
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to fetch Group owned cluster records: " << err.GetMessage());
-		return clusters;
-	}
-	const auto& queryResult=outcome.GetResult();
-	clusters.reserve(queryResult.GetCount());
-	for(const auto& item : queryResult.GetItems())
+	bool complete=queryAll(Aws::DynamoDB::Model::QueryRequest()
+	                       .WithTableName(clusterTableName)
+	                       .WithIndexName("ByGroup")
+	                       .WithKeyConditionExpression("#groupID = :id_val")
+	                       .WithExpressionAttributeNames({{"#groupID","owningGroup"}})
+	                       .WithExpressionAttributeValues({{":id_val",AttributeValue(groupID)}}),
+	                       [&clusters](const DatabaseItem& item){
 		clusters.push_back(item.find("ID")->second.GetS());
+	});
+	if(!complete)
+		log_error("Failed to fetch Group owned cluster records");
 	
 	return clusters;
 }
@@ -1717,58 +2323,31 @@ std::vector<Group> PersistentStore::listGroups(){
 	//First check if vos are cached
 	std::vector<Group> collected;
 	if(groupCacheExpirationTime.load() > std::chrono::steady_clock::now()){
-	        auto table = groupCache.lock_table();
-		for(auto itr = table.cbegin(); itr != table.cend(); itr++){
-		        auto group = itr->second;
+		groupCache.for_each([&](const std::string&, const CacheRecord<Group>& record){
 			cacheHits++;
-			collected.push_back(group);
-		}
-	
-		table.unlock();
+			collected.push_back(record);
+		});
 		return collected;
 	}	
 
 	databaseScans++;
+	const std::size_t removals=groupCache.removals();
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(groupTableName);
 	request.SetFilterExpression("attribute_exists(#name)");
 	request.SetExpressionAttributeNames({{"#name","name"}});
-	bool keepGoing=false;
-	
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			//TODO: more principled logging or reporting of the nature of the error
-			auto err=outcome.GetError();
-			log_error("Failed to fetch Group records: " << err.GetMessage());
-			return collected;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
-		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			Group group;
-			group.valid=true;
-			group.id=findOrThrow(item,"ID","Group record missing ID attribute").GetS();
-			group.name=findOrThrow(item,"name","Group record missing name attribute").GetS();
-			group.email=findOrDefault(item,"email",missingString).GetS();
-			group.phone=findOrDefault(item,"phone",missingString).GetS();
-			group.scienceField=findOrDefault(item,"scienceField",missingString).GetS();
-			group.description=findOrDefault(item,"description",missingString).GetS();
-			collected.push_back(group);
+	bool complete=scanAll(request,[&](const DatabaseItem& item){
+		Group group=groupFromItem(item);
+		collected.push_back(group);
 
-			CacheRecord<Group> record(group,groupCacheValidity);
-			replaceCacheRecord(groupCache,group.id,record);
-			replaceCacheRecord(groupByNameCache,group.name,record);
-		}
-	}while(keepGoing);
-	groupCacheExpirationTime=std::chrono::steady_clock::now()+groupCacheValidity;
+		CacheRecord<Group> record(group,groupCacheValidity);
+		replaceCacheRecord(groupCache,group.id,record);
+		replaceCacheRecord(groupByNameCache,group.name,record);
+	});
+	if(complete && groupCache.removals()==removals)
+		groupCacheExpirationTime=std::chrono::steady_clock::now()+groupCacheValidity;
+	else
+		log_error("Failed to fetch Group records");
 	
 	return collected;
 }
@@ -1781,38 +2360,34 @@ std::vector<Group> PersistentStore::listGroupsForUser(const std::string& user){
 	using AV=Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
 
-	Aws::DynamoDB::Model::QueryOutcome outcome;
-	outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-			       .WithTableName(userTableName)
-			       .WithKeyConditionExpression("ID = :user_val")
-			       .WithFilterExpression("attribute_exists(#groupID)")
-			       .WithExpressionAttributeValues({{":user_val", AV(user)}})
-			       .WithExpressionAttributeNames({{"#groupID", "groupID"}})
-			       );
-
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to list groups by user: " << err.GetMessage());
+	std::vector<std::string> groupIDs;
+	bool complete=queryAll(Aws::DynamoDB::Model::QueryRequest()
+	                       .WithTableName(userTableName)
+	                       .WithKeyConditionExpression("ID = :user_val")
+	                       .WithFilterExpression("attribute_exists(#groupID)")
+	                       .WithExpressionAttributeValues({{":user_val", AV(user)}})
+	                       .WithExpressionAttributeNames({{"#groupID", "groupID"}}),
+	                       [&groupIDs](const DatabaseItem& item){
+		groupIDs.push_back(findOrThrow(item, "groupID", "User record missing groupID attribute").GetS());
+	});
+	if(!complete){
+		log_error("Failed to list groups by user");
 		return vos;
 	}
-
-	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0)
+	if(groupIDs.empty())
 		return vos;
 
-	for(const auto& item : queryResult.GetItems()){
-		std::string groupID = findOrThrow(item, "groupID", "User record missing groupID attribute").GetS();
-		
-	  	Group group = findGroupByID(groupID);
+	for(auto& entry : getGroups(groupIDs,&complete)){
+		const Group& group=entry.second;
 		vos.push_back(group);
 		
 		//update caches
 		CacheRecord<Group> record(group,groupCacheValidity);
-		replaceCacheRecord(groupCache,group.id,record);
-		groupByNameCache.insert_or_assign(group.name,record);
 		groupByUserCache.insert_or_assign(user,record);
 	}
-	groupByUserCache.update_expiration(user,std::chrono::steady_clock::now()+groupCacheValidity);
+	//the cached list is only complete if every group was actually looked up
+	if(complete)
+		groupByUserCache.update_expiration(user,std::chrono::steady_clock::now()+groupCacheValidity);
 	
 	return vos;
 }
@@ -1845,14 +2420,7 @@ Group PersistentStore::findGroupByID(const std::string& id){
 	const auto& item=outcome.GetResult().GetItem();
 	if(item.empty()) //no match found
 		return Group{};
-	Group group;
-	group.valid=true;
-	group.id=id;
-	group.name=findOrThrow(item,"name","Group record missing name attribute").GetS();
-	group.email=findOrDefault(item,"email",missingString).GetS();
-	group.phone=findOrDefault(item,"phone",missingString).GetS();
-	group.scienceField=findOrDefault(item,"scienceField",missingString).GetS();
-	group.description=findOrDefault(item,"description",missingString).GetS();
+	Group group=groupFromItem(item);
 	
 	//update caches
 	CacheRecord<Group> record(group,groupCacheValidity);
@@ -1862,6 +2430,38 @@ Group PersistentStore::findGroupByID(const std::string& id){
 	return group;
 }
 
+std::map<std::string,Group> PersistentStore::getGroups(const std::vector<std::string>& ids, bool* complete){
+	std::map<std::string,Group> groups;
+	if(complete)
+		*complete=true;
+	std::vector<std::string> toFetch;
+	for(const auto& id : std::set<std::string>(ids.begin(),ids.end())){
+		CacheRecord<Group> record;
+		if(groupCache.find(id,record) && record){
+			cacheHits++;
+			groups.emplace(id,record.record);
+		}
+		else
+			toFetch.push_back(id);
+	}
+	if(toFetch.empty())
+		return groups;
+	
+	log_info("Querying database for " << toFetch.size() << " Groups");
+	std::vector<DatabaseItem> items;
+	bool fetchedAll=batchGetItems(groupTableName,toFetch,"",items);
+	if(complete)
+		*complete=fetchedAll;
+	for(const auto& item : items){
+		Group group=groupFromItem(item);
+		CacheRecord<Group> record(group,groupCacheValidity);
+		replaceCacheRecord(groupCache,group.id,record);
+		replaceCacheRecord(groupByNameCache,group.name,record);
+		groups.emplace(group.id,group);
+	}
+	return groups;
+}
+
 Group PersistentStore::findGroupByName(const std::string& name){
 	//first see if we have this cached
 	{
@@ -1954,6 +2554,7 @@ bool PersistentStore::addCluster(const Cluster& cluster){
 	replaceCacheRecord(clusterByNameCache,cluster.name,record);
 	clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
 	writeClusterConfigToDisk(cluster);
+	recordChange("cluster",cluster.id);
 	
 	return true;
 }
@@ -1998,15 +2599,7 @@ Cluster PersistentStore::findClusterByID(const std::string& cID){
 	const auto& item=outcome.GetResult().GetItem();
 	if(item.empty()) //no match found
 		return Cluster{};
-	Cluster cluster;
-	cluster.valid=true;
-	cluster.id=cID;
-	cluster.name=findOrThrow(item,"name","Cluster record missing name attribute").GetS();
-	cluster.owningGroup=findOrThrow(item,"owningGroup","Cluster record missing owningGroup attribute").GetS();
-	cluster.config=findOrThrow(item,"config","Cluster record missing config attribute").GetS();
-	cluster.systemNamespace=findOrThrow(item,"systemNamespace","Cluster record missing systemNamespace attribute").GetS();
-	cluster.owningOrganization=findOrDefault(item,"owningOrganization",missingString).GetS();
-	cluster.monitoringCredential=S3Credential::deserialize(findOrDefault(item,"monCredential",missingString).GetS());
+	Cluster cluster=clusterFromItem(item);
 	
 	//cache this result for reuse
 	CacheRecord<Cluster> record(cluster,clusterCacheValidity);
@@ -2018,6 +2611,40 @@ Cluster PersistentStore::findClusterByID(const std::string& cID){
 	return cluster;
 }
 
+std::map<std::string,Cluster> PersistentStore::getClusters(const std::vector<std::string>& ids, bool* complete){
+	std::map<std::string,Cluster> clusters;
+	if(complete)
+		*complete=true;
+	std::vector<std::string> toFetch;
+	for(const auto& id : std::set<std::string>(ids.begin(),ids.end())){
+		CacheRecord<Cluster> record;
+		if(clusterCache.find(id,record) && record){
+			cacheHits++;
+			clusters.emplace(id,record.record);
+		}
+		else
+			toFetch.push_back(id);
+	}
+	if(toFetch.empty())
+		return clusters;
+	
+	log_info("Querying database for " << toFetch.size() << " clusters");
+	std::vector<DatabaseItem> items;
+	bool fetchedAll=batchGetItems(clusterTableName,toFetch,"",items);
+	if(complete)
+		*complete=fetchedAll;
+	for(const auto& item : items){
+		Cluster cluster=clusterFromItem(item);
+		CacheRecord<Cluster> record(cluster,clusterCacheValidity);
+		replaceCacheRecord(clusterCache,cluster.id,record);
+		clusterByNameCache.insert_or_assign(cluster.name,record);
+		clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
+		writeClusterConfigToDisk(cluster);
+		clusters.emplace(cluster.id,cluster);
+	}
+	return clusters;
+}
+
 Cluster PersistentStore::findClusterByName(const std::string& name){
 	//first see if we have this cached
 	{
@@ -2108,6 +2735,7 @@ bool PersistentStore::removeCluster(const std::string& cID){
 	clusterCache.erase(cID);
 	clusterConfigs.erase(cID);
 	clusterLocationCache.erase(cID);
+	invalidateClusterObjects(cID);
 	
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto outcome=dbClient.DeleteItem(Aws::DynamoDB::Model::DeleteItemRequest()
@@ -2122,12 +2750,13 @@ bool PersistentStore::removeCluster(const std::string& cID){
 	outcome=dbClient.DeleteItem(Aws::DynamoDB::Model::DeleteItemRequest()
 								.WithTableName(clusterTableName)
 								.WithKey({{"ID",AttributeValue(cID)},
-	                                      {"sortKey",AttributeValue(cID+":Locations")}}));
+	                                      {"sortKey",AttributeValue(cID+locationsSortKeySuffix)}}));
 	if(!outcome.IsSuccess()){
 		auto err=outcome.GetError();
 		log_error("Failed to delete cluster location record: " << err.GetMessage());
 		return false;
 	}
+	recordChange("cluster",cID);
 	return true;
 }
 
@@ -2158,6 +2787,8 @@ bool PersistentStore::updateCluster(const Cluster& cluster){
 	clusterByNameCache.insert_or_assign(cluster.name,record);
 	clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
 	writeClusterConfigToDisk(cluster);
+	invalidateClusterObjects(cluster.id);
+	recordChange("cluster",cluster.id);
 	
 	return true;
 }
@@ -2167,61 +2798,33 @@ std::vector<Cluster> PersistentStore::listClusters(){
 
 	// first check if clusters are cached
 	if(clusterCacheExpirationTime.load() > std::chrono::steady_clock::now()){
-		auto table = clusterCache.lock_table();
-		for(auto itr = table.cbegin(); itr != table.cend(); itr++){
-			auto cluster = itr->second;
+		clusterCache.for_each([&](const std::string&, const CacheRecord<Cluster>& record){
 			cacheHits++;
-			collected.push_back(cluster);
-		 }
-		
-		table.unlock();
+			collected.push_back(record);
+		});
 		return collected;
 	}
 
 	databaseScans++;
+	const std::size_t removals=clusterCache.removals();
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(clusterTableName);
 	request.SetFilterExpression("attribute_not_exists(#groupID) AND attribute_exists(#name)");
 	request.SetExpressionAttributeNames({{"#groupID", "groupID"},{"#name","name"}});
-	bool keepGoing=false;
-	
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			//TODO: more principled logging or reporting of the nature of the error
-			auto err=outcome.GetError();
-			log_error("Failed to fetch cluster records: " << err.GetMessage());
-			return collected;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
-		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			Cluster cluster;
-			cluster.valid=true;
-			cluster.id=findOrThrow(item,"ID","Cluster record missing ID attribute").GetS();
-			cluster.name=findOrThrow(item,"name","Cluster record missing name attribute").GetS();
-			cluster.owningGroup=findOrThrow(item,"owningGroup","Cluster record missing owningGroup attribute").GetS();
-			cluster.config=findOrThrow(item,"config","Cluster record missing config attribute").GetS();
-			cluster.systemNamespace=findOrThrow(item,"systemNamespace","Cluster record missing systemNamespace attribute").GetS();
-			cluster.owningOrganization=findOrDefault(item,"owningOrganization",missingString).GetS();
-			cluster.monitoringCredential=S3Credential::deserialize(findOrDefault(item,"monCredential",missingString).GetS());
-			collected.push_back(cluster);
-			
-			CacheRecord<Cluster> record(cluster,clusterCacheValidity);
-			replaceCacheRecord(clusterCache,cluster.id,record);
-			clusterByNameCache.insert_or_assign(cluster.name,record);
-			clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
-			writeClusterConfigToDisk(cluster);
-		}
-	}while(keepGoing);
-	clusterCacheExpirationTime=std::chrono::steady_clock::now()+clusterCacheValidity;
+	bool complete=scanAll(request,[&](const DatabaseItem& item){
+		Cluster cluster=clusterFromItem(item);
+		collected.push_back(cluster);
+		
+		CacheRecord<Cluster> record(cluster,clusterCacheValidity);
+		replaceCacheRecord(clusterCache,cluster.id,record);
+		clusterByNameCache.insert_or_assign(cluster.name,record);
+		clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
+		writeClusterConfigToDisk(cluster);
+	});
+	if(complete && clusterCache.removals()==removals)
+		clusterCacheExpirationTime=std::chrono::steady_clock::now()+clusterCacheValidity;
+	else
+		log_error("Failed to fetch cluster records");
 	
 	return collected;
 }
@@ -2257,10 +2860,8 @@ bool PersistentStore::addGroupToCluster(std::string groupID, std::string cID){
 	if(!normalizeClusterID(cID))
 		return false;
 	
-	//remove any negative cache entry
-	//HACK: a special record with a trailing dash is used to indicate that the 
-	//group is known _not_ to have access
-	clusterGroupAccessCache.erase(cID,CacheRecord<std::string>(groupID+"-"));
+	//remove any cache entry
+	clusterGroupAccessCache.erase(cID+":"+groupID);
 	
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto request=Aws::DynamoDB::Model::PutItemRequest()
@@ -2278,8 +2879,8 @@ bool PersistentStore::addGroupToCluster(std::string groupID, std::string cID){
 	}
 	
 	//update cache
-	CacheRecord<std::string> record(groupID,clusterCacheValidity);
-	clusterGroupAccessCache.insert_or_assign(cID,record);
+	replaceCacheRecord(clusterGroupAccessCache,cID+":"+groupID,CacheRecord<bool>(true,clusterCacheValidity));
+	recordChange("access",cID,groupID);
 	
 	return true;
 }
@@ -2293,7 +2894,7 @@ bool PersistentStore::removeGroupFromCluster(std::string groupID, std::string cI
 		return false;
 	
 	//remove any cache entry
-	clusterGroupAccessCache.erase(cID,CacheRecord<std::string>(groupID));
+	clusterGroupAccessCache.erase(cID+":"+groupID);
 	
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto outcome=dbClient.DeleteItem(Aws::DynamoDB::Model::DeleteItemRequest()
@@ -2306,11 +2907,9 @@ bool PersistentStore::removeGroupFromCluster(std::string groupID, std::string cI
 		return false;
 	}
 	
-	//Make a cache entry
-	//HACK: group names (and IDs) may not end with a dash, so we use such a 
-	//record to indicate that a group is known _not_ to have access
-	CacheRecord<std::string> record(groupID+"-",clusterCacheValidity);
-	clusterGroupAccessCache.insert_or_assign(cID,record);
+	//Record that the group is now known not to have access
+	replaceCacheRecord(clusterGroupAccessCache,cID+":"+groupID,CacheRecord<bool>(false,clusterCacheValidity));
+	recordChange("access",cID,groupID);
 	
 	return true;
 }
@@ -2341,25 +2940,22 @@ std::vector<std::string> PersistentStore::listGroupsAllowedOnCluster(std::string
 		{":id",AttributeValue(cID)},
 		{":prefix",AttributeValue(cID+":"+IDGenerator::groupIDPrefix)}
 	});
-	auto outcome=dbClient.Query(request);
 	std::vector<std::string> vos;
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to fetch cluster's Group whitelist records: " << err.GetMessage());
-		return vos;
-	}
-	
-	const auto& queryResult=outcome.GetResult();
-	for(const auto& item : queryResult.GetItems()){
+	bool complete=queryAll(request,[&vos](const DatabaseItem& item){
 		if(item.count("groupID"))
 			vos.push_back(item.find("groupID")->second.GetS());
+	});
+	if(!complete){
+		log_error("Failed to fetch cluster's Group whitelist records");
+		return vos;
 	}
 	
 	if(useNames){
 		//do extra lookups to replace IDs with nicer names
+		auto groups=getGroups(vos);
 		for(std::string& groupStr : vos){
-			Group group=findGroupByID(groupStr);
-			groupStr=group.name;
+			auto group=groups.find(groupStr);
+			groupStr=(group!=groups.end() ? group->second.name : std::string());
 		}
 	}
 	
@@ -2367,12 +2963,6 @@ std::vector<std::string> PersistentStore::listGroupsAllowedOnCluster(std::string
 }
 
 bool PersistentStore::groupAllowedOnCluster(std::string groupID, std::string cID){
-	//TODO: possible issue: We only store memberships, so repeated queries about
-	//a Group's access to a cluster to which it does not have access belong will
-	//never be in the cache, and will always incur a database query. This should
-	//not be a problem for normal/well intentioned use, but seems like a way to
-	//turn accident or malice into denial of service or a large AWS bill. 
-	
 	//check whether the 'ID' we got was actually a name
 	if(!normalizeGroupID(groupID))
 		return false;
@@ -2384,107 +2974,54 @@ bool PersistentStore::groupAllowedOnCluster(std::string groupID, std::string cID
 		return true;
 	
 	//if no wildcard, look for the specific cluster
-	//first see if we have this cached
-	{
-		CacheRecord<std::string> record(groupID);
-		if(clusterGroupAccessCache.find(cID,record)){
-			//we have a cached record; is it still valid?
-			if(record){ //it is, just return it
-				cacheHits++;
-				return true;
-			}
-		}
-	}
-	{ //HACK: look for a special record with a trailing dash to indicate that 
-		//the group is known _not_ to have access
-		CacheRecord<std::string> record(groupID+"-");
-		if(clusterGroupAccessCache.find(cID,record)){
-			//we have a cached record; is it still valid?
-			if(record){ //it is, just return it
-				cacheHits++;
-				return false;
-			}
-		}
-	}
-	//need to query the database
-	databaseQueries++;
-	log_info("Querying database for Group " << groupID << " access to cluster " << cID);
-	using Aws::DynamoDB::Model::AttributeValue;
-	auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
-								  .WithTableName(clusterTableName)
-								  .WithKey({{"ID",AttributeValue(cID)},
-	                                        {"sortKey",AttributeValue(cID+":"+groupID)}}));
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to fetch cluster Group access record: " << err.GetMessage());
-		return false;
-	}
-	const auto& item=outcome.GetResult().GetItem();
-	if(item.empty()){ //no match found
-		//update cache
-		//HACK: group names (and IDs) may not end with a dash, so we use such a 
-		//record to indicate that a group is known _not_ to have access
-		CacheRecord<std::string> record(groupID+"-",clusterCacheValidity);
-		clusterGroupAccessCache.insert_or_assign(cID,record);
-		return false;
-	}
-	
-	//update cache
-	CacheRecord<std::string> record(groupID,clusterCacheValidity);
-	clusterGroupAccessCache.insert_or_assign(cID,record);
-	
-	return true;
+	return clusterGroupAccessRecordExists(cID,groupID);
 }
 
 bool PersistentStore::clusterAllowsAllGroups(std::string cID){
+	return clusterGroupAccessRecordExists(cID,wildcard);
+}
+
+bool PersistentStore::clusterGroupAccessRecordExists(const std::string& cID, const std::string& groupID){
+	const std::string key=cID+":"+groupID;
 	{ //check cache first
-		CacheRecord<std::string> record(wildcard);
-		if(clusterGroupAccessCache.find(cID,record)){
-			//we have a cached record; is it still valid?
-			if(record){ //it is, just return it
+		CacheRecord<bool> record;
+		if(clusterGroupAccessCache.find(key,record) && record){
+			if(record.record)
 				cacheHits++;
-				return record;
-			}
+			else
+				negativeCacheHits++;
+			return record.record;
 		}
 	}
-	{ //HACK: look for a special record with a trailing dash to indicate that 
-		//the group is known _not_ to have access
-		CacheRecord<std::string> record(wildcard+"-");
-		if(clusterGroupAccessCache.find(cID,record)){
-			//we have a cached record; is it still valid?
-			if(record){ //it is, just return it
-				cacheHits++;
-				return false;
-			}
+	//query the database, unless another thread is already doing so
+	bool shared;
+	bool exists=clusterGroupAccessLookups.run(key,[&]()->bool{
+		databaseQueries++;
+		if(groupID==wildcard)
+			log_info("Querying database for wildcard access to cluster " << cID);
+		else
+			log_info("Querying database for Group " << groupID << " access to cluster " << cID);
+		using Aws::DynamoDB::Model::AttributeValue;
+		auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
+		                              .WithTableName(clusterTableName)
+		                              .WithKey({{"ID",AttributeValue(cID)},
+		                                        {"sortKey",AttributeValue(key)}}));
+		if(!outcome.IsSuccess()){
+			auto err=outcome.GetError();
+			log_error("Failed to fetch cluster Group access record: " << err.GetMessage());
+			return false;
 		}
-	}
-	//query the database
-	databaseQueries++;
-	log_info("Querying database for wildcard access to cluster " << cID);
-	using Aws::DynamoDB::Model::AttributeValue;
-	auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
-								  .WithTableName(clusterTableName)
-								  .WithKey({{"ID",AttributeValue(cID)},
-	                                        {"sortKey",AttributeValue(cID+":"+wildcard)}}));
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to fetch cluster Group access record: " << err.GetMessage());
-		return false;
-	}
-	const auto& item=outcome.GetResult().GetItem();
-	if(item.empty()){ //no match found
-		//update cache
-		//HACK: group names (and IDs) may not end with a dash, so we use such a 
-		//record to indicate that a group is known _not_ to have access
-		CacheRecord<std::string> record(wildcard+"-",clusterCacheValidity);
-		clusterGroupAccessCache.insert_or_assign(cID,record);
-		return false;
-	}
-	//update cache
-	CacheRecord<std::string> record(wildcard,clusterCacheValidity);
-	clusterGroupAccessCache.insert_or_assign(cID,record);
-	
-	return true;
+		const auto& item=outcome.GetResult().GetItem();
+		if(item.empty()){ //no match found
+			storeNegativeCacheRecord(clusterGroupAccessCache,key,negativeCacheValidity);
+			return false;
+		}
+		replaceCacheRecord(clusterGroupAccessCache,key,CacheRecord<bool>(true,clusterCacheValidity));
+		return true;
+	},shared);
+	if(shared)
+		coalescedLookups++;
+	return exists;
 }
 
 std::set<std::string> PersistentStore::listApplicationsGroupMayUseOnCluster(std::string groupID, std::string cID){
@@ -2585,6 +3122,7 @@ bool PersistentStore::allowVoToUseApplication(std::string groupID, std::string c
 	//update cache
 	CacheRecord<std::set<std::string>> record(allowed,clusterCacheValidity);
 	replaceCacheRecord(clusterGroupApplicationCache,sortKey,record);
+	recordChange("applications",cID,groupID);
 	
 	return true;
 }
@@ -2643,6 +3181,7 @@ bool PersistentStore::denyGroupUseOfApplication(std::string groupID, std::string
 	//update cache
 	CacheRecord<std::set<std::string>> record(allowed,clusterCacheValidity);
 	replaceCacheRecord(clusterGroupApplicationCache,sortKey,record);
+	recordChange("applications",cID,groupID);
 	
 	return true;
 }
@@ -2662,7 +3201,7 @@ std::vector<GeoLocation> PersistentStore::getLocationsForCluster(std::string cID
 		return {};
 	}
 	
-	std::string sortKey=cID+":Locations";
+	std::string sortKey=cID+locationsSortKeySuffix;
 	{ //check cache first
 		CacheRecord<std::vector<GeoLocation>> record;
 		if(clusterLocationCache.find(cID,record)){
@@ -2689,17 +3228,8 @@ std::vector<GeoLocation> PersistentStore::getLocationsForCluster(std::string cID
 	}
 	std::vector<GeoLocation> result;
 	const auto& item=outcome.GetResult().GetItem();
-	if(!item.empty()){
-		const Aws::Vector<Aws::String> rawPositions=findOrThrow(item,"locations","Cluster location record missing locations attribute").GetSS();
-		for(const auto& sPos : rawPositions){
-			try{
-				result.push_back(boost::lexical_cast<GeoLocation>(sPos));
-			}
-			catch(boost::bad_lexical_cast& blc){
-				log_fatal("Malformatted location stored for cluster " << cID << ": " << blc.what());
-			}
-		}
-	}
+	if(!item.empty())
+		result=locationsFromItem(cID,item);
 	
 	//update cache
 	CacheRecord<std::vector<GeoLocation>> record(result,clusterCacheValidity);
@@ -2708,6 +3238,44 @@ std::vector<GeoLocation> PersistentStore::getLocationsForCluster(std::string cID
 	return result;
 }
 
+std::map<std::string,std::vector<GeoLocation>> PersistentStore::getLocationsForClusters(const std::vector<std::string>& ids){
+	std::map<std::string,std::vector<GeoLocation>> locations;
+	std::vector<std::string> toFetch;
+	for(const auto& id : std::set<std::string>(ids.begin(),ids.end())){
+		CacheRecord<std::vector<GeoLocation>> record;
+		if(clusterLocationCache.find(id,record) && record){
+			cacheHits++;
+			locations.emplace(id,record.record);
+		}
+		else
+			toFetch.push_back(id);
+	}
+	if(toFetch.empty())
+		return locations;
+	
+	log_info("Querying database for locations associated with " << toFetch.size() << " clusters");
+	std::vector<DatabaseItem> items;
+	bool complete=batchGetItems(clusterTableName,toFetch,locationsSortKeySuffix,items);
+	for(const auto& item : items){
+		std::string cID=findOrThrow(item,"ID","Cluster location record missing ID attribute").GetS();
+		locations[cID]=locationsFromItem(cID,item);
+	}
+	//clusters with no location record have no locations, but this is only 
+	//known if every key was actually looked up
+	if(complete){
+		for(const auto& cID : toFetch)
+			locations[cID]; //default construct an empty list if none was found
+	}
+	for(const auto& cID : toFetch){
+		auto it=locations.find(cID);
+		if(it==locations.end())
+			continue;
+		CacheRecord<std::vector<GeoLocation>> record(it->second,clusterCacheValidity);
+		replaceCacheRecord(clusterLocationCache,cID,record);
+	}
+	return locations;
+}
+
 bool PersistentStore::setLocationsForCluster(std::string cID, const std::vector<GeoLocation>& locations){
 	//check whether the cluster 'ID' we got was actually a name
 	if(!normalizeClusterID(cID)){
@@ -2715,7 +3283,7 @@ bool PersistentStore::setLocationsForCluster(std::string cID, const std::vector<
 		return {};
 	}
 	
-	std::string sortKey=cID+":Locations";
+	std::string sortKey=cID+locationsSortKeySuffix;
 	
 	using Aws::DynamoDB::Model::AttributeValue;
 	AttributeValue value;
@@ -2738,6 +3306,7 @@ bool PersistentStore::setLocationsForCluster(std::string cID, const std::vector<
 	//update cache
 	CacheRecord<std::vector<GeoLocation>> record(locations,clusterCacheValidity);
 	replaceCacheRecord(clusterLocationCache,cID,record);
+	recordChange("locations",cID);
 	
 	return true;
 }
@@ -2764,6 +3333,7 @@ bool PersistentStore::setClusterMonitoringCredential(const std::string& cID, con
 	//wipe out cache entry and force a load to update it
 	clusterCache.erase(cID);
 	findClusterByID(cID);
+	recordChange("cluster",cID);
 	
 	return true;
 }
@@ -2789,6 +3359,7 @@ bool PersistentStore::removeClusterMonitoringCredential(const std::string& cID){
 	//wipe out cache entry and force a load to update it
 	clusterCache.erase(cID);
 	findClusterByID(cID);
+	recordChange("cluster",cID);
 	
 	return true;
 }
@@ -2796,32 +3367,22 @@ bool PersistentStore::removeClusterMonitoringCredential(const std::string& cID){
 Cluster PersistentStore::findClusterUsingCredential(const S3Credential& cred){
 	databaseScans++;
 	using AV=Aws::DynamoDB::Model::AttributeValue;
-	using AVU=Aws::DynamoDB::Model::AttributeValueUpdate;
-	auto outcome=dbClient.Scan(Aws::DynamoDB::Model::ScanRequest()
-								.WithTableName(clusterTableName)
-								.WithFilterExpression("#monCredential = :cred")
-								.WithExpressionAttributeNames({{"#monCredential","monCredential"}})
-								.WithExpressionAttributeValues({{":cred",AV(cred.serialize())}})
-								);
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to scan clusters: " << err.GetMessage());
-		return Cluster{};
-	}
-	
-	if(outcome.GetResult().GetItems().empty()) //no match found
-		return Cluster{};
-	const auto& item=outcome.GetResult().GetItems().front();
-	
+	//the filter is applied to each page separately, so every page must be 
+	//examined to be sure of finding the matching record
 	Cluster cluster;
-	cluster.valid=true;
-	cluster.id=findOrThrow(item,"ID","Cluster record missing ID attribute").GetS();
-	cluster.name=findOrThrow(item,"name","Cluster record missing name attribute").GetS();
-	cluster.owningGroup=findOrThrow(item,"owningGroup","Cluster record missing owningGroup attribute").GetS();
-	cluster.config=findOrThrow(item,"config","Cluster record missing config attribute").GetS();
-	cluster.systemNamespace=findOrThrow(item,"systemNamespace","Cluster record missing systemNamespace attribute").GetS();
-	cluster.owningOrganization=findOrDefault(item,"owningOrganization",missingString).GetS();
-	cluster.monitoringCredential=S3Credential::deserialize(findOrDefault(item,"monCredential",missingString).GetS());
+	bool complete=scanAll(Aws::DynamoDB::Model::ScanRequest()
+	                      .WithTableName(clusterTableName)
+	                      .WithFilterExpression("#monCredential = :cred")
+	                      .WithExpressionAttributeNames({{"#monCredential","monCredential"}})
+	                      .WithExpressionAttributeValues({{":cred",AV(cred.serialize())}}),
+	                      [&cluster](const DatabaseItem& item){
+		if(!cluster)
+			cluster=clusterFromItem(item);
+	});
+	if(!complete)
+		log_error("Failed to scan clusters");
+	if(!cluster) //no match found
+		return Cluster{};
 	
 	//cache this result for reuse
 	CacheRecord<Cluster> record(cluster,clusterCacheValidity);
@@ -2847,15 +3408,72 @@ CacheRecord<bool> PersistentStore::getCachedClusterReachability(std::string cID)
 }
 
 void PersistentStore::cacheClusterReachability(std::string cID, bool reachable){
+	cacheClusterReachability(cID,reachable,clusterCacheValidity);
+}
+
+void PersistentStore::cacheClusterReachability(std::string cID, bool reachable, 
+                                               std::chrono::seconds validity){
 	//check whether the cluster 'ID' we got was actually a name
 	if(!normalizeClusterID(cID)){
 		log_error("Invalid cluster name");
 		return;
 	}
-	CacheRecord<bool> record(reachable,clusterCacheValidity);
+	CacheRecord<bool> record(reachable,validity);
 	replaceCacheRecord(clusterConnectivityCache,cID,record);
 }
 
+commandResult PersistentStore::getClusterObjects(const std::string& cID, const std::string& kind){
+	const std::string key=cID+":"+kind;
+	CacheRecord<commandResult> record;
+	if(clusterObjectCache.find(key,record) && record){
+		cacheHits++;
+		if(record.expirationTime-std::chrono::steady_clock::now()<clusterObjectRefreshMargin)
+			refreshClusterObjects(cID,kind);
+		return record;
+	}
+	bool shared=false;
+	commandResult result=clusterObjectLookups.run(key,[&]{ return fetchClusterObjects(cID,kind); },shared);
+	if(shared)
+		coalescedLookups++;
+	return result;
+}
+
+commandResult PersistentStore::fetchClusterObjects(const std::string& cID, const std::string& kind){
+	const std::size_t generation=clusterObjectGeneration.load();
+	auto configPath=configPathForCluster(cID);
+	commandResult result=kubernetes::kubectl_get(*configPath,kind);
+	//failures are not cached, nor are results which may predate a change to 
+	//the cluster
+	if(result.status==0 && generation==clusterObjectGeneration.load())
+		replaceCacheRecord(clusterObjectCache,cID+":"+kind,
+		                   CacheRecord<commandResult>(result,clusterObjectCacheValidity));
+	return result;
+}
+
+void PersistentStore::refreshClusterObjects(const std::string& cID, const std::string& kind){
+	const std::string key=cID+":"+kind;
+	if(!clusterObjectRefreshes.insert(key,true))
+		return; //already queued
+	clusterObjectRefreshCount++;
+	clusterObjectRefreshTasks->submit(cID,[this,cID,kind,key]{
+		try{
+			bool shared=false;
+			clusterObjectLookups.run(key,[&]{ return fetchClusterObjects(cID,kind); },shared);
+		}catch(std::exception& ex){
+			log_warn("Failed to refresh " << kind << " for " << cID << ": " << ex.what());
+		}
+		clusterObjectRefreshes.erase(key);
+	});
+}
+
+void PersistentStore::invalidateClusterObjects(const std::string& cID){
+	clusterObjectGeneration++;
+	const std::string prefix=cID+":";
+	clusterObjectCache.erase_if([&prefix](const std::string& key, const CacheRecord<commandResult>&){
+		return key.compare(0,prefix.size(),prefix)==0;
+	});
+}
+
 bool PersistentStore::addApplicationInstance(const ApplicationInstance& inst){
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto request=Aws::DynamoDB::Model::PutItemRequest()
@@ -2900,6 +3518,7 @@ bool PersistentStore::addApplicationInstance(const ApplicationInstance& inst){
 	instanceByClusterCache.insert_or_assign(inst.cluster,record);
 	instanceByGroupAndClusterCache.insert_or_assign(inst.owningGroup+":"+inst.cluster,record);
 	instanceConfigCache.insert(inst.id,inst.config,instanceCacheValidity);
+	recordChange("instance",inst.id);
 	
 	return true;
 }
@@ -2946,6 +3565,7 @@ bool PersistentStore::removeApplicationInstance(const std::string& id){
 		log_error("Failed to delete instance config record: " << err.GetMessage());
 		return false;
 	}
+	recordChange("instance",id);
 	return true;
 }
 
@@ -3037,60 +3657,33 @@ std::vector<ApplicationInstance> PersistentStore::listApplicationInstances(){
 	//First check if instances are cached
 	std::vector<ApplicationInstance> collected;
 	if(instanceCacheExpirationTime.load() > std::chrono::steady_clock::now()){
-		auto table = instanceCache.lock_table();
-		for(auto itr = table.cbegin(); itr != table.cend(); itr++){
-			auto instance = itr->second;
+		instanceCache.for_each([&](const std::string&, const CacheRecord<ApplicationInstance>& record){
 			cacheHits++;
-			collected.push_back(instance);
-		 }
-		
-		table.unlock();
+			collected.push_back(record);
+		});
 		return collected;
 	}
 
 	databaseScans++;
+	const std::size_t removals=instanceCache.removals();
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(instanceTableName);
 	request.SetFilterExpression("attribute_exists(ctime)");
-	bool keepGoing=false;
-	
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			//TODO: more principled logging or reporting of the nature of the error
-			auto err=outcome.GetError();
-			log_error("Failed to fetch application instance records: " << err.GetMessage());
-			return collected;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
-		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			ApplicationInstance inst;
-			inst.valid=true;
-			inst.id=findOrThrow(item,"ID","Instance record missing ID attribute").GetS();
-			inst.name=findOrThrow(item,"name","Instance record missing name attribute").GetS();
-			inst.application=findOrThrow(item,"application","Instance record missing application attribute").GetS();
-			inst.owningGroup=findOrThrow(item,"owningGroup","Instance record missing ID attribute").GetS();
-			inst.cluster=findOrThrow(item,"cluster","Instance record missing ID attribute").GetS();
-			inst.ctime=findOrThrow(item,"ctime","Instance record missing ID attribute").GetS();
-			collected.push_back(inst);
-
-			CacheRecord<ApplicationInstance> record(inst,instanceCacheValidity);
-			replaceCacheRecord(instanceCache,inst.id,record);
-			instanceByNameCache.insert_or_assign(inst.name,record);
-			instanceByGroupCache.insert_or_assign(inst.owningGroup,record);
-			instanceByClusterCache.insert_or_assign(inst.cluster,record);
-			instanceByGroupAndClusterCache.insert_or_assign(inst.owningGroup+":"+inst.cluster,record);
-		}
-	}while(keepGoing);
-	instanceCacheExpirationTime=std::chrono::steady_clock::now()+instanceCacheValidity;
+	bool complete=scanAll(request,[&](const DatabaseItem& item){
+		ApplicationInstance inst=instanceFromItem(item);
+		collected.push_back(inst);
+
+		CacheRecord<ApplicationInstance> record(inst,instanceCacheValidity);
+		replaceCacheRecord(instanceCache,inst.id,record);
+		instanceByNameCache.insert_or_assign(inst.name,record);
+		instanceByGroupCache.insert_or_assign(inst.owningGroup,record);
+		instanceByClusterCache.insert_or_assign(inst.cluster,record);
+		instanceByGroupAndClusterCache.insert_or_assign(inst.owningGroup+":"+inst.cluster,record);
+	});
+	if(complete && instanceCache.removals()==removals)
+		instanceCacheExpirationTime=std::chrono::steady_clock::now()+instanceCacheValidity;
+	else
+		log_error("Failed to fetch application instance records");
 	
 	return collected;
 }
@@ -3116,54 +3709,36 @@ std::vector<ApplicationInstance> PersistentStore::listApplicationInstancesByClus
 	// Query if cache is not updated
 	using AV=Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
-	Aws::DynamoDB::Model::QueryOutcome outcome;
+	Aws::DynamoDB::Model::QueryRequest request;
 
 	if (!group.empty() && !cluster.empty()) {
-		outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-				       .WithTableName(instanceTableName)
-				       .WithIndexName("ByGroup")
-				       .WithKeyConditionExpression("owningGroup = :group_val")
-				       .WithFilterExpression("contains(#cluster, :cluster_val)")
-				       .WithExpressionAttributeNames({{"#cluster", "cluster"}})
-				       .WithExpressionAttributeValues({{":group_val", AV(group)}, {":cluster_val", AV(cluster)}})
-				       );
+		request=Aws::DynamoDB::Model::QueryRequest()
+		        .WithTableName(instanceTableName)
+		        .WithIndexName("ByGroup")
+		        .WithKeyConditionExpression("owningGroup = :group_val")
+		        .WithFilterExpression("contains(#cluster, :cluster_val)")
+		        .WithExpressionAttributeNames({{"#cluster", "cluster"}})
+		        .WithExpressionAttributeValues({{":group_val", AV(group)}, {":cluster_val", AV(cluster)}});
 	} else if (!group.empty()) {
-		outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-				       .WithTableName(instanceTableName)
-				       .WithIndexName("ByGroup")
-				       .WithKeyConditionExpression("owningGroup = :group_val")
-				       .WithExpressionAttributeValues({{":group_val", AV(group)}})
-				       );
+		request=Aws::DynamoDB::Model::QueryRequest()
+		        .WithTableName(instanceTableName)
+		        .WithIndexName("ByGroup")
+		        .WithKeyConditionExpression("owningGroup = :group_val")
+		        .WithExpressionAttributeValues({{":group_val", AV(group)}});
 	} else if (!cluster.empty()) {
-		outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-				       .WithTableName(instanceTableName)
-				       .WithIndexName("ByCluster")
-				       .WithKeyConditionExpression("#cluster = :cluster_val")
-				       .WithExpressionAttributeNames({{"#cluster", "cluster"}})
-				       .WithExpressionAttributeValues({{":cluster_val", AV(cluster)}})
-				       );
-	}
-	
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to list Instances by Cluster or Group: " << err.GetMessage());
+		request=Aws::DynamoDB::Model::QueryRequest()
+		        .WithTableName(instanceTableName)
+		        .WithIndexName("ByCluster")
+		        .WithKeyConditionExpression("#cluster = :cluster_val")
+		        .WithExpressionAttributeNames({{"#cluster", "cluster"}})
+		        .WithExpressionAttributeValues({{":cluster_val", AV(cluster)}});
+	} else {
+		log_error("Failed to list Instances by Cluster or Group: neither was specified");
 		return instances;
 	}
-
-	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0)
-		return instances;
-
-	for(const auto& item : queryResult.GetItems()){
-		ApplicationInstance instance;
-		instance.name=findOrThrow(item,"name","Instance record missing name attribute").GetS();
-		instance.id=findOrThrow(item,"ID","Instance record missing ID attribute").GetS();
-		instance.application=findOrThrow(item,"application","Instance record missing application attribute").GetS();
-		instance.owningGroup=findOrThrow(item, "owningGroup", "Instance record missing owning Group attribute").GetS();
-		instance.cluster=findOrThrow(item,"cluster","Instance record missing cluster attribute").GetS();
-		instance.ctime=findOrThrow(item,"ctime","Instance record missing ctime attribute").GetS();
-		instance.valid=true;
-		
+	
+	bool complete=queryAll(request,[&](const DatabaseItem& item){
+		ApplicationInstance instance=instanceFromItem(item);
 		instances.push_back(instance);
 		
 		//update caches
@@ -3173,7 +3748,14 @@ std::vector<ApplicationInstance> PersistentStore::listApplicationInstancesByClus
 		instanceByNameCache.insert_or_assign(instance.name,record);
 		instanceByClusterCache.insert_or_assign(instance.cluster,record);
 		instanceByGroupAndClusterCache.insert_or_assign(instance.owningGroup+":"+instance.cluster,record);
+	});
+	if(!complete){
+		log_error("Failed to list Instances by Cluster or Group");
+		return instances;
 	}
+	if(instances.empty())
+		return instances;
+	
 	auto expirationTime = std::chrono::steady_clock::now() + instanceCacheValidity;
 	if (!group.empty() && !cluster.empty())
 		instanceByGroupAndClusterCache.update_expiration(group+":"+cluster, expirationTime);
@@ -3192,36 +3774,15 @@ std::vector<ApplicationInstance> PersistentStore::findInstancesByName(const std:
 	using AV=Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
 	log_info("Querying database for instance with name " << name);
-	auto outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-	                            .WithTableName(instanceTableName)
-	                            .WithIndexName("ByName")
-	                            .WithKeyConditionExpression("#name = :name_val")
-	                            .WithExpressionAttributeNames({{"#name","name"}})
-	                            .WithExpressionAttributeValues({{":name_val",AV(name)}})
-	                            );
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to look up Instances by name: " << err.GetMessage());
-		return instances;
-	}
-	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0)
-		return instances;
-	//this is allowed
-	//if(queryResult.GetCount()>1)
-	//	log_fatal("Cluster name \"" << name << "\" is not unique!");
-	
-	for(const auto& item : queryResult.GetItems()){
-		ApplicationInstance instance;
-		
-		instance.name=name;
-		instance.id=findOrThrow(item,"ID","Instance record missing ID attribute").GetS();
-		instance.application=findOrThrow(item,"application","Instance record missing application attribute").GetS();
-		instance.owningGroup=findOrThrow(item,"owningGroup","Instance record missing owning Group attribute").GetS();
-		instance.cluster=findOrThrow(item,"cluster","Instance record missing cluster attribute").GetS();
-		instance.ctime=findOrThrow(item,"ctime","Instance record missing ctime attribute").GetS();
-		instance.valid=true;
-		
+	//multiple instances with the same name are allowed
+	bool complete=queryAll(Aws::DynamoDB::Model::QueryRequest()
+	                       .WithTableName(instanceTableName)
+	                       .WithIndexName("ByName")
+	                       .WithKeyConditionExpression("#name = :name_val")
+	                       .WithExpressionAttributeNames({{"#name","name"}})
+	                       .WithExpressionAttributeValues({{":name_val",AV(name)}}),
+	                       [&](const DatabaseItem& item){
+		ApplicationInstance instance=instanceFromItem(item);
 		instances.push_back(instance);
 		
 		//update caches since we bothered to pull stuff directly from the DB
@@ -3231,39 +3792,46 @@ std::vector<ApplicationInstance> PersistentStore::findInstancesByName(const std:
 		instanceByNameCache.insert_or_assign(instance.name,record);
 		instanceByClusterCache.insert_or_assign(instance.cluster,record);
 		instanceByGroupAndClusterCache.insert_or_assign(instance.owningGroup+":"+instance.cluster,record);
-	}
+	});
+	if(!complete)
+		log_error("Failed to look up Instances by name");
 	return instances;
 }
 
 std::string PersistentStore::encryptSecret(const SecretData& s) const{
-	std::size_t outLen=s.dataSize+128;
-	std::string result(outLen,'\0');
-	int err=scryptenc_buf((const uint8_t*)s.data.get(),s.dataSize,
-	                      (uint8_t*)&result.front(),
-	                      (const uint8_t*)secretKey.data.get(),secretKey.dataSize,
-	                      17,8,1);
-	if(err)
-		throw std::runtime_error("Failed to encrypt with scrypt: error " + std::to_string(err));
-	return result;
+	return secretCipher->encrypt(s);
 }
 
 SecretData PersistentStore::decryptSecret(const Secret& s) const{
-	if(s.data.size()<128)
-		throw std::runtime_error("Invalid encrypted data: too short to contain header");
-	std::size_t outLen=s.data.size()-128;
-	SecretData output(outLen);
-	int err=scryptdec_buf((const uint8_t *)&s.data.front(),s.data.size(),
-						  (uint8_t*)output.data.get(),&outLen,
-						  (const uint8_t*)secretKey.data.get(),secretKey.dataSize);
-	if(err)
-		throw std::runtime_error("Failed to decrypt with scrypt: error " + std::to_string(err));
-	return output;
+	const auto validity=decryptedSecretCacheValidity;
+	if(validity==std::chrono::seconds(0) || s.id.empty())
+		return secretCipher->decrypt(s.data);
+	
+	auto copy=[](const SecretData& data){
+		SecretData result(data.dataSize);
+		std::copy(data.data.get(),data.data.get()+data.dataSize,result.data.get());
+		return result;
+	};
+	CacheRecord<DecryptedSecret> record;
+	if(decryptedSecretCache.find(s.id,record) && record && record.record.encrypted==s.data){
+		decryptedSecretCacheHits++;
+		return copy(*record.record.data);
+	}
+	
+	SecretData result=secretCipher->decrypt(s.data);
+	sweepDecryptedSecretCache();
+	auto data=std::make_shared<const SecretData>(copy(result));
+	decryptedSecretCache.insert_or_assign(s.id,CacheRecord<DecryptedSecret>(DecryptedSecret{s.data,data},validity));
+	return result;
+}
+
+void PersistentStore::sweepDecryptedSecretCache() const{
+	//the data is erased from memory when the last copy of its pointer is dropped
+	decryptedSecretCache.sweep();
 }
 
 bool PersistentStore::addSecret(const Secret& secret){
-	if(secret.data.substr(0,6)!="scrypt")
-		throw std::runtime_error("Secret data does not have valid encryption header");
-	if(secret.data.size()<128)
+	if(!SecretCipher::isEncrypted(secret.data))
 		throw std::runtime_error("Secret data does not have valid encryption header");
 	
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -3290,6 +3858,7 @@ bool PersistentStore::addSecret(const Secret& secret){
 	replaceCacheRecord(secretCache,secret.id,record);
 	secretByGroupCache.insert_or_assign(secret.group,record);
 	secretByGroupAndClusterCache.insert_or_assign(secret.group+":"+secret.cluster,record);
+	recordChange("secret",secret.id);
 	
 	return true;
 }
@@ -3312,6 +3881,7 @@ bool PersistentStore::removeSecret(const std::string& id){
 			secretByGroupAndClusterCache.erase(record.record.group+":"+record.record.cluster);
 		}
 		secretCache.erase(id);
+		decryptedSecretCache.erase(id);
 	}
 	
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -3324,6 +3894,7 @@ bool PersistentStore::removeSecret(const std::string& id){
 		log_error("Failed to delete secret record: " << err.GetMessage());
 		return false;
 	}
+	recordChange("secret",id);
 	
 	return true;
 }
@@ -3400,9 +3971,8 @@ std::vector<Secret> PersistentStore::listSecrets(std::string group, std::string
 	using AV=Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
 	
-	Aws::DynamoDB::Model::QueryOutcome outcome;
+	Aws::DynamoDB::Model::QueryRequest query;
 	if (!group.empty()) {
-		Aws::DynamoDB::Model::QueryRequest query;
 		query.WithTableName(secretTableName)
 		     .WithIndexName("ByGroup")
 		     .WithKeyConditionExpression("owningGroup = :group_val")
@@ -3412,28 +3982,16 @@ std::vector<Secret> PersistentStore::listSecrets(std::string group, std::string
 			query.AddExpressionAttributeNames("#cluster", "cluster");
 			query.AddExpressionAttributeValues(":cluster_val", AV(cluster));
 		}
-		
-		outcome=dbClient.Query(query);
 	}
 	else if (!cluster.empty()) {
-		outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-							   .WithTableName(secretTableName)
-							   .WithIndexName("ByCluster")
-							   .WithKeyConditionExpression("#cluster = :cluster_val")
-							   .WithExpressionAttributeNames({{"#cluster", "cluster"}})
-							   .WithExpressionAttributeValues({{":cluster_val", AV(cluster)}})
-							   );
-	}
-	
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to list secrets: " << err.GetMessage());
-		return secrets;
+		query.WithTableName(secretTableName)
+		     .WithIndexName("ByCluster")
+		     .WithKeyConditionExpression("#cluster = :cluster_val")
+		     .WithExpressionAttributeNames({{"#cluster", "cluster"}})
+		     .WithExpressionAttributeValues({{":cluster_val", AV(cluster)}});
 	}
-
-	const auto& queryResult=outcome.GetResult();
 	
-	for(const auto& item : queryResult.GetItems()){
+	bool complete=queryAll(query,[&](const DatabaseItem& item){
 		Secret secret;
 		secret.name=findOrThrow(item,"name","Secret record missing name attribute").GetS();
 		secret.id=findOrThrow(item,"ID","Secret record missing ID attribute").GetS();
@@ -3457,6 +4015,10 @@ std::vector<Secret> PersistentStore::listSecrets(std::string group, std::string
 		replaceCacheRecord(secretCache,secret.id,record);
 		secretByGroupCache.insert_or_assign(secret.group,record);
 		secretByGroupAndClusterCache.insert_or_assign(secret.group+":"+secret.cluster,record);
+	});
+	if(!complete){
+		log_error("Failed to list secrets");
+		return secrets;
 	}
 	auto expirationTime = std::chrono::steady_clock::now() + secretCacheValidity;
 	if (!cluster.empty())
@@ -3541,34 +4103,17 @@ std::vector<S3Credential> PersistentStore::listMonitoringCredentials(){
 	databaseScans++;
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(monCredTableName);
-	bool keepGoing=false;
-	
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			auto err=outcome.GetError();
-			log_error("Failed to fetch monitoring credential records: " << err.GetMessage());
-			return creds;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
-		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			S3Credential cred;
-			cred.accessKey=findOrThrow(item,"accessKey","Monitoring credential record missing accessKey attribute").GetS();
-			cred.secretKey=findOrThrow(item,"secretKey","Monitoring credential record missing secretKey attribute").GetS();
-			cred.inUse=findOrThrow(item,"inUse","Monitoring credential record missing inUse attribute").GetBool();
-			cred.revoked=findOrThrow(item,"revoked","Monitoring credential record missing revoked attribute").GetBool();
-			
-			creds.push_back(cred);
-		}
-	}while(keepGoing);
+	bool complete=scanAll(request,[&creds](const DatabaseItem& item){
+		S3Credential cred;
+		cred.accessKey=findOrThrow(item,"accessKey","Monitoring credential record missing accessKey attribute").GetS();
+		cred.secretKey=findOrThrow(item,"secretKey","Monitoring credential record missing secretKey attribute").GetS();
+		cred.inUse=findOrThrow(item,"inUse","Monitoring credential record missing inUse attribute").GetBool();
+		cred.revoked=findOrThrow(item,"revoked","Monitoring credential record missing revoked attribute").GetBool();
+		
+		creds.push_back(cred);
+	});
+	if(!complete)
+		log_error("Failed to fetch monitoring credential records");
 	
 	return creds;
 }
@@ -3580,25 +4125,26 @@ std::tuple<S3Credential,std::string> PersistentStore::allocateMonitoringCredenti
 		databaseScans++;
 		using AV=Aws::DynamoDB::Model::AttributeValue;
 		using AVU=Aws::DynamoDB::Model::AttributeValueUpdate;
-		auto outcome=dbClient.Scan(Aws::DynamoDB::Model::ScanRequest()
-		                            .WithTableName(monCredTableName)
-		                            .WithFilterExpression("#inUse = :false AND #revoked = :false")
-	                                .WithExpressionAttributeNames({{"#inUse","inUse"},{"#revoked","revoked"}})
-	                                .WithExpressionAttributeValues({{":false",AV().SetBool(false)}})
-		                            );
-		if(!outcome.IsSuccess()){
-			auto err=outcome.GetError();
-			log_error("Failed to look up available monitoring credentials: " << err.GetMessage());
-			return std::make_tuple(cred,"Failed to look up available monitoring credentials: "+err.GetMessage());
+		//the filter is applied to each page separately, so available 
+		//credentials may be found on any page
+		std::vector<DatabaseItem> candidates;
+		bool complete=scanAll(Aws::DynamoDB::Model::ScanRequest()
+		                      .WithTableName(monCredTableName)
+		                      .WithFilterExpression("#inUse = :false AND #revoked = :false")
+		                      .WithExpressionAttributeNames({{"#inUse","inUse"},{"#revoked","revoked"}})
+		                      .WithExpressionAttributeValues({{":false",AV().SetBool(false)}}),
+		                      [&candidates](const DatabaseItem& item){ candidates.push_back(item); });
+		if(!complete && candidates.empty()){
+			log_error("Failed to look up available monitoring credentials");
+			return std::make_tuple(cred,std::string("Failed to look up available monitoring credentials"));
 		}
-		const auto& queryResult=outcome.GetResult();
-		if(queryResult.GetCount()==0){
+		if(candidates.empty()){
 			log_error("No monitoring credentials available for allocation");
 			return std::make_tuple(cred,"No monitoring credentials available for allocation");
 		}
-		log_info("Found " << queryResult.GetCount() << " candidate credentials for allocation");
+		log_info("Found " << candidates.size() << " candidate credentials for allocation");
 		//try to acquire one of the candidate credentials
-		for(const auto& item : queryResult.GetItems()){
+		for(const auto& item : candidates){
 			std::string accessKey=findOrThrow(item,"accessKey","Monitoring credential record missing accessKey attribute").GetS();
 			
 			log_info("Attempting to allocate credential " << accessKey);
@@ -3715,6 +4261,7 @@ bool PersistentStore::addPersistentVolumeClaim(const PersistentVolumeClaim& pvc)
 	volumeByGroupCache.insert_or_assign(pvc.group,record);
 	volumeByClusterCache.insert_or_assign(pvc.cluster,record);
 	volumeByGroupAndClusterCache.insert_or_assign(pvc.group+":"+pvc.cluster,record);
+	recordChange("volume",pvc.id);
 	
 	return true;
 }
@@ -3750,6 +4297,7 @@ bool PersistentStore::removePersistentVolumeClaim(const std::string& id){
 		log_error("Failed to delete secret record: " << err.GetMessage());
 		return false;
 	}
+	recordChange("volume",id);
 	
 	return true;
 }
@@ -3824,75 +4372,43 @@ std::vector<PersistentVolumeClaim> PersistentStore::listPersistentVolumeClaims()
 	//First check if volumes are cached
 	std::vector<PersistentVolumeClaim> collected;
 	if(volumeCacheExpirationTime.load() > std::chrono::steady_clock::now()){
-		auto table = volumeCache.lock_table();
-		for(auto itr = table.cbegin(); itr != table.cend(); itr++){
-			auto volume = itr->second;
+		volumeCache.for_each([&](const std::string&, const CacheRecord<PersistentVolumeClaim>& record){
 			cacheHits++;
-			collected.push_back(volume);
-		}
-		
-		table.unlock();
-		return collected;
+			collected.push_back(record);
+		});
 		log_info("Found in cache");
+		return collected;
 	}
 
 	log_info("Not found in cache");
 
 	databaseScans++;
+	const std::size_t removals=volumeCache.removals();
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(volumeTableName);
-	bool keepGoing=false;
 	
 	std::set<std::string> allGroups, allClusters;
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			//TODO: more principled logging or reporting of the nature of the error
-			auto err=outcome.GetError();
-			log_error("Failed to fetch volume records: " << err.GetMessage());
-			return collected;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
-		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			PersistentVolumeClaim pvc;
-			pvc.valid=true;
-			pvc.id=findOrThrow(item,"ID","Volume record missing ID attribute").GetS();
-			pvc.name=findOrThrow(item,"name","Volume record missing name attribute").GetS();
-			pvc.group=findOrThrow(item,"owningGroup","Volume record missing owning group attribute").GetS();
-			pvc.cluster=findOrThrow(item,"cluster","Volume record missing cluster attribute").GetS();
-			pvc.storageRequest=findOrThrow(item,"storageRequest","Volume record missing storageRequest attribute").GetS();
-			pvc.accessMode=accessModeFromString(findOrThrow(item,"accessMode","Volume record missing accessMode attribute").GetS());
-			pvc.volumeMode=volumeModeFromString(findOrThrow(item,"volumeMode","Volume record missing volumeMode attribute").GetS());
-			pvc.ctime=findOrThrow(item,"ctime","Volume missing ctime attribute").GetS();
-			pvc.storageClass=findOrThrow(item,"storageClass","Volume record missing storageClass attribute").GetS();
-			//Not needed for list
-			//pvc.selectorMatchLabel=findOrThrow(item,"selectorMatchLabel","Volume record missing selectorMatchLabel attribute").GetS();
-			//auto selectorLabelExpressions=findOrThrow(item,"selectorLabelExpressions","Volume record missing selectorLabelExpressions attribute");
-			//for(const auto& exp : selectorLabelExpressions.GetL())
-			//	pvc.selectorLabelExpressions.push_back(exp->GetS());
-			
-			collected.push_back(pvc);
-			//add to caches
-			CacheRecord<PersistentVolumeClaim> record(pvc,volumeCacheValidity);
-			replaceCacheRecord(volumeCache,pvc.id,record);
-			volumeByGroupCache.insert_or_assign(pvc.group,record);
-			volumeByClusterCache.insert_or_assign(pvc.cluster,record);
-			volumeByGroupAndClusterCache.insert_or_assign(pvc.group+":"+pvc.cluster,record);
-			allGroups.insert(pvc.group);
-			allClusters.insert(pvc.cluster);
-
-		}
-	}while(keepGoing);
+	bool complete=scanAll(request,[&](const DatabaseItem& item){
+		PersistentVolumeClaim pvc=volumeClaimSummaryFromItem(item);
+		collected.push_back(pvc);
+		//add to caches
+		CacheRecord<PersistentVolumeClaim> record(pvc,volumeCacheValidity);
+		replaceCacheRecord(volumeCache,pvc.id,record);
+		volumeByGroupCache.insert_or_assign(pvc.group,record);
+		volumeByClusterCache.insert_or_assign(pvc.cluster,record);
+		volumeByGroupAndClusterCache.insert_or_assign(pvc.group+":"+pvc.cluster,record);
+		allGroups.insert(pvc.group);
+		allClusters.insert(pvc.cluster);
+	});
+	if(!complete){
+		log_error("Failed to fetch volume records");
+		return collected;
+	}
 	auto expirationTime=std::chrono::steady_clock::now()+volumeCacheValidity;
-	volumeCacheExpirationTime=expirationTime;
+	//the listings by group and cluster hold their own copies of the records, so
+	//they are complete even if the main cache is not
+	if(volumeCache.removals()==removals)
+		volumeCacheExpirationTime=expirationTime;
 	for(const auto& group : allGroups)
 		volumeByGroupCache.update_expiration(group, expirationTime);
 	for(const auto& cluster : allClusters){
@@ -3934,77 +4450,38 @@ std::vector<PersistentVolumeClaim> PersistentStore::listPersistentVolumeClaimsBy
 	using AV=Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
 
-	Aws::DynamoDB::Model::QueryOutcome outcome;
+	Aws::DynamoDB::Model::QueryRequest request;
 	if (!group.empty() && !cluster.empty()) {
 		log_info("RUNNING QUERY WITH CLUSTER AND GROUP");
-		outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-				       .WithTableName(volumeTableName)
-				       .WithIndexName("ByGroup")
-				       .WithKeyConditionExpression("owningGroup = :group_val")
-				       .WithFilterExpression("contains(#cluster, :cluster_val)")
-				       .WithExpressionAttributeNames({{"#cluster", "cluster"}})
-				       .WithExpressionAttributeValues({{":group_val", AV(group)}, {":cluster_val", AV(cluster)}})
-				       );
+		request=Aws::DynamoDB::Model::QueryRequest()
+		        .WithTableName(volumeTableName)
+		        .WithIndexName("ByGroup")
+		        .WithKeyConditionExpression("owningGroup = :group_val")
+		        .WithFilterExpression("contains(#cluster, :cluster_val)")
+		        .WithExpressionAttributeNames({{"#cluster", "cluster"}})
+		        .WithExpressionAttributeValues({{":group_val", AV(group)}, {":cluster_val", AV(cluster)}});
 	} else if (!group.empty()) {
 		log_info("RUNNING QUERY WITH GROUP: " << group);
-		outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-				       .WithTableName(volumeTableName)
-				       .WithIndexName("ByGroup")
-				       .WithKeyConditionExpression("owningGroup = :group_val")
-				       .WithExpressionAttributeValues({{":group_val", AV(group)}})
-				       );
+		request=Aws::DynamoDB::Model::QueryRequest()
+		        .WithTableName(volumeTableName)
+		        .WithIndexName("ByGroup")
+		        .WithKeyConditionExpression("owningGroup = :group_val")
+		        .WithExpressionAttributeValues({{":group_val", AV(group)}});
 	} else if (!cluster.empty()) { 
 		log_info("RUNNING QUERY WITH CLUSTER");
-		outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-				       .WithTableName(volumeTableName)
-				       .WithIndexName("ByCluster")
-				       .WithKeyConditionExpression("#cluster = :cluster_val")
-				       .WithExpressionAttributeNames({{"#cluster", "cluster"}})
-				       .WithExpressionAttributeValues({{":cluster_val", AV(cluster)}})
-				       );
-	}
-	
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to list volumes by Cluster or Group: " << err.GetMessage());
+		request=Aws::DynamoDB::Model::QueryRequest()
+		        .WithTableName(volumeTableName)
+		        .WithIndexName("ByCluster")
+		        .WithKeyConditionExpression("#cluster = :cluster_val")
+		        .WithExpressionAttributeNames({{"#cluster", "cluster"}})
+		        .WithExpressionAttributeValues({{":cluster_val", AV(cluster)}});
+	} else {
+		log_error("Failed to list volumes by Cluster or Group: neither was specified");
 		return volumes;
 	}
-
-	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0) {
-		log_info("EMPTY RESULTS");
-		return volumes;
-	}
-
-	/*
-	// just using to look at values in log. Will delete
-	for(const auto& item : queryResult.GetItems()) {
-		if(item.size() > 0 ) {
-			log_info("ITEM SIZE IS LARGER THAN ZERO");
-			for (const auto& i : item) {
-				log_info(i.first << ": " << i.second.GetS());
-			}
-		}
-	}
-	*/
-
-	for(const auto& item : queryResult.GetItems()){
-		PersistentVolumeClaim pvc;
-		pvc.valid=true;
-		pvc.id=findOrThrow(item,"ID","Volume record missing ID attribute").GetS();
-		pvc.name=findOrThrow(item,"name","Volume record missing name attribute").GetS();
-		pvc.group=findOrThrow(item,"owningGroup","Volume record missing owning group attribute").GetS();
-		pvc.cluster=findOrThrow(item,"cluster","Volume record missing cluster attribute").GetS();
-		pvc.storageRequest=findOrThrow(item,"storageRequest","Volume record missing storageRequest attribute").GetS();
-		pvc.accessMode=accessModeFromString(findOrThrow(item,"accessMode","Volume record missing accessMode attribute").GetS());
-		pvc.volumeMode=volumeModeFromString(findOrThrow(item,"volumeMode","Volume record missing volumeMode attribute").GetS());
-		pvc.ctime=findOrThrow(item,"ctime","Volume missing ctime attribute").GetS();
-		pvc.storageClass=findOrThrow(item,"storageClass","Volume record missing storageClass attribute").GetS();
-		// Not needed for listing volume claims
-		//pvc.selectorMatchLabel=findOrThrow(item,"selectorMatchLabel","Volume record missing selectorMatchLabel attribute").GetS();
-		//auto selectorLabelExpressions=findOrThrow(item,"selectorLabelExpressions","Volume record missing selectorLabelExpressions attribute");
-		//for(const auto& exp : selectorLabelExpressions.GetL())
-		//	pvc.selectorLabelExpressions.push_back(exp->GetS());
+	
+	bool complete=queryAll(request,[&](const DatabaseItem& item){
+		PersistentVolumeClaim pvc=volumeClaimSummaryFromItem(item);
 		
 		//add to caches
 		CacheRecord<PersistentVolumeClaim> record(pvc,volumeCacheValidity);
@@ -4013,7 +4490,16 @@ std::vector<PersistentVolumeClaim> PersistentStore::listPersistentVolumeClaimsBy
 		volumeByGroupAndClusterCache.insert_or_assign(pvc.group+":"+pvc.cluster,record);
 
 		volumes.push_back(pvc);
+	});
+	if(!complete){
+		log_error("Failed to list volumes by Cluster or Group");
+		return volumes;
+	}
+	if(volumes.empty()) {
+		log_info("EMPTY RESULTS");
+		return volumes;
 	}
+
 	auto expirationTime = std::chrono::steady_clock::now() + volumeCacheValidity;
 	if (!group.empty() && !cluster.empty())
 		volumeByGroupAndClusterCache.update_expiration(group+":"+cluster, expirationTime);
@@ -4030,8 +4516,7 @@ Application PersistentStore::findApplication(const std::string& repository, cons
 		log_info("Checking for application " << appName << " in cache");
 		auto cached = applicationCache.find(repository);
 		if(cached.second > std::chrono::steady_clock::now()){
-			auto records = cached.first;
-			for(const auto& record : records){
+			for(const auto& record : *cached.first){
 				if(record.record.name==appName && record)
 					return record;
 			}
@@ -4041,7 +4526,7 @@ Application PersistentStore::findApplication(const std::string& repository, cons
 	log_info("Querying helm for application " << appName);
 	std::string target=repository+"/"+appName;
 	std::vector<std::string> searchArgs={"search",target,"--version",chartVersion};
-	if(kubernetes::getHelmMajorVersion()==3)
+	if(kubernetes::getHelmCapabilities().searchRepoSubcommand)
 		searchArgs.insert(searchArgs.begin()+1,"repo");
 	auto result=runCommand("helm", searchArgs);
 	if(result.status)
@@ -4077,14 +4562,12 @@ Application PersistentStore::findApplication(const std::string& repository, cons
 std::vector<Application> PersistentStore::fetchApplications(const std::string& repository){
 	//Tell helm the terminal is rather wide to prevent truncation of results 
 	//(unless they are rather long).
-	unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
+	const kubernetes::HelmCapabilities helm=kubernetes::getHelmCapabilities();
 	std::vector<std::string> searchArgs={"search",repository+"/"};
-	if(helmMajorVersion==2)
-		searchArgs.push_back("--col-width=1024");
-	else if(helmMajorVersion==3){
+	if(helm.searchRepoSubcommand)
 		searchArgs.insert(searchArgs.begin()+1,"repo");
-		searchArgs.push_back("--max-col-width=1024");
-	}
+	if(!helm.columnWidthFlag.empty())
+		searchArgs.push_back(helm.columnWidthFlag+"=1024");
 	auto commandResult=runCommand("helm", searchArgs);
 	if(commandResult.status)
 		log_fatal("helm search failed: [err] " << commandResult.error << " [out] " << commandResult.output);
@@ -4114,11 +4597,673 @@ std::vector<Application> PersistentStore::listApplications(const std::string& re
 	return fetchApplications(repository);
 }
 
+void PersistentStore::setCommandExecutorLimits(unsigned int threads, unsigned int perCluster){
+	clusterObjectRefreshTasks.reset();
+	commandExecutor.reset(new Executor("Cluster command",threads,perCluster));
+	clusterObjectRefreshTasks.reset(new Executor::TaskGroup(*commandExecutor,0,Executor::Priority::Bulk));
+	//any refreshes which were queued were discarded with the old task group
+	clusterObjectRefreshes.clear();
+}
+
+void PersistentStore::setCacheLimits(std::size_t maxEntries, std::size_t maxBytes){
+	for(auto cache : evictingCaches)
+		cache->setLimits(maxEntries,maxBytes);
+}
+
+void PersistentStore::setCacheSweepInterval(std::chrono::seconds interval){
+	cacheSweeper.reset();
+	if(interval>std::chrono::seconds(0))
+		cacheSweeper.reset(new CacheSweeper(interval,[this]{ sweepCaches(); }));
+}
+
+void PersistentStore::sweepCaches(){
+	for(auto cache : evictingCaches)
+		cache->sweep();
+	std::size_t swept=0;
+	swept+=sweepCategories(userByGroupCache);
+	swept+=sweepCategories(groupByUserCache);
+	swept+=sweepCategories(clusterByGroupCache);
+	swept+=sweepCategories(instanceByGroupCache);
+	swept+=sweepCategories(instanceByNameCache);
+	swept+=sweepCategories(instanceByClusterCache);
+	swept+=sweepCategories(instanceByGroupAndClusterCache);
+	swept+=sweepCategories(secretByGroupCache);
+	swept+=sweepCategories(secretByGroupAndClusterCache);
+	swept+=sweepCategories(volumeByGroupCache);
+	swept+=sweepCategories(volumeByClusterCache);
+	swept+=sweepCategories(volumeByGroupAndClusterCache);
+	swept+=sweepCategories(applicationCache);
+	cacheCategoriesSwept+=swept;
+}
+
+void PersistentStore::setCacheValidityScale(unsigned int scale){
+	if(!scale)
+		scale=1;
+	userCacheValidity=defaultUserCacheValidity*scale;
+	groupCacheValidity=defaultGroupCacheValidity*scale;
+	clusterCacheValidity=defaultClusterCacheValidity*scale;
+	instanceCacheValidity=defaultInstanceCacheValidity*scale;
+	secretCacheValidity=defaultSecretCacheValidity*scale;
+	volumeCacheValidity=defaultVolumeCacheValidity*scale;
+}
+
+void PersistentStore::startChangeLog(std::chrono::seconds pollInterval, unsigned int cacheValidityScale){
+	changePoller.reset();
+	//without polling nothing corrects records cached for longer
+	if(pollInterval>std::chrono::seconds(0))
+		setCacheValidityScale(cacheValidityScale);
+	else if(cacheValidityScale>1)
+		log_warn("Not extending cache validity, since changes by other replicas are not polled");
+	{
+		//changes made before now are already reflected in the database, so 
+		//there is no need to apply them
+		std::lock_guard<std::mutex> lock(changePollMutex);
+		lastChangePoll=std::chrono::system_clock::now();
+		recentChanges.clear();
+	}
+	changeLogEnabled=true;
+	if(pollInterval>std::chrono::seconds(0))
+		changePoller.reset(new CacheSweeper(pollInterval,[this]{ pollChanges(); },
+		                                    "Polling for changes"));
+}
+
+void PersistentStore::recordChange(const std::string& kind, const std::string& id, const std::string& detail){
+	if(!changeLogEnabled.load())
+		return;
+	using AV=Aws::DynamoDB::Model::AttributeValue;
+	const auto now=std::chrono::system_clock::now();
+	const std::size_t count=changeCounter++;
+	const std::string sortKey=changeLogTime(now)+":"+replicaID+":"+std::to_string(count);
+	const long long expires=std::chrono::duration_cast<std::chrono::seconds>((now+changeRetention).time_since_epoch()).count();
+	auto request=Aws::DynamoDB::Model::PutItemRequest()
+	.WithTableName(changeTableName)
+	.WithItem({
+		{"ID",AV(changeLogKeyPrefix+std::to_string(count%changeLogShards))},
+		{"sortKey",AV(sortKey)},
+		{"kind",AV(kind)},
+		{"target",AV(id)},
+		{"replica",AV(replicaID)},
+		{"expires",AV().SetN(std::to_string(expires))}
+	});
+	//the database does not accept empty strings
+	if(!detail.empty())
+		request.AddItem("detail",AV(detail));
+	auto outcome=dbClient.PutItem(request);
+	if(!outcome.IsSuccess()){
+		//The change itself has already been made, so it should not be reported
+		//as failing, but other replicas may serve outdated data until their 
+		//cached records expire. 
+		log_warn("Failed to record change to " << kind << ' ' << id 
+		         << " in change log: " << outcome.GetError().GetMessage());
+		changesNotRecorded++;
+		return;
+	}
+	changesRecorded++;
+}
+
+std::size_t PersistentStore::pollChanges(){
+	using AV=Aws::DynamoDB::Model::AttributeValue;
+	std::lock_guard<std::mutex> lock(changePollMutex);
+	const auto pollStart=std::chrono::system_clock::now();
+	const std::string since=changeLogTime(lastChangePoll-changeClockSkewAllowance);
+	changePolls++;
+	std::size_t newChanges=0;
+	auto handleChange=[&](const DatabaseItem& item){
+		//this store's own changes are applied to its caches as they are made
+		if(findOrThrow(item,"replica","Change record missing replica attribute").GetS()==replicaID)
+			return;
+		const std::string& sortKey=findOrThrow(item,"sortKey","Change record missing sortKey attribute").GetS();
+		//Each change is applied a second time on the poll after the one which
+		//first finds it, so that records which were being read from the 
+		//database while the change was made, and were cached after it was 
+		//first applied, are not kept. 
+		unsigned int& applied=recentChanges[sortKey];
+		if(applied>=2)
+			return;
+		if(!applied++)
+			newChanges++;
+		auto detail=item.find("detail");
+		applyChange(findOrThrow(item,"kind","Change record missing kind attribute").GetS(),
+		            findOrThrow(item,"target","Change record missing target attribute").GetS(),
+		            detail!=item.end() ? detail->second.GetS() : std::string());
+	};
+	//the order in which changes are applied does not matter, so the shards
+	//can be read one after another
+	bool complete=true;
+	for(unsigned int shard=0; shard<changeLogShards; shard++){
+		if(!queryAll(Aws::DynamoDB::Model::QueryRequest()
+		             .WithTableName(changeTableName)
+		             .WithKeyConditionExpression("#id = :id AND #sortKey > :since")
+		             .WithExpressionAttributeNames({{"#id","ID"},{"#sortKey","sortKey"}})
+		             .WithExpressionAttributeValues({{":id",AV(changeLogKeyPrefix+std::to_string(shard))},
+		                                             {":since",AV(since)}})
+		             .WithConsistentRead(true),
+		             handleChange))
+			complete=false;
+	}
+	if(!complete){
+		log_warn("Failed to read all recent changes from the change log");
+		return newChanges;
+	}
+	lastChangePoll=pollStart;
+	//forget changes which are too old to be found by the next poll
+	recentChanges.erase(recentChanges.begin(),
+	                    recentChanges.lower_bound(changeLogTime(pollStart-changeClockSkewAllowance)));
+	changesApplied+=newChanges;
+	return newChanges;
+}
+
+void PersistentStore::applyChange(const std::string& kind, const std::string& id, const std::string& detail){
+	using steady_clock=std::chrono::steady_clock;
+	//Records are found by ID, as the keys of the secondary caches are not 
+	//known. Negative records in those caches are also removed, since they may
+	//be for the changed entity. 
+	auto matchesID=[&id](const std::string&, const CacheRecord<User>& record){
+		return record.record.id==id || !record.record.valid;
+	};
+	if(kind=="user"){
+		userCache.erase(id);
+		userByTokenCache.erase_if(matchesID);
+		userByGlobusIDCache.erase_if(matchesID);
+		userCacheExpirationTime=steady_clock::time_point::min();
+	}
+	else if(kind=="membership"){
+		groupMembershipCache.erase(id+":"+detail);
+		userByGroupCache.erase(detail);
+		groupByUserCache.erase(id);
+	}
+	else if(kind=="group"){
+		groupCache.erase(id);
+		groupByNameCache.erase_if([&id](const std::string&, const CacheRecord<Group>& record){
+			return record.record.id==id || !record.record.valid;
+		});
+		groupByUserCache.clear();
+		groupCacheExpirationTime=steady_clock::time_point::min();
+	}
+	else if(kind=="cluster"){
+		clusterCache.erase(id);
+		clusterByNameCache.erase_if([&id](const std::string&, const CacheRecord<Cluster>& record){
+			return record.record.id==id || !record.record.valid;
+		});
+		clusterByGroupCache.clear();
+		clusterCacheExpirationTime=steady_clock::time_point::min();
+		invalidateClusterObjects(id);
+	}
+	else if(kind=="access")
+		clusterGroupAccessCache.erase(id+":"+detail);
+	else if(kind=="applications")
+		clusterGroupApplicationCache.erase(id+":"+detail+":Applications");
+	else if(kind=="locations")
+		clusterLocationCache.erase(id);
+	else if(kind=="instance"){
+		instanceCache.erase(id);
+		instanceConfigCache.erase(id);
+		instanceByGroupCache.clear();
+		instanceByNameCache.clear();
+		instanceByClusterCache.clear();
+		instanceByGroupAndClusterCache.clear();
+		instanceCacheExpirationTime=steady_clock::time_point::min();
+	}
+	else if(kind=="secret"){
+		secretCache.erase(id);
+		decryptedSecretCache.erase(id);
+		secretByGroupCache.clear();
+		secretByGroupAndClusterCache.clear();
+	}
+	else if(kind=="volume"){
+		volumeCache.erase(id);
+		volumeByGroupCache.clear();
+		volumeByClusterCache.clear();
+		volumeByGroupAndClusterCache.clear();
+		volumeCacheExpirationTime=steady_clock::time_point::min();
+	}
+	else
+		log_warn("Ignoring change of unknown kind " << kind << " to " << id);
+}
+
+bool PersistentStore::preloadCaches(std::chrono::seconds timeBudget){
+	using steady_clock=std::chrono::steady_clock;
+	const auto start=steady_clock::now();
+	const auto deadline=start+timeBudget;
+	std::atomic<bool> outOfTime(false);
+	auto shouldStop=[&]{
+		if(steady_clock::now()<deadline)
+			return false;
+		outOfTime=true;
+		return true;
+	};
+	std::atomic<std::size_t> users(0), memberships(0), groups(0), clusters(0), instances(0);
+	
+	//Memberships and groups are collected so that the caches of each group's
+	//members and each user's groups can be filled once both tables are read. 
+	//Each is touched only by the handler for its own table. 
+	std::vector<std::pair<std::string,std::string>> membershipRecords; //user ID, group ID
+	std::map<std::string,Group> groupsByID;
+	auto loadUsers=[&]()->bool{
+		const std::size_t removals=userCache.removals();
+		bool complete=scanAll(Aws::DynamoDB::Model::ScanRequest().WithTableName(userTableName),
+		                      [&](const DatabaseItem& item){
+			const std::string& id=findOrThrow(item,"ID","User record missing ID attribute").GetS();
+			auto groupID=item.find("groupID");
+			if(groupID!=item.end()){
+				replaceCacheRecord(groupMembershipCache,id+":"+groupID->second.GetS(),CacheRecord<bool>(true,userCacheValidity));
+				membershipRecords.emplace_back(id,groupID->second.GetS());
+				memberships++;
+				return;
+			}
+			//skip any other kind of record which shares the table
+			if(findOrThrow(item,"sortKey","User record missing sortKey attribute").GetS()!=id)
+				return;
+			User user=userFromItem(item);
+			CacheRecord<User> record(user,userCacheValidity);
+			replaceCacheRecord(userCache,user.id,record);
+			replaceCacheRecord(userByTokenCache,user.token,record);
+			replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
+			users++;
+		},shouldStop);
+		if(complete && userCache.removals()==removals)
+			userCacheExpirationTime=steady_clock::now()+userCacheValidity;
+		return complete;
+	};
+	auto loadGroups=[&]()->bool{
+		const std::size_t removals=groupCache.removals();
+		Aws::DynamoDB::Model::ScanRequest request;
+		request.SetTableName(groupTableName);
+		request.SetFilterExpression("attribute_exists(#name)");
+		request.SetExpressionAttributeNames({{"#name","name"}});
+		bool complete=scanAll(request,[&](const DatabaseItem& item){
+			Group group=groupFromItem(item);
+			CacheRecord<Group> record(group,groupCacheValidity);
+			replaceCacheRecord(groupCache,group.id,record);
+			replaceCacheRecord(groupByNameCache,group.name,record);
+			groupsByID.emplace(group.id,group);
+			groups++;
+		},shouldStop);
+		if(complete && groupCache.removals()==removals)
+			groupCacheExpirationTime=steady_clock::now()+groupCacheValidity;
+		return complete;
+	};
+	auto loadClusters=[&]()->bool{
+		const std::size_t removals=clusterCache.removals();
+		Aws::DynamoDB::Model::ScanRequest request;
+		request.SetTableName(clusterTableName);
+		request.SetFilterExpression("attribute_not_exists(#groupID) AND attribute_exists(#name)");
+		request.SetExpressionAttributeNames({{"#groupID", "groupID"},{"#name","name"}});
+		bool complete=scanAll(request,[&](const DatabaseItem& item){
+			Cluster cluster=clusterFromItem(item);
+			CacheRecord<Cluster> record(cluster,clusterCacheValidity);
+			replaceCacheRecord(clusterCache,cluster.id,record);
+			replaceCacheRecord(clusterByNameCache,cluster.name,record);
+			clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
+			writeClusterConfigToDisk(cluster);
+			clusters++;
+		},shouldStop);
+		if(complete && clusterCache.removals()==removals)
+			clusterCacheExpirationTime=steady_clock::now()+clusterCacheValidity;
+		return complete;
+	};
+	//the keys of every category of instances, so that each can be marked 
+	//complete once the whole table has been read
+	std::set<std::string> instanceGroups, instanceClusters, instanceGroupsAndClusters;
+	auto loadInstances=[&]()->bool{
+		const std::size_t removals=instanceCache.removals();
+		Aws::DynamoDB::Model::ScanRequest request;
+		request.SetTableName(instanceTableName);
+		request.SetFilterExpression("attribute_exists(ctime)");
+		bool complete=scanAll(request,[&](const DatabaseItem& item){
+			ApplicationInstance inst=instanceFromItem(item);
+			CacheRecord<ApplicationInstance> record(inst,instanceCacheValidity);
+			replaceCacheRecord(instanceCache,inst.id,record);
+			instanceByNameCache.insert_or_assign(inst.name,record);
+			instanceByGroupCache.insert_or_assign(inst.owningGroup,record);
+			instanceByClusterCache.insert_or_assign(inst.cluster,record);
+			instanceByGroupAndClusterCache.insert_or_assign(inst.owningGroup+":"+inst.cluster,record);
+			instanceGroups.insert(inst.owningGroup);
+			instanceClusters.insert(inst.cluster);
+			instanceGroupsAndClusters.insert(inst.owningGroup+":"+inst.cluster);
+			instances++;
+		},shouldStop);
+		if(complete && instanceCache.removals()==removals)
+			instanceCacheExpirationTime=steady_clock::now()+instanceCacheValidity;
+		return complete;
+	};
+	
+	log_info("Preloading caches for at most " << timeBudget.count() << " seconds");
+	auto logProgress=[&](const std::string& prefix){
+		log_info(prefix << users.load() << " users, " << memberships.load() 
+		         << " group memberships, " << groups.load() << " groups, " 
+		         << clusters.load() << " clusters, and " << instances.load() 
+		         << " application instances");
+	};
+	//each table is scanned on its own thread, in as many segments as are 
+	//configured for all scans
+	std::future<bool> results[]={
+		std::async(std::launch::async,loadUsers),
+		std::async(std::launch::async,loadGroups),
+		std::async(std::launch::async,loadClusters),
+		std::async(std::launch::async,loadInstances)
+	};
+	while(true){
+		const auto nextReport=steady_clock::now()+preloadProgressInterval;
+		bool done=true;
+		for(auto& result : results){
+			if(result.wait_until(nextReport)!=std::future_status::ready){
+				done=false;
+				break;
+			}
+		}
+		if(done)
+			break;
+		logProgress("Preloading caches: loaded ");
+	}
+	bool loaded[4];
+	for(unsigned int i=0; i<4; i++){
+		try{
+			loaded[i]=results[i].get();
+		}catch(std::exception& ex){
+			log_error("Failed to preload cache: " << ex.what());
+			loaded[i]=false;
+		}
+	}
+	const bool usersLoaded=loaded[0], groupsLoaded=loaded[1], instancesLoaded=loaded[3];
+	
+	//Category caches can only be filled when the tables which they summarize
+	//have been read completely, since otherwise they would omit members. 
+	if(usersLoaded && groupsLoaded){
+		const auto now=steady_clock::now();
+		std::set<std::string> groupsWithMembers, usersInGroups;
+		for(const auto& membership : membershipRecords){
+			userByGroupCache.insert_or_assign(membership.second,CacheRecord<std::string>(membership.first,userCacheValidity));
+			groupsWithMembers.insert(membership.second);
+			usersInGroups.insert(membership.first);
+			auto group=groupsByID.find(membership.second);
+			if(group!=groupsByID.end())
+				groupByUserCache.insert_or_assign(membership.first,CacheRecord<Group>(group->second,groupCacheValidity));
+		}
+		for(const auto& group : groupsWithMembers)
+			userByGroupCache.update_expiration(group,now+userCacheValidity);
+		for(const auto& user : usersInGroups)
+			groupByUserCache.update_expiration(user,now+groupCacheValidity);
+	}
+	if(instancesLoaded){
+		const auto expirationTime=steady_clock::now()+instanceCacheValidity;
+		for(const auto& group : instanceGroups)
+			instanceByGroupCache.update_expiration(group,expirationTime);
+		for(const auto& cluster : instanceClusters)
+			instanceByClusterCache.update_expiration(cluster,expirationTime);
+		for(const auto& key : instanceGroupsAndClusters)
+			instanceByGroupAndClusterCache.update_expiration(key,expirationTime);
+	}
+	
+	recordsPreloaded+=users+memberships+groups+clusters+instances;
+	const auto elapsed=std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now()-start);
+	logProgress("Preloaded caches in "+std::to_string(elapsed.count())+" ms: ");
+	const bool complete=std::all_of(std::begin(loaded),std::end(loaded),[](bool b){ return b; });
+	if(outOfTime)
+		log_warn("Cache preloading was stopped after " << timeBudget.count() 
+		         << " seconds; remaining records will be loaded on demand");
+	else if(!complete)
+		log_warn("Cache preloading was incomplete; remaining records will be loaded on demand");
+	return complete;
+}
+
+bool PersistentStore::addOperation(const Operation& operation){
+	using Aws::DynamoDB::Model::AttributeValue;
+	auto request=Aws::DynamoDB::Model::PutItemRequest()
+	.WithTableName(operationTableName)
+	.WithItem({
+		{"ID",AttributeValue(operation.id)},
+		{"sortKey",AttributeValue(operation.id)},
+		{"kind",AttributeValue(operation.kind)},
+		{"target",AttributeValue(operation.target)},
+		{"user",AttributeValue(operation.user)},
+		{"parameters",AttributeValue(operation.parameters)},
+		{"state",AttributeValue(to_string(operation.state))},
+		{"progress",AttributeValue(operation.progress)},
+		{"ctime",AttributeValue(operation.ctime)},
+		{"mtime",AttributeValue(operation.mtime)}
+	})
+	.WithConditionExpression("attribute_not_exists(ID)");
+	//the result is empty until the operation finishes
+	if(!operation.result.empty())
+		request.AddItem("result",AttributeValue(operation.result));
+	if(!operation.owner.empty()){
+		request.AddItem("owner",AttributeValue(operation.owner));
+		request.AddItem("leaseExpires",AttributeValue().SetN(std::to_string(operation.leaseExpiration)));
+	}
+	auto outcome=dbClient.PutItem(request);
+	if(!outcome.IsSuccess()){
+		auto err=outcome.GetError();
+		log_error("Failed to store operation record: " << err.GetMessage());
+		return false;
+	}
+	return true;
+}
+
+bool PersistentStore::updateOperation(const Operation& operation){
+	using AV=Aws::DynamoDB::Model::AttributeValue;
+	std::string update="SET #state = :state, progress = :progress, mtime = :mtime";
+	Aws::Map<Aws::String,Aws::String> names={{"#state","state"},{"#owner","owner"}};
+	Aws::Map<Aws::String,AV> values={{":state",AV(to_string(operation.state))},
+	                                 {":progress",AV(operation.progress)},
+	                                 {":mtime",AV(operation.mtime)}};
+	//the result is empty until the operation finishes
+	if(!operation.result.empty()){
+		update+=", #result = :result";
+		names.emplace("#result","result");
+		values.emplace(":result",AV(operation.result));
+	}
+	//only the replica which owns the operation may change its record
+	std::string condition;
+	if(operation.owner.empty())
+		condition="attribute_exists(ID) AND attribute_not_exists(#owner)";
+	else{
+		condition="#owner = :owner";
+		values.emplace(":owner",AV(operation.owner));
+	}
+	auto outcome=dbClient.UpdateItem(Aws::DynamoDB::Model::UpdateItemRequest()
+	                                 .WithTableName(operationTableName)
+	                                 .WithKey({{"ID",AV(operation.id)},
+	                                           {"sortKey",AV(operation.id)}})
+	                                 .WithUpdateExpression(update)
+	                                 .WithConditionExpression(condition)
+	                                 .WithExpressionAttributeNames(names)
+	                                 .WithExpressionAttributeValues(values));
+	if(!outcome.IsSuccess()){
+		auto err=outcome.GetError();
+		if(err.GetErrorType()==Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED)
+			log_warn("Not updating record of " << operation << ", which is not owned by " << operation.owner);
+		else
+			log_error("Failed to update operation record: " << err.GetMessage());
+		return false;
+	}
+	return true;
+}
+
+bool PersistentStore::renewOperationLease(const Operation& operation){
+	using AV=Aws::DynamoDB::Model::AttributeValue;
+	auto outcome=dbClient.UpdateItem(Aws::DynamoDB::Model::UpdateItemRequest()
+	                                 .WithTableName(operationTableName)
+	                                 .WithKey({{"ID",AV(operation.id)},
+	                                           {"sortKey",AV(operation.id)}})
+	                                 .WithUpdateExpression("SET leaseExpires = :lease")
+	                                 .WithConditionExpression("#owner = :owner AND (#state = :pending OR #state = :running)")
+	                                 .WithExpressionAttributeNames({{"#owner","owner"},
+	                                                                {"#state","state"}})
+	                                 .WithExpressionAttributeValues({{":lease",AV().SetN(std::to_string(operation.leaseExpiration))},
+	                                                                 {":owner",AV(operation.owner)},
+	                                                                 {":pending",AV(to_string(Operation::Pending))},
+	                                                                 {":running",AV(to_string(Operation::Running))}}));
+	if(!outcome.IsSuccess()){
+		auto err=outcome.GetError();
+		if(err.GetErrorType()==Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED)
+			log_warn(operation << " is no longer owned by " << operation.owner);
+		else
+			log_error("Failed to renew lease on operation: " << err.GetMessage());
+		return false;
+	}
+	return true;
+}
+
+bool PersistentStore::claimOperation(const Operation& operation){
+	using AV=Aws::DynamoDB::Model::AttributeValue;
+	const long long now=std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	auto outcome=dbClient.UpdateItem(Aws::DynamoDB::Model::UpdateItemRequest()
+	                                 .WithTableName(operationTableName)
+	                                 .WithKey({{"ID",AV(operation.id)},
+	                                           {"sortKey",AV(operation.id)}})
+	                                 .WithUpdateExpression("SET #owner = :owner, leaseExpires = :lease, "
+	                                                       "#state = :state, progress = :progress, mtime = :mtime")
+	                                 .WithConditionExpression("(#state = :pending OR #state = :running) AND "
+	                                                          "(attribute_not_exists(leaseExpires) OR leaseExpires < :now)")
+	                                 .WithExpressionAttributeNames({{"#owner","owner"},
+	                                                                {"#state","state"}})
+	                                 .WithExpressionAttributeValues({{":owner",AV(operation.owner)},
+	                                                                 {":lease",AV().SetN(std::to_string(operation.leaseExpiration))},
+	                                                                 {":state",AV(to_string(operation.state))},
+	                                                                 {":progress",AV(operation.progress)},
+	                                                                 {":mtime",AV(operation.mtime)},
+	                                                                 {":pending",AV(to_string(Operation::Pending))},
+	                                                                 {":running",AV(to_string(Operation::Running))},
+	                                                                 {":now",AV().SetN(std::to_string(now))}}));
+	if(!outcome.IsSuccess()){
+		auto err=outcome.GetError();
+		//another replica still holds the operation, or has finished it
+		if(err.GetErrorType()!=Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED)
+			log_error("Failed to claim operation: " << err.GetMessage());
+		return false;
+	}
+	return true;
+}
+
+Operation PersistentStore::getOperation(const std::string& id){
+	databaseQueries++;
+	log_info("Querying database for operation " << id);
+	using Aws::DynamoDB::Model::AttributeValue;
+	auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
+	                              .WithTableName(operationTableName)
+	                              .WithKey({{"ID",AttributeValue(id)},
+	                                        {"sortKey",AttributeValue(id)}})
+	                              .WithConsistentRead(true));
+	if(!outcome.IsSuccess()){
+		auto err=outcome.GetError();
+		log_error("Failed to fetch operation record: " << err.GetMessage());
+		return Operation();
+	}
+	const auto& item=outcome.GetResult().GetItem();
+	if(item.empty()) //no match found
+		return Operation();
+	return operationFromItem(item);
+}
+
+std::vector<Operation> PersistentStore::listOperationsByUser(const std::string& uID){
+	using AV=Aws::DynamoDB::Model::AttributeValue;
+	databaseQueries++;
+	log_info("Querying database for operations requested by " << uID);
+	std::vector<Operation> operations;
+	bool complete=queryAll(Aws::DynamoDB::Model::QueryRequest()
+	                       .WithTableName(operationTableName)
+	                       .WithIndexName("ByUser")
+	                       .WithKeyConditionExpression("#user = :user_val")
+	                       .WithExpressionAttributeNames({{"#user","user"}})
+	                       .WithExpressionAttributeValues({{":user_val",AV(uID)}}),
+	                       [&](const DatabaseItem& item){
+		operations.push_back(operationFromItem(item));
+	});
+	if(!complete)
+		log_error("Failed to fetch all operation records for " << uID);
+	return operations;
+}
+
+std::vector<Operation> PersistentStore::listUnfinishedOperations(){
+	using AV=Aws::DynamoDB::Model::AttributeValue;
+	databaseScans++;
+	std::vector<Operation> operations;
+	bool complete=scanAll(Aws::DynamoDB::Model::ScanRequest()
+	                      .WithTableName(operationTableName)
+	                      .WithFilterExpression("#state = :pending OR #state = :running")
+	                      .WithExpressionAttributeNames({{"#state","state"}})
+	                      .WithExpressionAttributeValues({{":pending",AV(to_string(Operation::Pending))},
+	                                                      {":running",AV(to_string(Operation::Running))}}),
+	                      [&](const DatabaseItem& item){
+		operations.push_back(operationFromItem(item));
+	});
+	if(!complete)
+		log_error("Failed to fetch all unfinished operation records");
+	return operations;
+}
+
+void PersistentStore::setOperationThreads(unsigned int threads){
+	operationScheduler.reset(new OperationScheduler(*this,threads));
+}
+
+void PersistentStore::startClusterProber(ClusterProber::Probe probe, 
+                                         std::chrono::seconds interval, unsigned int concurrency){
+	clusterProber.reset();
+	clusterProber.reset(new ClusterProber(*this,std::move(probe),interval,concurrency));
+}
+
 std::string PersistentStore::getStatistics() const{
 	std::ostringstream os;
 	os << "Cache hits: " << cacheHits.load() << "\n";
 	os << "Database queries: " << databaseQueries.load() << "\n";
 	os << "Database scans: " << databaseScans.load() << "\n";
+	os << "Negative cache hits: " << negativeCacheHits.load() << "\n";
+	os << "Coalesced database lookups: " << coalescedLookups.load() << "\n";
+	os << "Cluster object listings cached: " << clusterObjectCache.size() << "\n";
+	os << "Cluster object listing refreshes: " << clusterObjectRefreshCount.load() << "\n";
+	auto cipherStats=secretCipher->getStatistics();
+	os << "Secret key derivations: " << cipherStats.keyDerivations << "\n";
+	os << "Secret keys cached: " << cipherStats.keysCached << "\n";
+	os << "Legacy secret decryptions: " << cipherStats.legacyDecryptions << "\n";
+	os << "Decrypted secrets cached: " << decryptedSecretCache.size() << "\n";
+	os << "Decrypted secret cache hits: " << decryptedSecretCacheHits.load() << "\n";
+	for(const auto cache : evictingCaches){
+		auto cacheStats=cache->getStatistics();
+		const std::string& name=cache->getName();
+		os << name << " cache entries: " << cacheStats.entries << "\n";
+		os << name << " cache memory (bytes): " << cacheStats.bytes << "\n";
+		os << name << " cache hits: " << cacheStats.hits << "\n";
+		os << name << " cache misses: " << cacheStats.misses << "\n";
+		os << name << " cache evictions: " << cacheStats.evictions << "\n";
+		os << name << " cache expirations: " << cacheStats.expirations << "\n";
+	}
+	os << "Expired cache index keys swept: " << cacheCategoriesSwept.load() << "\n";
+	os << "Changes recorded: " << changesRecorded.load() << "\n";
+	os << "Changes not recorded: " << changesNotRecorded.load() << "\n";
+	os << "Change log polls: " << changePolls.load() << "\n";
+	os << "Changes applied from other replicas: " << changesApplied.load() << "\n";
+	os << "Records preloaded: " << recordsPreloaded.load() << "\n";
+	os << "Child processes started: " << childProcessesStarted() << "\n";
+	auto apiStats=kubernetes::getAPIClientStatistics();
+	os << "Direct Kubernetes API requests: " << apiStats.directRequests << "\n";
+	os << "Kubernetes API requests via kubectl: " << apiStats.fallbackRequests << "\n";
+	os << "Kubernetes API connections created: " << apiStats.connectionsCreated << "\n";
+	os << "Kubernetes API watches started: " << apiStats.watchesStarted << "\n";
+	auto operationStats=operationScheduler->getStatistics();
+	os << "Operations started: " << operationStats.started << "\n";
+	os << "Operations resumed: " << operationStats.resumed << "\n";
+	os << "Operations succeeded: " << operationStats.succeeded << "\n";
+	os << "Operations failed: " << operationStats.failed << "\n";
+	if(clusterProber){
+		auto probeStats=clusterProber->getStatistics();
+		os << "Clusters probed: " << probeStats.clusters << "\n";
+		os << "Cluster probes: " << probeStats.probes << "\n";
+		os << "Cluster probe failures: " << probeStats.failures << "\n";
+		os << "Cluster probe errors: " << probeStats.errors << "\n";
+		double meanLatency=0;
+		if(probeStats.probes)
+			meanLatency=(double)probeStats.totalLatency.count()/probeStats.probes;
+		os << "Cluster probe mean latency (ms): " << meanLatency << "\n";
+		//report the histogram cumulatively, as Prometheus does
+		std::size_t probesWithin=0;
+		for(std::size_t i=0; i<ClusterProber::latencyBuckets.size(); i++){
+			probesWithin+=probeStats.latencyCounts[i];
+			os << "Cluster probe latency <= " << ClusterProber::latencyBuckets[i] 
+			   << " ms: " << probesWithin << "\n";
+		}
+	}
+	os << getExecutorStatistics();
 	return os.str();
 }
 
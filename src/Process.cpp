@@ -1,5 +1,7 @@
 #include "Process.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <iostream>
@@ -9,10 +11,19 @@
 
 #include <fcntl.h>
 #include <paths.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+//closefrom and posix_spawn_file_actions_addclosefrom_np are needed to 
+//efficiently keep other file descriptors from leaking into child processes
+#if defined(__GLIBC__) && (__GLIBC__>2 || (__GLIBC__==2 && __GLIBC_MINOR__>=34))
+#define SLATE_CLOSEFROM_AVAIL 1
+#endif
+
 #include <libcuckoo/cuckoohash_map.hh>
 
 #include <Utilities.h>
@@ -32,15 +43,28 @@ void setNonblocking(int fd){
 
 namespace{
 sig_atomic_t reapFlag=0;
+std::atomic<unsigned long long> processesStarted(0);
+///A pipe used to wake the reaper thread. A byte is written to wakePipe[1] 
+///whenever SIGCHLD arrives, or when the reaper should stop. 
+int wakePipe[2]={-1,-1};
 
 void handleSIGCHLD(int, siginfo_t* info, void* uap){
 	reapFlag=1;
-	//const char msg[]="We get signal!\n";
-	//write(1,msg,sizeof(msg));
+	//write is async-signal-safe; if the pipe is full the reaper has a wakeup 
+	//pending already, so failure is harmless
+	int savedErrno=errno;
+	char c=0;
+	ssize_t ignored=write(wakePipe[1],&c,1);
+	(void)ignored;
+	errno=savedErrno;
 }
 	
 struct PrepareForSignals{
 	PrepareForSignals(){
+		if(pipe2(wakePipe,O_CLOEXEC|O_NONBLOCK)==-1){
+			auto err=errno;
+			throw std::runtime_error("Unable to allocate reaper wake pipe: "+std::to_string(err));
+		}
 		struct sigaction act;
 		act.sa_flags=SA_RESTART | SA_NOCLDSTOP | SA_SIGINFO;
 		act.sa_sigaction=handleSIGCHLD;
@@ -61,8 +85,43 @@ struct PrepareForSignals{
 	
 std::atomic<bool> reaperStop;
 cuckoohash_map<pid_t,ProcessRecord> processTable;
+
+///Owns the reaper thread, and stops it if the program exits while it is 
+///running, since destroying a running std::thread would abort. This must be 
+///declared after the objects the thread uses, so that it is destroyed first. 
+struct ReaperThread{
+	std::thread thread;
+	~ReaperThread(){ stopReaper(); }
+} reaper;
 } //anonymous namespace
 
+namespace{
+///Write to a pipe without the risk of this process being killed by SIGPIPE if
+///the reader has closed it. SIGPIPE is blocked only in the calling thread, 
+///since the signal is sent to the thread which wrote. 
+///\return the result of write(), with errno set to EPIPE if the pipe was closed
+ssize_t writeToPipe(int fd, const char* data, std::size_t size){
+	sigset_t pipeSignal, oldMask;
+	sigemptyset(&pipeSignal);
+	sigaddset(&pipeSignal,SIGPIPE);
+	pthread_sigmask(SIG_BLOCK,&pipeSignal,&oldMask);
+	sigset_t pending;
+	sigpending(&pending);
+	const bool alreadyPending=sigismember(&pending,SIGPIPE);
+	
+	ssize_t result=write(fd,data,size);
+	int err=errno;
+	//discard the signal this write raised, unless one was already waiting
+	if(result<0 && err==EPIPE && !alreadyPending){
+		struct timespec noWait={0,0};
+		while(sigtimedwait(&pipeSignal,nullptr,&noWait)==-1 && errno==EINTR);
+	}
+	pthread_sigmask(SIG_SETMASK,&oldMask,nullptr);
+	errno=err;
+	return result;
+}
+}
+
 ProcessIOBuffer::ProcessIOBuffer():
 fd_in(-1),fd_out(-1),
 readBuffer(nullptr),
@@ -121,7 +180,7 @@ std::streamsize ProcessIOBuffer::xsputn(const char_type* s, std::streamsize n){
 		return(amountWritten);
 	while(n>0){
 		waitReady(WRITE);
-		int result=write(fd_in,s,n);
+		ssize_t result=writeToPipe(fd_in,s,n);
 		if(result>0){
 			n-=result;
 			s+=result;
@@ -130,11 +189,11 @@ std::streamsize ProcessIOBuffer::xsputn(const char_type* s, std::streamsize n){
 				return(amountWritten);
 		}
 		else{
-			if(errno==EAGAIN || errno==EWOULDBLOCK)
+			if(errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)
 				continue;
-			//TODO: include error code, etc
-			//throw std::runtime_error("Write Error");
-			std::cerr << "write gave error " << errno << std::endl;
+			//the reader has gone away or the pipe is otherwise broken; report 
+			//the short write so that the stream enters a failed state
+			break;
 		}
 	}
 	return(amountWritten);
@@ -179,7 +238,8 @@ std::streamsize ProcessIOBuffer::showmanyc(){
 }
 
 void ProcessIOBuffer::endInput(){
-	close(fd_in);
+	if(fd_in!=-1)
+		close(fd_in);
 	fd_in=-1;
 	closedIn=true;
 }
@@ -337,28 +397,43 @@ char ProcessHandle::exitStatus() const{
 	return exitStatusValue;
 }
 
+void ProcessHandle::wait(){
+	assert(child && "child process must not be detatched");
+	std::unique_lock<std::mutex> lock(exitMutex);
+	exitCondition.wait(lock,[this]{ return hasExitStatus.load(); });
+}
+
+bool ProcessHandle::waitFor(std::chrono::milliseconds timeout){
+	assert(child && "child process must not be detatched");
+	std::unique_lock<std::mutex> lock(exitMutex);
+	return exitCondition.wait_for(lock,timeout,[this]{ return hasExitStatus.load(); });
+}
+
 void ProcessHandle::setExitStatus(unsigned char status){
-	exitStatusValue=status;
-	hasExitStatus=true;
+	{
+		std::lock_guard<std::mutex> lock(exitMutex);
+		exitStatusValue=status;
+		hasExitStatus=true;
+	}
+	exitCondition.notify_all();
 }
 
 void reapProcesses(){
 	if(!reapFlag)
 		return;
+	//clear the flag before waiting, so that a child which exits after the last
+	//waitpid is not missed
+	reapFlag=0;
 	int stat;
 	pid_t p;
 	while(true){
 		p=waitpid(-1,&stat,WNOHANG);
-		if(!p){ //great, done
-			reapFlag=0;
+		if(!p) //great, done
 			return;
-		}
 		if(p==-1){
 			auto err=errno;
-			if(err==ECHILD){ //great, done
-				reapFlag=0;
+			if(err==ECHILD) //great, done
 				return;
-			}
 			if(err==EINTR)
 				continue;
 			else
@@ -382,28 +457,44 @@ void reapProcesses(){
 }
 
 void startReaper(){
+	if(reaper.thread.joinable()) //already running
+		return;
 	reaperStop.store(false);
-	std::thread reaper([](){
+	reaper.thread=std::thread([](){
+		struct pollfd wake;
+		wake.fd=wakePipe[0];
+		wake.events=POLLIN;
+		char drain[64];
 		while(!reaperStop.load()){
+			//children may have exited before the signal handler was able to 
+			//wake us, so always check once before sleeping
 			reapProcesses();
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			//the timeout is only a backstop; normally SIGCHLD wakes us
+			int result=poll(&wake,1,1000);
+			if(result>0){
+				while(read(wakePipe[0],drain,sizeof(drain))>0){}
+			}
 		}
-		//set the flag back to its original state to signal stopping
-		reaperStop.store(false);
 	});
-	reaper.detach();
 }
 
 void stopReaper(){
+	if(!reaper.thread.joinable())
+		return;
 	reaperStop.store(true);
-	//wait for background thread to signal that it has indeed stopped
-	while(!reaperStop.load()){
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
-	}
+	char c=0;
+	ssize_t ignored=write(wakePipe[1],&c,1);
+	(void)ignored;
+	reaper.thread.join();
+	reaperStop.store(false);
 }
 
 extern char **environ;
 
+unsigned long long childProcessesStarted(){
+	return processesStarted.load();
+}
+
 ProcessHandle startProcessAsync(std::string exe, const std::vector<std::string>& args, 
                                 const std::map<std::string,std::string>& env, 
                                 ForkCallbacks&& callbacks, bool detachable){
@@ -499,6 +590,8 @@ ProcessHandle startProcessAsync(std::string exe, const std::vector<std::string>&
 	
 	int err;
 	//create communication pipes
+	//These are close-on-exec so that they cannot leak into other children 
+	//started concurrently; the child's copies made by dup2 are not affected.
 	int inpipe[2]={-1,-1};
 	int outpipe[2]={-1,-1};
 	int errpipe[2]={-1,-1};
@@ -506,54 +599,104 @@ ProcessHandle startProcessAsync(std::string exe, const std::vector<std::string>&
 	FdCloser outcloser[2]={{outpipe[0]},{outpipe[1]}};
 	FdCloser errcloser[2]={{errpipe[0]},{errpipe[1]}};
 	if(!detachable){
-		err=pipe(inpipe);
-		if(err){
-			err=errno;
-			throw std::runtime_error("Unable to allocate pipe: Error "+std::to_string(err)+": "+strerror(err));
-		}
-		err=pipe(outpipe);
-		if(err){
-			err=errno;
-			throw std::runtime_error("Unable to allocate pipe: Error "+std::to_string(err)+": "+strerror(err));
-		}
-		err=pipe(errpipe);
-		if(err){
-			err=errno;
-			throw std::runtime_error("Unable to allocate pipe: Error "+std::to_string(err)+": "+strerror(err));
+		for(int* p : {inpipe,outpipe,errpipe}){
+			err=pipe2(p,O_CLOEXEC);
+			if(err){
+				err=errno;
+				throw std::runtime_error("Unable to allocate pipe: Error "+std::to_string(err)+": "+strerror(err));
+			}
 		}
 	}
 	
-	callbacks.beforeFork();
-	pid_t child=fork();
-	if(child<0){ //fork failed
-		auto err=errno;
-		throw std::runtime_error("Failed to start child process: Error "+std::to_string(err)+": "+strerror(err));
-	}
-	if(!child){ //if we don't know who the child is, it is us
-		callbacks.inChild();
+	pid_t child;
+#ifdef SLATE_CLOSEFROM_AVAIL
+	if(!callbacks.needsChildCallback()){
+		//posix_spawn avoids copying the page tables of this (potentially large, 
+		//heavily threaded) process just to immediately replace them with exec
+		posix_spawn_file_actions_t actions;
+		posix_spawnattr_t attr;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawnattr_init(&attr);
+		struct SpawnCleanup{
+			posix_spawn_file_actions_t& actions;
+			posix_spawnattr_t& attr;
+			~SpawnCleanup(){
+				posix_spawn_file_actions_destroy(&actions);
+				posix_spawnattr_destroy(&attr);
+			}
+		} spawnCleanup{actions,attr};
 		//connect standard fds to pipes
 		if(detachable){
-			int nullfd=open("/dev/null",O_RDWR);
-			dup2(nullfd,0);
-			dup2(nullfd,1);
-			dup2(nullfd,2);
+			posix_spawn_file_actions_addopen(&actions,0,"/dev/null",O_RDWR,0);
+			posix_spawn_file_actions_adddup2(&actions,0,1);
+			posix_spawn_file_actions_adddup2(&actions,0,2);
 		}
 		else{
-			dup2(inpipe[0],0);
-			dup2(outpipe[1],1);
-			dup2(errpipe[1],2);
+			posix_spawn_file_actions_adddup2(&actions,inpipe[0],0);
+			posix_spawn_file_actions_adddup2(&actions,outpipe[1],1);
+			posix_spawn_file_actions_adddup2(&actions,errpipe[1],2);
+		}
+		//close all other fds, not just those which were opened close-on-exec
+		posix_spawn_file_actions_addclosefrom_np(&actions,3);
+		//do not pass on any signals this process has blocked
+		sigset_t noSignals;
+		sigemptyset(&noSignals);
+		posix_spawnattr_setsigmask(&attr,&noSignals);
+		posix_spawnattr_setflags(&attr,POSIX_SPAWN_SETSIGMASK);
+		
+		callbacks.beforeFork();
+		err=posix_spawn(&child,exe.c_str(),&actions,&attr,
+		                (char *const *)rawArgs.get(),(char *const *)newEnv);
+		if(err)
+			throw std::runtime_error("Failed to start child process: Error "+std::to_string(err)+": "+strerror(err));
+	}
+	else
+#endif
+	{
+		callbacks.beforeFork();
+		child=fork();
+		if(child<0){ //fork failed
+			auto err=errno;
+			throw std::runtime_error("Failed to start child process: Error "+std::to_string(err)+": "+strerror(err));
+		}
+		if(!child){ //if we don't know who the child is, it is us
+			callbacks.inChild();
+			//connect standard fds to pipes
+			if(detachable){
+				int nullfd=open("/dev/null",O_RDWR);
+				dup2(nullfd,0);
+				dup2(nullfd,1);
+				dup2(nullfd,2);
+			}
+			else{
+				dup2(inpipe[0],0);
+				dup2(outpipe[1],1);
+				dup2(errpipe[1],2);
+			}
+			//close all other fds
+#ifdef SLATE_CLOSEFROM_AVAIL
+			closefrom(3);
+#else
+			struct rlimit fdLimit;
+			int maxFd=1024;
+			if(getrlimit(RLIMIT_NOFILE,&fdLimit)==0 && fdLimit.rlim_cur!=RLIM_INFINITY)
+				maxFd=fdLimit.rlim_cur;
+			for(int i = 3; i<maxFd; i++)
+				close(i);
+#endif
+			sigset_t noSignals;
+			sigemptyset(&noSignals);
+			sigprocmask(SIG_SETMASK,&noSignals,nullptr);
+			//be the child process
+			execve(exe.c_str(),(char *const *)rawArgs.get(),(char *const *)newEnv);
+			int err=errno;
+			//not that this will be any help if we are detatchable
+			fprintf(stderr,"Exec failed: Error %i\n",err);
+			_exit(err);
 		}
-		//close all other fds
-		for(int i = 3; i<FOPEN_MAX; i++)
-			close(i);
-		//be the child process
-		execve(exe.c_str(),(char *const *)rawArgs.get(),(char *const *)newEnv);
-		int err=errno;
-		//not that this will be any help if we are detatchable
-		fprintf(stderr,"Exec failed: Error %i\n",err);
-		exit(err);
 	}
 	//otherwise, we are still the parent
+	processesStarted++;
 	callbacks.inParent();
 	//close ends of pipes we will not use
 	if(!detachable)
@@ -563,56 +706,185 @@ ProcessHandle startProcessAsync(std::string exe, const std::vector<std::string>&
 
 
 namespace{
-	void collectChildOutput(ProcessHandle& child, commandResult& result){
-		std::unique_ptr<char[]> buf(new char[1024]);
-		char* bufptr=buf.get();
-		//collect stdout
-		//std::cout << "collecting child stdout" << std::endl;
-		std::istream& child_stdout=child.getStdout();
-		while(!child_stdout.eof()){
-			char* ptr=bufptr;
-			child_stdout.read(ptr,1);
-			ptr+=child_stdout.gcount();
-			child_stdout.readsome(ptr,1023);
-			ptr+=child_stdout.gcount();
-			result.output.append(bufptr,ptr-bufptr);
+	///Stop a child which is being abandoned, escalating to SIGKILL if it does 
+	///not exit promptly after SIGTERM
+	void stopChild(ProcessHandle& child){
+		child.kill();
+		if(!child.waitFor(std::chrono::seconds(1))){
+			::kill(child.getPid(),SIGKILL);
+			child.wait();
+		}
+	}
+
+	///Read the data currently available from a non-blocking fd into a string.
+	///At most maxReadPerPoll bytes are read in one call, so that a child which
+	///writes as fast as its output is read cannot keep the caller from 
+	///checking its time limit. 
+	///\param buffer scratch space for reads
+	///\param limit if non-zero, reading stops once \p dest is longer than this
+	///\return false if the end of the data has been reached
+	bool drainFd(int fd, std::string& dest, std::vector<char>& buffer, std::size_t limit){
+		const std::size_t maxReadPerPoll=4<<20;
+		std::size_t total=0;
+		while(total<maxReadPerPoll && (!limit || dest.size()<=limit)){
+			std::size_t amount=buffer.size();
+			//read only one byte past the limit, which is enough to show that 
+			//the output is too long
+			if(limit)
+				amount=std::min(amount,limit+1-dest.size());
+			ssize_t result=read(fd,buffer.data(),amount);
+			if(result>0){
+				//grow geometrically, so that large outputs are not copied many times
+				if(dest.capacity()-dest.size()<(std::size_t)result)
+					dest.reserve(std::max(2*dest.capacity(),dest.size()+result));
+				dest.append(buffer.data(),result);
+				total+=result;
+				continue;
+			}
+			if(result==0)
+				return false;
+			int err=errno;
+			if(err==EINTR)
+				continue;
+			if(err==EAGAIN || err==EWOULDBLOCK)
+				return true;
+			throw std::runtime_error("Failed to read child process output: Error "+std::to_string(err)+": "+strerror(err));
+		}
+		return true;
+	}
+
+	///Write as much data as a non-blocking fd will accept
+	///\param offset the position in \p data of the first byte not yet 
+	///              written, which is advanced past the written data
+	///\return false if the fd can accept no more data, because the reader has
+	///        closed it
+	bool fillFd(int fd, const std::string& data, std::size_t& offset){
+		while(offset<data.size()){
+			//limit the size of each write so that reads of output are not 
+			//delayed for too long
+			std::size_t amount=std::min(data.size()-offset,(std::size_t)1<<20);
+			ssize_t result=writeToPipe(fd,data.data()+offset,amount);
+			if(result>0){
+				offset+=result;
+				continue;
+			}
+			int err=errno;
+			if(err==EINTR)
+				continue;
+			if(err==EAGAIN || err==EWOULDBLOCK)
+				return true;
+			return false;
+		}
+		return true;
+	}
+
+	///Collect the output of a child process, optionally writing its input at
+	///the same time
+	///\param input the data to write to the child's stdin, or nullptr if its 
+	///             stdin should simply be closed
+	void collectChildOutput(ProcessHandle& child, commandResult& result, 
+	                        const CommandOptions& options, 
+	                        const std::string* input=nullptr){
+		using clock=std::chrono::steady_clock;
+		const bool hasDeadline=options.timeout.count()>0;
+		const clock::time_point deadline=clock::now()+options.timeout;
+		result.timedOut=false;
+		result.truncated=false;
+		
+		//wait for data on both stdout and stderr at once, so that a child 
+		//which fills the stderr pipe before finishing stdout cannot block, and
+		//write input only as the child accepts it, so that a child which 
+		//fills an output pipe before reading all of its input cannot block
+		struct pollfd fds[3];
+		fds[0].fd=child.stdoutFd();
+		fds[1].fd=child.stderrFd();
+		fds[0].events=fds[1].events=POLLIN;
+		fds[2].fd=-1;
+		fds[2].events=POLLOUT;
+		std::size_t inputOffset=0;
+		if(input && !input->empty() && child.stdinFd()>=0)
+			fds[2].fd=child.stdinFd();
+		else
+			child.endInput();
+#ifdef F_SETPIPE_SZ
+		//a larger pipe lets the child write large outputs with fewer context 
+		//switches; failure (e.g. due to the system limit) is harmless
+		if(options.largeOutput)
+			fcntl(fds[0].fd,F_SETPIPE_SZ,1<<20);
+#endif
+		std::string* dest[2]={&result.output,&result.error};
+		std::vector<char> buffer(256*1024);
+		while(fds[0].fd>=0 || fds[1].fd>=0 || fds[2].fd>=0){
+			int waitTime=-1;
+			if(hasDeadline){
+				auto remaining=std::chrono::duration_cast<std::chrono::milliseconds>(deadline-clock::now()).count();
+				if(remaining<=0){
+					result.timedOut=true;
+					break;
+				}
+				waitTime=remaining;
+			}
+			int ready=poll(fds,3,waitTime);
+			if(ready<0){
+				int err=errno;
+				if(err==EINTR)
+					continue;
+				throw std::runtime_error("Failed to poll child process output: Error "+std::to_string(err)+": "+strerror(err));
+			}
+			if(fds[2].fd>=0 && fds[2].revents){
+				//stop writing once all input is written, or if the child will
+				//not read any more of it
+				if(!fillFd(fds[2].fd,*input,inputOffset) || inputOffset==input->size()){
+					child.endInput();
+					fds[2].fd=-1;
+				}
+			}
+			for(int i=0; i<2; i++){
+				if(fds[i].fd<0 || !fds[i].revents)
+					continue;
+				//negative fds are ignored by poll
+				if(!drainFd(fds[i].fd,*dest[i],buffer,options.outputLimit))
+					fds[i].fd=-1;
+				if(options.outputLimit && dest[i]->size()>options.outputLimit){
+					dest[i]->resize(options.outputLimit);
+					result.truncated=true;
+				}
+			}
+			if(result.truncated)
+				break;
 		}
-		//collect stderr
-		//std::cout << "collecting child stderr" << std::endl;
-		std::istream& child_stderr=child.getStderr();
-		while(!child_stderr.eof()){
-			char* ptr=bufptr;
-			child_stderr.read(ptr,1);
-			ptr+=child_stderr.gcount();
-			child_stderr.readsome(ptr,1023);
-			ptr+=child_stderr.gcount();
-			result.error.append(bufptr,ptr-bufptr);
+		if(result.timedOut || result.truncated)
+			stopChild(child);
+		else if(hasDeadline){
+			auto remaining=std::chrono::duration_cast<std::chrono::milliseconds>(deadline-clock::now());
+			if(!child.waitFor(std::max(remaining,std::chrono::milliseconds(0)))){
+				result.timedOut=true;
+				stopChild(child);
+			}
 		}
-		//std::cout << "waiting for child exit" << std::endl;
-		while(!child.done())
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		else
+			child.wait();
 		result.status=child.exitStatus();
 	}
 }
 
 commandResult runCommand(const std::string& command, 
                          const std::vector<std::string>& args,
-                         const std::map<std::string,std::string>& env){
+                         const std::map<std::string,std::string>& env,
+                         const CommandOptions& options){
 	commandResult result;
 	ProcessHandle child=startProcessAsync(command,args,env);
-	collectChildOutput(child,result);
+	collectChildOutput(child,result,options);
 	return result;
 }
 
 commandResult runCommandWithInput(const std::string& command, 
                                   const std::string& input,
                                   const std::vector<std::string>& args,
-                                  const std::map<std::string,std::string>& env){
+                                  const std::map<std::string,std::string>& env,
+                                  const CommandOptions& options){
 	commandResult result;
 	ProcessHandle child=startProcessAsync(command,args,env);
-	child.getStdin() << input;
-	child.getStdin().flush();
-	child.endInput();
-	collectChildOutput(child,result);
+	collectChildOutput(child,result,options,&input);
 	return result;
 }
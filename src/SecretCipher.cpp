@@ -0,0 +1,234 @@
+#include "SecretCipher.h"
+
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+extern "C"{
+	#include <scrypt/crypto/crypto_scrypt.h>
+	#include <scrypt/scryptenc/scryptenc.h>
+	#include <scrypt/util/insecure_memzero.h>
+}
+
+constexpr std::size_t SecretCipher::keySize;
+constexpr std::size_t SecretCipher::saltSize;
+constexpr std::size_t SecretCipher::nonceSize;
+constexpr std::size_t SecretCipher::tagSize;
+constexpr std::size_t SecretCipher::headerSize;
+constexpr uint8_t SecretCipher::logN;
+constexpr uint32_t SecretCipher::r;
+constexpr uint32_t SecretCipher::p;
+constexpr std::size_t SecretCipher::maxKeysCached;
+
+namespace{
+	const std::string magic="slatev2";
+	const std::string legacyMagic="scrypt";
+	///The smallest amount of data which the original format can hold
+	const std::size_t legacyHeaderSize=128;
+
+	void putUint32(std::string& s, uint32_t value){
+		for(int shift=24; shift>=0; shift-=8)
+			s.push_back((char)((value>>shift)&0xFF));
+	}
+
+	uint32_t getUint32(const std::string& s, std::size_t offset){
+		uint32_t value=0;
+		for(std::size_t i=0; i<4; i++)
+			value=(value<<8)|(uint8_t)s[offset+i];
+		return value;
+	}
+
+	using CipherContext=std::unique_ptr<EVP_CIPHER_CTX,void(*)(EVP_CIPHER_CTX*)>;
+
+	CipherContext makeContext(){
+		CipherContext ctx(EVP_CIPHER_CTX_new(),&EVP_CIPHER_CTX_free);
+		if(!ctx)
+			throw std::runtime_error("Failed to allocate cipher context");
+		return ctx;
+	}
+}
+
+SecretCipher::DerivedKey::~DerivedKey(){
+	insecure_memzero(key,keySize);
+}
+
+SecretCipher::SecretCipher(const SecretData& password, unsigned int concurrency):
+password(password.dataSize),
+salt(saltSize,'\0'),
+scryptLimit(concurrency ? concurrency : 1),
+scryptRunning(0),
+keyDerivations(0),
+legacyDecryptions(0)
+{
+	std::memcpy(this->password.data.get(),password.data.get(),password.dataSize);
+	if(RAND_bytes((unsigned char*)&salt.front(),saltSize)!=1)
+		throw std::runtime_error("Failed to generate salt for secret encryption");
+}
+
+template<typename F>
+auto SecretCipher::limitScrypt(F f) const -> decltype(f()){
+	struct Slot{
+		const SecretCipher& cipher;
+		Slot(const SecretCipher& c):cipher(c){
+			std::unique_lock<std::mutex> lock(cipher.scryptMutex);
+			cipher.scryptDone.wait(lock,[this]{ return cipher.scryptRunning<cipher.scryptLimit; });
+			cipher.scryptRunning++;
+		}
+		~Slot(){
+			{
+				std::lock_guard<std::mutex> lock(cipher.scryptMutex);
+				cipher.scryptRunning--;
+			}
+			cipher.scryptDone.notify_one();
+		}
+	} slot(*this);
+	return f();
+}
+
+void SecretCipher::setConcurrencyLimit(unsigned int concurrency){
+	{
+		std::lock_guard<std::mutex> lock(scryptMutex);
+		scryptLimit=(concurrency ? concurrency : 1);
+	}
+	scryptDone.notify_all();
+}
+
+std::shared_ptr<SecretCipher::DerivedKey> SecretCipher::getKey(const std::string& params) const{
+	std::shared_ptr<DerivedKey> key;
+	{
+		std::lock_guard<std::mutex> lock(keyMutex);
+		auto it=keys.find(params);
+		if(it!=keys.end())
+			key=it->second;
+		else{
+			//Only an attacker, or a very long history of server restarts,
+			//should produce this many distinct salts
+			if(keys.size()>=maxKeysCached)
+				keys.clear();
+			key=std::make_shared<DerivedKey>();
+			keys.emplace(params,key);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(key->mut);
+	if(!key->ready){
+		unsigned int keyLogN=(uint8_t)params[0];
+		uint32_t keyR=getUint32(params,1), keyP=getUint32(params,5);
+		//refuse parameters which would need far more memory or time than 
+		//those which this class uses
+		if(keyLogN<1 || keyLogN>20 || keyR<1 || keyR>16 || keyP<1 || keyP>4)
+			throw std::runtime_error("Invalid encrypted data: bad key parameters");
+		int err=limitScrypt([&]{
+			return crypto_scrypt((const uint8_t*)password.data.get(),password.dataSize,
+			                     (const uint8_t*)params.data()+9,saltSize,
+			                     (uint64_t)1<<keyLogN,keyR,keyP,key->key,keySize);
+		});
+		if(err){
+			std::lock_guard<std::mutex> lock(keyMutex);
+			keys.erase(params);
+			throw std::runtime_error("Failed to derive secret encryption key");
+		}
+		keyDerivations++;
+		key->ready=true;
+	}
+	return key;
+}
+
+std::string SecretCipher::encrypt(const SecretData& data) const{
+	if(data.dataSize>INT_MAX)
+		throw std::runtime_error("Secret data too large to encrypt");
+	std::string result=magic;
+	result.reserve(headerSize+data.dataSize+tagSize);
+	result.push_back((char)logN);
+	putUint32(result,r);
+	putUint32(result,p);
+	result+=salt;
+	auto key=getKey(result.substr(magic.size()));
+
+	std::string nonce(nonceSize,'\0');
+	if(RAND_bytes((unsigned char*)&nonce.front(),nonceSize)!=1)
+		throw std::runtime_error("Failed to generate nonce for secret encryption");
+	const std::size_t aadSize=result.size();
+	result+=nonce;
+	result.resize(headerSize+data.dataSize+tagSize);
+	uint8_t* out=(uint8_t*)&result.front();
+
+	auto ctx=makeContext();
+	int len=0;
+	if(EVP_EncryptInit_ex(ctx.get(),EVP_aes_256_gcm(),nullptr,nullptr,nullptr)!=1
+	   || EVP_CIPHER_CTX_ctrl(ctx.get(),EVP_CTRL_GCM_SET_IVLEN,nonceSize,nullptr)!=1
+	   || EVP_EncryptInit_ex(ctx.get(),nullptr,nullptr,key->key,out+aadSize)!=1
+	   || EVP_EncryptUpdate(ctx.get(),nullptr,&len,out,aadSize)!=1
+	   || EVP_EncryptUpdate(ctx.get(),out+headerSize,&len,
+	                        (const uint8_t*)data.data.get(),data.dataSize)!=1
+	   || EVP_EncryptFinal_ex(ctx.get(),out+headerSize+len,&len)!=1
+	   || EVP_CIPHER_CTX_ctrl(ctx.get(),EVP_CTRL_GCM_GET_TAG,tagSize,
+	                          out+headerSize+data.dataSize)!=1)
+		throw std::runtime_error("Failed to encrypt secret data");
+	return result;
+}
+
+SecretData SecretCipher::decrypt(const std::string& data) const{
+	if(data.compare(0,legacyMagic.size(),legacyMagic)==0){
+		if(data.size()<legacyHeaderSize)
+			throw std::runtime_error("Invalid encrypted data: too short to contain header");
+		std::size_t outLen=data.size()-legacyHeaderSize;
+		SecretData output(outLen);
+		int err=limitScrypt([&]{
+			return scryptdec_buf((const uint8_t*)data.data(),data.size(),
+			                     (uint8_t*)output.data.get(),&outLen,
+			                     (const uint8_t*)password.data.get(),password.dataSize);
+		});
+		if(err)
+			throw std::runtime_error("Failed to decrypt with scrypt: error " + std::to_string(err));
+		legacyDecryptions++;
+		return output;
+	}
+
+	if(data.compare(0,magic.size(),magic)!=0)
+		throw std::runtime_error("Invalid encrypted data: unrecognized format");
+	if(data.size()<headerSize+tagSize)
+		throw std::runtime_error("Invalid encrypted data: too short to contain header");
+	if(data.size()-headerSize-tagSize>INT_MAX)
+		throw std::runtime_error("Invalid encrypted data: too large");
+	auto key=getKey(data.substr(magic.size(),headerSize-nonceSize-magic.size()));
+
+	const std::size_t dataSize=data.size()-headerSize-tagSize;
+	const uint8_t* in=(const uint8_t*)data.data();
+	std::string tag=data.substr(headerSize+dataSize);
+	SecretData output(dataSize);
+	auto ctx=makeContext();
+	int len=0;
+	if(EVP_DecryptInit_ex(ctx.get(),EVP_aes_256_gcm(),nullptr,nullptr,nullptr)!=1
+	   || EVP_CIPHER_CTX_ctrl(ctx.get(),EVP_CTRL_GCM_SET_IVLEN,nonceSize,nullptr)!=1
+	   || EVP_DecryptInit_ex(ctx.get(),nullptr,nullptr,key->key,in+headerSize-nonceSize)!=1
+	   || EVP_DecryptUpdate(ctx.get(),nullptr,&len,in,headerSize-nonceSize)!=1
+	   || EVP_DecryptUpdate(ctx.get(),(uint8_t*)output.data.get(),&len,in+headerSize,dataSize)!=1
+	   || EVP_CIPHER_CTX_ctrl(ctx.get(),EVP_CTRL_GCM_SET_TAG,tagSize,&tag.front())!=1)
+		throw std::runtime_error("Failed to decrypt secret data");
+	if(EVP_DecryptFinal_ex(ctx.get(),(uint8_t*)output.data.get()+len,&len)!=1)
+		throw std::runtime_error("Failed to decrypt secret data: data has been altered or the key is incorrect");
+	return output;
+}
+
+bool SecretCipher::isEncrypted(const std::string& data){
+	if(data.compare(0,magic.size(),magic)==0)
+		return data.size()>=headerSize+tagSize;
+	if(data.compare(0,legacyMagic.size(),legacyMagic)==0)
+		return data.size()>=legacyHeaderSize;
+	return false;
+}
+
+SecretCipher::Statistics SecretCipher::getStatistics() const{
+	Statistics stats;
+	{
+		std::lock_guard<std::mutex> lock(keyMutex);
+		stats.keysCached=keys.size();
+	}
+	stats.keyDerivations=keyDerivations.load();
+	stats.legacyDecryptions=legacyDecryptions.load();
+	return stats;
+}
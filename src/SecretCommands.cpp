@@ -173,6 +173,8 @@ crow::response createSecret(PersistentStore& store, const crow::request& req){
 	const static std::string allowedKeyCharacters="-._0123456789"
 	"abcdefghijklmnopqrstuvwxyz"
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	//values are decoded as they are checked, and kept for sending to kubernetes
+	std::map<std::string,std::string> decodedContents;
 	if(body.HasMember("contents")){
 		for(const auto& member : body["contents"].GetObject()){
 			if(!member.value.IsString())
@@ -184,7 +186,7 @@ crow::response createSecret(PersistentStore& store, const crow::request& req){
 			if(std::string(member.name.GetString())
 			   .find_first_not_of(allowedKeyCharacters)!=std::string::npos)
 				return crow::response(400,generateError("Secret key does not match [-._a-zA-Z0-9]+"));
-			if(!sanityCheckBase64(member.value.GetString())){
+			if(!decodeBase64(member.value.GetString(),decodedContents[member.name.GetString()])){
 				log_warn("Secret data appears not to be base64 encoded");
 				return crow::response(400,generateError("Secret data items must be base64 encoded"));
 			}
@@ -262,6 +264,8 @@ crow::response createSecret(PersistentStore& store, const crow::request& req){
 		SecretData secretData=store.decryptSecret(existing);
 		rapidjson::Document contents(rapidjson::kObjectType,&body.GetAllocator());
 		contents.Parse(secretData.data.get(),secretData.dataSize);
+		for(const auto& member : contents.GetObject())
+			decodedContents[member.name.GetString()]=decodeBase64(member.value.GetString());
 		body.AddMember("contents",contents,body.GetAllocator());
 	}
 	secret.valid=true;
@@ -291,33 +295,28 @@ crow::response createSecret(PersistentStore& store, const crow::request& req){
 			return crow::response(500,generateError(err.what()));
 		}
 		
-		//build up the kubectl command to create the secret. this involves 
-		//writing each secret value to a temporary file to avoid losing data if 
-		//there are NUL bytes. This is not very nice because it means that 
-		//unencrypted secrets are temporarily on the local filesystem (and on 
-		//an SSD) may continue to exist on the disk for a long time. The only 
-		//alternative would be to compose a large YAML document specifying the 
-		//secret and streaming it directly to kubectl, but input to child 
-		//processes seems to be unreliable at the moment for reasons which are unclear. 
-		std::vector<std::string> arguments={"create","secret","generic",
-		                                    secret.name,"--namespace",group.namespaceName()};
-		std::vector<FileHandle> valueFiles;
-		for(const auto& member : body["contents"].GetObject()){
-			const std::string value=decodeBase64(member.value.GetString());
-			valueFiles.emplace_back(makeTemporaryFile("secret_"));
-			std::string outPath=valueFiles.back();
-			{
-				std::ofstream outFile(outPath);
-				if(!outFile)
-					log_fatal("Failed to open " << outPath << " for writing");
-				outFile.write(value.c_str(),value.size());
-				if(outFile.fail())
-					log_fatal("Failed while writing to " << outPath);
-			}
-			arguments.push_back(std::string("--from-file=")+member.name.GetString()
-			+std::string("=")+outPath);
+		//compose the secret object and stream it to kubectl, so that the 
+		//unencrypted data is never written to the local filesystem. The 
+		//values are re-encoded, since kubernetes accepts only padded base64. 
+		//The object is created rather than applied, since applying would copy
+		//all of the data into an annotation. 
+		rapidjson::Document manifest(rapidjson::kObjectType);
+		rapidjson::Document::AllocatorType& alloc=manifest.GetAllocator();
+		manifest.AddMember("apiVersion","v1",alloc);
+		manifest.AddMember("kind","Secret",alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name",secret.name,alloc);
+		metadata.AddMember("namespace",group.namespaceName(),alloc);
+		manifest.AddMember("metadata",metadata,alloc);
+		manifest.AddMember("type","Opaque",alloc);
+		rapidjson::Value data(rapidjson::kObjectType);
+		for(const auto& entry : decodedContents){
+			rapidjson::Value key(entry.first,alloc);
+			rapidjson::Value value(encodeBase64(entry.second),alloc);
+			data.AddMember(key,value,alloc);
 		}
-		auto result=kubernetes::kubectl(*configPath, arguments);
+		manifest.AddMember("data",data,alloc);
+		auto result=kubernetes::kubectl(*configPath,{"create","-f","-"},to_string(manifest));
 		
 		if(result.status){
 			std::string errMsg="Failed to store secret to kubernetes: "+result.error;
@@ -10,34 +10,47 @@ crow::response listUsers(PersistentStore& store, const crow::request& req){
 		return crow::response(403,generateError("Not authorized"));
 	//TODO: Are all users are allowed to list all users?
 
-	std::vector<User> users;
-	if (auto group = req.url_params.get("group"))
-		users = store.listUsersByGroup(group);
+	//Write the result incrementally, since there may be very many users
+	std::string resultData;
+	StringOutputStream resultStream(resultData);
+	rapidjson::Writer<StringOutputStream> writer(resultStream);
+	auto writeUser=[&writer](const User& user){
+		writer.StartObject();
+		writer.Key("apiVersion");
+		writer.String("v1alpha3");
+		writer.Key("kind");
+		writer.String("User");
+		writer.Key("metadata");
+		writer.StartObject();
+		writer.Key("id");
+		writer.String(user.id);
+		writer.Key("name");
+		writer.String(user.name);
+		writer.Key("email");
+		writer.String(user.email);
+		writer.Key("phone");
+		writer.String(user.phone);
+		writer.Key("institution");
+		writer.String(user.institution);
+		writer.EndObject();
+		writer.EndObject();
+	};
+	
+	writer.StartObject();
+	writer.Key("apiVersion");
+	writer.String("v1alpha3");
+	writer.Key("items");
+	writer.StartArray();
+	if (auto group = req.url_params.get("group")){
+		for(const User& user : store.listUsersByGroup(group))
+			writeUser(user);
+	}
 	else
-		users = store.listUsers();
-
-	rapidjson::Document result(rapidjson::kObjectType);
-	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
+		store.forEachUser(writeUser);
+	writer.EndArray();
+	writer.EndObject();
 	
-	result.AddMember("apiVersion", "v1alpha3", alloc);
-	rapidjson::Value resultItems(rapidjson::kArrayType);
-	resultItems.Reserve(users.size(), alloc);
-	for(const User& user : users){
-		rapidjson::Value userResult(rapidjson::kObjectType);
-		userResult.AddMember("apiVersion", "v1alpha3", alloc);
-		userResult.AddMember("kind", "User", alloc);
-		rapidjson::Value userData(rapidjson::kObjectType);
-		userData.AddMember("id", rapidjson::StringRef(user.id.c_str()), alloc);
-		userData.AddMember("name", rapidjson::StringRef(user.name.c_str()), alloc);
-		userData.AddMember("email", rapidjson::StringRef(user.email.c_str()), alloc);
-		userData.AddMember("phone", rapidjson::StringRef(user.phone.c_str()), alloc);
-		userData.AddMember("institution", rapidjson::StringRef(user.institution.c_str()), alloc);
-		userResult.AddMember("metadata", userData, alloc);
-		resultItems.PushBack(userResult, alloc);
-	}
-	result.AddMember("items", resultItems, alloc);
-	
-	return crow::response(to_string(result));
+	return crow::response(std::move(resultData));
 }
 
 crow::response createUser(PersistentStore& store, const crow::request& req){
@@ -1609,7 +1609,10 @@ void Client::denyGroupUseOfApplication(const GroupClusterAppUseOptions& opt){
 
 void Client::pingCluster(const ClusterPingOptions& opt){
 	ProgressToken progress(pman_,"Testing cluster connectivity...");
-	auto response=httpRequests::httpGet(makeURL("clusters/"+opt.clusterName+"/ping"),defaultOptions());
+	std::string url=makeURL("clusters/"+opt.clusterName+"/ping");
+	if(opt.fresh)
+		url+="&fresh";
+	auto response=httpRequests::httpGet(url,defaultOptions());
 	if(this->clientShouldPrintOnlyJson())
 		std::cout << response.body << std::endl;
 	else{
@@ -274,6 +274,7 @@ void registerClusterPing(CLI::App& parent, Client& client){
 	auto opt = std::make_shared<ClusterPingOptions>();
 	auto ping = parent.add_subcommand("ping", "Check whether the platform can connect to a cluster");
 	ping->add_option("cluster-name", opt->clusterName, "Name of the cluster")->required();
+	ping->add_flag("--fresh", opt->fresh, "Contact the cluster now, rather than using the result of a recent check");
 	ping->callback([&client,opt](){ client.pingCluster(*opt); });
 }
 
@@ -8,6 +8,7 @@
 #include <crow.h>
 
 #include "Entities.h"
+#include "Executor.h"
 #include "Logging.h"
 #include "PersistentStore.h"
 #include "Process.h"
@@ -18,6 +19,7 @@
 #include "ClusterCommands.h"
 #include "GroupCommands.h"
 #include "MonitoringCredentialCommands.h"
+#include "OperationCommands.h"
 #include "UserCommands.h"
 #include "SecretCommands.h"
 #include "VersionCommands.h"
@@ -32,7 +34,10 @@ void initializeHelm(){
 	if(helmCheck.status!=0)
 		log_fatal("`helm` is not available, error "+std::to_string(helmCheck.status)+" ("+strerror(helmCheck.status)+")");
 	
-	unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
+	//Probe helm once up front; later callers use the stored result
+	const kubernetes::HelmCapabilities helm=kubernetes::refreshHelmCapabilities();
+	log_info("Using helm version " << helm.version);
+	unsigned int helmMajorVersion=helm.majorVersion;
 	
 	if(helmMajorVersion==2){
 		std::string helmHome;
@@ -173,6 +178,24 @@ struct Configuration{
 	std::string emailDomain;
 	std::string opsEmail;
 	unsigned int serverThreads;
+	unsigned int multiplexThreads;
+	unsigned int multiplexConcurrency;
+	unsigned int commandThreads;
+	unsigned int commandsPerCluster;
+	unsigned int scanSegments;
+	unsigned int operationThreads;
+	unsigned int clusterProbeInterval;
+	unsigned int clusterProbeConcurrency;
+	unsigned int secretCacheTime;
+	unsigned int scryptConcurrency;
+	unsigned int cacheEntryLimit;
+	unsigned int cacheMemoryLimit;
+	unsigned int cacheSweepInterval;
+	unsigned int changeLogPollInterval;
+	unsigned int cacheValidityScale;
+	unsigned int preloadTimeBudget;
+	std::string logLevel;
+	std::string logFormat;
 	
 	std::map<std::string,ParamRef> options;
 	
@@ -192,6 +215,24 @@ struct Configuration{
 	emailDomain("slateci.io"),
 	opsEmail("slateci-ops@googlegroups.com"),
 	serverThreads(0),
+	multiplexThreads(0),
+	multiplexConcurrency(16),
+	commandThreads(16),
+	commandsPerCluster(4),
+	scanSegments(1),
+	operationThreads(8),
+	clusterProbeInterval(ClusterProber::defaultInterval),
+	clusterProbeConcurrency(8),
+	secretCacheTime(0),
+	scryptConcurrency(2),
+	cacheEntryLimit(100000),
+	cacheMemoryLimit(64),
+	cacheSweepInterval(60),
+	changeLogPollInterval(0),
+	cacheValidityScale(1),
+	preloadTimeBudget(30),
+	logLevel("info"),
+	logFormat("text"),
 	options{
 		{"awsAccessKey",awsAccessKey},
 		{"awsSecretKey",awsSecretKey},
@@ -212,7 +253,25 @@ struct Configuration{
 		{"mailgunKey",mailgunKey},
 		{"emailDomain",emailDomain},
 		{"opsEmail",opsEmail},
-		{"threads",serverThreads}
+		{"threads",serverThreads},
+		{"multiplexThreads",multiplexThreads},
+		{"multiplexConcurrency",multiplexConcurrency},
+		{"commandThreads",commandThreads},
+		{"commandsPerCluster",commandsPerCluster},
+		{"scanSegments",scanSegments},
+		{"operationThreads",operationThreads},
+		{"clusterProbeInterval",clusterProbeInterval},
+		{"clusterProbeConcurrency",clusterProbeConcurrency},
+		{"secretCacheTime",secretCacheTime},
+		{"scryptConcurrency",scryptConcurrency},
+		{"cacheEntryLimit",cacheEntryLimit},
+		{"cacheMemoryLimit",cacheMemoryLimit},
+		{"cacheSweepInterval",cacheSweepInterval},
+		{"changeLogPollInterval",changeLogPollInterval},
+		{"cacheValidityScale",cacheValidityScale},
+		{"preloadTimeBudget",preloadTimeBudget},
+		{"logLevel",logLevel},
+		{"logFormat",logFormat}
 	}
 	{
 		//check for environment variables
@@ -294,9 +353,13 @@ struct Configuration{
 };
 
 ///Accept a dictionary describing several individual requests, execute them all 
-///concurrently, and return the results in another dictionary. Currently very
-///simplistic; a new thread will be spawned for every individual request. 
-crow::response multiplex(crow::SimpleApp& server, PersistentStore& store, const crow::request& req){
+///concurrently, and return the results in another dictionary. The individual 
+///requests are run on a shared executor, at most bundleConcurrency at a time, 
+///and any which have not started are abandoned if the client disconnects. 
+crow::response multiplex(crow::SimpleApp& server, PersistentStore& store, 
+                         Executor& executor, unsigned int bundleConcurrency,
+                         const crow::request& req,
+                         const std::function<bool()>& clientConnected){
 	using namespace std::chrono;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
 	const User user=authenticateUser(store, req.url_params.get("token"));
@@ -339,12 +402,16 @@ crow::response multiplex(crow::SimpleApp& server, PersistentStore& store, const
 		if(rawRequest.value.HasMember("body") && !rawRequest.value["method"].IsString())
 			return crow::response(400,generateError("Individual requests must have bodies represented as strings"));
 		std::string rawURL=rawRequest.name.GetString();
+		std::string url=rawURL.substr(0, rawURL.find("?"));
+		//a nested bundle would multiply the number of concurrent requests
+		if(url=="/v1alpha3/multiplex")
+			return crow::response(400,generateError("Multiplexed requests may not themselves be multiplexed requests"));
 		std::string body;
 		if(rawRequest.value.HasMember("body"))
 			body=rawRequest.value["body"].GetString();
 		requests.emplace_back(parseHTTPMethod(rawRequest.value["method"].GetString()), //method
 		                      rawURL, //raw_url
-		                      rawURL.substr(0, rawURL.find("?")), //url
+		                      url, //url
 		                      crow::query_string(rawURL), //url_params
 		                      crow::ci_map{}, //headers, currently not handled
 		                      body //body
@@ -352,47 +419,69 @@ crow::response multiplex(crow::SimpleApp& server, PersistentStore& store, const
 		requests.back().remote_endpoint=req.remote_endpoint;
 	}
 	
-	std::vector<std::future<crow::response>> responses;
-	responses.reserve(requests.size());
+	//Requests which are never run because the client has gone away are 
+	//reported as unavailable, although the client will not see this. 
+	std::vector<crow::response> responses(requests.size());
+	for(auto& response : responses)
+		response.code=503;
 	
-	for(const auto& request : requests)
-		responses.emplace_back(std::async(std::launch::async,[&](){ 
-			crow::response response;
-			server.handle(request, response);
-			return response;
-		}));
+	{
+		Executor::TaskGroup tasks(executor,bundleConcurrency);
+		for(std::size_t i=0; i<requests.size(); i++){
+			tasks.submit([&,i](){
+				crow::response& response=responses[i];
+				try{
+					response.code=200;
+					server.handle(requests[i], response);
+				}
+				catch(std::exception& ex){
+					response.code=400;
+					response.body=generateError(ex.what());
+				}
+				catch(...){
+					response.code=400;
+					response.body=generateError("Exception");
+				}
+			});
+		}
+		if(!tasks.wait(clientConnected,milliseconds(250))){
+			log_info("Client disconnected; abandoned " << tasks.cancelledTasks() 
+			         << " of " << requests.size() << " requests in command bundle");
+			return crow::response(503,generateError("Client disconnected"));
+		}
+	}
 	
+	//The result refers to the URLs and bodies in place rather than copying them
 	rapidjson::Document result(rapidjson::kObjectType);
 	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
+	std::size_t totalSize=0;
 	
 	for(std::size_t i=0; i<requests.size(); i++){
-		const auto& request=requests[i];
+		const crow::response& response=responses[i];
 		rapidjson::Value singleResult(rapidjson::kObjectType);
-		try{
-			crow::response response=responses[i].get();
-			singleResult.AddMember("status",response.code,alloc);
-			singleResult.AddMember("body",response.body,alloc);
-		}
-		catch(std::exception& ex){
-			singleResult.AddMember("status",400,alloc);
-			singleResult.AddMember("body",generateError(ex.what()),alloc);
-		}
-		catch(...){
-			singleResult.AddMember("status",400,alloc);
-			singleResult.AddMember("body",generateError("Exception"),alloc);
-		}
-		rapidjson::Value key(rapidjson::kStringType);
-		key.SetString(requests[i].raw_url, alloc);
-		result.AddMember(key, singleResult, alloc);
+		singleResult.AddMember("status",response.code,alloc);
+		singleResult.AddMember("body",rapidjson::StringRef(response.body.data(),response.body.size()),alloc);
+		const std::string& rawURL=requests[i].raw_url;
+		result.AddMember(rapidjson::StringRef(rawURL.data(),rawURL.size()), singleResult, alloc);
+		totalSize+=rawURL.size()+response.body.size()+32;
 	}
 	
+	std::string resultData;
+	//Escaping makes the output somewhat larger than the input
+	resultData.reserve(totalSize+totalSize/8);
+	StringOutputStream resultStream(resultData);
+	rapidjson::Writer<StringOutputStream> writer(resultStream);
+	result.Accept(writer);
+	
 	high_resolution_clock::time_point t2 = high_resolution_clock::now();
 	log_info("command bundle completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
-	return crow::response(to_string(result));
+	return crow::response(std::move(resultData));
 }
 
 int main(int argc, char* argv[]){
 	Configuration config(argc, argv);
+	setLogLevel(parseLogLevel(config.logLevel));
+	setLogFormat(parseLogFormat(config.logFormat));
 	
 	if(config.sslCertificate.empty()!=config.sslKey.empty()){
 		log_fatal("--sslCertificate ($SLATE_sslCertificate) and --sslKey ($SLATE_sslKey)"
@@ -420,6 +509,12 @@ int main(int argc, char* argv[]){
 	if(config.serverThreads==0)
 		config.serverThreads=std::thread::hardware_concurrency();
 	log_info("Using " << config.serverThreads << " web server threads");
+	//multiplexed requests spend most of their time waiting on the database and 
+	//on clusters, so more of them than cores can usefully run at once
+	if(config.multiplexThreads==0)
+		config.multiplexThreads=4*config.serverThreads;
+	log_info("Using " << config.multiplexThreads << " threads for multiplexed requests, at most "
+	         << config.multiplexConcurrency << " per bundle");
 	
 	startReaper();
 	initializeHelm();
@@ -456,12 +551,62 @@ int main(int argc, char* argv[]){
 	else
 		log_info("Email notifications not configured");
 	store.setOpsEmail(config.opsEmail);
+	store.setCommandExecutorLimits(config.commandThreads,config.commandsPerCluster);
+	log_info("Running at most " << config.commandThreads << " cluster commands at once, "
+	         << config.commandsPerCluster << " per cluster");
+	store.setScanSegments(config.scanSegments);
+	if(config.scanSegments>1)
+		log_info("Scanning database tables in " << config.scanSegments << " parallel segments");
+	store.setOperationThreads(config.operationThreads);
+	store.setScryptConcurrencyLimit(config.scryptConcurrency);
+	store.setDecryptedSecretCacheValidity(std::chrono::seconds(config.secretCacheTime));
+	if(config.secretCacheTime)
+		log_info("Caching decrypted secrets for " << config.secretCacheTime << " seconds");
+	store.setCacheLimits(config.cacheEntryLimit,(std::size_t)config.cacheMemoryLimit<<20);
+	log_info("Limiting each cache to " << config.cacheEntryLimit << " records and " 
+	         << config.cacheMemoryLimit << " MB");
+	store.setCacheSweepInterval(std::chrono::seconds(config.cacheSweepInterval));
+	if(config.changeLogPollInterval){
+		store.startChangeLog(std::chrono::seconds(config.changeLogPollInterval),
+		                     config.cacheValidityScale);
+		log_info("Reading changes made by other replicas every " 
+		         << config.changeLogPollInterval << " seconds");
+		if(config.cacheValidityScale>1)
+			log_info("Caching database records " << config.cacheValidityScale 
+			         << " times longer than the default");
+	}
+	else if(config.cacheValidityScale>1)
+		log_warn("Ignoring cacheValidityScale, since changeLogPollInterval is not set;"
+		         " replicas would serve outdated records for longer");
+	//fill the caches before accepting requests, so that the database is not 
+	//flooded with lookups of individual records when traffic arrives
+	if(config.preloadTimeBudget)
+		store.preloadCaches(std::chrono::seconds(config.preloadTimeBudget));
+	//operations may only be taken over once their handlers are known
+	registerOperationHandlers(store);
+	std::size_t resumed=store.getOperationScheduler().resumeUnfinished();
+	if(resumed)
+		log_info("Resumed " << resumed << " interrupted operations");
+	store.getOperationScheduler().startBackgroundTasks();
+	if(config.clusterProbeInterval && config.clusterProbeConcurrency){
+		store.startClusterProber([&store](const Cluster& cluster){ return internal::pingCluster(store,cluster); },
+		                         std::chrono::seconds(config.clusterProbeInterval),
+		                         config.clusterProbeConcurrency);
+		log_info("Checking cluster reachability every " << config.clusterProbeInterval 
+		         << " seconds, at most " << config.clusterProbeConcurrency << " at once");
+	}
+	else
+		log_info("Background cluster reachability checks disabled");
 	
 	// REST server initialization
 	crow::SimpleApp server;
 	
+	Executor multiplexExecutor("Multiplex",config.multiplexThreads);
 	CROW_ROUTE(server, "/v1alpha3/multiplex").methods("POST"_method)(
-	  [&](const crow::request& req){ return multiplex(server,store,req); });
+	  [&](const crow::request& req, crow::response& res){
+		  res=multiplex(server,store,multiplexExecutor,config.multiplexConcurrency,
+		                req,[&res]{ return res.is_alive(); });
+		  res.end(); });
 	
 	// == User commands ==
 	CROW_ROUTE(server, "/v1alpha3/users").methods("GET"_method)(
@@ -606,6 +751,12 @@ int main(int argc, char* argv[]){
 	CROW_ROUTE(server, "/v1alpha3/secrets/<string>").methods("DELETE"_method)(
 	  [&](const crow::request& req, const std::string& id){ return deleteSecret(store,req,id); });
 	
+	// == Operation commands ==
+	CROW_ROUTE(server, "/v1alpha3/operations").methods("GET"_method)(
+	  [&](const crow::request& req){ return listOperations(store,req); });
+	CROW_ROUTE(server, "/v1alpha3/operations/<string>").methods("GET"_method)(
+	  [&](const crow::request& req, const std::string& id){ return getOperation(store,req,id); });
+	
 	CROW_ROUTE(server, "/v1alpha3/stats").methods("GET"_method)(
 	  [&](){ return(store.getStatistics()); });
 
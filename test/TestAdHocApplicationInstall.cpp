@@ -691,3 +691,28 @@ data:
 		             "Application install request with malformed chart (link to external file) should be rejected");
 	}
 }
+
+TEST(ApplicationInstallOversizeChart){
+	using namespace httpRequests;
+	TestContext tc({"--allowAdHocApps=1"});
+	std::string adminKey=tc.getPortalToken();
+	
+	//a chart which compresses well, but decompresses to more than the server 
+	//will accept
+	FileHandle workDir=makeTemporaryDir("oversize_chart_");
+	auto result=runCommand("sh",{"-c","cd "+workDir.path()+" && mkdir big-app "
+	                       "&& truncate -s 300M big-app/values.yaml "
+	                       "&& tar cz big-app | base64 -w0 && rm -rf big-app"});
+	ENSURE_EQUAL(result.status,0,"Creating the chart should succeed");
+	
+	rapidjson::Document request(rapidjson::kObjectType);
+	auto& alloc = request.GetAllocator();
+	request.AddMember("apiVersion", currentAPIVersion, alloc);
+	request.AddMember("group", "some-group", alloc);
+	request.AddMember("cluster", "some-cluster", alloc);
+	request.AddMember("tag", "install1", alloc);
+	request.AddMember("chart",result.output,alloc);
+	request.AddMember("configuration", "", alloc);
+	auto instResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/apps/ad-hoc?test&token="+adminKey,to_string(request));
+	ENSURE_EQUAL(instResp.status,400,"Application install request with an oversize chart should be rejected");
+}
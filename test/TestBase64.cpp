@@ -0,0 +1,104 @@
+#include "test.h"
+
+#include <random>
+
+#include <Archive.h>
+
+namespace{
+	using internal::Base64Implementation;
+	
+	const Base64Implementation allImplementations[]={
+		Base64Implementation::Scalar,
+		Base64Implementation::SSSE3,
+		Base64Implementation::AVX2
+	};
+	
+	std::string randomData(std::mt19937& rng, std::size_t size){
+		std::uniform_int_distribution<int> dist(0,255);
+		std::string data(size,'\0');
+		for(char& c : data)
+			c=(char)dist(rng);
+		return data;
+	}
+	
+	bool decodingFails(const std::string& coded){
+		try{
+			decodeBase64(coded);
+		}catch(std::runtime_error& err){
+			return true;
+		}
+		return false;
+	}
+	
+	///Restore the default implementation when a test ends
+	struct ImplementationReset{
+		~ImplementationReset(){
+			for(auto impl : {Base64Implementation::AVX2,Base64Implementation::SSSE3}){
+				if(internal::base64ImplementationSupported(impl)){
+					internal::setBase64Implementation(impl);
+					return;
+				}
+			}
+			internal::setBase64Implementation(Base64Implementation::Scalar);
+		}
+	};
+}
+
+TEST(Base64KnownValues){
+	ENSURE_EQUAL(encodeBase64(""),"");
+	ENSURE_EQUAL(encodeBase64("f"),"Zg==");
+	ENSURE_EQUAL(encodeBase64("fo"),"Zm8=");
+	ENSURE_EQUAL(encodeBase64("foo"),"Zm9v");
+	ENSURE_EQUAL(encodeBase64("foobar"),"Zm9vYmFy");
+	ENSURE_EQUAL(decodeBase64("Zg=="),"f");
+	ENSURE_EQUAL(decodeBase64("Zm8="),"fo");
+	ENSURE_EQUAL(decodeBase64("Zm8"),"fo","Padding should be optional");
+	ENSURE_EQUAL(decodeBase64("Zm9vYmFy"),"foobar");
+	ENSURE(decodingFails("Zm9v\nYmFy"));
+	ENSURE(decodingFails("Zg==Zg=="),"Padding should only be allowed at the end");
+}
+
+TEST(Base64ImplementationsAgree){
+	ImplementationReset reset;
+	std::mt19937 rng(17);
+	//cover every tail length after the vectorized blocks of each implementation
+	for(std::size_t size=0; size<200; size++){
+		std::string raw=randomData(rng,size);
+		internal::setBase64Implementation(Base64Implementation::Scalar);
+		std::string expected=encodeBase64(raw);
+		for(auto impl : allImplementations){
+			if(!internal::base64ImplementationSupported(impl))
+				continue;
+			internal::setBase64Implementation(impl);
+			ENSURE_EQUAL(encodeBase64(raw),expected,"Encoding should not depend on the implementation");
+			ENSURE_EQUAL(decodeBase64(expected),raw,"Decoding should reverse encoding");
+			std::string unpadded=expected.substr(0,expected.find('='));
+			ENSURE_EQUAL(decodeBase64(unpadded),raw,"Decoding unpadded data should reverse encoding");
+		}
+	}
+}
+
+TEST(Base64InvalidCharacters){
+	ImplementationReset reset;
+	std::mt19937 rng(23);
+	const std::string encoded=encodeBase64(randomData(rng,150));
+	//an invalid character anywhere, including in the middle of a vectorized
+	//block, must be detected
+	for(auto impl : allImplementations){
+		if(!internal::base64ImplementationSupported(impl))
+			continue;
+		internal::setBase64Implementation(impl);
+		for(std::size_t pos=0; pos<encoded.size(); pos++){
+			for(char bad : {'=','-','\n','\x80','\xff'}){
+				std::string altered=encoded;
+				altered[pos]=bad;
+				std::string decoded;
+				bool valid=decodeBase64(altered,decoded);
+				bool trailingPadding=(bad=='=' && altered.find_first_not_of('=',pos)==std::string::npos);
+				ENSURE_EQUAL(valid,trailingPadding,"Only trailing padding is valid");
+				if(!valid)
+					ENSURE(decoded.empty());
+			}
+		}
+	}
+}
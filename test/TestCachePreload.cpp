@@ -0,0 +1,70 @@
+#include "test.h"
+
+#include <PersistentStore.h>
+
+TEST(CachePreloadFillsCaches){
+	DatabaseContext db;
+	auto writerPtr=db.makePersistentStore();
+	auto& writer=*writerPtr;
+	
+	Group group;
+	group.id=idGenerator.generateGroupID();
+	group.name="preloaded-group";
+	group.email="abc@def";
+	group.phone="123";
+	group.scienceField="Logic";
+	group.description=" ";
+	group.valid=true;
+	ENSURE(writer.addGroup(group));
+	
+	std::vector<User> users;
+	for(unsigned int i=0; i<5; i++){
+		User user;
+		user.valid=true;
+		user.id="user_preload"+std::to_string(i);
+		user.name="User "+std::to_string(i);
+		user.email="user"+std::to_string(i)+"@example.com";
+		user.phone="555-5555";
+		user.institution="Institute";
+		user.token="token_preload"+std::to_string(i);
+		user.globusID="globus_preload"+std::to_string(i);
+		user.admin=false;
+		ENSURE(writer.addUser(user));
+		ENSURE(writer.addUserToGroup(user.id,group.id));
+		users.push_back(user);
+	}
+	
+	//a separate store starts with empty caches, like a newly started server
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+	ENSURE(store.preloadCaches(std::chrono::seconds(60)),"Preloading should complete");
+	ENSURE(getStatistic(store,"Records preloaded")>=11u);
+	
+	const std::size_t queries=getStatistic(store,"Database queries");
+	const std::size_t scans=getStatistic(store,"Database scans");
+	for(const auto& user : users){
+		ENSURE_EQUAL(store.findUserByToken(user.token).id,user.id);
+		ENSURE_EQUAL(store.getUser(user.id).name,user.name);
+		ENSURE(store.userInGroup(user.id,group.id));
+	}
+	ENSURE_EQUAL(store.findGroupByName(group.name).id,group.id);
+	ENSURE_EQUAL(store.listUsersByGroup(group.id).size(),users.size());
+	ENSURE_EQUAL(store.listGroupsForUser(users.front().id).size(),1u);
+	ENSURE(store.listUsers().size()>=users.size());
+	ENSURE_EQUAL(store.listGroups().size(),1u);
+	ENSURE_EQUAL(getStatistic(store,"Database queries"),queries,"Preloaded records should not be queried");
+	ENSURE_EQUAL(getStatistic(store,"Database scans"),scans,"Preloaded tables should not be scanned");
+}
+
+TEST(CachePreloadTimeBudget){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+	
+	//with no time, nothing can be loaded, but the store must still work
+	ENSURE(!store.preloadCaches(std::chrono::seconds(0)),"Preloading should not complete without time");
+	ENSURE_EQUAL(getStatistic(store,"Records preloaded"),0u);
+	const std::size_t scans=getStatistic(store,"Database scans");
+	store.listUsers();
+	ENSURE_EQUAL(getStatistic(store,"Database scans"),scans+1,"An incomplete preload should not be used for listing");
+}
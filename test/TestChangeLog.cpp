@@ -0,0 +1,65 @@
+#include "test.h"
+
+#include <PersistentStore.h>
+
+namespace{
+	User makeUser(const std::string& id, const std::string& name){
+		User user;
+		user.valid=true;
+		user.id=id;
+		user.name=name;
+		user.email=name+"@example.com";
+		user.phone="555-5555";
+		user.institution="Institute";
+		user.token="token_"+id;
+		user.globusID="globus_"+id;
+		user.admin=false;
+		return user;
+	}
+}
+
+TEST(ChangeLogInvalidatesOtherReplicas){
+	DatabaseContext db;
+	auto storeAPtr=db.makePersistentStore();
+	auto& storeA=*storeAPtr;
+	auto storeBPtr=db.makePersistentStore();
+	auto& storeB=*storeBPtr;
+	//poll only when the test asks
+	storeA.startChangeLog(std::chrono::hours(1));
+	storeB.startChangeLog(std::chrono::hours(1));
+	
+	User user=makeUser("user_change_log","Alice");
+	ENSURE(storeA.addUser(user));
+	ENSURE_EQUAL(storeB.getUser(user.id).name,"Alice");
+	
+	User updated=user;
+	updated.name="Bob";
+	ENSURE(storeA.updateUser(updated,user));
+	ENSURE(getStatistic(storeA,"Changes recorded")>=2u);
+	ENSURE_EQUAL(storeB.getUser(user.id).name,"Alice","Without polling, the other replica should still use its cached record");
+	
+	ENSURE(storeB.pollChanges()>=1u,"The other replica should find the change");
+	ENSURE_EQUAL(storeB.getUser(user.id).name,"Bob","The other replica should read the updated record");
+	ENSURE_EQUAL(storeB.findUserByToken(user.token).name,"Bob");
+	ENSURE_EQUAL(getStatistic(storeB,"Changes applied from other replicas"),getStatistic(storeA,"Changes recorded"));
+	
+	//a change is counted only once, even though it is applied again
+	ENSURE_EQUAL(storeB.pollChanges(),0u);
+	
+	//a store ignores its own changes
+	ENSURE_EQUAL(storeA.pollChanges(),0u);
+	ENSURE_EQUAL(getStatistic(storeA,"Changes applied from other replicas"),0u);
+	
+	ENSURE(storeA.removeUser(user.id));
+	ENSURE(storeB.pollChanges()>=1u);
+	ENSURE(!storeB.getUser(user.id),"The other replica should see that the user was removed");
+}
+
+TEST(ChangeLogDisabledByDefault){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+	
+	ENSURE(store.addUser(makeUser("user_unlogged","Carol")));
+	ENSURE_EQUAL(getStatistic(store,"Changes recorded"),0u);
+}
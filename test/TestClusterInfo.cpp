@@ -1,5 +1,7 @@
 #include "test.h"
 
+#include <sstream>
+
 #include <ServerUtilities.h>
 
 TEST(UnauthenticatedGetClusterInfo){
@@ -77,3 +79,93 @@ TEST(GetClusterInfo){
 	             "Cluster owning organization should match");
 	ENSURE(metadata.HasMember("id"));
 }
+
+TEST(ClusterInfoCaching){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=tc.getPortalToken();
+	
+	std::string groupID;
+	{
+		rapidjson::Document request1(rapidjson::kObjectType);
+		auto& alloc = request1.GetAllocator();
+		request1.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", "testgroup1", alloc);
+		metadata.AddMember("scienceField", "Logic", alloc);
+		request1.AddMember("metadata", metadata, alloc);
+		auto groupResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups?token="+adminKey,to_string(request1));
+		ENSURE_EQUAL(groupResp.status,200,"Portal admin user should be able to create a Group");
+		rapidjson::Document groupData;
+		groupData.Parse(groupResp.body.c_str());
+		groupID=groupData["metadata"]["id"].GetString();
+	}
+	
+	auto kubeConfig=tc.getKubeConfig();
+	std::string clusterID;
+	{
+		rapidjson::Document request1(rapidjson::kObjectType);
+		auto& alloc = request1.GetAllocator();
+		request1.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", "testcluster", alloc);
+		metadata.AddMember("group", rapidjson::StringRef(groupID), alloc);
+		metadata.AddMember("owningOrganization", "Department of Labor", alloc);
+		metadata.AddMember("kubeconfig", rapidjson::StringRef(kubeConfig), alloc);
+		request1.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/clusters?token="+adminKey, to_string(request1));
+		ENSURE_EQUAL(createResp.status,200, "Cluster creation should succeed");
+		rapidjson::Document createData;
+		createData.Parse(createResp.body.c_str());
+		clusterID=createData["metadata"]["id"].GetString();
+	}
+	
+	auto schema = loadSchema(getSchemaDir()+"/ClusterInfoResultSchema.json");
+	auto getInfo=[&](){
+		auto infoResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/clusters/"+clusterID+"?nodes&token="+adminKey);
+		ENSURE_EQUAL(infoResp.status,200,"Portal admin user should be able to fetch cluster info");
+		rapidjson::Document data;
+		data.Parse(infoResp.body.c_str());
+		ENSURE_CONFORMS(data,schema);
+		return data;
+	};
+	
+	rapidjson::Document first=getInfo();
+	const std::string masterAddress=first["metadata"]["masterAddress"].GetString();
+	ENSURE(!masterAddress.empty(),"The master address should be found");
+	ENSURE(kubeConfig.find("server: "+masterAddress)!=std::string::npos,
+	       "The master address should be taken from the kubeconfig");
+	
+	//a second request should be answered entirely from the cache
+	auto processesBefore=getStatistic(tc,"Child processes started");
+	auto requestsBefore=getStatistic(tc,"Direct Kubernetes API requests");
+	rapidjson::Document second=getInfo();
+	ENSURE_EQUAL(getStatistic(tc,"Child processes started"),processesBefore,
+	             "Cached cluster information should not require running kubectl");
+	ENSURE_EQUAL(getStatistic(tc,"Direct Kubernetes API requests"),requestsBefore,
+	             "Cached cluster information should not require contacting the cluster");
+	ENSURE(first["metadata"]["storageClasses"]==second["metadata"]["storageClasses"]);
+	ENSURE(first["metadata"]["priorityClasses"]==second["metadata"]["priorityClasses"]);
+	ENSURE(first["metadata"]["nodes"]==second["metadata"]["nodes"]);
+	ENSURE_EQUAL(second["metadata"]["masterAddress"].GetString(),masterAddress);
+	
+	//updating the cluster should discard what was cached
+	{
+		rapidjson::Document updateRequest(rapidjson::kObjectType);
+		auto& alloc = updateRequest.GetAllocator();
+		updateRequest.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("kubeconfig", rapidjson::StringRef(kubeConfig), alloc);
+		updateRequest.AddMember("metadata", metadata, alloc);
+		auto updateResp=httpPut(tc.getAPIServerURL()+"/"+currentAPIVersion+"/clusters/"+clusterID+"?token="+adminKey,
+		                        to_string(updateRequest));
+		ENSURE_EQUAL(updateResp.status,200,"Updating the cluster config should succeed");
+	}
+	auto cachedBefore=getStatistic(tc,"Cluster object listings cached");
+	ENSURE_EQUAL(cachedBefore,0u,"Updating a cluster should discard its cached listings");
+	rapidjson::Document third=getInfo();
+	ENSURE(first["metadata"]["storageClasses"]==third["metadata"]["storageClasses"]);
+	ENSURE(getStatistic(tc,"Cluster object listings cached")>0,
+	       "Listings should be cached again after being fetched");
+}
@@ -0,0 +1,105 @@
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <PersistentStore.h>
+
+namespace{
+
+Cluster makeCluster(const std::string& name){
+	Cluster cluster;
+	cluster.id=idGenerator.generateClusterID();
+	cluster.name=name;
+	cluster.config="-"; //Dynamo will get upset if this is empty, but it will not be used
+	cluster.systemNamespace="-"; //Dynamo will get upset if this is empty, but it will not be used
+	cluster.owningGroup="Group_1234";
+	cluster.owningOrganization="Something";
+	cluster.valid=true;
+	return cluster;
+}
+
+}
+
+TEST(ClusterProberChecksClusters){
+	using namespace std::chrono;
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+
+	Cluster up=makeCluster("up");
+	Cluster down=makeCluster("down");
+	Cluster broken=makeCluster("broken");
+	for(const Cluster& cluster : {up,down,broken})
+		ENSURE(store.addCluster(cluster),"Cluster creation should succeed");
+
+	std::mutex mut;
+	std::map<std::string,unsigned int> checks;
+	std::atomic<unsigned int> running(0), maxRunning(0);
+	auto countChecks=[&](const std::string& id)->unsigned int{
+		std::lock_guard<std::mutex> lock(mut);
+		return checks[id];
+	};
+
+	store.startClusterProber([&](const Cluster& cluster)->bool{
+		unsigned int now=++running;
+		unsigned int prev=maxRunning.load();
+		while(now>prev && !maxRunning.compare_exchange_weak(prev,now));
+		std::this_thread::sleep_for(milliseconds(50));
+		running--;
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			checks[cluster.id]++;
+		}
+		if(cluster.name=="broken")
+			throw std::runtime_error("Probe failed");
+		return cluster.name=="up";
+	},seconds(1),2);
+
+	//every cluster should be checked repeatedly
+	auto start=steady_clock::now();
+	while(steady_clock::now()-start<seconds(15)){
+		if(countChecks(up.id)>=2 && countChecks(down.id)>=2 && countChecks(broken.id)>=2)
+			break;
+		std::this_thread::sleep_for(milliseconds(100));
+	}
+	ENSURE(countChecks(up.id)>=2,"Reachable clusters should be checked periodically");
+	ENSURE(countChecks(down.id)>=2,"Unreachable clusters should be checked periodically");
+	ENSURE(countChecks(broken.id)>=2,"Clusters whose checks fail should still be checked periodically");
+	ENSURE(maxRunning.load()<=2,"The number of checks running at once should be limited");
+
+	//results should be available from the cache
+	auto record=store.getCachedClusterReachability(up.id);
+	ENSURE(record,"Reachability should be cached");
+	ENSURE(record.record,"Reachable cluster should be recorded as reachable");
+	record=store.getCachedClusterReachability(down.id);
+	ENSURE(record,"Reachability should be cached");
+	ENSURE(!record.record,"Unreachable cluster should be recorded as unreachable");
+	record=store.getCachedClusterReachability(broken.id);
+	ENSURE(record,"Reachability should be cached");
+	ENSURE(!record.record,"Cluster which could not be checked should be recorded as unreachable");
+
+	ClusterProber* prober=store.getClusterProber();
+	ENSURE(prober,"The prober should be running");
+	auto stats=prober->getStatistics();
+	ENSURE_EQUAL(stats.clusters,3u,"All clusters should be scheduled");
+	ENSURE(stats.probes>=6);
+	ENSURE(stats.failures>=4);
+	ENSURE(stats.errors>=2);
+	std::size_t bucketed=0;
+	for(auto count : stats.latencyCounts)
+		bucketed+=count;
+	ENSURE_EQUAL(bucketed,stats.probes,"Every check should be counted in the latency histogram");
+	ENSURE(stats.latencyCounts[0]==0,"Checks take longer than the smallest latency bucket");
+
+	//clusters which are removed should no longer be checked
+	ENSURE(store.removeCluster(down.id),"Cluster deletion should succeed");
+	std::this_thread::sleep_for(milliseconds(2500));
+	unsigned int checksAfterRemoval=countChecks(down.id);
+	std::this_thread::sleep_for(milliseconds(2500));
+	ENSURE_EQUAL(countChecks(down.id),checksAfterRemoval,"Removed clusters should not be checked");
+	ENSURE_EQUAL(prober->getStatistics().clusters,2u);
+}
@@ -0,0 +1,87 @@
+#include "test.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <concurrent_multimap.h>
+
+TEST(ConcurrentMultimapSnapshots){
+	concurrent_multimap<std::string,int> map;
+	auto missing=map.find("a");
+	ENSURE(missing.first,"Snapshots of missing keys should still have a set");
+	ENSURE(missing.first->empty());
+	
+	map.insert("a",1);
+	map.insert("a",2);
+	auto snapshot=map.find("a");
+	ENSURE_EQUAL(snapshot.first->size(),2u);
+	
+	//changes after a snapshot is taken must not affect it
+	map.insert("a",3);
+	map.erase("a",1);
+	ENSURE_EQUAL(snapshot.first->size(),2u,"Snapshots should not change");
+	ENSURE(snapshot.first->count(1));
+	ENSURE(!snapshot.first->count(3));
+	auto later=map.find("a");
+	ENSURE_EQUAL(later.first->size(),2u);
+	ENSURE(later.first->count(3));
+	ENSURE(!later.first->count(1));
+	ENSURE(later.first!=snapshot.first,"A changed set should be a new copy");
+	
+	//with no snapshot outstanding, changes should not copy the set
+	const void* address=later.first.get();
+	later.first.reset();
+	map.insert("a",4);
+	ENSURE_EQUAL(map.find("a").first.get(),address,"An unshared set should be changed in place");
+	
+	//erasing a key should not affect snapshots of it
+	snapshot=map.find("a");
+	ENSURE_EQUAL(map.erase("a"),3u);
+	ENSURE_EQUAL(snapshot.first->size(),3u);
+	ENSURE_EQUAL(map.count("a"),0u);
+}
+
+TEST(ConcurrentMultimapCopy){
+	concurrent_multimap<std::string,int> map;
+	map.insert("a",1);
+	concurrent_multimap<std::string,int> copy(map);
+	copy.insert("a",2);
+	ENSURE_EQUAL(map.count("a"),1u,"Changing a copy should not change the original");
+	ENSURE_EQUAL(copy.count("a"),2u);
+	map.erase("a",1);
+	ENSURE_EQUAL(copy.count("a",1),1u,"Changing the original should not change a copy");
+}
+
+TEST(ConcurrentMultimapConcurrentReaders){
+	concurrent_multimap<std::string,int> map;
+	const int items=200;
+	std::atomic<bool> done(false);
+	std::atomic<unsigned int> inconsistent(0);
+	std::vector<std::thread> readers;
+	for(unsigned int i=0; i<4; i++){
+		readers.emplace_back([&]{
+			while(!done){
+				//the writer only ever adds a value after removing the previous
+				//one, so every snapshot must contain exactly one value
+				auto snapshot=map.find("k");
+				std::size_t size=0;
+				for(int value : *snapshot.first){
+					(void)value;
+					size++;
+				}
+				if(size>1 || size!=snapshot.first->size())
+					inconsistent++;
+			}
+		});
+	}
+	for(int i=0; i<items; i++){
+		map.insert("k",i);
+		map.erase("k",i);
+	}
+	done=true;
+	for(auto& reader : readers)
+		reader.join();
+	ENSURE_EQUAL(inconsistent.load(),0u,"Readers should only see consistent snapshots");
+}
@@ -0,0 +1,231 @@
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <EvictingCache.h>
+#include <PersistentStore.h>
+
+namespace{
+	struct Record{
+		Record():expiration(std::chrono::steady_clock::time_point::min()){}
+		Record(std::string data, std::chrono::milliseconds validity):
+		data(std::move(data)),expiration(std::chrono::steady_clock::now()+validity){}
+		bool expired() const{ return std::chrono::steady_clock::now()>expiration; }
+		
+		std::string data;
+		std::chrono::steady_clock::time_point expiration;
+	};
+	
+	std::size_t approximateMemoryUsage(const Record& r){
+		return sizeof(r)+::approximateMemoryUsage(r.data)-sizeof(r.data);
+	}
+	
+	const std::chrono::milliseconds longTime=std::chrono::hours(1);
+}
+
+TEST(EvictingCacheBasics){
+	EvictingCache<std::string,Record> cache("test");
+	Record record;
+	ENSURE(!cache.find("a",record));
+	ENSURE(cache.insert("a","data",longTime));
+	ENSURE(!cache.insert("a","other",longTime),"Insert should not replace records");
+	ENSURE(cache.find("a",record));
+	ENSURE_EQUAL(record.data,"data");
+	ENSURE(!cache.insert_or_assign("a",Record("replacement",longTime)));
+	ENSURE(cache.find("a",record));
+	ENSURE_EQUAL(record.data,"replacement");
+	ENSURE_EQUAL(cache.size(),1u);
+	
+	auto stats=cache.getStatistics();
+	ENSURE_EQUAL(stats.entries,1u);
+	ENSURE_EQUAL(stats.hits,2u);
+	ENSURE_EQUAL(stats.misses,1u);
+	ENSURE(stats.bytes>sizeof(Record));
+	
+	//memory accounting should follow the size of the records
+	const std::size_t smallSize=cache.memoryUsage();
+	cache.insert_or_assign("a",Record(std::string(10000,'x'),longTime));
+	ENSURE(cache.memoryUsage()>=smallSize+10000);
+	ENSURE(cache.erase("a"));
+	ENSURE_EQUAL(cache.memoryUsage(),0u,"Erasing all records should leave no memory accounted");
+	ENSURE_EQUAL(cache.size(),0u);
+}
+
+TEST(EvictingCacheConditionalReplacement){
+	EvictingCache<std::string,Record> cache("test");
+	auto onlyIfExpired=[](const Record& existing){ return existing.expired(); };
+	ENSURE(cache.insert_or_assign_if("a",Record("first",longTime),onlyIfExpired),
+	       "A missing record should be inserted");
+	ENSURE(!cache.insert_or_assign_if("a",Record("second",longTime),onlyIfExpired),
+	       "A record should not be replaced if the predicate rejects it");
+	Record record;
+	ENSURE(cache.find("a",record));
+	ENSURE_EQUAL(record.data,"first");
+	const std::size_t usage=cache.memoryUsage();
+	
+	cache.insert_or_assign("a",Record("old",std::chrono::milliseconds(-1)));
+	ENSURE(cache.insert_or_assign_if("a",Record("new",longTime),onlyIfExpired),
+	       "A record should be replaced if the predicate accepts it");
+	ENSURE(cache.find("a",record));
+	ENSURE_EQUAL(record.data,"new");
+	ENSURE_EQUAL(cache.size(),1u);
+	ENSURE_EQUAL(cache.memoryUsage(),usage);
+}
+
+TEST(EvictingCacheEntryLimit){
+	EvictingCache<std::string,Record> cache("test",100);
+	unsigned int removalNotices=0;
+	cache.setRemovalHandler([&]{ removalNotices++; });
+	for(unsigned int i=0; i<50; i++)
+		cache.insert_or_assign("kept"+std::to_string(i),Record("data",longTime));
+	//mark half of the records as used
+	Record record;
+	for(unsigned int i=0; i<50; i++)
+		ENSURE(cache.find("kept"+std::to_string(i),record));
+	for(unsigned int i=0; i<500; i++){
+		cache.insert_or_assign("other"+std::to_string(i),Record("data",longTime));
+		ENSURE(cache.size()<=100u,"The cache should never exceed its limit");
+		//keep using the first set of records, as a working set
+		if(i%10==0){
+			for(unsigned int j=0; j<50; j++)
+				cache.find("kept"+std::to_string(j),record);
+		}
+	}
+	std::size_t kept=0;
+	for(unsigned int i=0; i<50; i++)
+		kept+=cache.contains("kept"+std::to_string(i));
+	ENSURE(kept>=45,"Records in frequent use should mostly survive eviction");
+	auto stats=cache.getStatistics();
+	ENSURE_EQUAL(stats.entries+stats.evictions,550u,"Every record should be either held or evicted");
+	ENSURE(removalNotices>0);
+}
+
+TEST(EvictingCacheMemoryLimit){
+	EvictingCache<std::string,Record> cache("test",0,1<<20);
+	for(unsigned int i=0; i<100; i++){
+		cache.insert_or_assign(std::to_string(i),Record(std::string(64<<10,'x'),longTime));
+		ENSURE(cache.memoryUsage()<=(1u<<20),"The cache should stay within its memory limit");
+	}
+	ENSURE(cache.size()>=10u);
+	ENSURE(cache.getStatistics().evictions>0);
+}
+
+TEST(EvictingCacheConcurrentAccounting){
+	//Records are inserted, erased, and cleared from many threads at once, so 
+	//that removals are often counted before the insertions they undo. The 
+	//counts must never wrap around, and must be exact once all threads stop. 
+	const std::size_t limit=1<<20;
+	EvictingCache<std::string,Record> cache("test",0,limit);
+	std::atomic<bool> stop(false), sane(true);
+	std::vector<std::thread> threads;
+	for(unsigned int t=0; t<4; t++){
+		threads.emplace_back([&,t]{
+			for(unsigned int i=0; i<20000; i++){
+				const std::string key=std::to_string(i%16);
+				if(t%2)
+					cache.erase(key);
+				else
+					cache.insert_or_assign(key,Record("data",longTime));
+			}
+		});
+	}
+	threads.emplace_back([&]{
+		while(!stop.load())
+			cache.clear();
+	});
+	threads.emplace_back([&]{
+		while(!stop.load()){
+			if(cache.memoryUsage()>2*limit || cache.size()>1000)
+				sane=false;
+		}
+	});
+	for(unsigned int t=0; t<4; t++)
+		threads[t].join();
+	stop=true;
+	for(unsigned int t=4; t<threads.size(); t++)
+		threads[t].join();
+	ENSURE(sane.load(),"Memory use and size should never wrap around");
+	std::size_t held=0;
+	cache.for_each([&](const std::string&, const Record&){ held++; });
+	ENSURE_EQUAL(cache.size(),held,"The count should be exact once all changes are done");
+	
+	cache.clear();
+	ENSURE_EQUAL(cache.size(),0u);
+	ENSURE_EQUAL(cache.memoryUsage(),0u,"Memory use should be exact once all changes are done");
+	for(unsigned int i=0; i<10; i++)
+		cache.insert_or_assign(std::to_string(i),Record("data",longTime));
+	ENSURE_EQUAL(cache.size(),10u,"Records should not be evicted from a cache under its limit");
+	ENSURE_EQUAL(cache.getStatistics().evictions,0u);
+}
+
+TEST(EvictingCacheSweep){
+	EvictingCache<std::string,Record> cache("test");
+	for(unsigned int i=0; i<10; i++)
+		cache.insert_or_assign("short"+std::to_string(i),Record("data",std::chrono::milliseconds(0)));
+	for(unsigned int i=0; i<10; i++)
+		cache.insert_or_assign("long"+std::to_string(i),Record("data",longTime));
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	
+	//expired records remain available until they are swept
+	Record record;
+	ENSURE(cache.find("short0",record));
+	ENSURE(record.expired());
+	ENSURE_EQUAL(cache.getStatistics().misses,1u,"Finding an expired record should count as a miss");
+	
+	std::atomic<std::size_t> sweeps(0);
+	{
+		CacheSweeper sweeper(std::chrono::seconds(1),[&]{ 
+			cache.sweep();
+			sweeps++;
+		});
+		auto start=std::chrono::steady_clock::now();
+		while(!sweeps && std::chrono::steady_clock::now()-start<std::chrono::seconds(10))
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+	ENSURE(sweeps>0,"The sweeper should run periodically");
+	ENSURE_EQUAL(cache.size(),10u,"Expired records should be swept");
+	ENSURE(!cache.contains("short0"));
+	ENSURE(cache.contains("long0"));
+	ENSURE_EQUAL(cache.getStatistics().expirations,10u);
+}
+
+TEST(EvictingCacheStoreListing){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+	
+	store.setCacheLimits(3,0);
+	for(unsigned int i=0; i<5; i++){
+		User user;
+		user.valid=true;
+		user.id="user_"+std::to_string(i);
+		user.name="User "+std::to_string(i);
+		user.email="user"+std::to_string(i)+"@example.com";
+		user.phone="555-5555";
+		user.institution="Institute";
+		user.token="token"+std::to_string(i);
+		user.globusID="globus"+std::to_string(i);
+		user.admin=false;
+		ENSURE(store.addUser(user));
+	}
+	const std::size_t userCount=store.listUsers().size();
+	ENSURE(userCount>=5);
+	ENSURE(getStatistic(store,"User cache entries")<=3u);
+	ENSURE(getStatistic(store,"User cache evictions")>0u);
+	
+	//the cache cannot hold all users, so it must not claim to have a full listing
+	std::size_t scans=getStatistic(store,"Database scans");
+	ENSURE_EQUAL(store.listUsers().size(),userCount);
+	ENSURE_EQUAL(getStatistic(store,"Database scans"),scans+1,"An incomplete cache should not be used for listing");
+	
+	store.setCacheLimits(0,0);
+	ENSURE_EQUAL(store.listUsers().size(),userCount);
+	scans=getStatistic(store,"Database scans");
+	ENSURE_EQUAL(store.listUsers().size(),userCount);
+	ENSURE_EQUAL(getStatistic(store,"Database scans"),scans,"A complete cache should be used for listing");
+	ENSURE(getStatistic(store,"User cache memory (bytes)")>userCount*sizeof(User));
+}
@@ -0,0 +1,146 @@
+#include "test.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <Executor.h>
+
+TEST(ExecutorRunsAllTasks){
+	Executor executor("Test",4);
+	std::atomic<unsigned int> count(0);
+	{
+		Executor::TaskGroup tasks(executor);
+		for(unsigned int i=0; i<100; i++)
+			tasks.submit([&]{ count++; });
+		tasks.wait();
+	}
+	ENSURE_EQUAL(count.load(),100u);
+	auto stats=executor.getStatistics();
+	ENSURE_EQUAL(stats.tasksSubmitted,100u);
+	ENSURE_EQUAL(stats.tasksCompleted,100u);
+	ENSURE_EQUAL(stats.queued,0u);
+	ENSURE_EQUAL(stats.running,0u);
+}
+
+TEST(ExecutorGroupConcurrencyLimit){
+	Executor executor("Test",8);
+	std::atomic<unsigned int> running(0), maxRunning(0);
+	Executor::TaskGroup tasks(executor,2);
+	for(unsigned int i=0; i<20; i++)
+		tasks.submit([&]{
+			unsigned int now=++running;
+			unsigned int prev=maxRunning.load();
+			while(now>prev && !maxRunning.compare_exchange_weak(prev,now));
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			running--;
+		});
+	tasks.wait();
+	ENSURE(maxRunning.load()<=2,"No more than the group's limit of tasks should run at once");
+	ENSURE(maxRunning.load()>=1);
+}
+
+TEST(ExecutorWaiterMakesProgress){
+	//with the only worker blocked, a waiting thread should still complete its
+	//own group's tasks
+	Executor executor("Test",1);
+	std::atomic<bool> release(false);
+	Executor::TaskGroup blocker(executor);
+	blocker.submit([&]{ while(!release) std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	std::atomic<unsigned int> count(0);
+	{
+		Executor::TaskGroup tasks(executor);
+		for(unsigned int i=0; i<10; i++)
+			tasks.submit([&]{ count++; });
+		tasks.wait();
+	}
+	ENSURE_EQUAL(count.load(),10u);
+	ENSURE(executor.getStatistics().tasksRunByWaiters>=10);
+	release=true;
+	blocker.wait();
+}
+
+TEST(ExecutorCancellation){
+	Executor executor("Test",1);
+	std::atomic<unsigned int> count(0);
+	Executor::TaskGroup tasks(executor,1);
+	for(unsigned int i=0; i<50; i++)
+		tasks.submit([&]{
+			count++;
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		});
+	unsigned int checks=0;
+	bool finished=tasks.wait([&]{ return ++checks<3; },std::chrono::milliseconds(1));
+	ENSURE(!finished,"Waiting should report that tasks were cancelled");
+	ENSURE(count.load()<50,"Cancelled tasks should not run");
+	ENSURE_EQUAL(count.load()+tasks.cancelledTasks(),50u);
+	ENSURE_EQUAL(executor.getStatistics().tasksCancelled,tasks.cancelledTasks());
+
+	//tasks submitted after cancellation are discarded
+	tasks.submit([&]{ count++; });
+	ENSURE_EQUAL(count.load()+tasks.cancelledTasks(),51u);
+}
+
+TEST(ExecutorStatisticsReport){
+	Executor executor("Example",2);
+	std::string report=getExecutorStatistics();
+	ENSURE(report.find("Example threads: 2")!=std::string::npos);
+}
+
+TEST(ExecutorPerKeyLimit){
+	Executor executor("Test",8,2);
+	std::mutex mut;
+	std::map<std::string,unsigned int> running, maxRunning;
+	auto task=[&](const std::string& key){
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			maxRunning[key]=std::max(maxRunning[key],++running[key]);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		std::lock_guard<std::mutex> lock(mut);
+		running[key]--;
+	};
+	//the limit applies across groups
+	Executor::TaskGroup first(executor), second(executor);
+	for(unsigned int i=0; i<10; i++){
+		first.submit("a",[&]{ task("a"); });
+		second.submit("a",[&]{ task("a"); });
+		second.submit("b",[&]{ task("b"); });
+	}
+	first.wait();
+	second.wait();
+	ENSURE(maxRunning["a"]<=2,"No more than the per-key limit of tasks should run at once");
+	ENSURE(maxRunning["b"]<=2,"No more than the per-key limit of tasks should run at once");
+	ENSURE_EQUAL(executor.getStatistics().tasksCompleted,30u);
+}
+
+TEST(ExecutorInteractivePriority){
+	Executor executor("Test",1);
+	std::atomic<bool> release(false);
+	Executor::TaskGroup blocker(executor);
+	blocker.submit([&]{ while(!release) std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	
+	//queue bulk work first, then interactive work, while the only worker is busy
+	std::mutex mut;
+	std::vector<char> order;
+	Executor::TaskGroup bulk(executor,0,Executor::Priority::Bulk);
+	Executor::TaskGroup interactive(executor,0,Executor::Priority::Interactive);
+	for(unsigned int i=0; i<3; i++)
+		bulk.submit([&]{ std::lock_guard<std::mutex> lock(mut); order.push_back('b'); });
+	for(unsigned int i=0; i<3; i++)
+		interactive.submit([&]{ std::lock_guard<std::mutex> lock(mut); order.push_back('i'); });
+	ENSURE_EQUAL(executor.getStatistics().bulkQueued,3u);
+	release=true;
+	blocker.wait();
+	//wait without running any tasks on this thread
+	while(executor.getStatistics().tasksCompleted<7)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	ENSURE_EQUAL(std::string(order.begin(),order.end()),"iiibbb",
+	             "Interactive tasks should run before bulk tasks");
+}
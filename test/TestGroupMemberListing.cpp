@@ -1,5 +1,6 @@
 #include "test.h"
 
+#include <PersistentStore.h>
 #include <ServerUtilities.h>
 
 TEST(UnauthenticatedListGroupMembers){
@@ -168,3 +169,134 @@ TEST(NonMemberListGroupMembers){
 		ENSURE_EQUAL(listResp.status,403,"Requests by non-members to list Group members should be rejected");
 	}
 }
+
+TEST(ListManyGroupMembers){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	std::string adminID=tc.getPortalUserID();
+	std::string adminKey=tc.getPortalToken();
+	std::string groupName="some-org";
+	auto schema=loadSchema(getSchemaDir()+"/UserListResultSchema.json");
+	
+	{ //create a VO
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", groupName, alloc);
+		metadata.AddMember("scienceField", "Logic", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"Group creation request should succeed");
+	}
+	
+	//many members, all of whose records the server has cached as it created 
+	//them; see BatchLookupOfUncachedMembers for fetching them from the database
+	const unsigned int nUsers=105;
+	std::set<std::string> expected{adminID};
+	for(unsigned int i=0; i<nUsers; i++){
+		std::string name="User"+std::to_string(i);
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", name, alloc);
+		metadata.AddMember("email", name+"@place.com", alloc);
+		metadata.AddMember("phone", "555-5555", alloc);
+		metadata.AddMember("institution", "Center of the Earth University", alloc);
+		metadata.AddMember("admin", false, alloc);
+		metadata.AddMember("globusID", name+"'s Globus ID", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"User creation request should succeed");
+		rapidjson::Document createData;
+		createData.Parse(createResp.body);
+		std::string uid=createData["metadata"]["id"].GetString();
+		expected.insert(uid);
+		auto addResp=httpPut(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users/"+uid+"/groups/"+groupName+"?token="+adminKey,"");
+		ENSURE_EQUAL(addResp.status,200,"User addition to Group request should succeed");
+	}
+	
+	auto listResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups/"+groupName+"/members?token="+adminKey);
+	ENSURE_EQUAL(listResp.status,200,"Listing Group members should succeed");
+	rapidjson::Document data;
+	data.Parse(listResp.body);
+	ENSURE_CONFORMS(data,schema);
+	ENSURE_EQUAL(data["items"].Size(),nUsers+1,"All members should be listed");
+	std::set<std::string> listed;
+	for(const auto& item : data["items"].GetArray()){
+		listed.insert(item["metadata"]["id"].GetString());
+		ENSURE(!std::string(item["metadata"]["name"].GetString()).empty(),
+		       "Each member's full record should be fetched");
+	}
+	ENSURE(listed==expected,"Each member should be listed exactly once");
+}
+
+TEST(BatchLookupOfUncachedMembers){
+	DatabaseContext db;
+	auto writerPtr=db.makePersistentStore();
+	auto& writer=*writerPtr;
+	
+	Group group;
+	group.id=idGenerator.generateGroupID();
+	group.name="batch-group";
+	group.email="abc@def";
+	group.phone="123";
+	group.scienceField="Logic";
+	group.description=" ";
+	group.valid=true;
+	ENSURE(writer.addGroup(group));
+	
+	//enough members that their records cannot all be fetched in one batch
+	const unsigned int nUsers=105;
+	std::vector<std::string> ids;
+	for(unsigned int i=0; i<nUsers; i++){
+		User user;
+		user.valid=true;
+		user.id="user_batch"+std::to_string(i);
+		user.name="User "+std::to_string(i);
+		user.email="user"+std::to_string(i)+"@example.com";
+		user.phone="555-5555";
+		user.institution="Institute";
+		user.token="token_batch"+std::to_string(i);
+		user.globusID="globus_batch"+std::to_string(i);
+		user.admin=false;
+		ENSURE(writer.addUser(user));
+		ENSURE(writer.addUserToGroup(user.id,group.id));
+		ids.push_back(user.id);
+	}
+	
+	{ //a store with empty caches must fetch every record from the database
+		auto readerPtr=db.makePersistentStore();
+		auto& reader=*readerPtr;
+		bool complete=false;
+		auto users=reader.getUsers(ids,&complete);
+		ENSURE(complete,"Every record should be looked up");
+		ENSURE_EQUAL(users.size(),nUsers,"Every user should be found");
+		for(const auto& id : ids){
+			auto it=users.find(id);
+			ENSURE(it!=users.end(),"Each user should be found");
+			ENSURE_EQUAL(it->second.id,id);
+			ENSURE(!it->second.name.empty(),"Each user's full record should be fetched");
+		}
+		ENSURE_EQUAL(getStatistic(reader,"Cache hits"),0u,"No user should have been cached");
+		
+		//the fetched records should now be cached
+		users=reader.getUsers(ids,&complete);
+		ENSURE(complete);
+		ENSURE_EQUAL(getStatistic(reader,"Cache hits"),nUsers);
+	}
+	
+	{ //listing the group's members from another cold store
+		auto readerPtr=db.makePersistentStore();
+		auto& reader=*readerPtr;
+		auto members=reader.listUsersByGroup(group.id);
+		ENSURE_EQUAL(members.size(),nUsers,"All members should be listed");
+		std::set<std::string> listed;
+		for(const auto& user : members)
+			listed.insert(user.id);
+		ENSURE(listed==std::set<std::string>(ids.begin(),ids.end()),
+		       "Each member should be listed exactly once");
+	}
+}
@@ -0,0 +1,205 @@
+#include "test.h"
+
+#include <fstream>
+
+#include <unistd.h>
+
+#include <crow.h>
+
+#include <KubeAPIClient.h>
+#include <ServerUtilities.h>
+
+namespace{
+
+///A minimal imitation of a kubernetes API server, which answers only the
+///requests these tests make
+struct StubAPIServer{
+	crow::SimpleApp app;
+	unsigned int port;
+	std::thread thread;
+	///The most recent label selector which was sent
+	std::string lastLabelSelector;
+	///Number of requests received
+	std::atomic<unsigned int> requests;
+	///Whether the pod in the 'deleting' namespace has been deleted
+	std::atomic<bool> deleted;
+
+	StubAPIServer():port(20000+(getpid()%20000)),requests(0),deleted(false){
+		crow::logger::setLogLevel(crow::LogLevel::Warning);
+		CROW_ROUTE(app, "/api/v1/namespaces/<string>/pods")
+		([this](const crow::request& req, const std::string& nspace){
+			requests++;
+			if(req.url_params.get("labelSelector"))
+				lastLabelSelector=req.url_params.get("labelSelector");
+			if(req.get_header_value("Authorization")!="Bearer abcdef")
+				return crow::response(401,R"({"kind":"Status","reason":"Unauthorized","message":"Unauthorized"})");
+			//the 'empty' namespace has no pods, the pod in the 'deleting'
+			//namespace is deleted when it is watched, and the pod in the
+			//'stuck' namespace is never deleted
+			if(nspace=="empty" || (nspace=="deleting" && deleted))
+				return crow::response(200,R"({"kind":"PodList","apiVersion":"v1","metadata":{"resourceVersion":"6"},"items":[]})");
+			if(req.url_params.get("watch")){
+				if(nspace!="deleting")
+					return crow::response(200,"");
+				deleted=true;
+				return crow::response(200,
+					R"({"type":"MODIFIED","object":{"metadata":{"name":"pod-1","resourceVersion":"5"}}})" "\n"
+					R"({"type":"DELETED","object":{"metadata":{"name":"pod-1","resourceVersion":"6"}}})" "\n");
+			}
+			return crow::response(200,R"({"kind":"PodList","apiVersion":"v1","metadata":{"resourceVersion":"4"},"items":[{"metadata":{"name":"pod-1","namespace":")"+nspace+R"("}}]})");
+		});
+		CROW_ROUTE(app, "/api/v1/nodes/<string>")
+		([this](const std::string& name){
+			requests++;
+			if(name!="node-1")
+				return crow::response(404,R"({"kind":"Status","reason":"NotFound","message":"nodes \")"+name+R"(\" not found"})");
+			return crow::response(200,R"({"kind":"Node","apiVersion":"v1","metadata":{"name":"node-1"}})");
+		});
+		thread=std::thread([this]{ app.port(port).bindaddr("127.0.0.1").run(); });
+		app.wait_for_server_start();
+	}
+	~StubAPIServer(){
+		app.stop();
+		thread.join();
+	}
+	std::string url() const{ return "http://127.0.0.1:"+std::to_string(port); }
+};
+
+///Write a kubeconfig which directs requests to the stub server
+FileHandle writeConfig(const StubAPIServer& server){
+	FileHandle config=makeTemporaryFile("kubeconfig_");
+	std::ofstream out(config.path());
+	out << "apiVersion: v1\n"
+	"kind: Config\n"
+	"clusters:\n"
+	"- name: stub\n"
+	"  cluster:\n"
+	"    server: " << server.url() << "\n"
+	"contexts:\n"
+	"- name: stub\n"
+	"  context:\n"
+	"    cluster: stub\n"
+	"    namespace: slate-system\n"
+	"    user: stub-user\n"
+	"current-context: stub\n"
+	"users:\n"
+	"- name: stub-user\n"
+	"  user:\n"
+	"    token: abcdef\n";
+	return config;
+}
+
+}
+
+TEST(KubeAPIListPods){
+	StubAPIServer server;
+	FileHandle config=writeConfig(server);
+
+	auto result=kubernetes::kubectl_get(config,"pods",{"slate-group-foo","","release=bar"});
+	ENSURE_EQUAL(result.status,0,"Listing pods should succeed");
+	ENSURE_EQUAL(server.lastLabelSelector,"release=bar","Label selector should be passed to the API server");
+	rapidjson::Document data;
+	data.Parse(result.output.c_str());
+	ENSURE(!data.HasParseError());
+	ENSURE_EQUAL(data["kind"].GetString(),std::string("List"),"Lists should be presented as kubectl does");
+	ENSURE_EQUAL(data["items"].Size(),1);
+	ENSURE_EQUAL(data["items"][0]["kind"].GetString(),std::string("Pod"),"Items should have their kind filled in");
+	ENSURE_EQUAL(data["items"][0]["metadata"]["namespace"].GetString(),std::string("slate-group-foo"));
+
+	//with no namespace specified, the context's namespace should be used
+	result=kubernetes::kubectl_get(config,"po");
+	ENSURE_EQUAL(result.status,0,"Listing pods should succeed");
+	data.Parse(result.output.c_str());
+	ENSURE_EQUAL(data["items"][0]["metadata"]["namespace"].GetString(),std::string("slate-system"));
+
+	ENSURE_EQUAL(server.requests.load(),2u,"Requests should be answered by the API server");
+}
+
+TEST(KubeAPIGetNode){
+	StubAPIServer server;
+	FileHandle config=writeConfig(server);
+
+	auto result=kubernetes::kubectl_get(config,"node",{"","node-1"});
+	ENSURE_EQUAL(result.status,0,"Getting a node should succeed");
+	rapidjson::Document data;
+	data.Parse(result.output.c_str());
+	ENSURE_EQUAL(data["metadata"]["name"].GetString(),std::string("node-1"));
+
+	result=kubernetes::kubectl_get(config,"node",{"","node-2"});
+	ENSURE(result.status!=0,"Getting a nonexistent node should fail");
+	ENSURE_EQUAL(result.error,"Error from server (NotFound): nodes \"node-2\" not found",
+	             "Errors should be reported as kubectl would");
+}
+
+TEST(KubeAPIConnectionReuse){
+	StubAPIServer server;
+	FileHandle config=writeConfig(server);
+
+	auto before=kubernetes::getAPIClientStatistics();
+	for(unsigned int i=0; i<10; i++){
+		auto result=kubernetes::kubectl_get(config,"pods",{"slate-system"});
+		ENSURE_EQUAL(result.status,0,"Listing pods should succeed");
+	}
+	auto after=kubernetes::getAPIClientStatistics();
+	ENSURE_EQUAL(after.directRequests-before.directRequests,10u);
+	ENSURE(after.connectionsCreated-before.connectionsCreated<=1,
+	       "Sequential requests should reuse a connection");
+	ENSURE_EQUAL(after.fallbackRequests,before.fallbackRequests);
+}
+
+TEST(KubeAPIUnauthorized){
+	StubAPIServer server;
+	FileHandle config=makeTemporaryFile("kubeconfig_");
+	{
+		std::ofstream out(config.path());
+		out << "apiVersion: v1\n"
+		"clusters:\n"
+		"- name: stub\n"
+		"  cluster:\n"
+		"    server: " << server.url() << "\n"
+		"contexts:\n"
+		"- name: stub\n"
+		"  context:\n"
+		"    cluster: stub\n"
+		"    user: stub-user\n"
+		"current-context: stub\n"
+		"users:\n"
+		"- name: stub-user\n"
+		"  user:\n"
+		"    token: wrong\n";
+	}
+	auto result=kubernetes::kubectl_get(config,"pods",{"slate-system"});
+	ENSURE(result.status!=0,"Requests with bad credentials should fail");
+	ENSURE_EQUAL(result.error,"Error from server (Unauthorized): Unauthorized");
+}
+
+TEST(KubeAPIWaitForDeletion){
+	using namespace std::chrono;
+	using kubernetes::DeletionWaitResult;
+	StubAPIServer server;
+	FileHandle config=writeConfig(server);
+	std::string error;
+
+	auto before=kubernetes::getAPIClientStatistics();
+	auto result=kubernetes::waitForDeletion(config,"empty","release=bar",
+	                                        steady_clock::now()+seconds(10),error);
+	ENSURE(result==DeletionWaitResult::Deleted,"Waiting with nothing to delete should succeed");
+	auto after=kubernetes::getAPIClientStatistics();
+	ENSURE_EQUAL(after.watchesStarted,before.watchesStarted,"No watch should be needed when nothing exists");
+
+	auto start=steady_clock::now();
+	result=kubernetes::waitForDeletion(config,"deleting","release=bar",
+	                                   steady_clock::now()+seconds(10),error);
+	ENSURE(result==DeletionWaitResult::Deleted,"Deletion events should be noticed");
+	ENSURE(steady_clock::now()-start<seconds(5),"Deletion should be noticed without waiting for the deadline");
+	ENSURE_EQUAL(server.lastLabelSelector,"release=bar","Label selector should be passed to the API server");
+	after=kubernetes::getAPIClientStatistics();
+	ENSURE_EQUAL(after.watchesStarted-before.watchesStarted,1u,"A watch should be used");
+	ENSURE_EQUAL(after.fallbackRequests,before.fallbackRequests);
+
+	start=steady_clock::now();
+	result=kubernetes::waitForDeletion(config,"stuck","release=bar",
+	                                   steady_clock::now()+seconds(1),error);
+	ENSURE(result==DeletionWaitResult::TimedOut,"Waiting for objects which remain should time out");
+	ENSURE(steady_clock::now()-start<seconds(5),"The deadline should be respected");
+}
@@ -0,0 +1,124 @@
+#include "test.h"
+
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <Logging.h>
+
+namespace{
+	///Collect everything written to stdout and stderr while it exists
+	struct OutputCapture{
+		std::ostringstream out, err;
+		std::streambuf* oldOut;
+		std::streambuf* oldErr;
+
+		OutputCapture():
+		oldOut(std::cout.rdbuf(out.rdbuf())),oldErr(std::cerr.rdbuf(err.rdbuf())){}
+		~OutputCapture(){
+			flushLog();
+			std::cout.rdbuf(oldOut);
+			std::cerr.rdbuf(oldErr);
+			setLogLevel(LogLevel::Info);
+			setLogFormat(LogFormat::Text);
+		}
+
+		std::vector<std::string> lines(const std::ostringstream& stream){
+			flushLog();
+			std::istringstream ss(stream.str());
+			std::vector<std::string> result;
+			std::string line;
+			while(std::getline(ss,line))
+				result.push_back(line);
+			return result;
+		}
+	};
+}
+
+TEST(LoggingLevels){
+	OutputCapture capture;
+	log_info("first info");
+	log_warn("first warning");
+	log_error("first error");
+
+	setLogLevel(LogLevel::Error);
+	log_info("second info");
+	log_warn("second warning");
+	log_error("second error");
+
+	auto out=capture.lines(capture.out);
+	auto err=capture.lines(capture.err);
+	ENSURE_EQUAL(out.size(),1u,"Only the first informational message should be written");
+	ENSURE(out[0].compare(0,7,"INFO: [")==0);
+	ENSURE(out[0].find(" UTC] (TID ")!=std::string::npos);
+	ENSURE(out[0].find("first info")!=std::string::npos);
+	ENSURE_EQUAL(err.size(),3u,"The second warning should not be written");
+	ENSURE(err[0].compare(0,6,"WARN: ")==0);
+	ENSURE(err[1].compare(0,7,"ERROR: ")==0);
+	ENSURE(err[2].find("second error")!=std::string::npos);
+
+	bool threw=false;
+	try{
+		log_fatal("fatal " << 42);
+	}catch(std::runtime_error& ex){
+		threw=true;
+		ENSURE_EQUAL(std::string(ex.what()),"fatal 42");
+	}
+	ENSURE(threw,"log_fatal should throw");
+	err=capture.lines(capture.err);
+	ENSURE_EQUAL(err.size(),4u,"Fatal messages should always be written");
+	ENSURE(err[3].compare(0,7,"FATAL: ")==0);
+}
+
+TEST(LoggingJSON){
+	OutputCapture capture;
+	setLogFormat(LogFormat::JSON);
+	log_info("a \"quoted\"\tmessage\\ with\nnewlines");
+
+	auto out=capture.lines(capture.out);
+	ENSURE_EQUAL(out.size(),1u,"A message with newlines should still be one line");
+	rapidjson::Document json;
+	json.Parse(out[0].c_str());
+	ENSURE(!json.HasParseError(),"Output should be valid JSON");
+	ENSURE(json.IsObject());
+	ENSURE_EQUAL(json["level"].GetString(),std::string("info"));
+	ENSURE_EQUAL(json["message"].GetString(),std::string("a \"quoted\"\tmessage\\ with\nnewlines"));
+	const std::string time=json["time"].GetString();
+	ENSURE_EQUAL(time.size(),27u,"Time should have the form YYYY-MM-DDTHH:MM:SS.uuuuuuZ");
+	ENSURE_EQUAL(time[10],'T');
+	ENSURE_EQUAL(time.back(),'Z');
+	ENSURE(json.HasMember("thread"));
+}
+
+TEST(LoggingManyThreads){
+	OutputCapture capture;
+	//log more messages than the queue can hold, so that producers must wait
+	//for the writer
+	const unsigned int threads=8, messages=5000;
+	std::vector<std::thread> loggers;
+	for(unsigned int t=0; t<threads; t++){
+		loggers.emplace_back([t]{
+			for(unsigned int i=0; i<messages; i++)
+				log_info("thread " << t << " message " << i);
+		});
+	}
+	for(auto& thread : loggers)
+		thread.join();
+
+	auto out=capture.lines(capture.out);
+	ENSURE_EQUAL(out.size(),threads*messages,"No message should be lost");
+	//each thread's messages should appear in the order they were logged
+	std::vector<unsigned int> next(threads,0);
+	for(const auto& line : out){
+		auto pos=line.find(") thread ");
+		ENSURE(pos!=std::string::npos,"Each line should be a whole message");
+		std::istringstream ss(line.substr(pos+9));
+		unsigned int t, i;
+		std::string word;
+		ss >> t >> word >> i;
+		ENSURE(t<threads);
+		ENSURE_EQUAL(i,next[t],"Messages from one thread should be in order");
+		next[t]++;
+	}
+}
@@ -0,0 +1,449 @@
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <PersistentStore.h>
+#include <ServerUtilities.h>
+
+namespace{
+
+///Poll an operation until it finishes, or until a time limit passes
+///\return the last response received for the operation
+rapidjson::Document waitForOperation(TestContext& tc, const std::string& token,
+                                     const std::string& operationID){
+	using namespace httpRequests;
+	rapidjson::Document data;
+	auto deadline=std::chrono::steady_clock::now()+std::chrono::minutes(5);
+	while(std::chrono::steady_clock::now()<deadline){
+		auto resp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/operations/"+operationID+"?token="+token);
+		ENSURE_EQUAL(resp.status,200,"Fetching an operation should succeed");
+		data.Parse(resp.body.c_str());
+		std::string state=data["status"]["state"].GetString();
+		if(state=="Succeeded" || state=="Failed")
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	}
+	return data;
+}
+
+}
+
+TEST(UnauthenticatedGetOperation){
+	using namespace httpRequests;
+	TestContext tc;
+
+	auto resp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/operations/operation_ABCD");
+	ENSURE_EQUAL(resp.status,403,
+	             "Requests to get operations without authentication should be rejected");
+
+	resp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/operations/operation_ABCD?token=00112233-4455-6677-8899-aabbccddeeff");
+	ENSURE_EQUAL(resp.status,403,
+	             "Requests to get operations with invalid authentication should be rejected");
+
+	resp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/operations");
+	ENSURE_EQUAL(resp.status,403,
+	             "Requests to list operations without authentication should be rejected");
+}
+
+TEST(GetNonexistentOperation){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=tc.getPortalToken();
+	auto resp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/operations/operation_ABCD?token="+adminKey);
+	ENSURE_EQUAL(resp.status,404,"Requests for nonexistent operations should be rejected");
+}
+
+TEST(AsyncRestartInstance){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=tc.getPortalToken();
+	auto schema=loadSchema(getSchemaDir()+"/OperationResultSchema.json");
+
+	std::string groupName="test-async-restart";
+	std::string clusterName="testcluster";
+
+	{ //create a group
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", groupName, alloc);
+		metadata.AddMember("scienceField", "Logic", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"Group creation request should succeed");
+	}
+
+	{ //create a cluster
+		auto kubeConfig = tc.getKubeConfig();
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", clusterName, alloc);
+		metadata.AddMember("group", groupName, alloc);
+		metadata.AddMember("owningOrganization", "Department of Labor", alloc);
+		metadata.AddMember("kubeconfig", kubeConfig, alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/clusters?token="+adminKey, to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"Cluster creation request should succeed");
+	}
+
+	std::string instID;
+	{ //install an instance
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		request.AddMember("group", groupName, alloc);
+		request.AddMember("cluster", clusterName, alloc);
+		request.AddMember("tag", "install1", alloc);
+		request.AddMember("configuration", "", alloc);
+		auto instResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/apps/test-app?test&token="+adminKey,to_string(request));
+		ENSURE_EQUAL(instResp.status,200,"Application install request should succeed");
+		rapidjson::Document data;
+		data.Parse(instResp.body);
+		if(data.HasMember("metadata") && data["metadata"].IsObject() && data["metadata"].HasMember("id"))
+			instID=data["metadata"]["id"].GetString();
+	}
+
+	std::string operationID;
+	{ //restart the instance, without waiting for the restart to finish
+		auto resResp=httpPut(tc.getAPIServerURL()+"/"+currentAPIVersion+"/instances/"+instID+"/restart?async&token="+adminKey,"");
+		ENSURE_EQUAL(resResp.status,202,"Asynchronous instance restart request should be accepted");
+		rapidjson::Document data;
+		data.Parse(resResp.body.c_str());
+		ENSURE_CONFORMS(data,schema);
+		operationID=data["metadata"]["id"].GetString();
+		ENSURE_EQUAL(data["metadata"]["kind"].GetString(),std::string("restartInstance"));
+		ENSURE_EQUAL(data["metadata"]["target"].GetString(),instID);
+	}
+
+	{ //wait for the restart to be done
+		rapidjson::Document data=waitForOperation(tc,adminKey,operationID);
+		ENSURE_CONFORMS(data,schema);
+		ENSURE_EQUAL(data["status"]["state"].GetString(),std::string("Succeeded"),
+		             "Instance restart operation should succeed");
+		ENSURE(data.HasMember("result"),"A finished restart should have a result");
+		ENSURE_EQUAL(data["result"]["metadata"]["id"].GetString(),instID);
+	}
+
+	{ //the operation should be listed for the user who started it
+		auto listResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/operations?token="+adminKey);
+		ENSURE_EQUAL(listResp.status,200,"Listing operations should succeed");
+		rapidjson::Document data;
+		data.Parse(listResp.body.c_str());
+		ENSURE_CONFORMS(data,loadSchema(getSchemaDir()+"/OperationListResultSchema.json"));
+		bool found=false;
+		for(const auto& item : data["items"].GetArray())
+			found|=(item["metadata"]["id"].GetString()==operationID);
+		ENSURE(found,"The restart operation should be listed");
+	}
+}
+
+TEST(AsyncDeleteGroup){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=tc.getPortalToken();
+	auto baseGroupUrl=tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups";
+
+	std::string groupID;
+	{ //create a group
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", "test-async-delete-group", alloc);
+		metadata.AddMember("scienceField", "Logic", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(baseGroupUrl+"?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"Group creation request should succeed");
+		rapidjson::Document data;
+		data.Parse(createResp.body.c_str());
+		groupID=data["metadata"]["id"].GetString();
+	}
+
+	auto deleteResp=httpDelete(baseGroupUrl+"/"+groupID+"?async&token="+adminKey);
+	ENSURE_EQUAL(deleteResp.status,202,"Asynchronous group deletion should be accepted");
+	rapidjson::Document data;
+	data.Parse(deleteResp.body.c_str());
+	std::string operationID=data["metadata"]["id"].GetString();
+
+	//the group itself should be gone at once
+	auto getResp=httpGet(baseGroupUrl+"/"+groupID+"?token="+adminKey);
+	ENSURE_EQUAL(getResp.status,404,"A deleted group should not be found");
+
+	rapidjson::Document result=waitForOperation(tc,adminKey,operationID);
+	ENSURE_EQUAL(result["status"]["state"].GetString(),std::string("Succeeded"),
+	             "Group cleanup operation should succeed");
+}
+
+TEST(OperationVisibility){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=tc.getPortalToken();
+
+	std::string groupID;
+	{ //create a group
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", "test-operation-visibility", alloc);
+		metadata.AddMember("scienceField", "Logic", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"Group creation request should succeed");
+		rapidjson::Document data;
+		data.Parse(createResp.body.c_str());
+		groupID=data["metadata"]["id"].GetString();
+	}
+
+	std::string tok;
+	{ //create an unrelated user
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("globusID", "Some Globus ID", alloc);
+		metadata.AddMember("name", "Bob", alloc);
+		metadata.AddMember("email", "bob@place.com", alloc);
+		metadata.AddMember("phone", "555-5555", alloc);
+		metadata.AddMember("institution", "Center of the Earth University", alloc);
+		metadata.AddMember("admin", false, alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto userResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(userResp.status,200,"User creation request should succeed");
+		rapidjson::Document data;
+		data.Parse(userResp.body.c_str());
+		tok=data["metadata"]["access_token"].GetString();
+	}
+
+	auto deleteResp=httpDelete(tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups/"+groupID+"?async&token="+adminKey);
+	ENSURE_EQUAL(deleteResp.status,202,"Asynchronous group deletion should be accepted");
+	rapidjson::Document data;
+	data.Parse(deleteResp.body.c_str());
+	std::string operationID=data["metadata"]["id"].GetString();
+
+	auto getResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/operations/"+operationID+"?token="+tok);
+	ENSURE_EQUAL(getResp.status,403,"Users should not be able to see other users' operations");
+
+	auto listResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/operations?token="+tok);
+	ENSURE_EQUAL(listResp.status,200,"Listing operations should succeed");
+	data.Parse(listResp.body.c_str());
+	ENSURE_EQUAL(data["items"].Size(),0,"Other users' operations should not be listed");
+
+	waitForOperation(tc,adminKey,operationID);
+}
+
+TEST(ResumeInterruptedOperations){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+
+	//records of operations which were running when a server stopped
+	Operation interrupted;
+	interrupted.valid=true;
+	interrupted.id=idGenerator.generateOperationID();
+	interrupted.kind="test";
+	interrupted.target="target_1";
+	interrupted.user=db.getPortalUserID();
+	interrupted.parameters="{\"value\":\"abc\"}";
+	interrupted.state=Operation::Running;
+	interrupted.progress="Started";
+	interrupted.ctime=timestamp();
+	interrupted.mtime=interrupted.ctime;
+	ENSURE(store.addOperation(interrupted),"Operation addition should succeed");
+
+	Operation unknown=interrupted;
+	unknown.id=idGenerator.generateOperationID();
+	unknown.kind="unknown";
+	unknown.target="target_2";
+	ENSURE(store.addOperation(unknown),"Operation addition should succeed");
+
+	Operation finished=interrupted;
+	finished.id=idGenerator.generateOperationID();
+	finished.state=Operation::Succeeded;
+	ENSURE(store.addOperation(finished),"Operation addition should succeed");
+
+	std::atomic<unsigned int> runs(0);
+	OperationScheduler& scheduler=store.getOperationScheduler();
+	scheduler.setHandler("test",[&](const Operation& operation, std::string& result,
+	                                const OperationScheduler::ProgressReporter& progress){
+		runs++;
+		progress("Halfway");
+		result="{\"echo\":"+operation.parameters+"}";
+		return true;
+	});
+
+	ENSURE_EQUAL(scheduler.resumeUnfinished(),1u,"Only unfinished operations with handlers should be resumed");
+
+	auto waitFinished=[&](const std::string& id){
+		Operation operation;
+		auto deadline=std::chrono::steady_clock::now()+std::chrono::seconds(30);
+		do{
+			operation=store.getOperation(id);
+			if(operation.finished())
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}while(std::chrono::steady_clock::now()<deadline);
+		return operation;
+	};
+
+	Operation resumed=waitFinished(interrupted.id);
+	ENSURE_EQUAL(resumed.state,Operation::Succeeded,"Resumed operation should succeed");
+	ENSURE_EQUAL(resumed.result,"{\"echo\":{\"value\":\"abc\"}}");
+	ENSURE_EQUAL(runs.load(),1u,"Only the operation with a handler should run");
+
+	//an operation of a kind this scheduler cannot carry out should be left 
+	//for another replica, not claimed and failed
+	Operation skipped=store.getOperation(unknown.id);
+	ENSURE_EQUAL(skipped.state,Operation::Running,"Operations of unknown kinds should not be changed");
+	ENSURE(skipped.owner.empty(),"Operations of unknown kinds should not be claimed");
+
+	auto unfinished=store.listUnfinishedOperations();
+	ENSURE_EQUAL(unfinished.size(),1u,"Only the operation of an unknown kind should remain unfinished");
+	auto stats=scheduler.getStatistics();
+	ENSURE_EQUAL(stats.resumed,1u);
+	ENSURE_EQUAL(stats.succeeded,1u);
+	ENSURE_EQUAL(stats.failed,0u);
+}
+
+TEST(OperationLeases){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+	const long long now=std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+	//an operation being carried out by another replica which is still running
+	Operation held;
+	held.valid=true;
+	held.id=idGenerator.generateOperationID();
+	held.kind="test";
+	held.target="target_1";
+	held.user=db.getPortalUserID();
+	held.parameters="{}";
+	held.state=Operation::Running;
+	held.progress="Started";
+	held.ctime=timestamp();
+	held.mtime=held.ctime;
+	held.owner="replica_other";
+	held.leaseExpiration=now+3600;
+	ENSURE(store.addOperation(held),"Operation addition should succeed");
+	ENSURE(!store.addOperation(held),"Adding an operation which exists should fail");
+
+	//an operation which was being carried out by a replica which stopped
+	Operation abandoned=held;
+	abandoned.id=idGenerator.generateOperationID();
+	abandoned.target="target_2";
+	abandoned.leaseExpiration=now-60;
+	ENSURE(store.addOperation(abandoned),"Operation addition should succeed");
+
+	std::atomic<unsigned int> runs(0);
+	OperationScheduler& scheduler=store.getOperationScheduler();
+	scheduler.setHandler("test",[&](const Operation&, std::string& result,
+	                                const OperationScheduler::ProgressReporter&){
+		runs++;
+		result="{}";
+		return true;
+	});
+
+	ENSURE_EQUAL(scheduler.resumeUnfinished(),1u,"Only the operation whose lease expired should be taken over");
+	auto deadline=std::chrono::steady_clock::now()+std::chrono::seconds(30);
+	Operation resumed;
+	do{
+		resumed=store.getOperation(abandoned.id);
+		if(resumed.finished())
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}while(std::chrono::steady_clock::now()<deadline);
+	ENSURE_EQUAL(resumed.state,Operation::Succeeded,"Resumed operation should succeed");
+	ENSURE_EQUAL(resumed.owner,store.getReplicaID(),"Resumed operation should be owned by the new replica");
+	ENSURE_EQUAL(runs.load(),1u);
+
+	Operation untouched=store.getOperation(held.id);
+	ENSURE_EQUAL(untouched.state,Operation::Running,"Another replica's operation should not be changed");
+	ENSURE_EQUAL(untouched.owner,held.owner);
+	ENSURE_EQUAL(untouched.leaseExpiration,held.leaseExpiration);
+	ENSURE(!store.claimOperation(held),"An operation with a current lease should not be claimed");
+	
+	//a replica which no longer owns an operation may not change its record
+	Operation stale=abandoned;
+	stale.state=Operation::Failed;
+	stale.progress="Finished";
+	stale.mtime=timestamp();
+	ENSURE(!store.updateOperation(stale),"A former owner should not update an operation");
+	ENSURE(!store.renewOperationLease(stale),"A former owner should not renew a lease");
+}
+
+TEST(OperationLeaseRenewal){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+
+	//a scheduler with a short lease, which must keep renewing it while its 
+	//operation runs, so that another scheduler cannot take the operation over
+	const std::chrono::seconds leaseDuration(3);
+	OperationScheduler owner(store,1,leaseDuration);
+	OperationScheduler other(store,1,leaseDuration);
+	std::atomic<bool> release(false);
+	std::atomic<unsigned int> runs(0);
+	auto handler=[&](const Operation&, std::string& result,
+	                 const OperationScheduler::ProgressReporter&){
+		runs++;
+		while(!release.load())
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		result="{}";
+		return true;
+	};
+	owner.setHandler("wait",handler);
+	other.setHandler("wait",handler);
+	owner.startBackgroundTasks();
+	other.startBackgroundTasks();
+
+	Operation operation=owner.start("wait","target_1",db.getPortalUserID());
+	ENSURE(operation,"Starting an operation should succeed");
+	std::this_thread::sleep_for(2*leaseDuration);
+	ENSURE_EQUAL(other.resumeUnfinished(),0u,"An operation whose lease is renewed should not be taken over");
+	release=true;
+
+	auto deadline=std::chrono::steady_clock::now()+std::chrono::seconds(30);
+	do{
+		operation=store.getOperation(operation.id);
+		if(operation.finished())
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}while(std::chrono::steady_clock::now()<deadline);
+	ENSURE_EQUAL(operation.state,Operation::Succeeded);
+	ENSURE_EQUAL(runs.load(),1u,"The operation should run only once");
+}
+
+TEST(FailingOperation){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+
+	OperationScheduler& scheduler=store.getOperationScheduler();
+	scheduler.setHandler("explode",[](const Operation&, std::string&,
+	                                  const OperationScheduler::ProgressReporter&)->bool{
+		throw std::runtime_error("Kaboom");
+	});
+	Operation operation=scheduler.start("explode","target_1",db.getPortalUserID());
+	ENSURE(operation,"Starting an operation should succeed");
+	ENSURE_EQUAL(operation.state,Operation::Pending);
+
+	auto deadline=std::chrono::steady_clock::now()+std::chrono::seconds(30);
+	do{
+		operation=store.getOperation(operation.id);
+		if(operation.finished())
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}while(std::chrono::steady_clock::now()<deadline);
+	ENSURE_EQUAL(operation.state,Operation::Failed,"An operation which throws should fail");
+	ENSURE_EQUAL(operation.result,"Kaboom");
+}
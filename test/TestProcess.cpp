@@ -0,0 +1,86 @@
+#include "test.h"
+
+#include <chrono>
+#include <iostream>
+
+TEST(RunCommandCollectsBothStreams){
+	startReaper();
+	//write enough to stderr to fill its pipe before anything is written to 
+	//stdout, which must not cause the child to block
+	const std::size_t size=1<<20;
+	auto result=runCommand("sh",{"-c","head -c "+std::to_string(size)+" /dev/zero >&2; head -c "+std::to_string(size)+" /dev/zero"});
+	stopReaper();
+	ENSURE_EQUAL(result.status,0);
+	ENSURE_EQUAL(result.output.size(),size,"All stdout data should be collected");
+	ENSURE_EQUAL(result.error.size(),size,"All stderr data should be collected");
+	ENSURE(!result.timedOut);
+	ENSURE(!result.truncated);
+}
+
+TEST(RunCommandOutputLimit){
+	startReaper();
+	CommandOptions options;
+	options.outputLimit=1000;
+	auto result=runCommand("head",{"-c","10000000","/dev/zero"},{},options);
+	stopReaper();
+	ENSURE(result.truncated,"Output beyond the limit should be reported");
+	ENSURE_EQUAL(result.output.size(),1000u,"Output should be cut off at the limit");
+}
+
+TEST(RunCommandEndlessOutput){
+	using namespace std::chrono;
+	//a child which writes as fast as its output is read must still be 
+	//stopped at the output limit
+	startReaper();
+	CommandOptions options;
+	options.outputLimit=1<<20;
+	options.timeout=seconds(10);
+	auto start=steady_clock::now();
+	auto result=runCommand("yes",{},{},options);
+	auto elapsed=steady_clock::now()-start;
+	stopReaper();
+	ENSURE(result.truncated,"Output beyond the limit should be reported");
+	ENSURE_EQUAL(result.output.size(),options.outputLimit);
+	ENSURE(!result.timedOut,"The command should be stopped by the output limit");
+	ENSURE(elapsed<seconds(5));
+}
+
+TEST(RunCommandTimeout){
+	using namespace std::chrono;
+	startReaper();
+	CommandOptions options;
+	options.timeout=milliseconds(200);
+	auto start=steady_clock::now();
+	auto result=runCommand("sleep",{"10"},{},options);
+	auto elapsed=steady_clock::now()-start;
+	stopReaper();
+	ENSURE(result.timedOut,"Commands running too long should be reported");
+	ENSURE(result.status!=0,"Stopped commands should not report success");
+	ENSURE(elapsed<seconds(5),"Commands running too long should be stopped");
+}
+
+TEST(RunCommandWithLargeInput){
+	//binary data, including NUL bytes, large enough to fill the pipes in both 
+	//directions many times over while cat echoes it back
+	const std::size_t size=32<<20;
+	std::string input(size,'\0');
+	for(std::size_t i=0; i<size; i++)
+		input[i]=(char)((i*7919)>>3);
+	startReaper();
+	auto result=runCommandWithInput("cat",input);
+	stopReaper();
+	ENSURE_EQUAL(result.status,0);
+	ENSURE_EQUAL(result.output.size(),size,"All output should be collected");
+	ENSURE(result.output==input,"Input should be passed to the child unaltered");
+}
+
+TEST(RunCommandWithUnreadInput){
+	//a child which exits without reading its input must not block or kill 
+	//the parent
+	const std::string input(4<<20,'x');
+	startReaper();
+	auto result=runCommandWithInput("sh",input,{"-c","echo done"});
+	stopReaper();
+	ENSURE_EQUAL(result.status,0);
+	ENSURE_EQUAL(result.output,"done\n");
+}
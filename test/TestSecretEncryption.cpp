@@ -0,0 +1,105 @@
+#include "test.h"
+
+#include <cstring>
+#include <fstream>
+
+#include <PersistentStore.h>
+extern "C"{
+	#include <scrypt/scryptenc/scryptenc.h>
+}
+
+namespace{
+	SecretData makeData(const std::string& contents){
+		SecretData data(contents.size());
+		std::memcpy(data.data.get(),contents.data(),contents.size());
+		return data;
+	}
+
+	std::string toString(const SecretData& data){
+		return std::string(data.data.get(),data.dataSize);
+	}
+}
+
+TEST(SecretEncryptionRoundTrip){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+
+	const std::string contents="some very secret data";
+	Secret secret;
+	secret.data=store.encryptSecret(makeData(contents));
+	ENSURE(secret.data.compare(0,7,"slatev2")==0,"Encrypted data should begin with the version header");
+	ENSURE(secret.data.find(contents)==std::string::npos);
+	ENSURE_EQUAL(toString(store.decryptSecret(secret)),contents,"Decryption should recover the original data");
+
+	//the same data should not encrypt the same way twice
+	Secret other;
+	other.data=store.encryptSecret(makeData(contents));
+	ENSURE(other.data!=secret.data,"Each encryption should use a new nonce");
+	ENSURE_EQUAL(toString(store.decryptSecret(other)),contents);
+	ENSURE_EQUAL(getStatistic(store,"Secret key derivations"),1u,"The derived key should be reused");
+
+	//altered data should be rejected
+	Secret altered=secret;
+	altered.data[altered.data.size()/2]^=1;
+	bool threw=false;
+	try{
+		store.decryptSecret(altered);
+	}catch(std::runtime_error& err){
+		threw=true;
+	}
+	ENSURE(threw,"Decrypting altered data should fail");
+}
+
+TEST(SecretEncryptionLegacyFormat){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+
+	std::ifstream keyFile(db.getEncryptionKeyPath());
+	std::string key((std::istreambuf_iterator<char>(keyFile)),std::istreambuf_iterator<char>());
+	const std::string contents="data encrypted by an older server";
+	Secret secret;
+	secret.data.resize(contents.size()+128);
+	//use a low cost, since it is recorded in the header and need not match
+	//what the server uses
+	int err=scryptenc_buf((const uint8_t*)contents.data(),contents.size(),
+	                      (uint8_t*)&secret.data.front(),
+	                      (const uint8_t*)key.data(),key.size(),10,8,1);
+	ENSURE_EQUAL(err,0,"Legacy encryption should succeed");
+	ENSURE_EQUAL(toString(store.decryptSecret(secret)),contents,"Data in the old format should still be readable");
+	ENSURE_EQUAL(getStatistic(store,"Legacy secret decryptions"),1u);
+}
+
+TEST(SecretEncryptionDecryptedCache){
+	DatabaseContext db;
+	auto storePtr=db.makePersistentStore();
+	auto& store=*storePtr;
+
+	const std::string contents="frequently read data";
+	Secret secret;
+	secret.id="secret_abc";
+	secret.data=store.encryptSecret(makeData(contents));
+
+	//by default nothing is cached
+	store.decryptSecret(secret);
+	store.decryptSecret(secret);
+	ENSURE_EQUAL(getStatistic(store,"Decrypted secret cache hits"),0u);
+	ENSURE_EQUAL(getStatistic(store,"Decrypted secrets cached"),0u);
+
+	store.setDecryptedSecretCacheValidity(std::chrono::seconds(60));
+	ENSURE_EQUAL(toString(store.decryptSecret(secret)),contents);
+	ENSURE_EQUAL(toString(store.decryptSecret(secret)),contents);
+	ENSURE_EQUAL(getStatistic(store,"Decrypted secret cache hits"),1u);
+	ENSURE_EQUAL(getStatistic(store,"Decrypted secrets cached"),1u);
+
+	//a different encryption under the same ID must not be answered from the cache
+	const std::string newContents="replacement data";
+	secret.data=store.encryptSecret(makeData(newContents));
+	ENSURE_EQUAL(toString(store.decryptSecret(secret)),newContents);
+	ENSURE_EQUAL(getStatistic(store,"Decrypted secret cache hits"),1u);
+
+	//removing the secret should drop its cached data
+	store.removeSecret(secret.id);
+	ENSURE_EQUAL(getStatistic(store,"Decrypted secrets cached"),0u);
+}
@@ -395,3 +395,85 @@ TEST(NonmemberRemoveOtherFromGroup){
 		ENSURE_EQUAL(data["metadata"]["groups"][0].GetString(),groupName,"User should belong to the correct Group");
 	}
 }
+
+TEST(ReaddUserToGroup){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	std::string adminKey=tc.getPortalToken();
+	std::string groupName="some-org";
+	
+	{ //create a Group
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", groupName, alloc);
+		metadata.AddMember("scienceField", "Logic", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"Group creation request should succeed");
+	}
+	
+	std::string uid, userToken;
+	{ //create a user
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", "Bob", alloc);
+		metadata.AddMember("email", "bob@place.com", alloc);
+		metadata.AddMember("phone", "555-5555", alloc);
+		metadata.AddMember("institution", "Center of the Earth University", alloc);
+		metadata.AddMember("admin", false, alloc);
+		metadata.AddMember("globusID", "Bob's Globus ID", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"User creation request should succeed");
+		rapidjson::Document createData;
+		createData.Parse(createResp.body);
+		uid=createData["metadata"]["id"].GetString();
+		userToken=createData["metadata"]["access_token"].GetString();
+	}
+	
+	auto groupInfoURL=tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups/"+groupName+"/members?token="+userToken;
+	
+	//a non-member should be refused, repeatedly, so that the refusal is 
+	//answered from the cache
+	for(unsigned int i=0; i<3; i++){
+		auto listResp=httpGet(groupInfoURL);
+		ENSURE_EQUAL(listResp.status,403,"A non-member should not be able to list a Group's members");
+	}
+	
+	{ //add the user to the Group
+		auto addResp=httpPut(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users/"+uid+"/groups/"+groupName+"?token="+adminKey,"");
+		ENSURE_EQUAL(addResp.status,200,"User addition to Group request should succeed");
+	}
+	{ //the cached non-membership should have been replaced
+		auto listResp=httpGet(groupInfoURL);
+		ENSURE_EQUAL(listResp.status,200,"A new member should be able to list a Group's members");
+	}
+	
+	{ //remove the user from the Group
+		auto remResp=httpDelete(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users/"+uid+"/groups/"+groupName+"?token="+adminKey);
+		ENSURE_EQUAL(remResp.status,200,"User removal from Group request should succeed");
+	}
+	{
+		auto listResp=httpGet(groupInfoURL);
+		ENSURE_EQUAL(listResp.status,403,"A former member should not be able to list a Group's members");
+	}
+	
+	{ //add the user to the Group again
+		auto addResp=httpPut(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users/"+uid+"/groups/"+groupName+"?token="+adminKey,"");
+		ENSURE_EQUAL(addResp.status,200,"User addition to Group request should succeed");
+	}
+	{
+		auto listResp=httpGet(groupInfoURL);
+		ENSURE_EQUAL(listResp.status,200,"A re-added member should be able to list a Group's members");
+		auto infoResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users/"+uid+"?token="+adminKey);
+		ENSURE_EQUAL(infoResp.status,200,"Getting user's information should succeed");
+		rapidjson::Document data;
+		data.Parse(infoResp.body);
+		ENSURE_EQUAL(data["metadata"]["groups"].Size(),1,"User should belong to one group");
+	}
+}
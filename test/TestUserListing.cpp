@@ -165,3 +165,44 @@ TEST(ListUsersByGroup){
 	ENSURE_EQUAL(metadata["id"].GetString(),tc.getPortalUser().id,
 	             "User ID should match");
 }
+
+TEST(ListUsersParallelScan){
+	using namespace httpRequests;
+	TestContext tc({"--scanSegments","4"});
+	
+	std::string adminKey=tc.getPortalToken();
+	std::string userURL=tc.getAPIServerURL()+"/"+currentAPIVersion+"/users?token="+adminKey;
+	
+	std::set<std::string> expected{tc.getPortalUserID()};
+	for(unsigned int i=0; i<20; i++){
+		std::string name="User"+std::to_string(i);
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", name, alloc);
+		metadata.AddMember("email", name+"@place.com", alloc);
+		metadata.AddMember("phone", "555-5555", alloc);
+		metadata.AddMember("institution", "Center of the Earth University", alloc);
+		metadata.AddMember("admin", false, alloc);
+		metadata.AddMember("globusID", name+"'s Globus ID", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(userURL,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"User creation request should succeed");
+		rapidjson::Document createData;
+		createData.Parse(createResp.body);
+		expected.insert(createData["metadata"]["id"].GetString());
+	}
+	
+	auto listResp=httpGet(userURL);
+	ENSURE_EQUAL(listResp.status,200,"Portal admin user should be able to list users");
+	rapidjson::Document data;
+	data.Parse(listResp.body.c_str());
+	auto schema=loadSchema(getSchemaDir()+"/UserListResultSchema.json");
+	ENSURE_CONFORMS(data,schema);
+	ENSURE_EQUAL(data["items"].Size(),expected.size(),"Every user should be listed once");
+	std::set<std::string> listed;
+	for(const auto& item : data["items"].GetArray())
+		listed.insert(item["metadata"]["id"].GetString());
+	ENSURE(listed==expected,"The users from all scan segments should be listed");
+}
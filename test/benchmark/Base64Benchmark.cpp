@@ -0,0 +1,96 @@
+//Measures the throughput of each base64 implementation which the processor
+//supports, encoding and decoding random data of sizes from 1 kB to 100 MB.
+//Results are reported in the style of Google Benchmark: one line per case,
+//with the time per iteration, the number of iterations, and the throughput in
+//terms of the unencoded data size.
+//Usage: slate-bench-base64 [max size in bytes] [min time per case in seconds]
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <Archive.h>
+
+namespace{
+using internal::Base64Implementation;
+
+const char* implementationName(Base64Implementation impl){
+	switch(impl){
+		case Base64Implementation::Scalar: return "Scalar";
+		case Base64Implementation::SSSE3: return "SSSE3";
+		case Base64Implementation::AVX2: return "AVX2";
+	}
+	return "?";
+}
+
+std::string sizeName(std::size_t size){
+	if(size>=(1u<<20) && size%(1u<<20)==0)
+		return std::to_string(size>>20)+"M";
+	if(size>=1024 && size%1024==0)
+		return std::to_string(size>>10)+"k";
+	return std::to_string(size);
+}
+
+///A value which the compiler cannot assume is unused
+volatile std::size_t sink;
+
+///Run an operation repeatedly until the minimum time has passed, doubling the
+///number of iterations in each round as Google Benchmark does
+template<typename F>
+void run(const std::string& name, std::size_t bytes, double minTime, F f){
+	using namespace std::chrono;
+	std::size_t iterations=1;
+	double elapsed=0;
+	while(true){
+		auto t1=steady_clock::now();
+		for(std::size_t i=0; i<iterations; i++)
+			sink=f();
+		auto t2=steady_clock::now();
+		elapsed=duration_cast<duration<double>>(t2-t1).count();
+		if(elapsed>=minTime || iterations>=(1u<<30))
+			break;
+		iterations*=2;
+	}
+	double perIteration=elapsed/iterations;
+	char line[256];
+	snprintf(line,sizeof(line),"%-40s %12.0f ns %10zu %10.2f MB/s",name.c_str(),
+	         perIteration*1e9,iterations,bytes/perIteration/(1<<20));
+	std::cout << line << std::endl;
+}
+}
+
+int main(int argc, char* argv[]){
+	std::size_t maxSize=100u<<20;
+	double minTime=0.5;
+	if(argc>1)
+		maxSize=std::stoul(argv[1]);
+	if(argc>2)
+		minTime=std::stod(argv[2]);
+
+	const std::size_t sizes[]={1u<<10,10u<<10,100u<<10,1u<<20,10u<<20,100u<<20};
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> dist(0,255);
+
+	char header[256];
+	snprintf(header,sizeof(header),"%-40s %15s %10s %15s","Benchmark","Time","Iterations","Throughput");
+	std::cout << header << '\n' << std::string(83,'-') << std::endl;
+	for(std::size_t size : sizes){
+		if(size>maxSize)
+			break;
+		std::string raw(size,'\0');
+		for(char& c : raw)
+			c=(char)dist(rng);
+		for(auto impl : {Base64Implementation::Scalar,Base64Implementation::SSSE3,Base64Implementation::AVX2}){
+			if(!internal::base64ImplementationSupported(impl))
+				continue;
+			internal::setBase64Implementation(impl);
+			const std::string suffix=std::string("/")+implementationName(impl)+"/"+sizeName(size);
+			std::string encoded=encodeBase64(raw);
+			run("BM_Encode"+suffix,size,minTime,[&]{ return encodeBase64(raw).size(); });
+			run("BM_Decode"+suffix,size,minTime,[&]{ return decodeBase64(encoded).size(); });
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,151 @@
+//Measures the time and peak memory needed to unpack base64 encoded, gzipped
+//chart archives of increasing size, as the server does for ad-hoc application
+//installs, both by decoding and decompressing each stage fully in memory and
+//by streaming the data through all stages at once.
+//Usage: slate-bench-chart [max MB]
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <Archive.h>
+#include <FileHandle.h>
+#include <FileSystem.h>
+
+namespace{
+///Create a base64 encoded, gzipped tar archive of a chart directory holding
+///roughly the given amount of data. The data is made from a small alphabet so
+///that it compresses about as well as typical chart contents.
+std::string makeChart(std::size_t size){
+	const std::size_t fileSize=1<<20;
+	std::mt19937 rng(size);
+	std::uniform_int_distribution<int> dist('a','p');
+	std::ostringstream tarData;
+	{
+		TarWriter writer(tarData);
+		writer.appendDirectory("chart");
+		writer.appendFile("chart/Chart.yaml","name: chart\nversion: 1.0.0\n");
+		writer.appendDirectory("chart/templates");
+		for(std::size_t i=0; i*fileSize<size; i++){
+			std::string data(std::min(fileSize,size-i*fileSize),'\0');
+			for(char& c : data)
+				c=dist(rng);
+			writer.appendFile("chart/templates/file"+std::to_string(i)+".yaml",data);
+		}
+	}
+	std::istringstream tarStream(tarData.str());
+	std::ostringstream gzipped;
+	gzipCompress(tarStream,gzipped);
+	return encodeBase64(gzipped.str());
+}
+
+///Read a value, in kB, from /proc/self/status
+std::size_t readStatus(const std::string& field){
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while(std::getline(status,line)){
+		if(line.compare(0,field.size()+1,field+":")==0)
+			return std::stoul(line.substr(field.size()+1));
+	}
+	return 0;
+}
+
+///The way ad-hoc charts were unpacked before the stages were streamed: each
+///stage's full output is held in memory before the next stage begins.
+void unpackBuffered(const std::string& chart, const std::string& dir){
+	std::stringstream gzipStream(decodeBase64(chart));
+	std::stringstream tarStream;
+	gzipDecompress(gzipStream,tarStream);
+	TarReader reader(tarStream);
+	reader.extractToFileSystem(dir+"/");
+}
+
+void unpackStreaming(const std::string& chart, const std::string& dir){
+	Base64DecodingBuffer decoder(chart.data(),chart.size());
+	std::istream gzipStream(&decoder);
+	gzipStream.exceptions(std::ios::badbit);
+	GzipDecompressingBuffer decompressor(gzipStream);
+	std::istream tarStream(&decompressor);
+	tarStream.exceptions(std::ios::badbit);
+	TarReader reader(tarStream);
+	reader.extractToFileSystem(dir+"/");
+}
+
+struct Measurement{
+	bool ok;
+	double time; //ms
+	std::size_t memory; //kB
+};
+
+///Run one way of unpacking a chart in a child process, so that the peak
+///memory use of each run can be measured separately
+template<typename F>
+Measurement measure(const std::string& chart, F unpack){
+	Measurement result={false,0,0};
+	int fds[2];
+	if(pipe(fds))
+		return result;
+	pid_t child=fork();
+	if(child<0){
+		close(fds[0]);
+		close(fds[1]);
+		return result;
+	}
+	if(child==0){
+		close(fds[0]);
+		Measurement m={true,0,0};
+		try{
+			FileHandle dir=makeTemporaryDir("/tmp/slate-bench-chart-");
+			std::size_t baseline=readStatus("VmRSS");
+			//reset the peak resident set size to the current size
+			std::ofstream("/proc/self/clear_refs") << "5";
+			auto t1=std::chrono::steady_clock::now();
+			unpack(chart,dir.path());
+			auto t2=std::chrono::steady_clock::now();
+			m.time=std::chrono::duration_cast<std::chrono::duration<double,std::milli>>(t2-t1).count();
+			std::size_t peak=readStatus("VmHWM");
+			m.memory=(peak>baseline ? peak-baseline : 0);
+		}catch(std::exception& ex){
+			std::cerr << ex.what() << std::endl;
+			m.ok=false;
+		}
+		ssize_t written=write(fds[1],&m,sizeof(m));
+		_exit(written==sizeof(m) ? 0 : 1);
+	}
+	close(fds[1]);
+	if(read(fds[0],&result,sizeof(result))!=sizeof(result))
+		result.ok=false;
+	close(fds[0]);
+	waitpid(child,nullptr,0);
+	return result;
+}
+
+void report(const std::string& label, const Measurement& m){
+	std::cout << '\t' << label << ": ";
+	if(m.ok)
+		std::cout << m.time << " ms, " << m.memory/1024.0 << " MB peak memory growth\n";
+	else
+		std::cout << "failed\n";
+}
+}
+
+int main(int argc, char* argv[]){
+	std::size_t maxSize=256;
+	if(argc>1)
+		maxSize=std::stoul(argv[1]);
+
+	for(std::size_t size=1; size<=maxSize; size*=4){
+		std::string chart=makeChart(size<<20);
+		std::cout << size << " MB chart (" << chart.size()/1024 << " kB encoded)\n";
+		report("buffered",measure(chart,unpackBuffered));
+		report("streaming",measure(chart,unpackStreaming));
+	}
+	return 0;
+}
@@ -0,0 +1,82 @@
+//Measures how many log messages per second many threads can log at once, as
+//when every web server thread logs each request it handles. Logging through
+//the background writer thread is compared with formatting the timestamp and
+//writing and flushing each message under a global lock, as the logging macros
+//formerly did. Output is discarded, by writing it to /dev/null, so that only
+//the cost to the logging threads is measured.
+//Usage: slate-bench-logging [threads] [messages per thread]
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Logging.h>
+
+namespace{
+std::mutex legacyMutex;
+
+///Log a message the way log_info formerly did
+#define legacy_log_info(msg) \
+do{ \
+	std::ostringstream str; \
+	str << "INFO: [" << timestamp() << "] (TID " \
+	<< std::this_thread::get_id() << ") " << msg << std::endl; \
+	std::lock_guard<std::mutex> guard(legacyMutex); \
+	std::cout << str.str(); \
+	std::cout.flush(); \
+} while(0)
+
+template<typename F>
+void measure(const std::string& label, unsigned int threads, unsigned int messages, F logOne){
+	using namespace std::chrono;
+	auto start=steady_clock::now();
+	std::vector<std::thread> loggers;
+	for(unsigned int t=0; t<threads; t++){
+		loggers.emplace_back([&,t]{
+			for(unsigned int i=0; i<messages; i++)
+				logOne(t,i);
+		});
+	}
+	for(auto& thread : loggers)
+		thread.join();
+	auto logged=steady_clock::now();
+	flushLog();
+	auto written=steady_clock::now();
+	double loggingTime=duration_cast<duration<double>>(logged-start).count();
+	double totalTime=duration_cast<duration<double>>(written-start).count();
+	std::cerr << label << ": " << threads*messages/loggingTime << " messages/s logged, "
+	          << threads*messages/totalTime << " messages/s written" << std::endl;
+}
+}
+
+int main(int argc, char* argv[]){
+	unsigned int threads=std::thread::hardware_concurrency();
+	unsigned int messages=100000;
+	if(argc>1)
+		threads=std::stoul(argv[1]);
+	if(argc>2)
+		messages=std::stoul(argv[2]);
+	if(!threads)
+		threads=4;
+
+	std::ofstream null("/dev/null");
+	std::streambuf* original=std::cout.rdbuf(null.rdbuf());
+	std::cerr << threads << " threads, " << messages << " messages each" << std::endl;
+	measure("locked",threads,messages,[](unsigned int t, unsigned int i){
+		legacy_log_info("Handling request " << i << " on thread " << t);
+	});
+	measure("asynchronous",threads,messages,[](unsigned int t, unsigned int i){
+		log_info("Handling request " << i << " on thread " << t);
+	});
+	setLogFormat(LogFormat::JSON);
+	measure("asynchronous JSON",threads,messages,[](unsigned int t, unsigned int i){
+		log_info("Handling request " << i << " on thread " << t);
+	});
+	std::cout.rdbuf(original);
+	return 0;
+}
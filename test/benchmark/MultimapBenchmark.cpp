@@ -0,0 +1,157 @@
+//Measures how many category lookups per second many reader threads can make
+//in a concurrent_multimap of cached application instances while one writer
+//occasionally changes the category, as when one cluster's instances are listed
+//repeatedly while instances are installed and deleted. The copy-on-write
+//snapshots which the map now returns are compared with copying each
+//category's set out of the table, as the map formerly did.
+//Usage: slate-bench-multimap [readers] [instances] [seconds] [writes per second]
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <concurrent_multimap.h>
+#include <PersistentStore.h>
+
+namespace{
+using Record=CacheRecord<ApplicationInstance>;
+using Multimap=concurrent_multimap<std::string,Record>;
+using steady_clock=std::chrono::steady_clock;
+
+///A multimap which copies categories out of the table when they are looked up
+class CopyingMultimap{
+public:
+	using set_type=Multimap::set_type;
+	using category_type=std::pair<set_type,steady_clock::time_point>;
+
+	void insert_or_assign(const std::string& key, const Record& val){
+		data.upsert(key,[&](category_type& cat){
+			cat.first.erase(val);
+			cat.first.emplace(val);
+		},category_type({val},steady_clock::now()));
+	}
+	void erase(const std::string& key, const Record& val){
+		data.erase_fn(key,[&](category_type& cat){
+			cat.first.erase(val);
+			return cat.first.empty();
+		});
+	}
+	category_type find(const std::string& key) const{
+		category_type items;
+		data.find_fn(key,[&items](const category_type& cat){ items=cat; });
+		return items;
+	}
+	void update_expiration(const std::string& key, steady_clock::time_point time){
+		data.update_fn(key,[&](category_type& cat){ cat.second=time; });
+	}
+private:
+	cuckoohash_map<std::string,category_type> data;
+};
+
+const Multimap::set_type& values(const Multimap::category_type& cat){ return *cat.first; }
+const CopyingMultimap::set_type& values(const CopyingMultimap::category_type& cat){ return cat.first; }
+
+Record makeRecord(unsigned int i){
+	ApplicationInstance instance;
+	instance.valid=true;
+	instance.id="instance_"+std::to_string(i);
+	instance.name="application-"+std::to_string(i);
+	instance.application="application";
+	instance.owningGroup="Group_1234";
+	instance.cluster="Cluster_5678";
+	instance.config=std::string(512,'x'); //a modest amount of configuration
+	instance.ctime="2020-01-01T00:00:00Z";
+	return Record(instance,std::chrono::hours(1));
+}
+
+template<typename Map>
+void measure(const std::string& label, unsigned int readers, unsigned int instances,
+             double seconds, unsigned int writeRate){
+	using namespace std::chrono;
+	const std::string key="Cluster_5678";
+	Map map;
+	for(unsigned int i=0; i<instances; i++)
+		map.insert_or_assign(key,makeRecord(i));
+	map.update_expiration(key,steady_clock::now()+hours(1));
+
+	std::atomic<bool> done(false);
+	std::atomic<unsigned long> lookups(0);
+	std::vector<std::thread> threads;
+	for(unsigned int i=0; i<readers; i++){
+		threads.emplace_back([&]{
+			unsigned long count=0;
+			while(!done){
+				//do what maybeReturnCachedCategoryMembers does with the result
+				auto cached=map.find(key);
+				std::vector<ApplicationInstance> results;
+				if(cached.second>steady_clock::now()){
+					results.reserve(values(cached).size());
+					for(const auto& record : values(cached)){
+						if(record)
+							results.push_back(record);
+					}
+				}
+				if(results.size()>=instances)
+					count++;
+			}
+			lookups+=count;
+		});
+	}
+
+	//the writer installs and deletes an instance periodically
+	unsigned long writes=0;
+	duration<double> writeTime(0), maxWriteTime(0);
+	Record extra=makeRecord(instances);
+	auto start=steady_clock::now();
+	auto end=start+duration_cast<steady_clock::duration>(duration<double>(seconds));
+	auto interval=duration_cast<steady_clock::duration>(duration<double>(1./writeRate));
+	for(auto next=start+interval; next<end; next+=interval){
+		std::this_thread::sleep_until(next);
+		auto t1=steady_clock::now();
+		map.insert_or_assign(key,extra);
+		map.erase(key,extra);
+		auto t2=steady_clock::now();
+		writes++;
+		writeTime+=t2-t1;
+		if(t2-t1>maxWriteTime)
+			maxWriteTime=t2-t1;
+	}
+	std::this_thread::sleep_until(end);
+	done=true;
+	for(auto& thread : threads)
+		thread.join();
+	double elapsed=duration_cast<duration<double>>(steady_clock::now()-start).count();
+
+	std::cout << label << ": " << lookups/elapsed << " lookups/s, "
+	          << (writes ? 1e6*writeTime.count()/writes : 0) << " us mean write, "
+	          << 1e6*maxWriteTime.count() << " us max write" << std::endl;
+}
+}
+
+int main(int argc, char* argv[]){
+	unsigned int readers=std::thread::hardware_concurrency();
+	unsigned int instances=2000;
+	double seconds=5;
+	unsigned int writeRate=10;
+	if(argc>1)
+		readers=std::stoul(argv[1]);
+	if(argc>2)
+		instances=std::stoul(argv[2]);
+	if(argc>3)
+		seconds=std::stod(argv[3]);
+	if(argc>4)
+		writeRate=std::stoul(argv[4]);
+	if(!readers)
+		readers=4;
+	if(!writeRate)
+		writeRate=1;
+
+	std::cout << readers << " readers, " << instances << " instances, "
+	          << writeRate << " writes/s" << std::endl;
+	measure<CopyingMultimap>("copying",readers,instances,seconds,writeRate);
+	measure<Multimap>("snapshots",readers,instances,seconds,writeRate);
+	return 0;
+}
@@ -0,0 +1,69 @@
+//Measures the throughput of collecting large outputs through runCommand. 
+//Usage: slate-bench-process-output [megabytes] [iterations] [--stdout-only]
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <sys/resource.h>
+
+#include <Process.h>
+
+namespace{
+double cpuSeconds(){
+	struct rusage usage;
+	getrusage(RUSAGE_SELF,&usage);
+	return usage.ru_utime.tv_sec+usage.ru_stime.tv_sec
+	       +(usage.ru_utime.tv_usec+usage.ru_stime.tv_usec)/1e6;
+}
+
+void measure(const std::string& label, const std::string& script, 
+             std::size_t expectedSize, unsigned int iterations){
+	using namespace std::chrono;
+	double total=0;
+	double cpuStart=cpuSeconds();
+	CommandOptions options;
+	options.largeOutput=true;
+	for(unsigned int i=0; i<iterations; i++){
+		auto t1=steady_clock::now();
+		auto result=runCommand("sh",{"-c",script},{},options);
+		auto t2=steady_clock::now();
+		if(result.status || result.output.size()+result.error.size()!=expectedSize){
+			std::cerr << label << ": unexpected result" << std::endl;
+			return;
+		}
+		total+=duration_cast<duration<double>>(t2-t1).count();
+	}
+	double mean=total/iterations;
+	double cpu=(cpuSeconds()-cpuStart)/iterations;
+	std::cout << label << ": " << 1000*mean << " ms, " 
+	          << (expectedSize/mean)/(1<<20) << " MB/s, parent CPU " 
+	          << 1000*cpu << " ms\n";
+}
+}
+
+int main(int argc, char* argv[]){
+	std::size_t megabytes=32;
+	unsigned int iterations=10;
+	if(argc>1)
+		megabytes=std::stoul(argv[1]);
+	if(argc>2)
+		iterations=std::stoul(argv[2]);
+	const std::size_t size=megabytes<<20;
+	const std::string count=std::to_string(size);
+	const std::string half=std::to_string(size/2);
+	
+	startReaper();
+	std::cout << megabytes << " MB x " << iterations << " iterations\n";
+	measure("stdout only","head -c "+count+" /dev/zero",size,iterations);
+	//before stdout and stderr were collected together, these would deadlock
+	//once the stderr pipe filled
+	if(argc<=3 || std::string(argv[3])!="--stdout-only"){
+		measure("stdout then stderr","head -c "+half+" /dev/zero; head -c "+half+" /dev/zero >&2",
+		        2*(size/2),iterations);
+		measure("stderr then stdout","head -c "+half+" /dev/zero >&2; head -c "+half+" /dev/zero",
+		        2*(size/2),iterations);
+	}
+	stopReaper();
+	return 0;
+}
@@ -0,0 +1,69 @@
+//Measures the fixed overhead of running child processes through runCommand, 
+//and the CPU time consumed by the process reaper while the server is idle. 
+//Usage: slate-bench-process [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <Process.h>
+
+namespace{
+double cpuSeconds(){
+	struct rusage usage;
+	getrusage(RUSAGE_SELF,&usage);
+	return usage.ru_utime.tv_sec+usage.ru_stime.tv_sec
+	       +(usage.ru_utime.tv_usec+usage.ru_stime.tv_usec)/1e6;
+}
+}
+
+int main(int argc, char* argv[]){
+	using namespace std::chrono;
+	unsigned int iterations=500;
+	if(argc>1)
+		iterations=std::stoul(argv[1]);
+	
+	startReaper();
+	
+	//warm up
+	for(unsigned int i=0; i<10; i++)
+		runCommand("true");
+	
+	std::vector<double> times;
+	times.reserve(iterations);
+	double cpuStart=cpuSeconds();
+	for(unsigned int i=0; i<iterations; i++){
+		auto t1=steady_clock::now();
+		auto result=runCommand("true");
+		auto t2=steady_clock::now();
+		if(result.status){
+			std::cerr << "Child process failed" << std::endl;
+			return 1;
+		}
+		times.push_back(duration_cast<duration<double,std::micro>>(t2-t1).count());
+	}
+	double cpuUsed=cpuSeconds()-cpuStart;
+	std::sort(times.begin(),times.end());
+	double total=0;
+	for(double t : times)
+		total+=t;
+	std::cout << "runCommand(\"true\") x " << iterations << '\n';
+	std::cout << "  mean:   " << total/iterations << " us\n";
+	std::cout << "  median: " << times[iterations/2] << " us\n";
+	std::cout << "  p99:    " << times[(iterations*99)/100] << " us\n";
+	std::cout << "  parent CPU per command: " << 1e6*cpuUsed/iterations << " us\n";
+	
+	const double idleSeconds=3;
+	cpuStart=cpuSeconds();
+	std::this_thread::sleep_for(duration<double>(idleSeconds));
+	double idleCPU=cpuSeconds()-cpuStart;
+	std::cout << "Idle CPU with reaper running: " << 100*idleCPU/idleSeconds << "% of one core\n";
+	
+	stopReaper();
+	return 0;
+}
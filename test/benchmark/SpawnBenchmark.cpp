@@ -0,0 +1,62 @@
+//Measures how the latency of starting a child process depends on the size of
+//the parent process, comparing posix_spawn to fork. 
+//Usage: slate-bench-spawn [iterations] [max ballast MB]
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Process.h>
+
+namespace{
+///Forces startProcessAsync to use fork()
+struct ForceFork : public ForkCallbacks{
+	bool needsChildCallback() const override{ return true; }
+};
+
+double measure(unsigned int iterations, bool useFork){
+	using namespace std::chrono;
+	double total=0;
+	for(unsigned int i=0; i<iterations; i++){
+		auto t1=steady_clock::now();
+		ProcessHandle child=(useFork ? 
+		                     startProcessAsync("/bin/true",{},{},ForceFork{}) :
+		                     startProcessAsync("/bin/true",{}));
+		auto t2=steady_clock::now();
+		child.wait();
+		total+=duration_cast<duration<double,std::micro>>(t2-t1).count();
+	}
+	return total/iterations;
+}
+}
+
+int main(int argc, char* argv[]){
+	unsigned int iterations=200;
+	std::size_t maxBallast=1024;
+	if(argc>1)
+		iterations=std::stoul(argv[1]);
+	if(argc>2)
+		maxBallast=std::stoul(argv[2]);
+	
+	startReaper();
+	std::vector<std::unique_ptr<char[]>> ballast;
+	std::size_t ballastSize=0;
+	std::cout << "RSS (MB)\tspawn (us)\tfork (us)\n";
+	for(std::size_t target=0; target<=maxBallast; target=(target?2*target:64)){
+		//grow the process and touch every page so that it is resident
+		while(ballastSize<target){
+			const std::size_t chunk=64<<20;
+			ballast.emplace_back(new char[chunk]);
+			memset(ballast.back().get(),1,chunk);
+			ballastSize+=64;
+		}
+		double spawnTime=measure(iterations,false);
+		double forkTime=measure(iterations,true);
+		std::cout << ballastSize << "\t\t" << spawnTime << "\t\t" << forkTime << '\n';
+	}
+	stopReaper();
+	return 0;
+}
@@ -0,0 +1,127 @@
+//Measures how long the consistency check of a cluster takes to find the
+//secrets in every group namespace, using a stub kubectl which answers after a
+//fixed delay, as a distant cluster would.
+//Usage: slate-bench-verify [namespaces] [latency ms] [secrets per namespace]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+
+#include <sys/stat.h>
+
+#include <ClusterCommands.h>
+#include <Executor.h>
+#include <FileHandle.h>
+#include <KubeInterface.h>
+#include <Process.h>
+#include <ServerUtilities.h>
+
+namespace{
+///Write a kubectl replacement which serves a fixed set of namespaces and
+///secrets. Listing secrets in all namespaces is refused if the
+///STUB_KUBECTL_FORBID_ALL environment variable is set.
+void writeStub(const std::string& path, unsigned int namespaces,
+               unsigned int latency, unsigned int secrets){
+	std::ofstream stub(path);
+	stub << "#!/bin/sh\n"
+	     << "sleep " << latency/1000 << '.' << (latency%1000)/100 << (latency%100)/10 << latency%10 << '\n'
+	     << "kind=''; all=0; ns=''\n"
+	     << "while [ $# -gt 0 ]; do\n"
+	     << "\tcase \"$1\" in\n"
+	     << "\t\tclusternamespaces|secrets) kind=\"$1\";;\n"
+	     << "\t\t--all-namespaces) all=1;;\n"
+	     << "\t\t-n) shift; ns=\"$1\";;\n"
+	     << "\tesac\n"
+	     << "\tshift\n"
+	     << "done\n"
+	     << "names() { i=0; while [ $i -lt $1 ]; do echo \"$2$i\"; i=$((i+1)); done; }\n"
+	     << "if [ \"$kind\" = clusternamespaces ]; then\n"
+	     << "\tnames " << namespaces << ' ' << Group::namespacePrefix() << "group | tr '\\n' ' '\n"
+	     << "elif [ \"$all\" = 1 ]; then\n"
+	     << "\tif [ -n \"$STUB_KUBECTL_FORBID_ALL\" ]; then\n"
+	     << "\t\techo 'Error from server (Forbidden): secrets is forbidden' >&2\n"
+	     << "\t\texit 1\n"
+	     << "\tfi\n"
+	     << "\tfor n in $(names " << namespaces << ' ' << Group::namespacePrefix() << "group); do\n"
+	     << "\t\techo \"$n default-token-abcde\"\n"
+	     << "\t\tfor s in $(names " << secrets << " secret); do echo \"$n $s\"; done\n"
+	     << "\tdone\n"
+	     << "else\n"
+	     << "\t(echo default-token-abcde; names " << secrets << " secret) | tr '\\n' ' '\n"
+	     << "fi\n";
+	stub.close();
+	chmod(path.c_str(),0755);
+}
+
+///The way the secrets on a cluster were found before namespaces were listed in
+///parallel: one namespace at a time
+std::set<std::string> listSequentially(const std::string& configPath){
+	std::set<std::string> secretNames;
+	auto namespaceInfo=kubernetes::kubectl(configPath,{"get","clusternamespaces","-o=jsonpath={.items[*].metadata.name}"});
+	for(const auto& namespaceName : string_split_columns(namespaceInfo.output,' ',false)){
+		if(namespaceName.find(Group::namespacePrefix())!=0)
+			continue;
+		std::string groupName=namespaceName.substr(Group::namespacePrefix().size());
+		auto secretsInfo=kubernetes::kubectl(configPath,{"get","secrets","-n",namespaceName,"-o=jsonpath={.items[*].metadata.name}"});
+		for(const auto& secretName : string_split_columns(secretsInfo.output,' ',false)){
+			if(secretName.find("default-token-")==0)
+				continue;
+			secretNames.insert(groupName+":"+secretName);
+		}
+	}
+	return secretNames;
+}
+
+template<typename F>
+void measure(const std::string& label, std::size_t expected, F list){
+	using namespace std::chrono;
+	auto t1=steady_clock::now();
+	std::set<std::string> secretNames=list();
+	auto t2=steady_clock::now();
+	if(secretNames.size()!=expected){
+		std::cerr << label << ": found " << secretNames.size()
+		          << " secrets, expected " << expected << std::endl;
+		return;
+	}
+	std::cout << label << ": " << duration_cast<duration<double,std::milli>>(t2-t1).count()
+	          << " ms\n";
+}
+}
+
+int main(int argc, char* argv[]){
+	unsigned int namespaces=50, latency=50, secrets=4;
+	if(argc>1)
+		namespaces=std::stoul(argv[1]);
+	if(argc>2)
+		latency=std::stoul(argv[2]);
+	if(argc>3)
+		secrets=std::stoul(argv[3]);
+	const std::size_t expected=namespaces*secrets;
+
+	FileHandle stubDir=makeTemporaryDir("/tmp/slate-bench-verify-");
+	const std::string stubPath=stubDir+"/kubectl";
+	writeStub(stubPath,namespaces,latency,secrets);
+	const char* oldPath=getenv("PATH");
+	setenv("PATH",(stubDir.path()+(oldPath?std::string(":")+oldPath:"")).c_str(),1);
+	const std::string configPath="/dev/null"; //not read by the stub
+
+	startReaper();
+	std::cout << namespaces << " namespaces, " << secrets << " secrets each, "
+	          << latency << " ms per kubectl command\n";
+	//the same limits as the persistent store's command executor
+	Executor executor("Cluster command",16,4);
+	measure("sequential",expected,[&]{ return listSequentially(configPath); });
+	measure("all namespaces at once",expected,
+	        [&]{ return internal::listClusterSecrets(executor,"cluster",configPath); });
+	setenv("STUB_KUBECTL_FORBID_ALL","1",1);
+	measure("parallel per namespace",expected,
+	        [&]{ return internal::listClusterSecrets(executor,"cluster",configPath); });
+	stopReaper();
+
+	std::remove(stubPath.c_str());
+	return 0;
+}
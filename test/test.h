@@ -141,6 +141,12 @@ private:
 	User baseUser;
 };
 
+///Find the value of one of the statistics reported by a PersistentStore
+///\param store the store whose statistics should be read
+///\param name the name of the statistic, as it appears before the colon
+///\return the value of the statistic. The test fails if it is not found. 
+std::size_t getStatistic(const PersistentStore& store, const std::string& name);
+
 struct TestContext{
 public:
 	explicit TestContext(std::vector<std::string> extraOptions={});
@@ -173,6 +179,12 @@ private:
 	} logger;
 };
 
+///Find the value of one of the statistics reported by a test API server
+///\param tc the context whose server's statistics should be read
+///\param name the name of the statistic, as it appears before the colon
+///\return the value of the statistic. The test fails if it is not found. 
+std::size_t getStatistic(TestContext& tc, const std::string& name);
+
 std::string getSchemaDir();
 
 rapidjson::SchemaDocument loadSchema(const std::string& path);
@@ -125,6 +125,29 @@ std::unique_ptr<PersistentStore> DatabaseContext::makePersistentStore() const{
 	                                                            "",0));
 }
 
+namespace{
+std::size_t findStatistic(const std::string& report, const std::string& name){
+	std::istringstream stats(report);
+	std::string line;
+	while(std::getline(stats,line)){
+		if(line.compare(0,name.size()+2,name+": ")==0)
+			return std::stoul(line.substr(name.size()+2));
+	}
+	FAIL("Statistic "+name+" not found");
+	return 0;
+}
+}
+
+std::size_t getStatistic(const PersistentStore& store, const std::string& name){
+	return findStatistic(store.getStatistics(),name);
+}
+
+std::size_t getStatistic(TestContext& tc, const std::string& name){
+	auto resp=httpRequests::httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/stats");
+	ENSURE_EQUAL(resp.status,200,"Fetching server statistics should succeed");
+	return findStatistic(resp.body,name);
+}
+
 void TestContext::waitServerReady(){
 	std::cout << "Waiting for API server to be ready" << std::endl;
 	//watch the server's output until it indicates that it has its database 